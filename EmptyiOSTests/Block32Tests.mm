@@ -5636,4 +5636,45 @@ vector<uint32_t> generateBlockiValues(int width, int height)
   return;
 }
 
+// Direct gather from image order must produce the same s32 layout as the
+// 8x8 block split followed by block_s32_format_block_layout().
+
+- (void)testFormatImageOrderMatchesBlockLayout {
+  const int blockDim = 8;
+  const int blockiDim = 4;
+  
+  const int numBigBlocksInWidth = 3;
+  const int numBigBlocksInHeight = 2;
+  const int width = numBigBlocksInWidth * 32;
+  const int height = numBigBlocksInHeight * 32;
+  const int blockN = (width / blockDim) * (height / blockDim);
+  
+  vector<uint8_t> imageOrder(width * height);
+  
+  for (int i = 0; i < imageOrder.size(); i++) {
+    imageOrder[i] = (i * 7) & 0xFF;
+  }
+  
+  vector<uint8_t> blockOrder;
+  block_process_encode<blockDim>(imageOrder.data(), (int)imageOrder.size(),
+                                 width, height,
+                                 width / blockDim, height / blockDim,
+                                 blockOrder);
+  
+  auto tables = block_reorder_blocki_tables<blockDim, blockiDim>(width, height);
+  
+  vector<uint8_t> expected(imageOrder.size());
+  block_s32_format_block_layout(blockOrder.data(), expected.data(), blockN, blockDim, 32, tables->blockiLookupVec.data());
+  
+  vector<uint8_t> s32(imageOrder.size());
+  block_s32_format_image_order(imageOrder.data(), s32.data(), numBigBlocksInWidth, numBigBlocksInHeight);
+  
+  XCTAssert(s32 == expected);
+  
+  vector<uint8_t> flattened(imageOrder.size());
+  block_s32_flatten_image_order(s32.data(), flattened.data(), numBigBlocksInWidth, numBigBlocksInHeight);
+  
+  XCTAssert(flattened == imageOrder);
+}
+
 @end
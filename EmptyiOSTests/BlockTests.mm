@@ -12,6 +12,7 @@
 #import "block_process.hpp"
 
 #import "rice.hpp"
+#import "rice_adapters.hpp"
 #import "zigzag.h"
 #import "Rice.h"
 #import "Util.h"
@@ -2342,4 +2343,218 @@
   return;
 }
 
+// Round trip 10/12/16 bit samples through the wide block delta
+// and G4 rice encoder/decoder. Every 50th sample is a spike so
+// that the wide escape path is exercised.
+
+template <const int SB>
+static
+void roundTripWideSamples(XCTestCase *self, const int width, const int height)
+{
+  const int blockDim = 8;
+  const uint32_t mask = (1 << SB) - 1;
+  
+  vector<uint16_t> inSamples(width * height);
+  
+  for ( int row = 0; row < height; row++ ) {
+    for ( int col = 0; col < width; col++ ) {
+      int offset = (row * width) + col;
+      uint32_t val = ((row * 37) + (col * 11)) << (SB - 8);
+      if ((offset % 50) == 0) {
+        val += (offset * 7919);
+      }
+      inSamples[offset] = val & mask;
+    }
+  }
+  
+  unsigned int blockWidth = (width + blockDim - 1) / blockDim;
+  unsigned int blockHeight = (height + blockDim - 1) / blockDim;
+  
+  vector<uint16_t> deltas;
+  
+  block_delta_process_encode_wide<blockDim>(inSamples.data(), (int)inSamples.size(),
+                                            width, height,
+                                            blockWidth, blockHeight,
+                                            SB,
+                                            deltas);
+  
+  const int numValuesEachBlock = blockDim * blockDim;
+  
+  vector<uint8_t> kTable;
+  
+  for (int i = 0; i < deltas.size(); i += numValuesEachBlock) {
+    int k = optimalRiceKG4<SB>(&deltas[i], numValuesEachBlock);
+    kTable.push_back(k);
+  }
+  
+  const int numBlocks = (int) kTable.size();
+  kTable.push_back(0);
+  
+  vector<uint32_t> countTable;
+  vector<uint32_t> nTable;
+  countTable.push_back(numBlocks);
+  nTable.push_back(numValuesEachBlock);
+  
+  RiceSplit16EncoderG4<false, true, BitWriterByteStream, SB> encoder;
+  encoder.encode(deltas.data(), (int)deltas.size(), kTable.data(), (int)kTable.size(), countTable, nTable);
+  vector<uint8_t> encodedBytes = encoder.bitWriter.moveBytes();
+  
+  RiceSplit16DecoderG4<false, true, BitReaderByteStream, SB> decoder;
+  vector<uint16_t> decodedDeltas(deltas.size());
+  decoder.decode(encodedBytes.data(), (int)encodedBytes.size(),
+                 decodedDeltas.data(), (int)decodedDeltas.size(),
+                 kTable.data(), (int)kTable.size(), countTable, nTable);
+  
+  for (int i = 0; i < deltas.size(); i++) {
+    XCTAssert(decodedDeltas[i] == deltas[i], @"delta[%d] : %d != %d", i, decodedDeltas[i], deltas[i]);
+  }
+  
+  vector<uint16_t> outSamples(inSamples.size());
+  
+  block_delta_process_decode_wide<blockDim>(decodedDeltas.data(), (int)decodedDeltas.size(),
+                                            width, height,
+                                            blockWidth, blockHeight,
+                                            SB,
+                                            outSamples.data(), (int)outSamples.size());
+  
+  for (int i = 0; i < inSamples.size(); i++) {
+    XCTAssert(outSamples[i] == inSamples[i], @"sample[%d] : %d != %d", i, outSamples[i], inSamples[i]);
+  }
+}
+
+- (void)testBlockDeltaRiceWide10Bit {
+  roundTripWideSamples<10>(self, 67, 41);
+}
+
+- (void)testBlockDeltaRiceWide12Bit {
+  roundTripWideSamples<12>(self, 67, 41);
+}
+
+- (void)testBlockDeltaRiceWide16Bit {
+  roundTripWideSamples<16>(self, 130, 70);
+}
+
+// Reorder tables are created once for each geometry and match a
+// BlockEncoder split of the image order blocki values, including
+// big blocks that are clipped at the right and bottom edges.
+
+- (void)testBlockiReorderTablesCached {
+  const int blockDim = 8;
+  const int blockiDim = 4;
+  
+  const int width = 8 * 6;
+  const int height = 8 * 5;
+  
+  auto tables1 = block_reorder_blocki_tables<blockDim, blockiDim>(width, height);
+  auto tables2 = block_reorder_blocki_tables<blockDim, blockiDim>(width, height);
+  auto tables3 = block_reorder_blocki_tables<blockDim, blockiDim>(width + 8, height);
+  
+  XCTAssert(tables1 == tables2);
+  XCTAssert(tables1 != tables3);
+  
+  vector<uint32_t> blockiVec;
+  
+  for (int blocki = 0; blocki < (6 * 5); blocki++) {
+    blockiVec.push_back(blocki);
+  }
+  
+  BlockEncoder<uint32_t, blockiDim> encoder;
+  encoder.splitIntoBlocks(blockiVec.data(), (int)blockiVec.size(), 6, 5, 2, 2, 0xFFFFFFFF);
+  
+  vector<uint32_t> expected;
+  
+  for ( vector<uint32_t> & blockVec : encoder.blockVectors ) {
+    for ( uint32_t blocki : blockVec ) {
+      if (blocki != 0xFFFFFFFF) {
+        expected.push_back(blocki);
+      }
+    }
+  }
+  
+  XCTAssert(tables1->blockiVec == blockiVec);
+  XCTAssert(tables1->blockiLookupVec == expected);
+}
+
+// Every coder adapter must round trip the same block order symbols
+
+template <class A>
+static
+void roundTripCoderAdapter(XCTestCase *self, const RiceCoderInput & input)
+{
+  int numBytes = 0;
+  bool worked = rice_adapter_round_trip<A>(input, numBytes);
+  XCTAssert(worked, @"%s", A::name());
+  XCTAssert(numBytes > 0, @"%s", A::name());
+}
+
+- (void)testRiceCoderAdapterRoundTrip {
+  const int blockSize = 8 * 8;
+  const int numBlocks = 32;
+  
+  RiceCoderInput input;
+  input.blockSize = blockSize;
+  
+  for (int blocki = 0; blocki < numBlocks; blocki++) {
+    for (int i = 0; i < blockSize; i++) {
+      // Mostly small values with an escape in every fourth block
+      uint8_t symbol = ((blocki * 3) + i) % (blocki + 2);
+      if ((blocki % 4) == 0 && i == 7) {
+        symbol = 0xFF;
+      }
+      input.symbols.push_back(symbol);
+    }
+    input.kTable.push_back(optimalRiceKG4<8>(&input.symbols[blocki * blockSize], blockSize));
+  }
+  input.kTable.push_back(0);
+  
+  roundTripCoderAdapter<RiceAdapterRice>(self, input);
+  roundTripCoderAdapter<RiceAdapterSplit16>(self, input);
+  roundTripCoderAdapter<RiceAdapterSplit16G4>(self, input);
+  roundTripCoderAdapter<RiceAdapterSplit16x2>(self, input);
+  roundTripCoderAdapter<RiceAdapterSplit16x2Prefix>(self, input);
+  roundTripCoderAdapter<RiceAdapterSplit16x2Prefix64>(self, input);
+  roundTripCoderAdapter<RiceAdapterSplit16x2Prefix64Read64>(self, input);
+  roundTripCoderAdapter<RiceAdapterInterleaved4x>(self, input);
+  roundTripCoderAdapter<RiceAdapterMultiplexer>(self, input);
+}
+
+// Byte fast path for 8x8 blocks pads edge blocks the same way as the
+// generic split and flattens back to the padded image.
+
+- (void)testSplitFlattenBlocksOfSize8Bytes {
+  const int blockDim = 8;
+  
+  const int width = 19;
+  const int height = 10;
+  
+  const int blockWidth = 3;
+  const int blockHeight = 2;
+  
+  vector<uint8_t> pixels(width * height);
+  
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = i + 1;
+  }
+  
+  const int numPaddedPixels = blockWidth * blockHeight * blockDim * blockDim;
+  
+  vector<uint8_t> expected(numPaddedPixels);
+  vector<uint8_t> blockLayout(numPaddedPixels);
+  
+  splitIntoBlocksOfSize<uint8_t>(blockDim, pixels.data(), width, height, blockWidth, blockHeight, expected.data(), blockWidth, blockHeight, 0);
+  
+  RiceThreadPool pool(2);
+  splitIntoBlocksOfSize(blockDim, pixels.data(), width, height, blockWidth, blockHeight, blockLayout.data(), blockWidth, blockHeight, (uint8_t) 0, &pool);
+  
+  XCTAssert(blockLayout == expected);
+  
+  vector<uint8_t> flat(numPaddedPixels);
+  flattenBlocksOfSize(blockDim, blockLayout.data(), flat.data(), blockWidth, blockHeight, &pool);
+  
+  cropZeroPaddedBlocks(blockDim, flat.data(), blockWidth * blockDim, blockHeight * blockDim, width, height);
+  flat.resize(width * height);
+  
+  XCTAssert(flat == pixels);
+}
+
 @end
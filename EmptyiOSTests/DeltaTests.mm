@@ -12,6 +12,10 @@
 
 #import "DeltaEncoder.h"
 
+#import "Rice.h"
+
+#import "zigzag.h"
+
 #import <vector>
 
 @interface DeltaTests : XCTestCase
@@ -161,5 +165,36 @@
   
 }
 
-@end
+// Fused delta and zigzag encode round trips through both decoders and
+// matches the per byte pixelpack mapping.
 
+- (void)testEncodeByteDeltasFused {
+  const int numBytes = 1000;
+  
+  NSMutableData *data = [NSMutableData dataWithLength:numBytes];
+  uint8_t *bytePtr = (uint8_t *) data.mutableBytes;
+  
+  for (int i = 0; i < numBytes; i++) {
+    bytePtr[i] = (uint8_t) ((i * 37) ^ ((i >> 2) * 91));
+  }
+  
+  NSData *zerodDeltas = [Rice encodeSignedByteDeltas:data];
+  const uint8_t *zerodPtr = (const uint8_t *) zerodDeltas.bytes;
+  
+  uint8_t prev = 0;
+  for (int i = 0; i < numBytes; i++) {
+    XCTAssert(zerodPtr[i] == pixelpack_int8_to_offset_uint8((int8_t) (bytePtr[i] - prev)), @"%d", i);
+    prev = bytePtr[i];
+  }
+  
+  XCTAssert([[Rice decodeSignedByteDeltas:zerodDeltas] isEqualToData:data]);
+  
+  NSData *deltas = [DeltaEncoder encodeByteDeltas:data];
+  XCTAssert([[DeltaEncoder decodeByteDeltas:deltas] isEqualToData:data]);
+  
+  std::vector<uint8_t> inplace(bytePtr, bytePtr + numBytes);
+  zigzag_byte_deltas_encode_inplace(inplace.data(), numBytes);
+  XCTAssert(memcmp(inplace.data(), zerodPtr, numBytes) == 0);
+}
+
+@end
@@ -23,10 +23,21 @@ using namespace std;
 
 #import "RiceDecodeBlocksImpl.hpp"
 
+#import "Rice2Planes.hpp"
+#import "RiceKernelSim.hpp"
+#import "Rice2Stream.hpp"
+#import "Rice2Preview.hpp"
+#import "Rice2Temporal.hpp"
+#import "Rice2Checksum.hpp"
+#import "Rice2Large.hpp"
+#import "Rice2Asset.hpp"
+#import "RiceFrameRing.hpp"
+
 #import "MetalRenderContext.h"
 
 #import "MetalRice2RenderContext.h"
 #import "MetalRice2RenderFrame.h"
+#import "MetalRice2FrameRing.h"
 
 #import "AAPLShaderTypes.h"
 
@@ -9297,5 +9308,791 @@ blockOptimalKTableData:blockOptimalKTableData
   return;
 }
 
-@end
+// Encode BGRA pixels as planes with and without the YCoCg-R
+// transform, then decode from the serialized container.
+
+- (void)testRice2PlanesBGRA {
+  const int width = 67;
+  const int height = 45;
+  const int numPixels = width * height;
+  
+  vector<uint32_t> inPixels(numPixels);
+  
+  for (int i = 0; i < numPixels; i++) {
+    int x = i % width;
+    int y = i / width;
+    uint32_t B = (x * 3) & 0xFF;
+    uint32_t G = (x + y) & 0xFF;
+    uint32_t R = ((y * 2) + x) & 0xFF;
+    uint32_t A = (i * 13) & 0xFF;
+    inPixels[i] = (A << 24) | (R << 16) | (G << 8) | B;
+  }
+  
+  for (int ycocg = 0; ycocg < 2; ycocg++) {
+    for (int includeAlpha = 0; includeAlpha < 2; includeAlpha++) {
+      Rice2PlanesContainer container;
+      
+      rice2_encode_bgra(inPixels.data(), width, height, ycocg, includeAlpha, container);
+      
+      XCTAssert(container.planes.size() == (includeAlpha ? 4 : 3));
+      
+      vector<uint8_t> containerBytes = container.encode();
+      
+      Rice2PlanesContainer decodedContainer;
+      BOOL worked = decodedContainer.decode(containerBytes);
+      XCTAssert(worked);
+      
+      vector<uint32_t> outPixels(numPixels);
+      
+      rice2_decode_bgra(decodedContainer, outPixels.data());
+      
+      for (int i = 0; i < numPixels; i++) {
+        uint32_t expected = inPixels[i];
+        if (!includeAlpha) {
+          expected |= 0xFF000000;
+        }
+        XCTAssert(outPixels[i] == expected, @"pixel %d : 0x%08X != 0x%08X", i, outPixels[i], expected);
+      }
+    }
+  }
+}
+
+// Decode stats must count every symbol and escape
+
+- (void)testRice2DecodeStats {
+  const int width = 64;
+  const int height = 32;
+  
+  vector<uint8_t> inBytes(width * height);
+  
+  for (int i = 0; i < inBytes.size(); i++) {
+    // Spike in a zero block forces escapes with k = 0
+    inBytes[i] = (i == 1) ? 0x80 : 0;
+  }
+  
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(inBytes.data(), width, height, plane);
+  
+  RiceDecodeStatsReport stats;
+  vector<uint8_t> deltas;
+  rice2_decode_plane_deltas(plane, deltas, &stats);
+  
+  XCTAssert(stats.numSymbols == (width * height));
+  XCTAssert(stats.numEscapes == 2);
+  XCTAssert(stats.numBits <= (plane.riceEncodedBits.size() * 8));
+  XCTAssert(stats.bigBlockNumBits.size() == 2);
+  XCTAssert(stats.halfBlockNumSymbols.size() == 64);
+  XCTAssert(stats.halfBlockNumSymbols[0] == 32);
+  
+  string json = stats.toJSON();
+  XCTAssert(json.find("\"numEscapes\"") != string::npos);
+}
+
+// Simulated threadgroups must decode the same pixels as the CPU decoder
+
+- (void)testRiceKernelSimUndeltaSync {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint8_t> inBytes(width * height);
+  
+  for (int i = 0; i < inBytes.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    inBytes[i] = ((x * 3) + (y * 5) + ((i % 7) == 0 ? 40 : 0)) & 0xFF;
+  }
+  
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(inBytes.data(), width, height, plane);
+  
+  RiceKernelBuffers buffers;
+  rice_kernel_sim_plane_buffers(plane, buffers);
+  
+  vector<uint32_t> texture(width * height);
+  buffers.outTexture = texture.data();
+  buffers.outTextureWidth = width;
+  buffers.outTextureHeight = height;
+  
+  RiceThreadPool pool(2);
+  RiceKernelSimResult result;
+  rice_kernel_sim_dispatch(RiceKernelRenderRiceUndeltaSync, buffers, &pool, (RiceDecodeStatsNone *) nullptr, &result);
+  
+  XCTAssert(result.numThreadgroups == 6);
+  XCTAssert(result.numBarriers == (6 * 3));
+  XCTAssert(result.numUnsyncedReads == 0);
+  
+  for (int i = 0; i < inBytes.size(); i++) {
+    uint32_t expected = 0xFF000000 | (inBytes[i] << 16) | (inBytes[i] << 8) | inBytes[i];
+    XCTAssert(texture[i] == expected, @"pixel %d : 0x%08X != 0x%08X", i, texture[i], expected);
+  }
+  
+  // Without barriers the kernel depends on simdgroup execution order
+  
+  RiceKernelSimResult unsyncedResult;
+  rice_kernel_sim_dispatch(RiceKernelRenderRiceUndelta, buffers, &pool, (RiceDecodeStatsNone *) nullptr, &unsyncedResult);
+  
+  XCTAssert(unsyncedResult.numBarriers == 0);
+  XCTAssert(unsyncedResult.numUnsyncedReads > 0);
+}
+
+// Bands emitted by the streaming encoder concatenate to the same plane
+
+- (void)testRice2StreamEncoderBands {
+  const int width = 70;
+  const int height = 75;
+  
+  vector<uint8_t> inBytes(width * height);
+  
+  for (int i = 0; i < inBytes.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    inBytes[i] = ((x * 7) + (y * 3) + ((i % 11) == 0 ? 60 : 0)) & 0xFF;
+  }
+  
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(inBytes.data(), width, height, plane);
+  
+  Rice2EncodedPlane streamPlane;
+  vector<int> bandRows;
+  
+  Rice2StreamEncoder streamEncoder(width, height, [&](const Rice2EncodedBand & band) {
+    bandRows.push_back(band.numRows);
+    rice2_stream_append_band(band, width, height, streamPlane);
+  });
+  
+  for (int y = 0; y < height; y += 5) {
+    streamEncoder.appendRows(&inBytes[y * width], 5);
+  }
+  
+  XCTAssert(streamEncoder.isFinished());
+  XCTAssert(bandRows == vector<int>({32, 32, 11}));
+  
+  XCTAssert(streamPlane.riceEncodedBits == plane.riceEncodedBits);
+  XCTAssert(streamPlane.blockOptimalKTable == plane.blockOptimalKTable);
+  XCTAssert(streamPlane.halfBlockOffsetTable == plane.halfBlockOffsetTable);
+}
+
+// Stream decoder emits each band once the record after it has arrived
+
+- (void)testRice2StreamDecoderChunks {
+  const int width = 40;
+  const int height = 70;
+  
+  vector<uint8_t> inBytes(width * height);
+  
+  for (int i = 0; i < inBytes.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    inBytes[i] = ((x * 5) + (y * 9) + ((i % 17) == 0 ? 30 : 0)) & 0xFF;
+  }
+  
+  vector<uint8_t> streamBytes;
+  rice2_stream_write_header(width, height, streamBytes);
+  
+  vector<int> recordEnds;
+  
+  Rice2StreamEncoder streamEncoder(width, height, [&](const Rice2EncodedBand & band) {
+    rice2_stream_write_band(band, streamBytes);
+    recordEnds.push_back((int) streamBytes.size());
+  });
+  streamEncoder.appendRows(inBytes.data(), height);
+  
+  XCTAssert(recordEnds.size() == 3);
+  
+  vector<uint8_t> outBytes(width * height);
+  vector<int> bandRows;
+  
+  Rice2StreamDecoder streamDecoder([&](int y, int numRows, const uint8_t * rowBytes) {
+    bandRows.push_back(numRows);
+    memcpy(&outBytes[y * width], rowBytes, numRows * width);
+  });
+  
+  // The first band is decoded once the second record is complete
+  
+  XCTAssert(streamDecoder.appendBytes(streamBytes.data(), recordEnds[1] - 1));
+  XCTAssert(bandRows.size() == 0);
+  
+  XCTAssert(streamDecoder.appendBytes(&streamBytes[recordEnds[1] - 1], 1));
+  XCTAssert(bandRows.size() == 1);
+  
+  XCTAssert(streamDecoder.appendBytes(&streamBytes[recordEnds[1]], (int)streamBytes.size() - recordEnds[1]));
+  XCTAssert(streamDecoder.isFinished());
+  XCTAssert(bandRows == vector<int>({32, 32, 6}));
+  XCTAssert(outBytes == inBytes);
+}
+
+// A thumbnail decodes from the preview prefix alone
+
+- (void)testRice2ProgressivePreviewPrefix {
+  const int width = 50;
+  const int height = 20;
+  
+  vector<uint8_t> inBytes(width * height);
+  
+  for (int i = 0; i < inBytes.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    inBytes[i] = ((x * 4) + (y * 6)) & 0xFF;
+  }
+  
+  vector<uint8_t> buf;
+  rice2_progressive_encode_plane(inBytes.data(), width, height, buf);
+  
+  const int previewNumBytes = rice2_progressive_preview_num_bytes(buf);
+  XCTAssert(previewNumBytes > 0 && previewNumBytes < buf.size());
+  
+  vector<uint8_t> prefix(buf.begin(), buf.begin() + previewNumBytes);
+  
+  vector<uint8_t> preview;
+  int previewWidth, previewHeight;
+  XCTAssert(rice2_progressive_decode_preview(prefix, preview, previewWidth, previewHeight));
+  XCTAssert(previewWidth == 7);
+  XCTAssert(previewHeight == 3);
+  
+  for (int by = 0; by < previewHeight; by++) {
+    for (int bx = 0; bx < previewWidth; bx++) {
+      XCTAssert(preview[(by * previewWidth) + bx] == inBytes[(by * 8 * width) + (bx * 8)]);
+    }
+  }
+  
+  vector<uint8_t> outBytes(width * height);
+  XCTAssert(rice2_progressive_decode_plane(buf, outBytes.data()));
+  XCTAssert(outBytes == inBytes);
+}
+
+// Unchanged blocks are coded as inter residuals against the previous frame
+
+- (void)testRice2TemporalInterBlocks {
+  const int width = 64;
+  const int height = 40;
+  
+  vector<uint8_t> frame1(width * height);
+  
+  for (int i = 0; i < frame1.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    frame1[i] = ((x * 13) ^ (y * 7)) & 0xFF;
+  }
+  
+  // Change one 8x8 block
+  
+  vector<uint8_t> frame2 = frame1;
+  
+  for (int y = 8; y < 16; y++) {
+    for (int x = 16; x < 24; x++) {
+      frame2[(y * width) + x] = 0x80;
+    }
+  }
+  
+  Rice2TemporalPlane keyFrame;
+  rice2_temporal_encode_plane(frame1.data(), nullptr, width, height, keyFrame);
+  XCTAssert(keyFrame.numInterBlocks == 0);
+  
+  Rice2TemporalPlane interFrame;
+  rice2_temporal_encode_plane(frame2.data(), frame1.data(), width, height, interFrame);
+  XCTAssert(interFrame.numInterBlocks > 0);
+  XCTAssert(interFrame.plane.riceEncodedBits.size() < keyFrame.plane.riceEncodedBits.size());
+  
+  vector<uint8_t> decoded1(width * height);
+  rice2_temporal_decode_plane(keyFrame, nullptr, decoded1.data());
+  XCTAssert(decoded1 == frame1);
+  
+  vector<uint8_t> decoded2(width * height);
+  rice2_temporal_decode_plane(interFrame, decoded1.data(), decoded2.data());
+  XCTAssert(decoded2 == frame2);
+}
+
+// All zero 8x8 blocks are coded with the skip k and emit no bits
+
+- (void)testRice2SkipBlocks {
+  const int width = 64;
+  const int height = 32;
+  
+  // Left big block is a gradient, right big block is flat
+  
+  vector<uint8_t> inBytes(width * height, 0);
+  
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < 32; x++) {
+      inBytes[(y * width) + x] = ((x * 5) + (y * 3)) & 0xFF;
+    }
+  }
+  
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(inBytes.data(), width, height, plane);
+  
+  for (int blocki = 16; blocki < 32; blocki++) {
+    XCTAssert(plane.blockOptimalKTable[blocki] == RICE2_SKIP_BLOCK_K);
+    XCTAssert(plane.halfBlockOffsetTable[(blocki * 2)] == plane.halfBlockOffsetTable[32]);
+  }
+  
+  vector<uint8_t> outBytes(width * height);
+  rice2_decode_plane(plane, outBytes.data());
+  XCTAssert(outBytes == inBytes);
+  
+  vector<uint8_t> s32Symbols;
+  rice2_decode_plane_serial(plane, s32Symbols);
+  
+  for (int i = 16 * 64; i < 32 * 64; i++) {
+    XCTAssert(s32Symbols[i] == 0);
+  }
+}
+
+// Flat input with random spikes encoded with 8, 12, and 16 bit escapes
+
+- (void)testRice2EscapeNumBits {
+  const int width = 96;
+  const int height = 64;
+  
+  vector<uint8_t> inBytes(width * height);
+  
+  uint32_t seed = 1;
+  for (int i = 0; i < inBytes.size(); i++) {
+    seed = (seed * 1103515245) + 12345;
+    inBytes[i] = (((seed >> 16) & 0xF) == 0) ? ((seed >> 20) & 0xFF) : 0x80;
+  }
+  
+  vector<uint8_t> imageOrderDeltas;
+  rice2_image_order_deltas(inBytes.data(), width, height, 3, 2, imageOrderDeltas);
+  
+  Rice2EncodedPlane plane8, plane12, plane16;
+  rice2_encode_plane_symbols<8>(imageOrderDeltas, width, height, plane8);
+  rice2_encode_plane_symbols<12>(imageOrderDeltas, width, height, plane12);
+  rice2_encode_plane_symbols<16>(imageOrderDeltas, width, height, plane16);
+  
+  XCTAssert(plane8.escapeNumBits == 8);
+  XCTAssert(plane12.escapeNumBits == 12);
+  XCTAssert(plane16.escapeNumBits == 16);
+  
+  // Spikes are cheaper with a short escape when k is small
+  XCTAssert(plane8.riceEncodedBits.size() < plane16.riceEncodedBits.size());
+  
+  for ( Rice2EncodedPlane * plane : { &plane8, &plane12, &plane16 } ) {
+    vector<uint8_t> outBytes(width * height);
+    rice2_decode_plane(*plane, outBytes.data());
+    XCTAssert(outBytes == inBytes, @"escape %d", plane->escapeNumBits);
+  }
+  
+  Rice2EncodedPlane bestPlane;
+  rice2_encode_plane_best_escape(inBytes.data(), width, height, bestPlane);
+  
+  XCTAssert(bestPlane.riceEncodedBits.size() <= plane8.riceEncodedBits.size());
+  XCTAssert(bestPlane.riceEncodedBits.size() <= plane12.riceEncodedBits.size());
+  XCTAssert(bestPlane.riceEncodedBits.size() <= plane16.riceEncodedBits.size());
+}
+
+// Decode a plane, check the SIMD adler32 and the per big block hashes
+// of the decoded pixels against the input.
+
+- (void)testRice2BigBlockHashes {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint8_t> inBytes(width * height);
+  
+  for (int i = 0; i < (int)inBytes.size(); i++) {
+    inBytes[i] = (uint8_t) ((i * 7) ^ (i >> 5));
+  }
+  
+  vector<uint64_t> hashes;
+  rice2_big_block_hashes(inBytes.data(), width, height, 1, hashes);
+  XCTAssert(hashes.size() == 3 * 2);
+  
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(inBytes.data(), width, height, plane);
+  
+  vector<uint8_t> outBytes(width * height);
+  rice2_decode_plane(plane, outBytes.data());
+  
+  XCTAssert(adler32_update(1, outBytes.data(), outBytes.size()) == adler32_update(1, inBytes.data(), inBytes.size()));
+  XCTAssert(rice2_verify_big_block_hashes(outBytes.data(), width, height, 1, hashes) == 0);
+  
+  // Change one pixel in the bottom right big block
+  
+  outBytes[(39 * width) + 69] ^= 0x80;
+  
+  vector<int> badBlocks;
+  XCTAssert(rice2_verify_big_block_hashes(outBytes.data(), width, height, 1, hashes, nullptr, &badBlocks) == 1);
+  XCTAssert(badBlocks.size() == 1 && badBlocks[0] == 5);
+}
+
+// Container with per big block hashes, a corrupted plane reports only
+// the tile that does not match.
+
+- (void)testRice2BigBlockHashTable {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint32_t> pixels(width * height);
+  
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = 0xFF000000 | ((i * 7) & 0xFF) << 16 | (((i * i) >> 2) & 0xFF) << 8 | ((i * 3) & 0xFF);
+  }
+  
+  Rice2PlanesContainer container;
+  rice2_encode_bgra(pixels.data(), width, height, false, false, container, true);
+  
+  Rice2PlanesContainer decodedContainer;
+  XCTAssert(decodedContainer.decode(container.encode()));
+  XCTAssert(decodedContainer.hasBigBlockHashes());
+  
+  vector<uint32_t> decoded(pixels.size());
+  XCTAssert(rice2_decode_bgra(decodedContainer, decoded.data()) == 0);
+  XCTAssert(decoded == pixels);
+  
+  // Flip bits in the middle of the G plane bits for bbid 1
+  
+  Rice2EncodedPlane & plane = decodedContainer.planes[1];
+  const int wordi = plane.halfBlockOffsetTable[(1 * 32) + 2] / 32 + 1;
+  XCTAssert(wordi < (int) (plane.halfBlockOffsetTable[(1 * 32) + 3] / 32));
+  plane.riceEncodedBits[(wordi * 4) + 1] ^= 0x5A;
+  
+  vector<int> badBlocks;
+  XCTAssert(rice2_decode_bgra(decodedContainer, decoded.data(), &badBlocks) == 1);
+  XCTAssert(badBlocks.size() == 1 && badBlocks[0] == 1);
+}
+
+- (void)testRice2Predictors {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint32_t> pixels(width * height);
+  
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    pixels[i] = 0xFF000000 | (((x * 3) + (y * 2)) & 0xFF) << 16 | (((x * y) >> 3) & 0xFF) << 8 | ((x + (y * 5)) & 0xFF);
+  }
+  
+  const BlockDeltaPredictor predictors[] = {
+    BlockDeltaPredictorLeft,
+    BlockDeltaPredictorGradient,
+    BlockDeltaPredictorMED
+  };
+  
+  for ( BlockDeltaPredictor predictor : predictors ) {
+    Rice2PlanesContainer container;
+    rice2_encode_bgra(pixels.data(), width, height, false, false, container, false, predictor);
+    
+    Rice2PlanesContainer decodedContainer;
+    XCTAssert(decodedContainer.decode(container.encode()));
+    XCTAssert(decodedContainer.hasPredictors() == (predictor != BlockDeltaPredictorLeft));
+    XCTAssert(decodedContainer.planes[0].predictor == predictor);
+    
+    vector<uint32_t> decoded(pixels.size());
+    XCTAssert(rice2_decode_bgra(decodedContainer, decoded.data()) == 0);
+    XCTAssert(decoded == pixels);
+  }
+}
+
+- (void)testRice2DecodeCostKSearch {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint8_t> pixels(width * height);
+  
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = (i % 5 == 0) ? ((i * 131) & 0xFF) : (i & 0xF);
+  }
+  
+  vector<uint8_t> imageOrderDeltas;
+  rice2_image_order_deltas(pixels.data(), width, height, 3, 2, imageOrderDeltas);
+  
+  Rice2EncodedPlane plane;
+  rice2_encode_plane_symbols(imageOrderDeltas, width, height, plane, Rice2KSearchDecodeCost);
+  
+  vector<uint8_t> decoded(width * height);
+  rice2_decode_plane(plane, decoded.data());
+  XCTAssert(decoded == pixels);
+}
+
+- (void)testRice2BalancedTidTable {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint32_t> pixels(width * height);
+  
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = 0xFF000000 | ((i * 7) & 0xFF) << 16 | (((i * i) >> 2) & 0xFF) << 8 | ((i * 3) & 0xFF);
+  }
+  
+  Rice2PlanesContainer container;
+  rice2_encode_bgra(pixels.data(), width, height, false, false, container, false, BlockDeltaPredictorLeft, false, 8);
+  XCTAssert(container.hasTidTables());
+  
+  Rice2BalanceReport report;
+  rice2_balance_report(container.planes[0], 8, report);
+  
+  Rice2EncodedPlane identityPlane = container.planes[0];
+  identityPlane.halfBlockTidTable.clear();
+  
+  Rice2BalanceReport identityReport;
+  rice2_balance_report(identityPlane, 8, identityReport);
+  
+  XCTAssert(report.simdNumBits < identityReport.simdNumBits);
+  
+  Rice2PlanesContainer decodedContainer;
+  XCTAssert(decodedContainer.decode(container.encode()));
+  XCTAssert(decodedContainer.planes[0].halfBlockTidTable == container.planes[0].halfBlockTidTable);
+  
+  vector<uint32_t> decoded(pixels.size());
+  XCTAssert(rice2_decode_bgra(decodedContainer, decoded.data()) == 0);
+  XCTAssert(decoded == pixels);
+}
+
+- (void)testRice2LargePlane {
+  const uint32_t width = 66000;
+  const uint32_t height = 33;
+  
+  vector<uint8_t> pixels(width * height);
+  
+  for (uint32_t i = 0; i < width * height; i++) {
+    pixels[i] = (uint8_t) ((i % width) >> 3) ^ (i / width);
+  }
+  
+  Rice2LargePlane plane;
+  rice2_large_encode_plane(pixels.data(), width, height, plane);
+  XCTAssert(plane.numSegments() == 9);
+  
+  Rice2LargePlane decodedPlane;
+  XCTAssert(decodedPlane.decode(plane.encode()));
+  
+  vector<uint8_t> decoded(width * height);
+  rice2_large_decode_plane(decodedPlane, decoded.data());
+  XCTAssert(decoded == pixels);
+  
+  vector<uint8_t> region(64 * 8);
+  rice2_large_decode_region(decodedPlane, 65900, 20, 64, 8, region.data(), 64);
+  XCTAssert(memcmp(region.data(), &pixels[(20 * width) + 65900], 64) == 0);
+}
 
+- (void)testRice2EncodeSteps {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint8_t> pixels(width * height);
+  
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = (uint8_t) ((i * 7) ^ (i >> 5));
+  }
+  
+  Rice2EncodedPlane expected;
+  rice2_encode_plane(pixels.data(), width, height, expected);
+  
+  vector<uint8_t> imageOrderDeltas;
+  rice2_image_order_deltas(pixels.data(), width, height, 3, 2, imageOrderDeltas);
+  
+  Rice2EncodedPlane plane;
+  vector<uint8_t> s32OrderSymbols;
+  rice2_plane_k_table(imageOrderDeltas, width, height, plane, s32OrderSymbols);
+  XCTAssert(plane.blockOptimalKTable == expected.blockOptimalKTable);
+  
+  rice2_encode_plane_bits(s32OrderSymbols, plane);
+  XCTAssert(plane.riceEncodedBits == expected.riceEncodedBits);
+  XCTAssert(plane.halfBlockOffsetTable == expected.halfBlockOffsetTable);
+}
+
+- (void)testRice2LoadAsset {
+  const int width = 70;
+  const int height = 40;
+  
+  vector<uint8_t> pixels(width * height);
+  
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = (uint8_t) ((i % width) + ((i / width) * 3));
+  }
+  
+  Rice2PlanesContainer container;
+  container.width = width;
+  container.height = height;
+  container.planes.resize(1);
+  rice2_encode_plane(pixels.data(), width, height, container.planes[0]);
+  
+  const Rice2EncodedPlane & plane = container.planes[0];
+  
+  vector<uint8_t> assetVec = container.encode();
+  NSData *assetData = [NSData dataWithBytes:assetVec.data() length:assetVec.size()];
+  
+  int assetWidth = 0;
+  int assetHeight = 0;
+  int numBigBlocksInWidth = 0;
+  int numBigBlocksInHeight = 0;
+  
+  NSMutableData *riceEncodedStream = [NSMutableData data];
+  NSMutableData *blockOptimalKTable = [NSMutableData data];
+  NSMutableData *halfBlockOffsetTable = [NSMutableData data];
+  
+  BOOL worked = [Rice loadRice2Asset:assetData
+                               width:&assetWidth
+                              height:&assetHeight
+                 numBigBlocksInWidth:&numBigBlocksInWidth
+                numBigBlocksInHeight:&numBigBlocksInHeight
+                   riceEncodedStream:riceEncodedStream
+                  blockOptimalKTable:blockOptimalKTable
+                halfBlockOffsetTable:halfBlockOffsetTable];
+  
+  XCTAssert(worked);
+  XCTAssert(assetWidth == width && assetHeight == height);
+  XCTAssert(numBigBlocksInWidth == 3 && numBigBlocksInHeight == 2);
+  XCTAssert(riceEncodedStream.length == plane.riceEncodedBits.size());
+  XCTAssert(memcmp(riceEncodedStream.bytes, plane.riceEncodedBits.data(), riceEncodedStream.length) == 0);
+  XCTAssert(blockOptimalKTable.length == plane.blockOptimalKTable.size());
+  XCTAssert(memcmp(blockOptimalKTable.bytes, plane.blockOptimalKTable.data(), blockOptimalKTable.length) == 0);
+  XCTAssert(halfBlockOffsetTable.length == plane.halfBlockOffsetTable.size() * sizeof(uint32_t));
+  XCTAssert(memcmp(halfBlockOffsetTable.bytes, plane.halfBlockOffsetTable.data(), halfBlockOffsetTable.length) == 0);
+  
+  // A plane with a predictor other than Left falls back to encode on launch
+  
+  rice2_encode_plane(pixels.data(), width, height, container.planes[0], BlockDeltaPredictorMED);
+  assetVec = container.encode();
+  assetData = [NSData dataWithBytes:assetVec.data() length:assetVec.size()];
+  
+  worked = [Rice loadRice2Asset:assetData
+                          width:&assetWidth
+                         height:&assetHeight
+            numBigBlocksInWidth:&numBigBlocksInWidth
+           numBigBlocksInHeight:&numBigBlocksInHeight
+              riceEncodedStream:riceEncodedStream
+             blockOptimalKTable:blockOptimalKTable
+           halfBlockOffsetTable:halfBlockOffsetTable];
+  
+  XCTAssert(!worked);
+}
+
+- (void)testRice2FrameRing {
+  const int width = 70;
+  const int height = 40;
+  const int numFrames = 5;
+  
+  // Write a short sequence of frames, frame 3 is missing
+  
+  vector<vector<uint8_t> > framePixels(numFrames);
+  NSMutableArray *paths = [NSMutableArray array];
+  
+  for (int f = 0; f < numFrames; f++) {
+    vector<uint8_t> & pixels = framePixels[f];
+    pixels.resize(width * height);
+    
+    for (int i = 0; i < (int)pixels.size(); i++) {
+      pixels[i] = (uint8_t) ((i % width) + ((i / width) * 3) + (f * 7));
+    }
+    
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"frame_ring_%d.r2pl", f]];
+    [paths addObject:path];
+    
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    
+    if (f == 3) {
+      continue;
+    }
+    
+    Rice2PlanesContainer container;
+    container.width = width;
+    container.height = height;
+    container.planes.resize(1);
+    rice2_encode_plane(pixels.data(), width, height, container.planes[0]);
+    
+    vector<uint8_t> assetVec = container.encode();
+    NSData *assetData = [NSData dataWithBytes:assetVec.data() length:assetVec.size()];
+    XCTAssert([assetData writeToFile:path atomically:YES]);
+  }
+  
+  // CPU decode with 2 slots
+  
+  RiceFrameRing<Rice2FrameSlot> ring(2);
+  
+  vector<int> frameOrder;
+  int numMatched = 0;
+  
+  int numFailed = ring.run(numFrames,
+                           [&](int frameIndex, Rice2FrameSlot & slot) -> size_t {
+                             return rice2_frame_read_file(string([paths[frameIndex] UTF8String]), slot);
+                           },
+                           [&](Rice2FrameSlot & slot) -> size_t {
+                             return rice2_frame_decode(slot);
+                           },
+                           [&](int frameIndex, Rice2FrameSlot & slot, bool ok) {
+                             frameOrder.push_back(frameIndex);
+                             if (ok && slot.outPixels == framePixels[frameIndex]) {
+                               numMatched += 1;
+                             }
+                           });
+  
+  XCTAssert(numFailed == 1);
+  XCTAssert(numMatched == numFrames - 1);
+  XCTAssert(frameOrder == vector<int>({0, 1, 2, 3, 4}));
+  
+  // Metal ring with 2 render frames, the reader copies each frame into
+  // the buffers of a free render frame.
+  
+  id<MTLDevice> device = MTLCreateSystemDefaultDevice();
+  
+  MetalRenderContext *mrc = [[MetalRenderContext alloc] init];
+  
+  [mrc setupMetal:device];
+  
+  MetalRice2RenderContext *mRenderContext = [[MetalRice2RenderContext alloc] init];
+  
+  mRenderContext.computeKernelFunction = @"kernel_render_rice2";
+  
+  [mRenderContext setupRenderPipelines:mrc];
+  
+  MetalRice2FrameRing *frameRing = [[MetalRice2FrameRing alloc] initWithRenderContext:mRenderContext
+                                                                                  mrc:mrc
+                                                                            numFrames:2
+                                                                           renderSize:CGSizeMake(96, 64)
+                                                                            blockSize:CGSizeMake(8, 8)
+                                                                      maxNumBitsBytes:width * height * 2];
+  
+  XCTAssert(frameRing.renderFrames.count == 2);
+  
+  [frameRing startReading:numFrames pathForFrame:^NSString *(int frameIndex) {
+    return paths[frameIndex];
+  }];
+  
+  int numRendered = 0;
+  int frameIndex = 0;
+  BOOL ok = NO;
+  
+  while (MetalRice2RenderFrame *renderFrame = [frameRing nextFrame:&frameIndex ok:&ok]) {
+    XCTAssert(frameIndex == numRendered);
+    XCTAssert(ok == (frameIndex != 3));
+    
+    if (ok) {
+      Rice2EncodedPlane plane;
+      rice2_encode_plane(framePixels[frameIndex].data(), width, height, plane);
+      
+      XCTAssert(memcmp(renderFrame.bitsBuff.contents, plane.riceEncodedBits.data(), plane.riceEncodedBits.size()) == 0);
+      XCTAssert(memcmp(renderFrame.blockOptimalKTable.contents, plane.blockOptimalKTable.data(), plane.blockOptimalKTable.size()) == 0);
+      
+      RiceRenderUniform *riceRenderUniformPtr = (RiceRenderUniform*) renderFrame.riceRenderUniform.contents;
+      XCTAssert(riceRenderUniformPtr->cropWidth == width && riceRenderUniformPtr->cropHeight == height);
+      
+      id <MTLCommandBuffer> commandBuffer = [mrc.commandQueue commandBuffer];
+      
+      [mRenderContext renderRice:mrc commandBuffer:commandBuffer renderFrame:renderFrame];
+      
+      // The render frame goes back to the ring once the GPU is done
+      
+      [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+        [frameRing releaseFrame:renderFrame];
+      }];
+      
+      [commandBuffer commit];
+    } else {
+      [frameRing releaseFrame:renderFrame];
+    }
+    
+    numRendered += 1;
+  }
+  
+  [frameRing stop];
+  
+  XCTAssert(numRendered == numFrames);
+  
+  for (NSString *path in paths) {
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+  }
+}
+
+@end
@@ -0,0 +1,200 @@
+//
+//  bench.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Minimal benchmark harness in the style of Google Benchmark. Each
+//  registered benchmark is a function that runs one iteration of the
+//  work being measured. The harness repeats the function until the
+//  min time has elapsed and then reports time per iteration, MB/s,
+//  symbols per cycle and any user counters like compressed size.
+
+#ifndef _bench_hpp
+#define _bench_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+// Read a cycle counter, returns 0 when no counter is available
+
+static inline
+uint64_t bench_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// Prevent the compiler from optimizing away a result
+
+template <typename T>
+static inline
+void bench_do_not_optimize(T const & value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class BenchState
+{
+public:
+  // Bytes and symbols processed by a single iteration
+  int64_t bytesPerIteration;
+  int64_t symbolsPerIteration;
+
+  // Named values reported along with the timing, for example
+  // the compressed size in bytes.
+  vector<pair<string, double> > counters;
+
+  // Set by setup when a correctness check fails, the
+  // benchmark is skipped and runAll() returns non-zero.
+  bool failed;
+
+  BenchState()
+  : bytesPerIteration(0),
+  symbolsPerIteration(0),
+  failed(false)
+  {
+  }
+
+  void setCounter(const string & name, double value) {
+    for ( auto & counter : counters ) {
+      if (counter.first == name) {
+        counter.second = value;
+        return;
+      }
+    }
+    counters.push_back(make_pair(name, value));
+  }
+};
+
+class Bench
+{
+public:
+  string name;
+
+  // Invoked once before timing so that input can be prepared
+  function<void(BenchState &)> setup;
+
+  // One iteration of the work being measured
+  function<void(BenchState &)> run;
+};
+
+class BenchRunner
+{
+public:
+  vector<Bench> benchmarks;
+
+  double minTimeSeconds;
+
+  string filter;
+
+  BenchRunner()
+  : minTimeSeconds(0.5)
+  {
+  }
+
+  void add(const string & name,
+           function<void(BenchState &)> setup,
+           function<void(BenchState &)> run)
+  {
+    Bench bench;
+    bench.name = name;
+    bench.setup = setup;
+    bench.run = run;
+    benchmarks.push_back(bench);
+  }
+
+  // Parse --min-time=N and --filter=S, returns false on unknown args
+
+  bool parseArgs(int argc, const char **argv) {
+    for (int i = 1; i < argc; i++) {
+      const char *arg = argv[i];
+      if (strncmp(arg, "--min-time=", 11) == 0) {
+        minTimeSeconds = atof(arg + 11);
+      } else if (strncmp(arg, "--filter=", 9) == 0) {
+        filter = arg + 9;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int runAll() {
+    printf("%-56s %12s %10s %10s %10s  %s\n", "Benchmark", "Time(ms)", "Iterations", "MB/s", "sym/cycle", "Counters");
+    printf("%s\n", string(116, '-').c_str());
+
+    int numFailed = 0;
+
+    for ( Bench & bench : benchmarks ) {
+      if (!filter.empty() && bench.name.find(filter) == string::npos) {
+        continue;
+      }
+
+      BenchState state;
+
+      if (bench.setup) {
+        bench.setup(state);
+      }
+
+      if (state.failed) {
+        printf("%-56s FAILED\n", bench.name.c_str());
+        numFailed += 1;
+        continue;
+      }
+
+      // One warm up iteration then repeat until min time has elapsed
+
+      bench.run(state);
+
+      int64_t iterations = 0;
+      uint64_t startCycles = bench_cycles();
+      auto startTime = chrono::steady_clock::now();
+      double elapsed = 0.0;
+
+      do {
+        bench.run(state);
+        iterations += 1;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+      } while (elapsed < minTimeSeconds);
+
+      uint64_t cycles = bench_cycles() - startCycles;
+
+      double msPerIteration = (elapsed * 1000.0) / iterations;
+      double mbPerSecond = (state.bytesPerIteration * iterations) / (elapsed * 1024.0 * 1024.0);
+
+      char symbolsPerCycle[32] = "-";
+
+      if (cycles > 0 && state.symbolsPerIteration > 0) {
+        snprintf(symbolsPerCycle, sizeof(symbolsPerCycle), "%.4f", (double)(state.symbolsPerIteration * iterations) / cycles);
+      }
+
+      printf("%-56s %12.3f %10lld %10.1f %10s ", bench.name.c_str(), msPerIteration, (long long)iterations, mbPerSecond, symbolsPerCycle);
+
+      for ( auto & counter : state.counters ) {
+        printf(" %s=%.6g", counter.first.c_str(), counter.second);
+      }
+
+      printf("\n");
+      fflush(stdout);
+    }
+
+    return (numFailed > 0) ? 1 : 0;
+  }
+};
+
+#endif // _bench_hpp
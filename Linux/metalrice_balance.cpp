@@ -0,0 +1,115 @@
+//
+//  metalrice_balance.cpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Report the load balance of the 32 half block substreams in each big
+//  block of a Rice2 encoding. Each input is either a PGM image, which
+//  is encoded first, or a serialized Rice2PlanesContainer. For each
+//  plane the max to mean ratio of the half block bits and histograms
+//  are printed along with the simdgroup cost before and after the
+//  half block to tid mapping is balanced for --simd=N.
+//
+//  metalrice_balance [--simd=8|16|32] [--decode-cost] [--json] FILE...
+
+#include "metalrice_core.hpp"
+
+#include <cstdlib>
+
+static
+void printReport(const string & label,
+                 const Rice2EncodedPlane & plane,
+                 const int simdWidth,
+                 const bool json)
+{
+  Rice2BalanceReport report;
+  rice2_balance_report(plane, simdWidth, report);
+
+  Rice2EncodedPlane balancedPlane = plane;
+  const int numPermuted = rice2_plane_balance_tids(balancedPlane, simdWidth);
+
+  Rice2BalanceReport balancedReport;
+  rice2_balance_report(balancedPlane, simdWidth, balancedReport);
+
+  if (json) {
+    printf("\"%s\": %s", label.c_str(), report.toJSON().c_str());
+    return;
+  }
+
+  const int numNonEmpty = report.numBigBlocks - report.numEmptyBigBlocks;
+
+  printf("%s\n", label.c_str());
+  printf("  big blocks        %d (%d empty)\n", report.numBigBlocks, report.numEmptyBigBlocks);
+  printf("  max / mean        %.3f\n", report.meanMaxToMeanRatio);
+  printf("  sum max / mean    %.3f\n", (report.numBits == 0) ? 0.0 : (report.maxNumBits * 32.0) / report.numBits);
+  printf("  simd %2d bits      %llu -> %llu balanced (%d big blocks permuted)\n", simdWidth,
+         (unsigned long long) report.simdNumBits,
+         (unsigned long long) balancedReport.simdNumBits,
+         numPermuted);
+
+  printf("  max / mean histogram\n");
+  for (int i = 0; i < 8; i++) {
+    const double pct = (numNonEmpty == 0) ? 0.0 : (report.ratioHistogram[i] * 100.0) / numNonEmpty;
+    printf("    %4.2f%s %6u %5.1f%%\n", 1.0 + (i * 0.25), (i == 7) ? "+" : " ", report.ratioHistogram[i], pct);
+  }
+
+  printf("  half block bits histogram\n");
+  for (int i = 0; i < 16; i++) {
+    printf("    %3d%s %8u\n", i * 32, (i == 15) ? "+" : " ", report.halfBlockBitsHistogram[i]);
+  }
+}
+
+int main(int argc, const char **argv)
+{
+  int simdWidth = 16;
+  bool decodeCost = false;
+  bool json = false;
+  vector<string> paths;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg.rfind("--simd=", 0) == 0) {
+      simdWidth = atoi(arg.c_str() + 7);
+    } else if (arg == "--decode-cost") {
+      decodeCost = true;
+    } else if (arg == "--json") {
+      json = true;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+
+  if (paths.empty() || (simdWidth != 8 && simdWidth != 16 && simdWidth != 32)) {
+    fprintf(stderr, "usage: metalrice_balance [--simd=8|16|32] [--decode-cost] [--json] FILE...\n");
+    return 1;
+  }
+
+  for ( const string & path : paths ) {
+    vector<uint8_t> pixels;
+    int width, height;
+
+    if (metalrice_read_pgm(path, pixels, width, height)) {
+      Rice2EncodedPlane plane;
+      rice2_encode_plane(pixels.data(), width, height, plane, BlockDeltaPredictorLeft,
+                         decodeCost ? Rice2KSearchDecodeCost : Rice2KSearchMinBits);
+      printReport(path, plane, simdWidth, json);
+      continue;
+    }
+
+    vector<uint8_t> bytes;
+    Rice2PlanesContainer container;
+
+    if (!metalrice_read_file(path, bytes) || !container.decode(bytes)) {
+      fprintf(stderr, "could not read %s\n", path.c_str());
+      return 1;
+    }
+
+    for (int planei = 0; planei < (int) container.planes.size(); planei++) {
+      printReport(path + " plane " + to_string(planei), container.planes[planei], simdWidth, json);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,988 @@
+//
+//  metalrice_bench.cpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Benchmarks for the codec core on the bundled test images. Each
+//  image is read from a pre-converted grayscale PGM file and run
+//  through the encode steps, k optimization, each CPU decoder and
+//  the undelta step. Decode stats for each image can be written as
+//  JSON with --stats-dir. Each coder family in rice.hpp is also run
+//  over the same block order symbols through rice_adapters.hpp, a
+//  coder that does not round trip is reported as FAILED. The decode
+//  kernels are also timed in the threadgroup simulator.
+
+#include "metalrice_core.hpp"
+#include "rice_adapters.hpp"
+#include "bench.hpp"
+
+#include <memory>
+
+#if !defined(METALRICE_IMAGES_DIR)
+#define METALRICE_IMAGES_DIR "Linux/images"
+#endif
+
+// Shared state for all benchmarks on one image, the encoded plane
+// is created once so that decode benchmarks only time decoding.
+
+class BenchImage
+{
+public:
+  string name;
+  int width;
+  int height;
+  vector<uint8_t> pixels;
+
+  Rice2EncodedPlane plane;
+
+  // Intermediate values from the encode steps
+  vector<uint8_t> blockOrderSymbols;
+  vector<uint8_t> imageOrderDeltas;
+
+  // Decode stats used to explain throughput differences
+  RiceDecodeStatsReport stats;
+
+  // Block order symbols and k table for the coder matrix
+  RiceCoderInput coderInput;
+};
+
+// Encode and decode benchmarks for one coder adapter, the round trip
+// is checked once in setup before timing.
+
+template <class A>
+static
+void addCoderBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img)
+{
+  shared_ptr<RiceCoderEncoded> encoded = make_shared<RiceCoderEncoded>();
+
+  auto setup = [img, encoded](BenchState & state) {
+    int numBytes = 0;
+    state.failed = !rice_adapter_round_trip<A>(img->coderInput, numBytes);
+
+    if (encoded->streams.empty()) {
+      A::encode(img->coderInput, *encoded);
+    }
+
+    state.bytesPerIteration = img->coderInput.symbols.size();
+    state.symbolsPerIteration = img->coderInput.symbols.size();
+    state.setCounter("bytes", (double) numBytes);
+    state.setCounter("bpp", (numBytes * 8.0) / img->coderInput.symbols.size());
+    state.setCounter("prefixOnly", A::prefixOnly ? 1 : 0);
+  };
+
+  const string suffix = string(A::name()) + "/" + img->name;
+
+  runner.add("CoderEncode/" + suffix, setup, [img](BenchState &) {
+    RiceCoderEncoded encoded;
+    A::encode(img->coderInput, encoded);
+    bench_do_not_optimize(encoded.streams[0].data());
+  });
+
+  runner.add("CoderDecode/" + suffix, setup, [img, encoded](BenchState &) {
+    vector<uint8_t> decoded;
+    A::decode(img->coderInput, *encoded, decoded);
+    bench_do_not_optimize(decoded.data());
+  });
+}
+
+// Decode kernels run through the threadgroup simulator on a thread pool
+
+static
+void addKernelSimBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img, shared_ptr<RiceThreadPool> pool)
+{
+  const RiceKernelType types[] = {
+    RiceKernelRenderRice2,
+    RiceKernelRenderRice2Undelta,
+    RiceKernelRenderRice2UndeltaSync,
+    RiceKernelRenderRiceUndelta,
+    RiceKernelRenderRiceUndeltaSync
+  };
+
+  for ( RiceKernelType type : types ) {
+    auto setup = [img, pool](BenchState & state) {
+      state.bytesPerIteration = img->width * img->height;
+      state.symbolsPerIteration = img->plane.paddedWidth() * img->plane.paddedHeight();
+      state.setCounter("threads", (double) pool->numThreads());
+    };
+
+    runner.add(string("KernelSim/") + rice_kernel_sim_name(type) + "/" + img->name, setup, [img, pool, type](BenchState &) {
+      const bool expandGray = (type == RiceKernelRenderRiceUndelta || type == RiceKernelRenderRiceUndeltaSync);
+
+      RiceKernelBuffers buffers;
+      rice_kernel_sim_plane_buffers(img->plane, buffers);
+
+      if (expandGray) {
+        buffers.outTextureWidth = img->width;
+        buffers.outTextureHeight = img->height;
+      } else {
+        buffers.outTextureWidth = img->plane.paddedWidth() / 4;
+        buffers.outTextureHeight = img->plane.paddedHeight();
+      }
+
+      vector<uint32_t> texture(buffers.outTextureWidth * buffers.outTextureHeight);
+      buffers.outTexture = texture.data();
+
+      rice_kernel_sim_dispatch(type, buffers, pool.get());
+      bench_do_not_optimize(texture.data());
+    });
+  }
+}
+
+// Encode and decode with each block delta predictor, the bpp counter
+// compares the size of each encoding. The gradient and MED planes are
+// also decoded with the matching undelta kernel in the simulator.
+
+static
+void addPredictorBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img, shared_ptr<RiceThreadPool> pool)
+{
+  const BlockDeltaPredictor predictors[] = {
+    BlockDeltaPredictorLeft,
+    BlockDeltaPredictorGradient,
+    BlockDeltaPredictorMED
+  };
+  const char *names[] = { "Left", "Gradient", "MED" };
+
+  for ( BlockDeltaPredictor predictor : predictors ) {
+    shared_ptr<Rice2EncodedPlane> plane = make_shared<Rice2EncodedPlane>();
+    rice2_encode_plane(img->pixels.data(), img->width, img->height, *plane, predictor);
+
+    auto setup = [img, plane](BenchState & state) {
+      state.bytesPerIteration = img->width * img->height;
+      state.symbolsPerIteration = plane->paddedWidth() * plane->paddedHeight();
+      state.setCounter("bpp", (plane->riceEncodedBits.size() * 8.0) / (img->width * img->height));
+    };
+
+    runner.add(string("EncodePredictor/") + names[predictor] + "/" + img->name, setup, [img, predictor](BenchState &) {
+      Rice2EncodedPlane plane;
+      rice2_encode_plane(img->pixels.data(), img->width, img->height, plane, predictor);
+      bench_do_not_optimize(plane.riceEncodedBits.data());
+    });
+
+    runner.add(string("DecodePredictor/") + names[predictor] + "/" + img->name, setup, [img, plane](BenchState &) {
+      vector<uint8_t> decoded(img->width * img->height);
+      rice2_decode_plane(*plane, decoded.data());
+      bench_do_not_optimize(decoded.data());
+    });
+
+    if (predictor == BlockDeltaPredictorLeft) {
+      continue;
+    }
+
+    const RiceKernelType type = (predictor == BlockDeltaPredictorGradient) ? RiceKernelRenderRice2UndeltaGradientSync : RiceKernelRenderRice2UndeltaMEDSync;
+
+    runner.add(string("KernelSim/") + rice_kernel_sim_name(type) + "/" + img->name, setup, [plane, pool, type](BenchState &) {
+      RiceKernelBuffers buffers;
+      rice_kernel_sim_plane_buffers(*plane, buffers);
+
+      buffers.outTextureWidth = plane->paddedWidth() / 4;
+      buffers.outTextureHeight = plane->paddedHeight();
+
+      vector<uint32_t> texture(buffers.outTextureWidth * buffers.outTextureHeight);
+      buffers.outTexture = texture.data();
+
+      rice_kernel_sim_dispatch(type, buffers, pool.get());
+      bench_do_not_optimize(texture.data());
+    });
+  }
+}
+
+// Split image bytes into DxD blocks and flatten back, the generic
+// per row copy is compared to the byte fast path with and without a pool.
+
+template <const int D>
+static
+void addBlockSplitBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img, shared_ptr<RiceThreadPool> pool)
+{
+  const unsigned int blockWidth = (img->width + D - 1) / D;
+  const unsigned int blockHeight = (img->height + D - 1) / D;
+  const unsigned int numPaddedPixels = blockWidth * blockHeight * D * D;
+
+  shared_ptr<vector<uint8_t> > blockLayout = make_shared<vector<uint8_t> >(numPaddedPixels);
+  splitIntoBlocksOfSize(D, img->pixels.data(), img->width, img->height, blockWidth, blockHeight, blockLayout->data(), blockWidth, blockHeight, (uint8_t) 0);
+
+  auto setup = [img, pool](BenchState & state) {
+    state.bytesPerIteration = img->width * img->height;
+    state.setCounter("threads", (double) pool->numThreads());
+  };
+
+  const string dim = to_string(D);
+
+  runner.add("BlockSplit" + dim + "Generic/" + img->name, setup, [=](BenchState &) {
+    vector<uint8_t> out(numPaddedPixels);
+    splitIntoBlocksOfSize<uint8_t>(D, img->pixels.data(), img->width, img->height, blockWidth, blockHeight, out.data(), blockWidth, blockHeight, 0);
+    bench_do_not_optimize(out.data());
+  });
+
+  runner.add("BlockSplit" + dim + "/" + img->name, setup, [=](BenchState &) {
+    vector<uint8_t> out(numPaddedPixels);
+    splitIntoBlocksOfSize(D, img->pixels.data(), img->width, img->height, blockWidth, blockHeight, out.data(), blockWidth, blockHeight, (uint8_t) 0);
+    bench_do_not_optimize(out.data());
+  });
+
+  runner.add("BlockSplit" + dim + "Pool/" + img->name, setup, [=](BenchState &) {
+    vector<uint8_t> out(numPaddedPixels);
+    splitIntoBlocksOfSize(D, img->pixels.data(), img->width, img->height, blockWidth, blockHeight, out.data(), blockWidth, blockHeight, (uint8_t) 0, pool.get());
+    bench_do_not_optimize(out.data());
+  });
+
+  runner.add("BlockFlatten" + dim + "Generic/" + img->name, setup, [=](BenchState &) {
+    vector<uint8_t> out(numPaddedPixels);
+    flattenBlocksOfSize<uint8_t>(D, blockLayout->data(), out.data(), blockWidth, blockHeight);
+    bench_do_not_optimize(out.data());
+  });
+
+  runner.add("BlockFlatten" + dim + "/" + img->name, setup, [=](BenchState &) {
+    vector<uint8_t> out(numPaddedPixels);
+    flattenBlocksOfSize(D, blockLayout->data(), out.data(), blockWidth, blockHeight);
+    bench_do_not_optimize(out.data());
+  });
+
+  runner.add("BlockFlatten" + dim + "Pool/" + img->name, setup, [=](BenchState &) {
+    vector<uint8_t> out(numPaddedPixels);
+    flattenBlocksOfSize(D, blockLayout->data(), out.data(), blockWidth, blockHeight, pool.get());
+    bench_do_not_optimize(out.data());
+  });
+}
+
+// Frame checksums, the byte at a time adler32 loop compared to the
+// 32 byte chunk SIMD update, whole frame and per big block hash64, and
+// decode with verification of each tile.
+
+static
+void addChecksumBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img, shared_ptr<RiceThreadPool> pool)
+{
+  auto setup = [img, pool](BenchState & state) {
+    state.bytesPerIteration = img->width * img->height;
+    state.setCounter("threads", (double) pool->numThreads());
+  };
+
+  runner.add("Adler32Scalar/" + img->name, setup, [img](BenchState &) {
+    uint32_t s1 = 1;
+    uint32_t s2 = 0;
+    const uint8_t *ptr = img->pixels.data();
+    size_t len = img->pixels.size();
+    while (len > 0) {
+      const int n = (len < CHECKSUM_ADLER_NMAX32) ? (int) len : CHECKSUM_ADLER_NMAX32;
+      adler32_update_scalar(&s1, &s2, ptr, n);
+      s1 %= CHECKSUM_ADLER_BASE;
+      s2 %= CHECKSUM_ADLER_BASE;
+      ptr += n;
+      len -= n;
+    }
+    bench_do_not_optimize((s2 << 16) | s1);
+  });
+
+  runner.add("Adler32/" + img->name, setup, [img](BenchState &) {
+    bench_do_not_optimize(adler32_update(1, img->pixels.data(), img->pixels.size()));
+  });
+
+  runner.add("Hash64/" + img->name, setup, [img](BenchState &) {
+    bench_do_not_optimize(hash64(img->pixels.data(), img->pixels.size(), 0));
+  });
+
+  runner.add("BigBlockHashes/" + img->name, setup, [img](BenchState &) {
+    vector<uint64_t> hashes;
+    rice2_big_block_hashes(img->pixels.data(), img->width, img->height, 1, hashes);
+    bench_do_not_optimize(hashes.data());
+  });
+
+  runner.add("BigBlockHashesPool/" + img->name, setup, [img, pool](BenchState &) {
+    vector<uint64_t> hashes;
+    rice2_big_block_hashes(img->pixels.data(), img->width, img->height, 1, hashes, pool.get());
+    bench_do_not_optimize(hashes.data());
+  });
+
+  // Whole plane decode followed by a serial adler32 pass, compared to
+  // tile decode with each big block hash checked as the tile finishes.
+
+  shared_ptr<Rice2EncodedPlane> hashedPlane = make_shared<Rice2EncodedPlane>(img->plane);
+  rice2_plane_add_big_block_hashes(img->pixels.data(), *hashedPlane);
+
+  runner.add("DecodeThenAdler32/" + img->name, setup, [img](BenchState &) {
+    vector<uint8_t> outBytes(img->width * img->height);
+    rice2_decode_plane(img->plane, outBytes.data());
+    bench_do_not_optimize(adler32_update(1, outBytes.data(), outBytes.size()));
+  });
+
+  runner.add("DecodeTilesVerified/" + img->name, setup, [img, hashedPlane](BenchState &) {
+    vector<uint8_t> outBytes(img->width * img->height);
+    bench_do_not_optimize(rice2_decode_plane_verified(*hashedPlane, outBytes.data()));
+  });
+
+  runner.add("DecodeTilesVerifiedPool/" + img->name, setup, [img, hashedPlane, pool](BenchState &) {
+    vector<uint8_t> outBytes(img->width * img->height);
+    bench_do_not_optimize(rice2_decode_plane_verified(*hashedPlane, outBytes.data(), pool.get()));
+  });
+}
+
+// Mosaic of the image repeated across until it is wider than the 16 bit
+// uniform limit, with at most 256 rows, encoded as a large plane. The
+// region decode reads a 1024 pixel wide window across a segment edge.
+
+static
+void addLargeBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img, shared_ptr<RiceThreadPool> pool)
+{
+  const uint32_t numCopies = (65536 / img->width) + 1;
+  const uint32_t width = numCopies * img->width;
+  const uint32_t height = min(img->height, 256);
+
+  shared_ptr<vector<uint8_t> > mosaic = make_shared<vector<uint8_t> >(width * height);
+
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t copyi = 0; copyi < numCopies; copyi++) {
+      memcpy(mosaic->data() + (y * width) + (copyi * img->width), img->pixels.data() + (y * img->width), img->width);
+    }
+  }
+
+  shared_ptr<Rice2LargePlane> plane = make_shared<Rice2LargePlane>();
+  rice2_large_encode_plane(mosaic->data(), width, height, *plane, BlockDeltaPredictorLeft, Rice2KSearchMinBits, RICE2_LARGE_SEGMENT_DIM, pool.get());
+
+  auto setup = [width, height, plane, pool](BenchState & state) {
+    state.bytesPerIteration = width * height;
+    state.setCounter("segments", (double) plane->numSegments());
+    state.setCounter("threads", (double) pool->numThreads());
+  };
+
+  runner.add("EncodeLargePool/" + img->name, setup, [mosaic, width, height, pool](BenchState &) {
+    Rice2LargePlane largePlane;
+    rice2_large_encode_plane(mosaic->data(), width, height, largePlane, BlockDeltaPredictorLeft, Rice2KSearchMinBits, RICE2_LARGE_SEGMENT_DIM, pool.get());
+    bench_do_not_optimize(largePlane.segments.data());
+  });
+
+  runner.add("DecodeLarge/" + img->name, setup, [plane](BenchState &) {
+    vector<uint8_t> outBytes(plane->width * plane->height);
+    rice2_large_decode_plane(*plane, outBytes.data());
+    bench_do_not_optimize(outBytes.data());
+  });
+
+  runner.add("DecodeLargePool/" + img->name, setup, [plane, pool](BenchState &) {
+    vector<uint8_t> outBytes(plane->width * plane->height);
+    rice2_large_decode_plane(*plane, outBytes.data(), pool.get());
+    bench_do_not_optimize(outBytes.data());
+  });
+
+  auto setRegion = [height](BenchState & state) {
+    state.bytesPerIteration = 1024 * height;
+  };
+
+  runner.add("DecodeLargeRegion/" + img->name, setRegion, [plane, height, pool](BenchState &) {
+    vector<uint8_t> outBytes(1024 * height);
+    rice2_large_decode_region(*plane, RICE2_LARGE_SEGMENT_DIM - 512, 0, 1024, height, outBytes.data(), 1024, pool.get());
+    bench_do_not_optimize(outBytes.data());
+  });
+}
+
+// Time to the first decoded frame when an app starts from the image
+// and encodes on launch, compared to starting from a prebuilt asset
+// written offline. Both read their input from a file and then decode
+// the plane once, the asset is written to TMPDIR before timing.
+
+static
+string benchAssetPath(shared_ptr<BenchImage> img)
+{
+  const char *tmpDir = getenv("TMPDIR");
+  return string((tmpDir != NULL) ? tmpDir : "/tmp") + "/metalrice_bench_" + img->name + ".r2pl";
+}
+
+static
+void addStartupBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img, const string & imagesDir)
+{
+  const string pgmPath = imagesDir + "/" + img->name + ".pgm";
+  const string assetPath = benchAssetPath(img);
+
+  Rice2PlanesContainer container;
+  container.width = img->width;
+  container.height = img->height;
+  container.planes.push_back(img->plane);
+
+  vector<uint8_t> assetBytes = container.encode();
+
+  FILE *fp = fopen(assetPath.c_str(), "wb");
+  size_t numWritten = (fp == NULL) ? 0 : fwrite(assetBytes.data(), 1, assetBytes.size(), fp);
+  if (fp != NULL) {
+    fclose(fp);
+  }
+
+  if (numWritten != assetBytes.size()) {
+    fprintf(stderr, "could not write %s\n", assetPath.c_str());
+    return;
+  }
+
+  const size_t numAssetBytes = assetBytes.size();
+
+  // The asset must load and decode to the image before it is timed
+
+  auto setup = [img, assetPath, numAssetBytes](BenchState & state) {
+    state.bytesPerIteration = img->pixels.size();
+    state.setCounter("assetBytes", (double) numAssetBytes);
+
+    vector<uint8_t> bytes;
+    Rice2EncodedPlane plane;
+    vector<uint8_t> outBytes(img->pixels.size());
+
+    if (!metalrice_read_file(assetPath, bytes) || !rice2_asset_load_gray(bytes, plane)) {
+      state.failed = true;
+      return;
+    }
+
+    rice2_decode_plane(plane, outBytes.data());
+    state.failed = (outBytes != img->pixels);
+  };
+
+  runner.add("StartupEncode/" + img->name, setup, [pgmPath](BenchState &) {
+    vector<uint8_t> pixels;
+    int width, height;
+    metalrice_read_pgm(pgmPath, pixels, width, height);
+    Rice2EncodedPlane plane;
+    rice2_encode_plane(pixels.data(), width, height, plane);
+    vector<uint8_t> outBytes(width * height);
+    rice2_decode_plane(plane, outBytes.data());
+    bench_do_not_optimize(outBytes.data());
+  });
+
+  runner.add("StartupAsset/" + img->name, setup, [assetPath](BenchState &) {
+    vector<uint8_t> bytes;
+    Rice2EncodedPlane plane;
+    metalrice_read_file(assetPath, bytes);
+    rice2_asset_load_gray(bytes, plane);
+    vector<uint8_t> outBytes(plane.width * plane.height);
+    rice2_decode_plane(plane, outBytes.data());
+    bench_do_not_optimize(outBytes.data());
+  });
+}
+
+// Read and decode a sequence of frames, here the asset written by the
+// startup benchmarks is read as every frame. The serial loop reads,
+// parses and decodes each frame into new buffers, the ring reads the
+// next frame while the current one decodes and reuses the slot buffers.
+
+static
+void addFrameRingBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img, shared_ptr<RiceThreadPool> pool)
+{
+  const int numFrames = 8;
+  const string assetPath = benchAssetPath(img);
+
+  shared_ptr<RiceFrameRing<Rice2FrameSlot> > ring = make_shared<RiceFrameRing<Rice2FrameSlot> >(3);
+
+  auto setup = [img, assetPath](BenchState & state) {
+    state.bytesPerIteration = img->pixels.size() * numFrames;
+
+    Rice2FrameSlot slot;
+
+    if (rice2_frame_read_file(assetPath, slot) == 0) {
+      state.failed = true;
+      return;
+    }
+
+    rice2_frame_decode(slot);
+    state.failed = (slot.outPixels != img->pixels);
+  };
+
+  runner.add("DecodeFramesSerial/" + img->name, setup, [assetPath](BenchState &) {
+    for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+      vector<uint8_t> bytes;
+      Rice2EncodedPlane plane;
+      metalrice_read_file(assetPath, bytes);
+      vector<uint32_t> paddedBits;
+      rice2_asset_load_gray(bytes, plane);
+      rice2_plane_padded_bits(plane, paddedBits);
+      vector<uint8_t> outBytes(plane.width * plane.height);
+      rice2_decode_plane_tiles(plane, outBytes.data(), [](int) {}, nullptr, nullptr, &paddedBits);
+      bench_do_not_optimize(outBytes.data());
+    }
+  });
+
+  runner.add("DecodeFramesRing/" + img->name, setup, [assetPath, ring](BenchState &) {
+    ring->run(numFrames, [&](int, Rice2FrameSlot & slot) {
+      return rice2_frame_read_file(assetPath, slot);
+    }, [](Rice2FrameSlot & slot) {
+      return rice2_frame_decode(slot);
+    }, [](int, Rice2FrameSlot & slot, bool) {
+      bench_do_not_optimize(slot.outPixels.data());
+    });
+  });
+
+  runner.add("DecodeFramesRingPool/" + img->name, setup, [assetPath, ring, pool](BenchState &) {
+    ring->run(numFrames, [&](int, Rice2FrameSlot & slot) {
+      return rice2_frame_read_file(assetPath, slot);
+    }, [&](Rice2FrameSlot & slot) {
+      return rice2_frame_decode(slot, pool.get());
+    }, [](int, Rice2FrameSlot & slot, bool) {
+      bench_do_not_optimize(slot.outPixels.data());
+    });
+  });
+}
+
+// Encode every image one after another, compared to a pipeline where
+// the block delta, k table and rice encode steps run on separate threads
+// so that the steps of different images overlap.
+
+class PipelineJob
+{
+public:
+  shared_ptr<BenchImage> img;
+  vector<uint8_t> imageOrderDeltas;
+  vector<uint8_t> s32OrderSymbols;
+  Rice2EncodedPlane plane;
+};
+
+static
+void addPipelineBenchmarks(BenchRunner & runner, const vector<shared_ptr<BenchImage> > & imgs)
+{
+  size_t numBytes = 0;
+  for ( const shared_ptr<BenchImage> & img : imgs ) {
+    numBytes += img->pixels.size();
+  }
+
+  auto setup = [numBytes](BenchState & state) {
+    state.bytesPerIteration = numBytes;
+  };
+
+  runner.add("EncodeSerial/All", setup, [imgs](BenchState &) {
+    for ( const shared_ptr<BenchImage> & img : imgs ) {
+      Rice2EncodedPlane plane;
+      rice2_encode_plane(img->pixels.data(), img->width, img->height, plane);
+      bench_do_not_optimize(plane.riceEncodedBits.data());
+    }
+  });
+
+  runner.add("EncodePipeline/All", setup, [imgs](BenchState &) {
+    RicePipeline<shared_ptr<PipelineJob> > pipeline(2);
+
+    pipeline.addStage("block delta", [](shared_ptr<PipelineJob> & job) {
+      const shared_ptr<BenchImage> & img = job->img;
+      rice2_image_order_deltas(img->pixels.data(), img->width, img->height,
+                               img->plane.numBigBlocksInWidth, img->plane.numBigBlocksInHeight,
+                               job->imageOrderDeltas);
+      return img->pixels.size();
+    });
+    pipeline.addStage("k table", [](shared_ptr<PipelineJob> & job) {
+      const shared_ptr<BenchImage> & img = job->img;
+      rice2_plane_k_table(job->imageOrderDeltas, img->width, img->height, job->plane, job->s32OrderSymbols);
+      return img->pixels.size();
+    });
+    pipeline.addStage("rice encode", [](shared_ptr<PipelineJob> & job) {
+      rice2_encode_plane_bits(job->s32OrderSymbols, job->plane);
+      bench_do_not_optimize(job->plane.riceEncodedBits.data());
+      return job->img->pixels.size();
+    });
+
+    pipeline.run((int) imgs.size(), [&imgs](int i) {
+      shared_ptr<PipelineJob> job = make_shared<PipelineJob>();
+      job->img = imgs[i];
+      return job;
+    });
+  });
+}
+
+static
+void addImageBenchmarks(BenchRunner & runner, shared_ptr<BenchImage> img)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int numValuesInBlock = blockDim * blockDim;
+
+  // Input bytes and padded symbols processed by each iteration
+
+  auto setInput = [img](BenchState & state) {
+    state.bytesPerIteration = img->width * img->height;
+    state.symbolsPerIteration = img->plane.paddedWidth() * img->plane.paddedHeight();
+    state.setCounter("bytes", (double) img->plane.riceEncodedBits.size());
+    state.setCounter("bpp", (img->plane.riceEncodedBits.size() * 8.0) / (img->width * img->height));
+    state.setCounter("esc", (double) img->stats.numEscapes);
+    state.setCounter("refill/sym", (double) img->stats.numRefills / img->stats.numSymbols);
+    state.setCounter("skip", (double) img->stats.kHistogram[RICE2_SKIP_BLOCK_K] / numValuesInBlock);
+    state.setCounter("maxbits", img->stats.meanMaxHalfBlockNumBits());
+  };
+
+  runner.add("Encode/" + img->name, setInput, [img](BenchState &) {
+    Rice2EncodedPlane plane;
+    rice2_encode_plane(img->pixels.data(), img->width, img->height, plane);
+    bench_do_not_optimize(plane.riceEncodedBits.data());
+  });
+
+  // Band at a time encode, each band is dropped once it has been emitted
+
+  runner.add("EncodeStream/" + img->name, setInput, [img](BenchState &) {
+    size_t numBytes = 0;
+    Rice2StreamEncoder streamEncoder(img->width, img->height, [&](const Rice2EncodedBand & band) {
+      numBytes += band.riceEncodedBits.size();
+    });
+    streamEncoder.appendRows(img->pixels.data(), img->height);
+    bench_do_not_optimize(numBytes);
+  });
+
+  // Band stream fed to the push decoder 64 KB at a time
+
+  shared_ptr<vector<uint8_t> > streamBytes = make_shared<vector<uint8_t> >();
+  rice2_stream_write_header(img->width, img->height, *streamBytes);
+  {
+    Rice2StreamEncoder streamEncoder(img->width, img->height, [&](const Rice2EncodedBand & band) {
+      rice2_stream_write_band(band, *streamBytes);
+    });
+    streamEncoder.appendRows(img->pixels.data(), img->height);
+  }
+
+  runner.add("DecodeStream/" + img->name, setInput, [img, streamBytes](BenchState &) {
+    const int chunkSize = 64 * 1024;
+    vector<uint8_t> outPixels(img->width * img->height);
+    Rice2StreamDecoder streamDecoder([&](int y, int numRows, const uint8_t * rowBytes) {
+      memcpy(&outPixels[y * img->width], rowBytes, numRows * img->width);
+    });
+    for (int i = 0; i < (int)streamBytes->size(); i += chunkSize) {
+      streamDecoder.appendBytes(&(*streamBytes)[i], min(chunkSize, (int)streamBytes->size() - i));
+    }
+    bench_do_not_optimize(outPixels.data());
+  });
+
+  // Whole image byte deltas, the encodeDelta() and zigzag copy chain
+  // compared to the fused single pass kernel.
+
+  runner.add("ByteDeltasChain/" + img->name, setInput, [img](BenchState &) {
+    vector<int8_t> inBytes(img->pixels.begin(), img->pixels.end());
+    vector<int8_t> signedDeltas = encodeDelta(inBytes);
+    vector<uint8_t> outBytes(signedDeltas.size());
+    for (int i = 0; i < (int)signedDeltas.size(); i++) {
+      outBytes[i] = pixelpack_int8_to_offset_uint8(signedDeltas[i]);
+    }
+    bench_do_not_optimize(outBytes.data());
+  });
+
+  runner.add("ByteDeltasFused/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> outBytes(img->pixels.size());
+    zigzag_byte_deltas_encode(img->pixels.data(), outBytes.data(), (int)outBytes.size(), 0);
+    bench_do_not_optimize(outBytes.data());
+  });
+
+  runner.add("DeltaEncode2Stage/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> blockOrderSymbols;
+    rice2_block_delta_encoding_2stage(img->pixels.data(), img->width, img->height,
+                                      img->plane.numBigBlocksInWidth, img->plane.numBigBlocksInHeight,
+                                      blockOrderSymbols);
+    bench_do_not_optimize(blockOrderSymbols.data());
+  });
+
+  // s32 layout from 8x8 block order with the big block lookup table,
+  // compared to a direct gather from image order deltas.
+
+  runner.add("S32FormatBlockLayout/" + img->name, setInput, [img](BenchState &) {
+    const int blockDim = RICE_SMALL_BLOCK_DIM;
+    const int blockiDim = RICE_LARGE_BLOCK_DIM / RICE_SMALL_BLOCK_DIM;
+    auto tables = block_reorder_blocki_tables<blockDim, blockiDim>(img->plane.paddedWidth(), img->plane.paddedHeight());
+    vector<uint8_t> blockOrderSymbols;
+    block_process_encode<blockDim>(img->imageOrderDeltas.data(), (int)img->imageOrderDeltas.size(),
+                                   img->plane.paddedWidth(), img->plane.paddedHeight(),
+                                   img->plane.paddedWidth() / blockDim, img->plane.paddedHeight() / blockDim,
+                                   blockOrderSymbols);
+    vector<uint8_t> s32(blockOrderSymbols.size());
+    block_s32_format_block_layout(blockOrderSymbols.data(), s32.data(), img->plane.numBlocks(), blockDim, 32, tables->blockiLookupVec.data());
+    bench_do_not_optimize(s32.data());
+  });
+
+  runner.add("S32FormatImageOrder/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> s32(img->imageOrderDeltas.size());
+    block_s32_format_image_order(img->imageOrderDeltas.data(), s32.data(), img->plane.numBigBlocksInWidth, img->plane.numBigBlocksInHeight);
+    bench_do_not_optimize(s32.data());
+  });
+
+  runner.add("KOpt/" + img->name, setInput, [img, numValuesInBlock](BenchState &) {
+    const int blockN = img->plane.numBlocks();
+    int kSum = 0;
+    for (int blocki = 0; blocki < blockN; blocki++) {
+      kSum += optimalRiceKG4<8>(&img->blockOrderSymbols[blocki * numValuesInBlock], numValuesInBlock);
+    }
+    bench_do_not_optimize(kSum);
+  });
+
+  runner.add("DecodeSerialG4/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> s32Symbols;
+    rice2_decode_plane_serial(img->plane, s32Symbols);
+    bench_do_not_optimize(s32Symbols.data());
+  });
+
+  // Escape bit widths, the bpp and escape counters are for each width
+
+  const int escapeNumBits[] = { 8, 12 };
+
+  for ( int esc : escapeNumBits ) {
+    shared_ptr<Rice2EncodedPlane> escPlane = make_shared<Rice2EncodedPlane>();
+    if (esc == 8) {
+      rice2_encode_plane_symbols<8>(img->imageOrderDeltas, img->width, img->height, *escPlane);
+    } else {
+      rice2_encode_plane_symbols<12>(img->imageOrderDeltas, img->width, img->height, *escPlane);
+    }
+
+    RiceDecodeStatsReport escStats;
+    vector<uint8_t> escDeltas;
+    rice2_decode_plane_deltas(*escPlane, escDeltas, &escStats);
+
+    const double numEscapes = (double) escStats.numEscapes;
+    const double refillsPerSymbol = (double) escStats.numRefills / escStats.numSymbols;
+
+    auto setEscInput = [img, escPlane, numEscapes, refillsPerSymbol](BenchState & state) {
+      state.bytesPerIteration = img->width * img->height;
+      state.symbolsPerIteration = escPlane->paddedWidth() * escPlane->paddedHeight();
+      state.setCounter("bytes", (double) escPlane->riceEncodedBits.size());
+      state.setCounter("bpp", (escPlane->riceEncodedBits.size() * 8.0) / (img->width * img->height));
+      state.setCounter("esc", numEscapes);
+      state.setCounter("refill/sym", refillsPerSymbol);
+    };
+
+    runner.add("DecodeSerialG4Esc" + to_string(esc) + "/" + img->name, setEscInput, [escPlane](BenchState &) {
+      vector<uint8_t> s32Symbols;
+      rice2_decode_plane_serial(*escPlane, s32Symbols);
+      bench_do_not_optimize(s32Symbols.data());
+    });
+
+    runner.add("DecodeEsc" + to_string(esc) + "/" + img->name, setEscInput, [img, escPlane](BenchState &) {
+      vector<uint8_t> outPixels(img->width * img->height);
+      rice2_decode_plane(*escPlane, outPixels.data());
+      bench_do_not_optimize(outPixels.data());
+    });
+  }
+
+  runner.add("EncodeBestEscape/" + img->name, setInput, [img](BenchState &) {
+    Rice2EncodedPlane plane;
+    rice2_encode_plane_best_escape(img->pixels.data(), img->width, img->height, plane);
+    bench_do_not_optimize(plane.riceEncodedBits.data());
+  });
+
+  // k picked by decoder cost, maxbits is the mean over big blocks of
+  // the longest half block and sets the latency of each threadgroup.
+
+  {
+    shared_ptr<Rice2EncodedPlane> costPlane = make_shared<Rice2EncodedPlane>();
+    rice2_encode_plane_symbols(img->imageOrderDeltas, img->width, img->height, *costPlane, Rice2KSearchDecodeCost);
+
+    RiceDecodeStatsReport costStats;
+    vector<uint8_t> costDeltas;
+    rice2_decode_plane_deltas(*costPlane, costDeltas, &costStats);
+
+    const double numEscapes = (double) costStats.numEscapes;
+    const double maxBits = costStats.meanMaxHalfBlockNumBits();
+
+    auto setCostInput = [img, costPlane, numEscapes, maxBits](BenchState & state) {
+      state.bytesPerIteration = img->width * img->height;
+      state.symbolsPerIteration = costPlane->paddedWidth() * costPlane->paddedHeight();
+      state.setCounter("bytes", (double) costPlane->riceEncodedBits.size());
+      state.setCounter("bpp", (costPlane->riceEncodedBits.size() * 8.0) / (img->width * img->height));
+      state.setCounter("esc", numEscapes);
+      state.setCounter("maxbits", maxBits);
+    };
+
+    runner.add("EncodeDecodeCost/" + img->name, setCostInput, [img](BenchState &) {
+      Rice2EncodedPlane plane;
+      rice2_encode_plane_symbols(img->imageOrderDeltas, img->width, img->height, plane, Rice2KSearchDecodeCost);
+      bench_do_not_optimize(plane.riceEncodedBits.data());
+    });
+
+    runner.add("DecodeKernelRiceTypedDecodeCost/" + img->name, setCostInput, [costPlane](BenchState &) {
+      vector<uint8_t> imageOrderDeltas;
+      rice2_decode_plane_deltas(*costPlane, imageOrderDeltas);
+      bench_do_not_optimize(imageOrderDeltas.data());
+    });
+  }
+
+  // Half block to tid balancing for a simdgroup of 8, simd8 is the sum
+  // over simdgroups of the longest half block before and after.
+
+  {
+    Rice2BalanceReport report;
+    rice2_balance_report(img->plane, 8, report);
+
+    Rice2EncodedPlane balancedPlane = img->plane;
+    rice2_plane_balance_tids(balancedPlane, 8);
+
+    Rice2BalanceReport balancedReport;
+    rice2_balance_report(balancedPlane, 8, balancedReport);
+
+    const double simdNumBits = (double) report.simdNumBits;
+    const double balancedSimdNumBits = (double) balancedReport.simdNumBits;
+    const double ratio = report.meanMaxToMeanRatio;
+
+    auto setBalanceInput = [img, simdNumBits, balancedSimdNumBits, ratio](BenchState & state) {
+      state.bytesPerIteration = img->width * img->height;
+      state.symbolsPerIteration = img->plane.paddedWidth() * img->plane.paddedHeight();
+      state.setCounter("max/mean", ratio);
+      state.setCounter("simd8", simdNumBits);
+      state.setCounter("simd8Balanced", balancedSimdNumBits);
+    };
+
+    runner.add("BalanceTids/" + img->name, setBalanceInput, [img](BenchState &) {
+      Rice2EncodedPlane plane = img->plane;
+      rice2_plane_balance_tids(plane, 8);
+      bench_do_not_optimize(plane.halfBlockTidTable.data());
+    });
+  }
+
+  runner.add("DecodeKernelRiceTyped/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> imageOrderDeltas;
+    rice2_decode_plane_deltas(img->plane, imageOrderDeltas);
+    bench_do_not_optimize(imageOrderDeltas.data());
+  });
+
+  runner.add("DecodeKernelRiceTypedStats/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> imageOrderDeltas;
+    RiceDecodeStatsReport stats;
+    rice2_decode_plane_deltas(img->plane, imageOrderDeltas, &stats);
+    bench_do_not_optimize(stats.numBits);
+  });
+
+  // 1/8 scale preview decoded from the progressive prefix
+
+  shared_ptr<vector<uint8_t> > progressiveBytes = make_shared<vector<uint8_t> >();
+  rice2_progressive_encode_plane(img->pixels.data(), img->width, img->height, *progressiveBytes);
+
+  auto setPreview = [img, progressiveBytes](BenchState & state) {
+    const int previewNumBytes = rice2_progressive_preview_num_bytes(*progressiveBytes);
+    state.bytesPerIteration = img->width * img->height;
+    state.setCounter("prefixBytes", (double) previewNumBytes);
+    state.setCounter("prefix%", (previewNumBytes * 100.0) / progressiveBytes->size());
+  };
+
+  runner.add("DecodePreview/" + img->name, setPreview, [progressiveBytes](BenchState &) {
+    vector<uint8_t> preview;
+    int previewWidth, previewHeight;
+    rice2_progressive_decode_preview(*progressiveBytes, preview, previewWidth, previewHeight);
+    bench_do_not_optimize(preview.data());
+  });
+
+  // Second frame where one region changed, encoded against the first
+
+  shared_ptr<vector<uint8_t> > nextFrame = make_shared<vector<uint8_t> >(img->pixels);
+  for (int y = img->height / 4; y < min(img->height, (img->height / 4) + 64); y++) {
+    for (int x = img->width / 3; x < min(img->width, (img->width / 3) + 64); x++) {
+      (*nextFrame)[(y * img->width) + x] ^= 0x55;
+    }
+  }
+
+  shared_ptr<Rice2TemporalPlane> interFrame = make_shared<Rice2TemporalPlane>();
+  rice2_temporal_encode_plane(nextFrame->data(), img->pixels.data(), img->width, img->height, *interFrame);
+
+  auto setTemporal = [img, interFrame](BenchState & state) {
+    state.bytesPerIteration = img->width * img->height;
+    state.setCounter("bytes", (double) interFrame->plane.riceEncodedBits.size());
+    state.setCounter("bpp", (interFrame->plane.riceEncodedBits.size() * 8.0) / (img->width * img->height));
+    state.setCounter("inter%", (interFrame->numInterBlocks * 100.0) / interFrame->plane.numBlocks());
+  };
+
+  runner.add("EncodeTemporal/" + img->name, setTemporal, [img, nextFrame](BenchState &) {
+    Rice2TemporalPlane temporalPlane;
+    rice2_temporal_encode_plane(nextFrame->data(), img->pixels.data(), img->width, img->height, temporalPlane);
+    bench_do_not_optimize(temporalPlane.plane.riceEncodedBits.data());
+  });
+
+  runner.add("DecodeTemporal/" + img->name, setTemporal, [img, interFrame](BenchState &) {
+    vector<uint8_t> outPixels(img->width * img->height);
+    rice2_temporal_decode_plane(*interFrame, img->pixels.data(), outPixels.data());
+    bench_do_not_optimize(outPixels.data());
+  });
+
+  runner.add("Undelta/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> outPixels(img->width * img->height);
+    rice2_undelta_plane(img->imageOrderDeltas.data(), img->width, img->height,
+                        img->plane.numBigBlocksInWidth, img->plane.numBigBlocksInHeight,
+                        outPixels.data());
+    bench_do_not_optimize(outPixels.data());
+  });
+
+  runner.add("Decode/" + img->name, setInput, [img](BenchState &) {
+    vector<uint8_t> outPixels(img->width * img->height);
+    rice2_decode_plane(img->plane, outPixels.data());
+    bench_do_not_optimize(outPixels.data());
+  });
+}
+
+int main(int argc, const char **argv)
+{
+  string imagesDir = METALRICE_IMAGES_DIR;
+  string statsDir;
+
+  vector<const char *> runnerArgs;
+  runnerArgs.push_back(argv[0]);
+
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--images=", 9) == 0) {
+      imagesDir = argv[i] + 9;
+    } else if (strncmp(argv[i], "--stats-dir=", 12) == 0) {
+      statsDir = argv[i] + 12;
+    } else {
+      runnerArgs.push_back(argv[i]);
+    }
+  }
+
+  BenchRunner runner;
+
+  if (!runner.parseArgs((int)runnerArgs.size(), runnerArgs.data())) {
+    fprintf(stderr, "usage: %s [--images=DIR] [--stats-dir=DIR] [--min-time=SECONDS] [--filter=SUBSTRING]\n", argv[0]);
+    return 1;
+  }
+
+  const char *names[] = { "Image", "ImageHuge", "BigBridge", "Lenna_B" };
+
+  shared_ptr<RiceThreadPool> pool = make_shared<RiceThreadPool>();
+
+  vector<shared_ptr<BenchImage> > imgs;
+
+  for ( const char *name : names ) {
+    shared_ptr<BenchImage> img = make_shared<BenchImage>();
+    img->name = name;
+
+    string path = imagesDir + "/" + name + ".pgm";
+
+    if (!metalrice_read_pgm(path, img->pixels, img->width, img->height)) {
+      fprintf(stderr, "could not read %s\n", path.c_str());
+      return 1;
+    }
+
+    rice2_encode_plane(img->pixels.data(), img->width, img->height, img->plane);
+
+    rice2_block_delta_encoding_2stage(img->pixels.data(), img->width, img->height,
+                                      img->plane.numBigBlocksInWidth, img->plane.numBigBlocksInHeight,
+                                      img->blockOrderSymbols);
+
+    rice2_decode_plane_deltas(img->plane, img->imageOrderDeltas, &img->stats);
+
+    img->coderInput.blockSize = RICE_SMALL_BLOCK_DIM * RICE_SMALL_BLOCK_DIM;
+    img->coderInput.symbols = img->blockOrderSymbols;
+    img->coderInput.kTable = img->plane.blockOptimalKTable;
+    replace(img->coderInput.kTable.begin(), img->coderInput.kTable.end(), (uint8_t) RICE2_SKIP_BLOCK_K, (uint8_t) 0);
+
+    if (!statsDir.empty()) {
+      string jsonPath = statsDir + "/" + name + ".json";
+      FILE *fp = fopen(jsonPath.c_str(), "w");
+      if (fp == NULL) {
+        fprintf(stderr, "could not write %s\n", jsonPath.c_str());
+        return 1;
+      }
+      fputs(img->stats.toJSON().c_str(), fp);
+      fclose(fp);
+    }
+
+    addImageBenchmarks(runner, img);
+    addKernelSimBenchmarks(runner, img, pool);
+    addPredictorBenchmarks(runner, img, pool);
+    addBlockSplitBenchmarks<8>(runner, img, pool);
+    addBlockSplitBenchmarks<32>(runner, img, pool);
+    addChecksumBenchmarks(runner, img, pool);
+    addLargeBenchmarks(runner, img, pool);
+    addStartupBenchmarks(runner, img, imagesDir);
+    addFrameRingBenchmarks(runner, img, pool);
+
+    addCoderBenchmarks<RiceAdapterRice>(runner, img);
+    addCoderBenchmarks<RiceAdapterSplit16>(runner, img);
+    addCoderBenchmarks<RiceAdapterSplit16G4>(runner, img);
+    addCoderBenchmarks<RiceAdapterSplit16x2>(runner, img);
+    addCoderBenchmarks<RiceAdapterSplit16x2Prefix>(runner, img);
+    addCoderBenchmarks<RiceAdapterSplit16x2Prefix64>(runner, img);
+    addCoderBenchmarks<RiceAdapterSplit16x2Prefix64Read64>(runner, img);
+    addCoderBenchmarks<RiceAdapterInterleaved4x>(runner, img);
+    addCoderBenchmarks<RiceAdapterMultiplexer>(runner, img);
+
+    imgs.push_back(img);
+  }
+
+  addPipelineBenchmarks(runner, imgs);
+
+  return runner.runAll();
+}
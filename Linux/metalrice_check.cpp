@@ -0,0 +1,1794 @@
+//
+//  metalrice_check.cpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Round trip checks for the codec core that run under ctest. Each
+//  bundled image is encoded and then decoded with every CPU decoder,
+//  the decoded output must match the original input exactly. The
+//  block order symbols are also run through every coder adapter and
+//  every compute kernel is run through the threadgroup simulator.
+
+#include "metalrice_core.hpp"
+#include "rice_adapters.hpp"
+
+#if !defined(METALRICE_IMAGES_DIR)
+#define METALRICE_IMAGES_DIR "Linux/images"
+#endif
+
+#if !defined(METALRICE_ASSETS_DIR)
+#define METALRICE_ASSETS_DIR "Shared"
+#endif
+
+static int numFailed = 0;
+
+#define CHECK(cond, ...) \
+  do { \
+    if (!(cond)) { \
+      printf("FAILED %s:%d : %s : ", __FILE__, __LINE__, #cond); \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      numFailed += 1; \
+    } \
+  } while (0)
+
+// Map the s32 order output of the serial decoder to padded image order,
+// this is the same (bbid, tid) to pixel mapping used by the kernel.
+
+static
+void s32ToImageOrder(const Rice2EncodedPlane & plane,
+                     const vector<uint8_t> & s32Symbols,
+                     vector<uint8_t> & imageOrder)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int paddedWidth = plane.paddedWidth();
+  const int numBigBlocks = plane.numBigBlocksInWidth * plane.numBigBlocksInHeight;
+
+  imageOrder.resize(plane.paddedWidth() * plane.paddedHeight());
+
+  int offset = 0;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    const int bigBlockX = (bbid % plane.numBigBlocksInWidth) * RICE_LARGE_BLOCK_DIM;
+    const int bigBlockY = (bbid / plane.numBigBlocksInWidth) * RICE_LARGE_BLOCK_DIM;
+
+    for (int tid = 0; tid < 32; tid++) {
+      const int blockiInBigBlock = tid >> 1;
+      const int x0 = bigBlockX + ((blockiInBigBlock % 4) * blockDim);
+      const int y0 = bigBlockY + ((blockiInBigBlock / 4) * blockDim) + ((tid & 0x1) ? blockDim/2 : 0);
+
+      for (int i = 0; i < (blockDim * blockDim)/2; i++) {
+        int x = x0 + (i % blockDim);
+        int y = y0 + (i / blockDim);
+        imageOrder[(y * paddedWidth) + x] = s32Symbols[offset++];
+      }
+    }
+  }
+}
+
+// Run each kernel through the threadgroup simulator on a thread pool
+
+static
+void checkKernelSim(const Rice2EncodedPlane & plane,
+                    const vector<uint8_t> & pixels,
+                    const vector<uint8_t> & kernelDeltas,
+                    RiceThreadPool & pool,
+                    const string & label)
+{
+  const int width = plane.width;
+  const int height = plane.height;
+  const int paddedWidth = plane.paddedWidth();
+  const int paddedHeight = plane.paddedHeight();
+
+  RiceKernelBuffers buffers;
+  rice_kernel_sim_plane_buffers(plane, buffers);
+
+  // kernel_render_rice2 writes the same deltas as the per thread decode
+
+  {
+    vector<uint8_t> deltas(paddedWidth * paddedHeight);
+    buffers.outTexture = (uint32_t *) deltas.data();
+    buffers.outTextureWidth = paddedWidth / 4;
+    buffers.outTextureHeight = paddedHeight;
+
+    rice_kernel_sim_dispatch(RiceKernelRenderRice2, buffers, &pool);
+
+    CHECK(deltas == kernelDeltas, "%s %s", rice_kernel_sim_name(RiceKernelRenderRice2), label.c_str());
+  }
+
+  // Undelta kernels write the original pixels, only the _sync
+  // variants are free of unsynced threadgroup memory reads.
+
+  const RiceKernelType undeltaTypes[] = {
+    RiceKernelRenderRice2Undelta,
+    RiceKernelRenderRice2UndeltaSync,
+    RiceKernelRenderRiceUndelta,
+    RiceKernelRenderRiceUndeltaSync
+  };
+
+  for ( RiceKernelType type : undeltaTypes ) {
+    const bool expandGray = (type == RiceKernelRenderRiceUndelta || type == RiceKernelRenderRiceUndeltaSync);
+    const bool sync = (type == RiceKernelRenderRice2UndeltaSync || type == RiceKernelRenderRiceUndeltaSync);
+
+    vector<uint32_t> texture;
+    if (expandGray) {
+      buffers.outTextureWidth = width;
+      buffers.outTextureHeight = height;
+    } else {
+      buffers.outTextureWidth = paddedWidth / 4;
+      buffers.outTextureHeight = paddedHeight;
+    }
+    texture.resize(buffers.outTextureWidth * buffers.outTextureHeight);
+    buffers.outTexture = texture.data();
+
+    RiceDecodeStatsReport stats;
+    RiceKernelSimResult result;
+    rice_kernel_sim_dispatch(type, buffers, &pool, &stats, &result);
+
+    vector<uint8_t> decoded(width * height);
+    const uint8_t *textureBytes = (const uint8_t *) texture.data();
+
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        if (expandGray) {
+          decoded[(y * width) + x] = textureBytes[((y * width) + x) * 4];
+        } else {
+          decoded[(y * width) + x] = textureBytes[(y * paddedWidth) + x];
+        }
+      }
+    }
+
+    CHECK(decoded == pixels, "%s %s", rice_kernel_sim_name(type), label.c_str());
+    CHECK(stats.numSymbols == (uint64_t)(paddedWidth * paddedHeight), "%s %llu", rice_kernel_sim_name(type), (unsigned long long)stats.numSymbols);
+    CHECK(result.numThreadgroups == (plane.numBigBlocksInWidth * plane.numBigBlocksInHeight), "%d", result.numThreadgroups);
+    CHECK(result.numBarriers == (sync ? (result.numThreadgroups * 3) : 0), "%s %d", rice_kernel_sim_name(type), result.numBarriers);
+    CHECK((result.numUnsyncedReads == 0) == sync, "%s %d", rice_kernel_sim_name(type), result.numUnsyncedReads);
+  }
+
+  // Pool and serial dispatch of the blocki and bit offset kernels must agree
+
+  const RiceKernelType indexTypes[] = {
+    RiceKernelRenderRice2Blocki,
+    RiceKernelRenderRice2BlockBitOffset
+  };
+
+  for ( RiceKernelType type : indexTypes ) {
+    vector<uint32_t> serial(paddedWidth * paddedHeight);
+    vector<uint32_t> pooled(paddedWidth * paddedHeight);
+
+    buffers.out32Ptr = serial.data();
+    rice_kernel_sim_dispatch(type, buffers);
+
+    buffers.out32Ptr = pooled.data();
+    rice_kernel_sim_dispatch(type, buffers, &pool);
+
+    CHECK(pooled == serial, "%s %s", rice_kernel_sim_name(type), label.c_str());
+    CHECK(serial[0] == ((type == RiceKernelRenderRice2Blocki) ? 0 : plane.halfBlockOffsetTable[0]), "%d", serial[0]);
+    CHECK(serial.back() == ((type == RiceKernelRenderRice2Blocki) ? (plane.numBlocks() - 1) : plane.halfBlockOffsetTable.back()), "%d", serial.back());
+  }
+}
+
+// Gradient and MED predictors decode with the plane decoder, as tiles
+// and with the matching undelta kernel in the threadgroup simulator.
+
+static
+void checkPredictors(const vector<uint8_t> & pixels,
+                     const int width,
+                     const int height,
+                     const string & path,
+                     RiceThreadPool & pool)
+{
+  const BlockDeltaPredictor predictors[] = {
+    BlockDeltaPredictorGradient,
+    BlockDeltaPredictorMED
+  };
+
+  for ( BlockDeltaPredictor predictor : predictors ) {
+    Rice2EncodedPlane plane;
+    rice2_encode_plane(pixels.data(), width, height, plane, predictor);
+
+    CHECK(plane.predictor == predictor, "predictor %d %s", predictor, path.c_str());
+
+    vector<uint8_t> decoded(width * height);
+    rice2_decode_plane(plane, decoded.data());
+
+    CHECK(decoded == pixels, "predictor %d decode %s", predictor, path.c_str());
+
+    rice2_plane_add_big_block_hashes(pixels.data(), plane, &pool);
+
+    vector<uint8_t> tileDecoded(width * height);
+    int numBad = rice2_decode_plane_verified(plane, tileDecoded.data(), &pool);
+
+    CHECK(numBad == 0 && tileDecoded == pixels, "predictor %d tile decode %s", predictor, path.c_str());
+
+    const RiceKernelType type = (predictor == BlockDeltaPredictorGradient) ? RiceKernelRenderRice2UndeltaGradientSync : RiceKernelRenderRice2UndeltaMEDSync;
+    const int paddedWidth = plane.paddedWidth();
+
+    RiceKernelBuffers buffers;
+    rice_kernel_sim_plane_buffers(plane, buffers);
+
+    vector<uint32_t> texture((paddedWidth / 4) * plane.paddedHeight());
+    buffers.outTexture = texture.data();
+    buffers.outTextureWidth = paddedWidth / 4;
+    buffers.outTextureHeight = plane.paddedHeight();
+
+    RiceKernelSimResult result;
+    rice_kernel_sim_dispatch<RiceDecodeStatsNone>(type, buffers, &pool, nullptr, &result);
+
+    const uint8_t *textureBytes = (const uint8_t *) texture.data();
+
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        decoded[(y * width) + x] = textureBytes[(y * paddedWidth) + x];
+      }
+    }
+
+    CHECK(decoded == pixels, "%s %s", rice_kernel_sim_name(type), path.c_str());
+    CHECK(result.numUnsyncedReads == 0, "%s %d", rice_kernel_sim_name(type), result.numUnsyncedReads);
+  }
+
+  // Best predictor is never larger than the left predictor
+
+  Rice2EncodedPlane leftPlane;
+  rice2_encode_plane(pixels.data(), width, height, leftPlane);
+
+  Rice2EncodedPlane bestPlane;
+  rice2_encode_plane_best_predictor(pixels.data(), width, height, bestPlane);
+
+  CHECK(bestPlane.riceEncodedBits.size() <= leftPlane.riceEncodedBits.size(), "best predictor %s", path.c_str());
+}
+
+// A balanced tid table lowers the simdgroup cost and every kernel that
+// honors the table still writes the original pixels.
+
+static
+void checkBalance(const Rice2EncodedPlane & plane,
+                  const vector<uint8_t> & pixels,
+                  const string & path,
+                  RiceThreadPool & pool)
+{
+  const int width = plane.width;
+  const int height = plane.height;
+  const int paddedWidth = plane.paddedWidth();
+
+  Rice2BalanceReport report;
+  rice2_balance_report(plane, 8, report);
+
+  uint64_t numHalfBlocks = 0;
+  for (int i = 0; i < 16; i++) {
+    numHalfBlocks += report.halfBlockBitsHistogram[i];
+  }
+  CHECK(numHalfBlocks == (uint64_t)(plane.numBlocks() * 2), "balance half blocks %s", path.c_str());
+
+  int numBigBlocks = report.numEmptyBigBlocks;
+  for (int i = 0; i < 8; i++) {
+    numBigBlocks += report.ratioHistogram[i];
+  }
+  CHECK(numBigBlocks == report.numBigBlocks, "balance big blocks %s", path.c_str());
+  CHECK(report.maxNumBits <= report.simdNumBits && report.simdNumBits <= report.numBits, "balance bits %s", path.c_str());
+
+  Rice2EncodedPlane balancedPlane = plane;
+  int numPermuted = rice2_plane_balance_tids(balancedPlane, 8);
+
+  CHECK(numPermuted > 0 && balancedPlane.halfBlockTidTable.size() == (size_t) (plane.numBlocks() * 2), "balance tids %s", path.c_str());
+
+  Rice2BalanceReport balancedReport;
+  rice2_balance_report(balancedPlane, 8, balancedReport);
+
+  CHECK(balancedReport.simdNumBits < report.simdNumBits, "balance simd bits %s", path.c_str());
+  CHECK(balancedReport.maxNumBits == report.maxNumBits, "balance max bits %s", path.c_str());
+
+  // Each thread of a big block decodes a different half block
+
+  for (int bbid = 0; bbid < report.numBigBlocks; bbid++) {
+    uint32_t seen = 0;
+    for (int tid = 0; tid < 32; tid++) {
+      seen |= (1u << balancedPlane.halfBlockTidTable[(bbid * 32) + tid]);
+    }
+    if (seen != 0xFFFFFFFF) {
+      CHECK(false, "balance permutation %s %d", path.c_str(), bbid);
+      break;
+    }
+  }
+
+  const RiceKernelType types[] = {
+    RiceKernelRenderRice2UndeltaSync,
+    RiceKernelRenderRice2UndeltaGradientSync
+  };
+
+  for ( RiceKernelType type : types ) {
+    Rice2EncodedPlane kernelPlane = balancedPlane;
+
+    if (type == RiceKernelRenderRice2UndeltaGradientSync) {
+      rice2_encode_plane(pixels.data(), width, height, kernelPlane, BlockDeltaPredictorGradient);
+      rice2_plane_balance_tids(kernelPlane, 8);
+    }
+
+    RiceKernelBuffers buffers;
+    rice_kernel_sim_plane_buffers(kernelPlane, buffers);
+
+    vector<uint32_t> texture((paddedWidth / 4) * plane.paddedHeight());
+    buffers.outTexture = texture.data();
+    buffers.outTextureWidth = paddedWidth / 4;
+    buffers.outTextureHeight = plane.paddedHeight();
+
+    RiceKernelSimResult result;
+    rice_kernel_sim_dispatch<RiceDecodeStatsNone>(type, buffers, &pool, nullptr, &result);
+
+    const uint8_t *textureBytes = (const uint8_t *) texture.data();
+    vector<uint8_t> decoded(width * height);
+
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        decoded[(y * width) + x] = textureBytes[(y * paddedWidth) + x];
+      }
+    }
+
+    CHECK(decoded == pixels, "balance %s %s", rice_kernel_sim_name(type), path.c_str());
+    CHECK(result.numUnsyncedReads == 0, "balance %s %d", rice_kernel_sim_name(type), result.numUnsyncedReads);
+  }
+}
+
+template <class A>
+static
+void checkCoderAdapter(const RiceCoderInput & input, const string & label)
+{
+  int numBytes = 0;
+  bool worked = rice_adapter_round_trip<A>(input, numBytes);
+  CHECK(worked, "%s %s", A::name(), label.c_str());
+}
+
+static
+void checkCoderAdapters(const RiceCoderInput & input, const string & label)
+{
+  checkCoderAdapter<RiceAdapterRice>(input, label);
+  checkCoderAdapter<RiceAdapterSplit16>(input, label);
+  checkCoderAdapter<RiceAdapterSplit16G4>(input, label);
+  checkCoderAdapter<RiceAdapterSplit16x2>(input, label);
+  checkCoderAdapter<RiceAdapterSplit16x2Prefix>(input, label);
+  checkCoderAdapter<RiceAdapterSplit16x2Prefix64>(input, label);
+  checkCoderAdapter<RiceAdapterSplit16x2Prefix64Read64>(input, label);
+  checkCoderAdapter<RiceAdapterInterleaved4x>(input, label);
+  checkCoderAdapter<RiceAdapterMultiplexer>(input, label);
+}
+
+static
+void checkPixels(const vector<uint8_t> & pixels,
+                 const int width,
+                 const int height,
+                 const string & path,
+                 RiceThreadPool & pool)
+{
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(pixels.data(), width, height, plane);
+
+  CHECK(plane.halfBlockOffsetTable.size() == (size_t) (plane.numBlocks() * 2), "%d", (int)plane.halfBlockOffsetTable.size());
+  CHECK(plane.blockOptimalKTable.size() == (size_t) (plane.numBlocks() + 1), "%d", (int)plane.blockOptimalKTable.size());
+
+  vector<uint8_t> decoded(width * height);
+  rice2_decode_plane(plane, decoded.data());
+
+  CHECK(decoded == pixels, "decode %s", path.c_str());
+
+  // Big blocks decoded and verified as tiles on the pool
+
+  {
+    Rice2EncodedPlane hashedPlane = plane;
+    rice2_plane_add_big_block_hashes(pixels.data(), hashedPlane, &pool);
+
+    vector<uint8_t> tileDecoded(width * height);
+    int numBad = rice2_decode_plane_verified(hashedPlane, tileDecoded.data(), &pool);
+
+    CHECK(numBad == 0 && tileDecoded == pixels, "tile decode %s", path.c_str());
+  }
+
+  // The serial decoder must produce the same deltas as the per thread decoder
+
+  vector<uint8_t> kernelDeltas;
+  rice2_decode_plane_deltas(plane, kernelDeltas);
+
+  vector<uint8_t> s32Symbols;
+  rice2_decode_plane_serial(plane, s32Symbols);
+
+  vector<uint8_t> serialDeltas;
+  s32ToImageOrder(plane, s32Symbols, serialDeltas);
+
+  CHECK(serialDeltas == kernelDeltas, "serial decode %s", path.c_str());
+
+  // Direct image order gather and scatter must match the block layout formatter
+
+  {
+    vector<uint8_t> blockOrderSymbols;
+    rice2_block_delta_encoding_2stage(pixels.data(), width, height,
+                                      plane.numBigBlocksInWidth, plane.numBigBlocksInHeight,
+                                      blockOrderSymbols);
+
+    auto tables = block_reorder_blocki_tables<RICE_SMALL_BLOCK_DIM, RICE_LARGE_BLOCK_DIM/RICE_SMALL_BLOCK_DIM>(plane.paddedWidth(), plane.paddedHeight());
+
+    vector<uint8_t> expectedS32(blockOrderSymbols.size());
+    block_s32_format_block_layout(blockOrderSymbols.data(), expectedS32.data(),
+                                  plane.numBlocks(), RICE_SMALL_BLOCK_DIM, 32,
+                                  tables->blockiLookupVec.data());
+
+    vector<uint8_t> imageOrderDeltas;
+    rice2_image_order_deltas(pixels.data(), width, height,
+                             plane.numBigBlocksInWidth, plane.numBigBlocksInHeight,
+                             imageOrderDeltas);
+
+    vector<uint8_t> s32(imageOrderDeltas.size());
+    block_s32_format_image_order(imageOrderDeltas.data(), s32.data(), plane.numBigBlocksInWidth, plane.numBigBlocksInHeight);
+
+    CHECK(s32 == expectedS32, "s32 format %s", path.c_str());
+    CHECK(s32 == s32Symbols, "s32 decode %s", path.c_str());
+
+    vector<uint8_t> flattened(s32.size());
+    block_s32_flatten_image_order(s32Symbols.data(), flattened.data(), plane.numBigBlocksInWidth, plane.numBigBlocksInHeight);
+
+    CHECK(flattened == serialDeltas, "s32 flatten %s", path.c_str());
+  }
+
+  checkKernelSim(plane, pixels, kernelDeltas, pool, path);
+
+  checkPredictors(pixels, width, height, path, pool);
+
+  checkBalance(plane, pixels, path, pool);
+
+  // Second frame with a changed region is encoded against the first
+
+  {
+    vector<uint8_t> nextFrame = pixels;
+    for (int y = height / 4; y < min(height, (height / 4) + 40); y++) {
+      for (int x = width / 3; x < min(width, (width / 3) + 50); x++) {
+        nextFrame[(y * width) + x] = pixels[(y * width) + (width - 1 - x)];
+      }
+    }
+
+    Rice2TemporalPlane keyFrame;
+    rice2_temporal_encode_plane(pixels.data(), nullptr, width, height, keyFrame);
+
+    CHECK(keyFrame.numInterBlocks == 0, "key frame %s", path.c_str());
+    CHECK(keyFrame.plane.riceEncodedBits == plane.riceEncodedBits, "key frame bits %s", path.c_str());
+
+    Rice2TemporalPlane interFrame;
+    rice2_temporal_encode_plane(nextFrame.data(), pixels.data(), width, height, interFrame);
+
+    CHECK(interFrame.numInterBlocks > 0, "inter blocks %s", path.c_str());
+    CHECK(interFrame.plane.riceEncodedBits.size() < plane.riceEncodedBits.size(), "inter size %s", path.c_str());
+
+    vector<uint8_t> keyDecoded(width * height);
+    rice2_temporal_decode_plane(keyFrame, nullptr, keyDecoded.data());
+
+    vector<uint8_t> interDecoded(width * height);
+    rice2_temporal_decode_plane(interFrame, keyDecoded.data(), interDecoded.data());
+
+    CHECK(keyDecoded == pixels, "key frame decode %s", path.c_str());
+    CHECK(interDecoded == nextFrame, "inter frame decode %s", path.c_str());
+  }
+
+  // Preview prefix decodes to the 8x8 block base values, the full plane follows
+
+  {
+    vector<uint8_t> progressiveBytes;
+    rice2_progressive_encode_plane(pixels.data(), width, height, progressiveBytes);
+
+    vector<uint8_t> expectedPreview;
+    rice2_preview_base_values(pixels.data(), width, height, expectedPreview);
+
+    const int previewNumBytes = rice2_progressive_preview_num_bytes(progressiveBytes);
+    vector<uint8_t> prefix(progressiveBytes.begin(), progressiveBytes.begin() + previewNumBytes);
+
+    vector<uint8_t> preview;
+    int previewWidth, previewHeight;
+    bool decodedPreview = rice2_progressive_decode_preview(prefix, preview, previewWidth, previewHeight);
+
+    CHECK(decodedPreview, "preview %s", path.c_str());
+    CHECK(preview == expectedPreview, "preview pixels %s", path.c_str());
+
+    prefix.pop_back();
+    CHECK(!rice2_progressive_decode_preview(prefix, preview, previewWidth, previewHeight), "short preview %s", path.c_str());
+
+    vector<uint8_t> progressiveDecoded(width * height);
+    bool decodedPlane = rice2_progressive_decode_plane(progressiveBytes, progressiveDecoded.data());
+
+    CHECK(decodedPlane, "progressive %s", path.c_str());
+    CHECK(progressiveDecoded == pixels, "progressive pixels %s", path.c_str());
+
+    // A preview byte count that does not fit in an int after the header
+    // is rejected, and a k out of range in either plane fails the decode.
+    // Each plane is its big block dims and the k count, then the k table.
+
+    vector<uint8_t> corrupted = progressiveBytes;
+    memset(&corrupted[12], 0xFF, 4);
+    CHECK(rice2_progressive_preview_num_bytes(corrupted) == 0, "preview huge count %s", path.c_str());
+
+    corrupted = progressiveBytes;
+    corrupted[RICE2_PREVIEW_HEADER_NUM_BYTES + 8 + 4 + 1] = 9;
+    CHECK(!rice2_progressive_decode_preview(corrupted, preview, previewWidth, previewHeight), "preview corrupt k %s", path.c_str());
+
+    corrupted = progressiveBytes;
+    corrupted[previewNumBytes + 8 + 4 + 1] = 9;
+    CHECK(!rice2_progressive_decode_plane(corrupted, progressiveDecoded.data()), "progressive corrupt k %s", path.c_str());
+  }
+
+  // Streaming band encoder must emit the same plane for any row chunking
+
+  for ( int numRowsEachAppend : { 1, 13, RICE_LARGE_BLOCK_DIM, height } ) {
+    Rice2EncodedPlane streamPlane;
+    rice2_stream_encode_plane(pixels.data(), width, height, numRowsEachAppend, streamPlane);
+
+    CHECK(streamPlane.riceEncodedBits == plane.riceEncodedBits, "stream bits %s %d", path.c_str(), numRowsEachAppend);
+    CHECK(streamPlane.blockOptimalKTable == plane.blockOptimalKTable, "stream k table %s %d", path.c_str(), numRowsEachAppend);
+    CHECK(streamPlane.halfBlockOffsetTable == plane.halfBlockOffsetTable, "stream offsets %s %d", path.c_str(), numRowsEachAppend);
+  }
+
+  // Serialized bands decoded as bytes arrive in small chunks
+
+  {
+    vector<uint8_t> streamBytes;
+    rice2_stream_write_header(width, height, streamBytes);
+
+    Rice2StreamEncoder streamEncoder(width, height, [&](const Rice2EncodedBand & band) {
+      rice2_stream_write_band(band, streamBytes);
+    });
+    streamEncoder.appendRows(pixels.data(), height);
+
+    vector<uint8_t> streamDecoded(width * height);
+    int nextRow = 0;
+
+    Rice2StreamDecoder streamDecoder([&](int y, int numRows, const uint8_t * rowBytes) {
+      CHECK(y == nextRow, "stream band order %s %d", path.c_str(), y);
+      memcpy(&streamDecoded[y * width], rowBytes, numRows * width);
+      nextRow = y + numRows;
+    });
+
+    const int chunkSize = 4093;
+
+    for (int i = 0; i < (int)streamBytes.size(); i += chunkSize) {
+      const int numBytes = min(chunkSize, (int)streamBytes.size() - i);
+      bool appended = streamDecoder.appendBytes(&streamBytes[i], numBytes);
+      CHECK(appended, "stream append %s %d", path.c_str(), i);
+    }
+
+    CHECK(streamDecoder.isFinished(), "stream finished %s", path.c_str());
+    CHECK(streamDecoded == pixels, "stream decode %s", path.c_str());
+
+    // A record with a k out of range, an offset past the buffered words
+    // or an offset before the previous band is rejected before decoding.
+    // The k table of band 0 starts after the header, the record size and
+    // the k count, the offsets follow the k table and the offset count.
+
+    const int blockN = plane.numBigBlocksInWidth * 16;
+    const int kOffset = 12 + 4 + 4;
+    const int offsetsOffset = kOffset + blockN + 4;
+
+    auto corruptStream = [&](int offset, uint32_t value, int numBytes) {
+      vector<uint8_t> corrupted = streamBytes;
+      memcpy(&corrupted[offset], &value, numBytes);
+      int numRows = 0;
+      Rice2StreamDecoder corruptDecoder([&](int, int bandNumRows, const uint8_t *) {
+        numRows += bandNumRows;
+      });
+      bool appended = corruptDecoder.appendBytes(corrupted.data(), (int) corrupted.size());
+      return appended || corruptDecoder.isFinished() || numRows == height;
+    };
+
+    CHECK(!corruptStream(kOffset + 5, 9, 1), "stream corrupt k %s", path.c_str());
+    CHECK(!corruptStream(offsetsOffset + (7 * 4), 0xFFFFFFFF, 4), "stream corrupt offset %s", path.c_str());
+
+    if (height > RICE_LARGE_BLOCK_DIM) {
+      int recordOffset = 12;
+      uint32_t recordSize;
+      ::decode(streamBytes, recordOffset, recordSize);
+      const int band1OffsetsOffset = recordOffset + recordSize + 4 + 4 + blockN + 4;
+      CHECK(!corruptStream(band1OffsetsOffset, 0, 4), "stream corrupt band offset %s", path.c_str());
+    }
+  }
+
+  // Decode stats must account for every symbol and bit
+
+  RiceDecodeStatsReport stats;
+  vector<uint8_t> statsDeltas;
+  rice2_decode_plane_deltas(plane, statsDeltas, &stats);
+
+  CHECK(statsDeltas == kernelDeltas, "stats decode %s", path.c_str());
+  CHECK(stats.numSymbols == (uint64_t)(plane.paddedWidth() * plane.paddedHeight()), "%llu", (unsigned long long)stats.numSymbols);
+  CHECK(stats.numBits <= (plane.riceEncodedBits.size() * 8), "%llu", (unsigned long long)stats.numBits);
+  CHECK(stats.halfBlockNumSymbols.size() == (size_t) (plane.numBlocks() * 2), "%d", (int)stats.halfBlockNumSymbols.size());
+
+  uint64_t kSum = 0;
+  for (int k = 0; k < 16; k++) {
+    kSum += stats.kHistogram[k];
+  }
+  CHECK(kSum == stats.numSymbols, "%llu", (unsigned long long)kSum);
+
+  uint64_t bitsSum = 0;
+  for ( uint32_t numBits : stats.bigBlockNumBits ) {
+    bitsSum += numBits;
+  }
+  CHECK(bitsSum == stats.numBits, "%llu", (unsigned long long)bitsSum);
+
+  uint64_t halfBlockBitsSum = 0;
+  for ( uint32_t numBits : stats.halfBlockNumBits ) {
+    halfBlockBitsSum += numBits;
+  }
+  CHECK(halfBlockBitsSum == stats.numBits, "%llu", (unsigned long long)halfBlockBitsSum);
+
+  // k picked by decoder cost changes only the k table and bits, with
+  // escapes weighted as extra bits these images have fewer escapes.
+
+  {
+    vector<uint8_t> imageOrderDeltas;
+    rice2_image_order_deltas(pixels.data(), width, height,
+                             plane.numBigBlocksInWidth, plane.numBigBlocksInHeight,
+                             imageOrderDeltas);
+
+    Rice2EncodedPlane costPlane;
+    rice2_encode_plane_symbols(imageOrderDeltas, width, height, costPlane, Rice2KSearchDecodeCost);
+
+    vector<uint8_t> costDecoded(width * height);
+    rice2_decode_plane(costPlane, costDecoded.data());
+    CHECK(costDecoded == pixels, "decode cost decode %s", path.c_str());
+
+    vector<uint8_t> costS32Symbols;
+    rice2_decode_plane_serial(costPlane, costS32Symbols);
+    CHECK(costS32Symbols == s32Symbols, "decode cost serial decode %s", path.c_str());
+
+    RiceDecodeStatsReport costStats;
+    vector<uint8_t> costDeltas;
+    rice2_decode_plane_deltas(costPlane, costDeltas, &costStats);
+    CHECK(costStats.numEscapes <= stats.numEscapes, "decode cost escapes %s %llu", path.c_str(), (unsigned long long)costStats.numEscapes);
+  }
+
+  // Every coder adapter must round trip the same block order symbols
+
+  RiceCoderInput coderInput;
+  coderInput.blockSize = RICE_SMALL_BLOCK_DIM * RICE_SMALL_BLOCK_DIM;
+  coderInput.kTable = plane.blockOptimalKTable;
+  replace(coderInput.kTable.begin(), coderInput.kTable.end(), (uint8_t) RICE2_SKIP_BLOCK_K, (uint8_t) 0);
+  rice2_block_delta_encoding_2stage(pixels.data(), width, height,
+                                    plane.numBigBlocksInWidth, plane.numBigBlocksInHeight,
+                                    coderInput.symbols);
+
+  checkCoderAdapters(coderInput, path);
+
+  // Each escape width round trips through the kernel and serial decoders,
+  // a shorter escape never reads more prefix bits for one symbol.
+
+  {
+    vector<uint8_t> imageOrderDeltas;
+    rice2_image_order_deltas(pixels.data(), width, height,
+                             plane.numBigBlocksInWidth, plane.numBigBlocksInHeight,
+                             imageOrderDeltas);
+
+    Rice2EncodedPlane planes[2];
+    rice2_encode_plane_symbols<8>(imageOrderDeltas, width, height, planes[0]);
+    rice2_encode_plane_symbols<12>(imageOrderDeltas, width, height, planes[1]);
+
+    for ( const Rice2EncodedPlane & escPlane : planes ) {
+      vector<uint8_t> escDecoded(width * height);
+      rice2_decode_plane(escPlane, escDecoded.data());
+      CHECK(escDecoded == pixels, "escape %d decode %s", escPlane.escapeNumBits, path.c_str());
+
+      vector<uint8_t> escS32Symbols;
+      rice2_decode_plane_serial(escPlane, escS32Symbols);
+      CHECK(escS32Symbols == s32Symbols, "escape %d serial decode %s", escPlane.escapeNumBits, path.c_str());
+
+      RiceDecodeStatsReport escStats;
+      vector<uint8_t> escDeltas;
+      rice2_decode_plane_deltas(escPlane, escDeltas, &escStats);
+      CHECK(escStats.numSymbols == stats.numSymbols, "escape %d stats %s", escPlane.escapeNumBits, path.c_str());
+      CHECK(escStats.numEscapes >= stats.numEscapes, "escape %d escapes %s", escPlane.escapeNumBits, path.c_str());
+
+      // The escape width is stored with the plane, a plane written
+      // without the escape byte must use the default 16 bit escape.
+
+      Rice2PlanesContainer escContainer;
+      escContainer.width = width;
+      escContainer.height = height;
+      escContainer.planes.push_back(escPlane);
+
+      Rice2PlanesContainer escParsed;
+      CHECK(escParsed.decode(escContainer.encode()) &&
+            escParsed.planes[0].escapeNumBits == escPlane.escapeNumBits &&
+            escParsed.planes[0].riceEncodedBits == escPlane.riceEncodedBits,
+            "escape %d container %s", escPlane.escapeNumBits, path.c_str());
+
+      vector<uint8_t> escBuf;
+      CHECK(!rice2_plane_write(escPlane, escBuf) && escBuf.empty(), "escape %d write %s", escPlane.escapeNumBits, path.c_str());
+    }
+
+    Rice2EncodedPlane bestPlane;
+    rice2_encode_plane_best_escape(pixels.data(), width, height, bestPlane);
+
+    CHECK(bestPlane.riceEncodedBits.size() <= plane.riceEncodedBits.size(), "best escape %s", path.c_str());
+    CHECK(bestPlane.riceEncodedBits.size() <= planes[0].riceEncodedBits.size(), "best escape %s", path.c_str());
+    CHECK(bestPlane.riceEncodedBits.size() <= planes[1].riceEncodedBits.size(), "best escape %s", path.c_str());
+
+    vector<uint8_t> bestDecoded(width * height);
+    rice2_decode_plane(bestPlane, bestDecoded.data());
+    CHECK(bestDecoded == pixels, "best escape decode %s", path.c_str());
+  }
+
+  printf("%-40s %5d x %5d : %8d -> %8d bytes\n", path.c_str(), width, height, width * height, (int)plane.riceEncodedBits.size());
+}
+
+static
+void checkImage(const string & path, RiceThreadPool & pool)
+{
+  vector<uint8_t> pixels;
+  int width, height;
+
+  bool worked = metalrice_read_pgm(path, pixels, width, height);
+  CHECK(worked, "read %s", path.c_str());
+
+  if (!worked) {
+    return;
+  }
+
+  checkPixels(pixels, width, height, path, pool);
+}
+
+// Flat regions and identical rows produce all zero 8x8 blocks that are
+// coded as skip blocks with no bits, every decoder must fill them in.
+
+static
+void checkSkipBlocks(RiceThreadPool & pool)
+{
+  const int width = 131;
+  const int height = 97;
+
+  vector<uint8_t> pixels(width * height, 0);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t & pixel = pixels[(y * width) + x];
+
+      if (x >= 40 && x < 90 && y >= 20 && y < 70) {
+        pixel = (uint8_t) ((x * 7) ^ (y * 3));
+      } else if (y >= 70) {
+        pixel = (uint8_t) x;
+      }
+    }
+  }
+
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(pixels.data(), width, height, plane);
+
+  // A skip block starts at the same bit offset as the half block after it
+
+  const int blockN = plane.numBlocks();
+  int numSkipBlocks = 0;
+
+  for (int blocki = 0; blocki < blockN; blocki++) {
+    if (plane.blockOptimalKTable[blocki] != RICE2_SKIP_BLOCK_K) {
+      continue;
+    }
+    numSkipBlocks += 1;
+
+    const uint32_t offset = plane.halfBlockOffsetTable[blocki * 2];
+    CHECK(plane.halfBlockOffsetTable[(blocki * 2) + 1] == offset, "skip block %d", blocki);
+    if (blocki < (blockN - 1)) {
+      CHECK(plane.halfBlockOffsetTable[(blocki * 2) + 2] == offset, "skip block %d", blocki);
+    }
+  }
+
+  CHECK(numSkipBlocks > (blockN / 2), "skip blocks %d of %d", numSkipBlocks, blockN);
+
+  checkPixels(pixels, width, height, "skip blocks", pool);
+
+  // All skip blocks, only the finish padding is written
+
+  vector<uint8_t> flat(width * height, 0);
+
+  Rice2EncodedPlane flatPlane;
+  rice2_encode_plane(flat.data(), width, height, flatPlane);
+
+  CHECK(count(flatPlane.blockOptimalKTable.begin(), flatPlane.blockOptimalKTable.end(), (uint8_t) RICE2_SKIP_BLOCK_K) == flatPlane.numBlocks(), "all skip blocks");
+  CHECK(flatPlane.riceEncodedBits.size() == (2 * sizeof(uint32_t)), "all skip blocks %d", (int)flatPlane.riceEncodedBits.size());
+
+  vector<uint8_t> flatDecoded(width * height, 1);
+  rice2_decode_plane(flatPlane, flatDecoded.data());
+  CHECK(flatDecoded == flat, "all skip blocks decode");
+
+  vector<uint8_t> flatS32;
+  rice2_decode_plane_serial(flatPlane, flatS32);
+  CHECK(count(flatS32.begin(), flatS32.end(), 0) == (int)flatS32.size(), "all skip blocks serial decode");
+
+  Rice2EncodedPlane flatStreamPlane;
+  rice2_stream_encode_plane(flat.data(), width, height, 32, flatStreamPlane);
+  CHECK(flatStreamPlane.riceEncodedBits == flatPlane.riceEncodedBits, "all skip blocks stream");
+}
+
+// Closed form reorder tables must match a BlockEncoder split of the
+// image order blocki values, repeated lookups share one table.
+
+template <const int blockDim, const int blockiDim>
+static
+void checkReorderTables(const int width, const int height)
+{
+  auto tables = block_reorder_blocki_tables<blockDim, blockiDim>(width, height);
+
+  CHECK(tables == (block_reorder_blocki_tables<blockDim, blockiDim>(width, height)), "cached %d x %d", width, height);
+
+  unsigned int numBlocksInWidth, numBlocksInHeight;
+  unsigned int numBigBlocksInWidth, numBigBlocksInHeight;
+
+  BlockEncoder<uint32_t, blockDim> blockEncoder;
+  blockEncoder.calcBlockWidthAndHeight(width, height, numBlocksInWidth, numBlocksInHeight);
+
+  BlockEncoder<uint32_t, blockiDim> encoder;
+  encoder.calcBlockWidthAndHeight(numBlocksInWidth, numBlocksInHeight, numBigBlocksInWidth, numBigBlocksInHeight);
+
+  vector<uint32_t> blockiVec;
+  for (unsigned int blocki = 0; blocki < (numBlocksInWidth * numBlocksInHeight); blocki++) {
+    blockiVec.push_back(blocki);
+  }
+
+  encoder.splitIntoBlocks(blockiVec.data(), (int)blockiVec.size(), numBlocksInWidth, numBlocksInHeight, numBigBlocksInWidth, numBigBlocksInHeight, 0xFFFFFFFF);
+
+  vector<uint32_t> expected;
+  for ( vector<uint32_t> & blockVec : encoder.blockVectors ) {
+    for ( uint32_t blocki : blockVec ) {
+      if (blocki != 0xFFFFFFFF) {
+        expected.push_back(blocki);
+      }
+    }
+  }
+
+  CHECK(tables->blockiVec == blockiVec, "blockiVec %d x %d", width, height);
+  CHECK(tables->blockiLookupVec == expected, "blockiLookupVec %d x %d", width, height);
+
+  vector<uint32_t> outBlockiVec, outBlockiLookupVec;
+  block_reorder_blocki<blockDim, blockiDim>(width, height, outBlockiVec, outBlockiLookupVec, true);
+
+  CHECK(outBlockiVec == blockiVec && outBlockiLookupVec == expected, "block_reorder_blocki %d x %d", width, height);
+
+  // The cache only keeps the most recently used geometries, so once
+  // more than that many others have been used the tables are rebuilt.
+
+  for (int i = 1; i <= BLOCK_REORDER_TABLES_CACHE_SIZE; i++) {
+    block_reorder_blocki_tables<blockDim, blockiDim>(width + i, height);
+  }
+
+  auto rebuilt = block_reorder_blocki_tables<blockDim, blockiDim>(width, height);
+
+  CHECK(rebuilt != tables && rebuilt->blockiLookupVec == expected, "evicted %d x %d", width, height);
+}
+
+// Byte fast paths for 8x8 and 32x32 blocks must match the generic
+// split and flatten, with and without a thread pool.
+
+template <const int D>
+static
+void checkBlockSplitFlatten(const int width, const int height, RiceThreadPool & pool)
+{
+  vector<uint8_t> pixels(width * height);
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = (uint8_t) ((i * 31) + (i / width));
+  }
+
+  const unsigned int blockWidth = (width + D - 1) / D;
+  const unsigned int blockHeight = (height + D - 1) / D;
+
+  // One extra row of output blocks is padding only
+
+  const unsigned int numPaddedPixels = blockWidth * (blockHeight + 1) * D * D;
+
+  vector<uint8_t> expected(numPaddedPixels);
+  vector<uint8_t> serial(numPaddedPixels);
+  vector<uint8_t> parallel(numPaddedPixels);
+
+  splitIntoBlocksOfSize<uint8_t>(D, pixels.data(), width, height, blockWidth, blockHeight, expected.data(), blockWidth, blockHeight + 1, 0x7F);
+  splitIntoBlocksOfSize(D, pixels.data(), width, height, blockWidth, blockHeight, serial.data(), blockWidth, blockHeight + 1, (uint8_t) 0x7F);
+  splitIntoBlocksOfSize(D, pixels.data(), width, height, blockWidth, blockHeight, parallel.data(), blockWidth, blockHeight + 1, (uint8_t) 0x7F, &pool);
+
+  CHECK(serial == expected, "split %d %d x %d", D, width, height);
+  CHECK(parallel == expected, "split pool %d %d x %d", D, width, height);
+
+  const unsigned int numFlatPixels = blockWidth * blockHeight * D * D;
+
+  vector<uint8_t> flatExpected(numFlatPixels);
+  vector<uint8_t> flatSerial(numFlatPixels);
+  vector<uint8_t> flatParallel(numFlatPixels);
+
+  flattenBlocksOfSize<uint8_t>(D, expected.data(), flatExpected.data(), blockWidth, blockHeight);
+  flattenBlocksOfSize(D, expected.data(), flatSerial.data(), blockWidth, blockHeight);
+  flattenBlocksOfSize(D, expected.data(), flatParallel.data(), blockWidth, blockHeight, &pool);
+
+  CHECK(flatSerial == flatExpected, "flatten %d %d x %d", D, width, height);
+  CHECK(flatParallel == flatExpected, "flatten pool %d %d x %d", D, width, height);
+}
+
+// 10/12/16 bit samples through the wide delta and G4 coder
+
+template <const int SB>
+static
+void checkWideSamples(const int width, const int height)
+{
+  const int blockDim = 8;
+  const uint32_t mask = (1 << SB) - 1;
+
+  vector<uint16_t> samples(width * height);
+
+  for (int i = 0; i < (int)samples.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    uint32_t val = ((y * 37) + (x * 11)) << (SB - 8);
+    if ((i % 50) == 0) {
+      val += (i * 7919);
+    }
+    samples[i] = val & mask;
+  }
+
+  unsigned int blockWidth = (width + blockDim - 1) / blockDim;
+  unsigned int blockHeight = (height + blockDim - 1) / blockDim;
+
+  vector<uint16_t> deltas;
+  block_delta_process_encode_wide<blockDim>(samples.data(), (int)samples.size(), width, height, blockWidth, blockHeight, SB, deltas);
+
+  vector<uint8_t> kTable;
+  for (int i = 0; i < (int)deltas.size(); i += (blockDim * blockDim)) {
+    kTable.push_back(optimalRiceKG4<SB>(&deltas[i], blockDim * blockDim));
+  }
+  const int numBlocks = (int) kTable.size();
+  kTable.push_back(0);
+
+  vector<uint32_t> countTable(1, numBlocks);
+  vector<uint32_t> nTable(1, blockDim * blockDim);
+
+  RiceSplit16EncoderG4<false, true, BitWriterByteStream, SB> encoder;
+  encoder.encode(deltas.data(), (int)deltas.size(), kTable.data(), (int)kTable.size(), countTable, nTable);
+  vector<uint8_t> bytes = encoder.bitWriter.moveBytes();
+
+  RiceSplit16DecoderG4<false, true, BitReaderByteStream, SB> decoder;
+  vector<uint16_t> decodedDeltas(deltas.size());
+  decoder.decode(bytes.data(), (int)bytes.size(), decodedDeltas.data(), (int)decodedDeltas.size(), kTable.data(), (int)kTable.size(), countTable, nTable);
+
+  CHECK(decodedDeltas == deltas, "%d bit deltas", SB);
+
+  vector<uint16_t> decoded(samples.size());
+  block_delta_process_decode_wide<blockDim>(decodedDeltas.data(), (int)decodedDeltas.size(), width, height, blockWidth, blockHeight, SB, decoded.data(), (int)decoded.size());
+
+  CHECK(decoded == samples, "%d bit samples", SB);
+}
+
+// Fused delta and zigzag kernels match encodeDelta() and the pixelpack
+// mapping for every length, alignment, and in place
+
+static
+void checkByteDeltas()
+{
+  const int lengths[] = { 0, 1, 15, 16, 17, 31, 32, 33, 64, 1000 };
+
+  for ( int numBytes : lengths ) {
+    for (int align = 0; align < 3; align++) {
+      vector<uint8_t> buf(numBytes + align);
+      for (int i = 0; i < (int)buf.size(); i++) {
+        buf[i] = (uint8_t) ((i * 37) ^ ((i >> 2) * 91));
+      }
+      const uint8_t *inPtr = buf.data() + align;
+
+      vector<uint8_t> signedDeltas(numBytes);
+      vector<uint8_t> zigzagDeltas(numBytes);
+
+      if (numBytes > 0) {
+        vector<uint8_t> inVec(inPtr, inPtr + numBytes);
+        signedDeltas = encodeDelta(inVec);
+        for (int i = 0; i < numBytes; i++) {
+          zigzagDeltas[i] = pixelpack_int8_to_offset_uint8((int8_t) signedDeltas[i]);
+        }
+      }
+
+      vector<uint8_t> out(numBytes);
+
+      byte_deltas_encode(inPtr, out.data(), numBytes, 0);
+      CHECK(out == signedDeltas, "byte deltas %d %d", numBytes, align);
+
+      zigzag_byte_deltas_encode(inPtr, out.data(), numBytes, 0);
+      CHECK(out == zigzagDeltas, "zigzag byte deltas %d %d", numBytes, align);
+
+      vector<uint8_t> inplace(inPtr, inPtr + numBytes);
+      zigzag_byte_deltas_encode_inplace(inplace.data(), numBytes);
+      CHECK(inplace == zigzagDeltas, "zigzag byte deltas in place %d %d", numBytes, align);
+    }
+  }
+}
+
+// SIMD adler32 against the byte at a time update, hash64 against
+// xxHash64 test vectors and per big block hashes with a pool.
+
+static
+void checkChecksums(RiceThreadPool & pool)
+{
+  const int lengths[] = { 0, 1, 31, 32, 33, 100, 5536, 5537, 20000 };
+
+  for ( int numBytes : lengths ) {
+    for (int align = 0; align < 3; align++) {
+      for (int fill = 0; fill < 2; fill++) {
+        vector<uint8_t> buf(numBytes + align);
+        for (int i = 0; i < (int)buf.size(); i++) {
+          buf[i] = fill ? 0xFF : (uint8_t) ((i * 37) ^ ((i >> 2) * 91));
+        }
+        const uint8_t *inPtr = buf.data() + align;
+
+        uint32_t s1 = 1;
+        uint32_t s2 = 0;
+        for (int i = 0; i < numBytes; i++) {
+          s1 = (s1 + inPtr[i]) % CHECKSUM_ADLER_BASE;
+          s2 = (s2 + s1) % CHECKSUM_ADLER_BASE;
+        }
+
+        CHECK(adler32_update(1, inPtr, numBytes) == ((s2 << 16) | s1), "adler32 %d %d %d", numBytes, align, fill);
+      }
+    }
+  }
+
+  CHECK(hash64((const uint8_t *) "", 0, 0) == 0xEF46DB3751D8E999ULL, "hash64 empty");
+  CHECK(hash64((const uint8_t *) "abc", 3, 0) == 0x44BC2CF5AD770999ULL, "hash64 abc");
+
+  const int width = 131;
+  const int height = 97;
+
+  for ( int bytesPerPixel : { 1, 4 } ) {
+    vector<uint8_t> pixels(width * height * bytesPerPixel);
+    for (int i = 0; i < (int)pixels.size(); i++) {
+      pixels[i] = (uint8_t) ((i * 7) ^ (i >> 5));
+    }
+
+    vector<uint64_t> hashes;
+    vector<uint64_t> poolHashes;
+    rice2_big_block_hashes(pixels.data(), width, height, bytesPerPixel, hashes);
+    rice2_big_block_hashes(pixels.data(), width, height, bytesPerPixel, poolHashes, &pool);
+
+    CHECK(hashes.size() == 5 * 4, "big block hashes size %d", bytesPerPixel);
+    CHECK(hashes == poolHashes, "big block hashes pool %d", bytesPerPixel);
+    CHECK(rice2_verify_big_block_hashes(pixels.data(), width, height, bytesPerPixel, hashes, &pool) == 0, "big block hashes verify %d", bytesPerPixel);
+
+    // One changed pixel in the last column of bbid 9
+
+    pixels[((40 * width) + 130) * bytesPerPixel] ^= 1;
+
+    vector<int> badBlocks;
+    int numBad = rice2_verify_big_block_hashes(pixels.data(), width, height, bytesPerPixel, hashes, &pool, &badBlocks);
+    CHECK(numBad == 1 && badBlocks == vector<int>{ 9 }, "big block hashes bad block %d", bytesPerPixel);
+  }
+}
+
+// Every item passes through every stage in order even when a stage has
+// several workers and the queues only hold one item.
+
+static
+void checkPipeline()
+{
+  const int numItems = 200;
+
+  RicePipeline<shared_ptr<vector<int> > > pipeline(1);
+
+  pipeline.addStage("first", [](shared_ptr<vector<int> > & item) {
+    item->push_back(1);
+    return (size_t) 1;
+  });
+  pipeline.addStage("second", [](shared_ptr<vector<int> > & item) {
+    item->push_back(2);
+    return (size_t) 2;
+  }, 3);
+  pipeline.addStage("third", [](shared_ptr<vector<int> > & item) {
+    item->push_back(3);
+    return (size_t) 3;
+  });
+
+  vector<shared_ptr<vector<int> > > items;
+  for (int i = 0; i < numItems; i++) {
+    items.push_back(make_shared<vector<int> >(1, i));
+  }
+
+  pipeline.run(numItems, [&](int i) {
+    return items[i];
+  });
+
+  bool allStages = true;
+  for (int i = 0; i < numItems; i++) {
+    allStages = allStages && (*items[i] == vector<int>({ i, 1, 2, 3 }));
+  }
+  CHECK(allStages, "pipeline stages");
+
+  vector<RicePipelineCounters> counters = pipeline.counters();
+
+  CHECK(counters.size() == 3 && counters[1].numWorkers == 3, "pipeline workers");
+
+  for (int stagei = 0; stagei < (int) counters.size(); stagei++) {
+    CHECK(counters[stagei].numItems == numItems, "pipeline items %d", stagei);
+    CHECK(counters[stagei].numBytes == (uint64_t) (numItems * (stagei + 1)), "pipeline bytes %d", stagei);
+  }
+
+  // A closed queue drains the remaining items and then fails
+
+  RiceBoundedQueue<int> queue(2);
+  CHECK(queue.push(1) && queue.push(2), "queue push");
+  queue.close();
+  CHECK(!queue.push(3), "queue closed push");
+
+  int value = 0;
+  CHECK(queue.pop(value) && value == 1 && queue.pop(value) && value == 2, "queue drain");
+  CHECK(!queue.pop(value), "queue closed pop");
+}
+
+// A large plane wider than the 16 bit uniform limit round trips through
+// its segments, any region can be decoded, and each segment holds the
+// same bits as an ordinary plane encoded from that part of the image.
+
+static
+void checkLargePlane(RiceThreadPool & pool)
+{
+  {
+    const uint32_t width = 70000;
+    const uint32_t height = 40;
+
+    vector<uint8_t> pixels(width * height);
+
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+        pixels[(y * width) + x] = (uint8_t) ((x >> 4) + (y * 3) + (((x * 7) ^ y) & 0x7));
+      }
+    }
+
+    Rice2LargePlane plane;
+    rice2_large_encode_plane(pixels.data(), width, height, plane, BlockDeltaPredictorLeft, Rice2KSearchMinBits, RICE2_LARGE_SEGMENT_DIM, &pool);
+
+    CHECK(plane.numSegmentsInWidth == 9 && plane.numSegmentsInHeight == 1, "large segments");
+    CHECK(plane.segments[8].width == (int) (width - (8 * RICE2_LARGE_SEGMENT_DIM)), "large last segment");
+
+    vector<uint8_t> decoded(width * height);
+    rice2_large_decode_plane(plane, decoded.data(), &pool);
+
+    CHECK(decoded == pixels, "large decode");
+
+    // Region that crosses a segment edge, written with a wider stride
+
+    const uint32_t x = RICE2_LARGE_SEGMENT_DIM - 100;
+    const uint32_t y = 5;
+    const uint32_t regionWidth = 300;
+    const uint32_t regionHeight = 30;
+    const size_t stride = regionWidth + 7;
+
+    vector<uint8_t> region(stride * regionHeight, 0);
+    rice2_large_decode_region(plane, x, y, regionWidth, regionHeight, region.data(), stride);
+
+    bool same = true;
+    for (uint32_t row = 0; row < regionHeight; row++) {
+      same = same && memcmp(region.data() + (row * stride), pixels.data() + ((y + row) * width) + x, regionWidth) == 0;
+    }
+    CHECK(same, "large region");
+
+    vector<uint8_t> bytes = plane.encode();
+
+    Rice2LargePlane parsed;
+    CHECK(parsed.decode(bytes), "large parse");
+
+    vector<uint8_t> parsedDecoded(width * height);
+    rice2_large_decode_plane(parsed, parsedDecoded.data());
+
+    CHECK(parsedDecoded == pixels, "large parse decode");
+
+    bytes[0] ^= 0xFF;
+    CHECK(!parsed.decode(bytes), "large bad magic");
+  }
+
+  {
+    const uint32_t width = 300;
+    const uint32_t height = 170;
+    const int segmentDim = 64;
+
+    vector<uint8_t> pixels(width * height);
+
+    for (uint32_t i = 0; i < width * height; i++) {
+      pixels[i] = (uint8_t) (((i % width) * 5) ^ ((i / width) * 3));
+    }
+
+    Rice2LargePlane plane;
+    rice2_large_encode_plane(pixels.data(), width, height, plane, BlockDeltaPredictorGradient, Rice2KSearchDecodeCost, segmentDim);
+
+    CHECK(plane.numSegments() == 15, "large small segments");
+
+    const int segi = plane.numSegments() - 1;
+    const int segWidth = plane.segmentWidth(segi);
+    const int segHeight = plane.segmentHeight(segi);
+
+    vector<uint8_t> segmentPixels(segWidth * segHeight);
+    for (int row = 0; row < segHeight; row++) {
+      memcpy(segmentPixels.data() + (row * segWidth),
+             pixels.data() + ((plane.segmentY(segi) + row) * width) + plane.segmentX(segi),
+             segWidth);
+    }
+
+    Rice2EncodedPlane expected;
+    rice2_encode_plane(segmentPixels.data(), segWidth, segHeight, expected, BlockDeltaPredictorGradient, Rice2KSearchDecodeCost);
+
+    CHECK(plane.segments[segi].riceEncodedBits == expected.riceEncodedBits, "large segment bits");
+    CHECK(plane.segments[segi].halfBlockOffsetTable == expected.halfBlockOffsetTable, "large segment offsets");
+
+    Rice2LargePlane parsed;
+    CHECK(parsed.decode(plane.encode()), "large small parse");
+
+    vector<uint8_t> decoded(width * height);
+    int numBad = rice2_large_decode_plane(parsed, decoded.data(), &pool);
+
+    CHECK(numBad == 0 && decoded == pixels, "large small decode");
+
+    // Header dimensions whose segment count wraps, overflows an int or
+    // needs more base offsets than the buffer holds are rejected. The
+    // width is at byte 4, the height at 8 and the segment dim at 12.
+
+    const vector<uint8_t> bytes = plane.encode();
+
+    auto corruptHeader = [&](uint32_t w, uint32_t h, uint32_t dim) {
+      vector<uint8_t> corrupted = bytes;
+      memcpy(&corrupted[4], &w, 4);
+      memcpy(&corrupted[8], &h, 4);
+      memcpy(&corrupted[12], &dim, 4);
+      Rice2LargePlane corruptParsed;
+      return corruptParsed.decode(corrupted);
+    };
+
+    CHECK(corruptHeader(width, height, segmentDim), "large header rewrite");
+    CHECK(!corruptHeader(0xFFFFFFFF, height, segmentDim), "large header wrapped width");
+    CHECK(!corruptHeader(0xFFFFFFFF, 0xFFFFFFFF, 32), "large header segment count");
+
+    // A k out of range in one segment leaves that big block undecoded
+
+    parsed.segments[4].blockOptimalKTable[3] = 9;
+
+    numBad = rice2_large_decode_plane(parsed, decoded.data(), &pool);
+
+    CHECK(numBad == 1, "large corrupt segment %d", numBad);
+  }
+}
+
+static
+void checkPlanes()
+{
+  const int width = 67;
+  const int height = 45;
+
+  vector<uint32_t> pixels(width * height);
+
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    int x = i % width;
+    int y = i / width;
+    pixels[i] = ((i * 13) & 0xFF) << 24 | (((y * 2) + x) & 0xFF) << 16 | ((x + y) & 0xFF) << 8 | ((x * 3) & 0xFF);
+  }
+
+  for (int ycocg = 0; ycocg < 2; ycocg++) {
+    for (int hashes = 0; hashes < 2; hashes++) {
+      for (int predictor = BlockDeltaPredictorLeft; predictor <= BlockDeltaPredictorMED; predictor++) {
+        Rice2PlanesContainer container;
+        rice2_encode_bgra(pixels.data(), width, height, ycocg, true, container, hashes, (BlockDeltaPredictor) predictor);
+
+        Rice2PlanesContainer decodedContainer;
+        bool worked = decodedContainer.decode(container.encode());
+        CHECK(worked, "container decode");
+        CHECK(decodedContainer.hasBigBlockHashes() == (hashes != 0), "container hashes %d", hashes);
+        CHECK(decodedContainer.hasPredictors() == (predictor != BlockDeltaPredictorLeft), "container predictors %d", predictor);
+
+        vector<uint32_t> decoded(pixels.size());
+        int numBad = rice2_decode_bgra(decodedContainer, decoded.data());
+
+        CHECK(numBad == 0 && decoded == pixels, "planes ycocg %d hashes %d predictor %d", ycocg, hashes, predictor);
+      }
+    }
+  }
+
+  // Tid tables balanced for a simdgroup of 8 round trip with flag 0x8
+
+  {
+    Rice2PlanesContainer container;
+    rice2_encode_bgra(pixels.data(), width, height, false, true, container, true, BlockDeltaPredictorLeft, false, 8);
+
+    CHECK(container.hasTidTables(), "planes tid tables");
+
+    Rice2PlanesContainer decodedContainer;
+    bool worked = decodedContainer.decode(container.encode());
+
+    CHECK(worked && decodedContainer.hasTidTables(), "planes tid tables decode");
+
+    for (int planei = 0; planei < (int) container.planes.size(); planei++) {
+      CHECK(decodedContainer.planes[planei].halfBlockTidTable == container.planes[planei].halfBlockTidTable, "planes tid table %d", planei);
+    }
+
+    vector<uint32_t> decoded(pixels.size());
+    int numBad = rice2_decode_bgra(decodedContainer, decoded.data());
+
+    CHECK(numBad == 0 && decoded == pixels, "planes tid tables decode pixels");
+  }
+
+  // Each plane picks the predictor with the smallest encoding
+
+  {
+    Rice2PlanesContainer container;
+    rice2_encode_bgra(pixels.data(), width, height, true, true, container, false, BlockDeltaPredictorLeft, true);
+
+    Rice2PlanesContainer decodedContainer;
+    bool worked = decodedContainer.decode(container.encode());
+
+    vector<uint32_t> decoded(pixels.size());
+    int numBad = rice2_decode_bgra(decodedContainer, decoded.data());
+
+    CHECK(worked && numBad == 0 && decoded == pixels, "planes best predictor");
+  }
+
+  // Truncated or corrupt containers are rejected before any table is
+  // indexed, every prefix of a valid buffer fails to parse.
+
+  {
+    Rice2PlanesContainer container;
+    rice2_encode_bgra(pixels.data(), width, height, false, true, container, true, BlockDeltaPredictorMED, false, 8);
+
+    const vector<uint8_t> bytes = container.encode();
+    int numAccepted = 0;
+
+    for (int n = 0; n < (int) bytes.size(); n++) {
+      Rice2PlanesContainer parsed;
+      vector<uint8_t> prefix(bytes.begin(), bytes.begin() + n);
+      numAccepted += parsed.decode(prefix) ? 1 : 0;
+    }
+
+    CHECK(numAccepted == 0, "planes truncated accepted %d", numAccepted);
+
+    // Byte offsets in the first plane : big block dims at 14, predictor
+    // at 22 and the k table count at 23.
+
+    auto corrupt = [&](int offset, uint8_t value) {
+      vector<uint8_t> corrupted = bytes;
+      corrupted[offset] = value;
+      Rice2PlanesContainer parsed;
+      return parsed.decode(corrupted);
+    };
+
+    CHECK(!corrupt(14, 4), "planes bad big block width");
+    CHECK(!corrupt(22, 3), "planes bad predictor");
+    CHECK(!corrupt(23 + 3, 0x7F), "planes huge k table count");
+    CHECK(!corrupt(23, bytes[23] - 1), "planes short k table count");
+    CHECK(!corrupt(13, 7), "planes bad num planes");
+
+    // A permuted tid entry of 32 or more, or a repeated tid, fails
+
+    const Rice2EncodedPlane & plane = container.planes[0];
+    const int numBigBlocks = plane.numBigBlocksInWidth * plane.numBigBlocksInHeight;
+    const int tidOffset = 23 + 4 + (numBigBlocks * 16 + 1) + 4 + (numBigBlocks * 32 * 4);
+
+    int permutedOffset = tidOffset;
+    while (bytes[permutedOffset] == 0) {
+      permutedOffset += 1;
+    }
+
+    CHECK(!plane.halfBlockTidTable.empty() && corrupt(permutedOffset + 1, bytes[permutedOffset + 1]), "planes tid offset");
+    CHECK(!corrupt(permutedOffset + 1, 32), "planes tid out of range");
+    CHECK(!corrupt(permutedOffset + 1, bytes[permutedOffset + 2]), "planes tid repeated");
+  }
+
+  // A plane without hashes parses with a k out of range in bbid 1 and an
+  // offset past the bits in bbid 3, those tiles are reported as bad and
+  // are not decoded, every other tile still decodes.
+
+  {
+    Rice2PlanesContainer container;
+    rice2_encode_bgra(pixels.data(), width, height, false, true, container, false, BlockDeltaPredictorMED);
+
+    vector<uint8_t> bytes = container.encode();
+
+    const Rice2EncodedPlane & plane = container.planes[0];
+    const int kTableOffset = 23 + 4;
+    const int offsetTableOffset = kTableOffset + (int) plane.blockOptimalKTable.size() + 4;
+
+    bytes[kTableOffset + (1 * 16) + 2] = 9;
+    memset(&bytes[offsetTableOffset + (3 * 32 * 4) + (7 * 4)], 0xFF, 4);
+
+    Rice2PlanesContainer parsed;
+    bool worked = parsed.decode(bytes);
+
+    vector<uint32_t> decoded(pixels.size());
+    vector<int> badBlocks;
+    int numBad = worked ? rice2_decode_bgra(parsed, decoded.data(), &badBlocks) : 0;
+
+    CHECK(worked && numBad == 2 && badBlocks == (vector<int>{ 1, 3 }), "planes unhashed corrupt tables %d", numBad);
+
+    const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+    int numGoodMismatched = 0;
+
+    for (int i = 0; i < (int) pixels.size(); i++) {
+      const int bbid = (((i / width) / bigBlockDim) * plane.numBigBlocksInWidth) + ((i % width) / bigBlockDim);
+      if (bbid != 1 && bbid != 3 && decoded[i] != pixels[i]) {
+        numGoodMismatched += 1;
+      }
+    }
+
+    CHECK(numGoodMismatched == 0, "planes unhashed good tiles %d", numGoodMismatched);
+  }
+}
+
+// Corrupt the bits of one big block, only that tile fails verification
+// and every other tile still decodes to the original pixels.
+
+static
+void checkBigBlockHashTable(RiceThreadPool & pool)
+{
+  const int width = 131;
+  const int height = 97;
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+  vector<uint8_t> pixels(width * height);
+
+  for (int i = 0; i < (int)pixels.size(); i++) {
+    pixels[i] = (uint8_t) (((i % width) * 3) + ((i / width) * 5) + ((i * 7) % 11));
+  }
+
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(pixels.data(), width, height, plane);
+  rice2_plane_add_big_block_hashes(pixels.data(), plane, &pool);
+
+  CHECK(plane.bigBlockHashTable.size() == 5 * 4, "hash table size %d", (int)plane.bigBlockHashTable.size());
+
+  // Flip bits in a word inside the half block of thread 16 in bbid 7
+
+  const int badBBID = 7;
+  const int wordi = plane.halfBlockOffsetTable[(badBBID * 32) + 16] / 32 + 1;
+  CHECK(wordi < (int) (plane.halfBlockOffsetTable[(badBBID * 32) + 17] / 32), "hash table word");
+
+  Rice2EncodedPlane corrupted = plane;
+  corrupted.riceEncodedBits[(wordi * 4) + 1] ^= 0x5A;
+
+  vector<uint8_t> decoded(width * height);
+  vector<int> badBlocks;
+  int numBad = rice2_decode_plane_verified(corrupted, decoded.data(), &pool, &badBlocks);
+
+  CHECK(numBad == 1 && badBlocks == vector<int>{ badBBID }, "hash table bad tile %d", numBad);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const int bbid = ((y / bigBlockDim) * plane.numBigBlocksInWidth) + (x / bigBlockDim);
+      if (bbid != badBBID && decoded[(y * width) + x] != pixels[(y * width) + x]) {
+        CHECK(false, "hash table good tile %d", bbid);
+        return;
+      }
+    }
+  }
+
+  // Corrupt tables are reported as bad tiles, an offset past the end of
+  // the bits or a k out of range is not decoded, and an offset at the
+  // last bit decodes zero padding without reading past the bits.
+
+  {
+    const int numBits = (int) plane.riceEncodedBits.size() * 8;
+
+    Rice2EncodedPlane corruptTables = plane;
+    corruptTables.halfBlockOffsetTable[(2 * 32) + 5] = 0x7FFFFFFF;
+    corruptTables.blockOptimalKTable[(4 * 16) + 3] = 9;
+    corruptTables.halfBlockOffsetTable[(11 * 32) + 20] = numBits - 1;
+    corruptTables.halfBlockOffsetTable[(11 * 32) + 21] = numBits - 1;
+
+    CHECK(!rice2_plane_tile_is_valid(corruptTables, 2) && !rice2_plane_tile_is_valid(corruptTables, 4), "hash table tile check");
+    CHECK(rice2_plane_tile_is_valid(corruptTables, 11), "hash table tile check end");
+
+    badBlocks.clear();
+    numBad = rice2_decode_plane_verified(corruptTables, decoded.data(), &pool, &badBlocks);
+
+    CHECK(numBad == 3 && badBlocks == (vector<int>{ 2, 4, 11 }), "hash table corrupt tables %d", numBad);
+  }
+}
+
+// Frames are consumed in order with at most numSlots frames in flight,
+// a frame that fails to read is still consumed, and a sequence of frame
+// files decodes into the same slot buffers frame after frame.
+
+class FrameRingCheckSlot
+{
+public:
+  int value;
+  int decoded;
+};
+
+static
+void checkFrameRing(RiceThreadPool & pool)
+{
+  {
+    const int numFrames = 50;
+    const int numSlots = 2;
+    const int badFrame = 7;
+
+    RiceFrameRing<FrameRingCheckSlot> ring(numSlots);
+
+    atomic<int> numInFlight(0);
+    int maxInFlight = 0;
+    int nextFrame = 0;
+    bool inOrder = true;
+    bool decoded = true;
+
+    int numFailed = ring.run(numFrames, [&](int frameIndex, FrameRingCheckSlot & slot) {
+      int n = ++numInFlight;
+      maxInFlight = max(maxInFlight, n);
+      slot.value = frameIndex * 3;
+      slot.decoded = -1;
+      return (size_t) ((frameIndex == badFrame) ? 0 : 1);
+    }, [](FrameRingCheckSlot & slot) {
+      slot.decoded = slot.value * 2;
+      return (size_t) 2;
+    }, [&](int frameIndex, FrameRingCheckSlot & slot, bool ok) {
+      inOrder = inOrder && (frameIndex == nextFrame) && (ok == (frameIndex != badFrame));
+      decoded = decoded && (slot.decoded == (ok ? frameIndex * 6 : -1));
+      nextFrame += 1;
+      --numInFlight;
+    });
+
+    CHECK(numFailed == 1, "frame ring failed %d", numFailed);
+    CHECK(inOrder && nextFrame == numFrames, "frame ring order");
+    CHECK(decoded, "frame ring decode");
+    CHECK(maxInFlight <= numSlots, "frame ring in flight %d", maxInFlight);
+
+    vector<RicePipelineCounters> counters = ring.counters();
+
+    CHECK(counters.size() == 3, "frame ring counters");
+    CHECK(counters[0].numItems == numFrames && counters[0].numBytes == numFrames - 1, "frame ring read counters");
+    CHECK(counters[1].numItems == numFrames && counters[1].numBytes == 2 * (numFrames - 1), "frame ring decode counters");
+    CHECK(counters[2].numItems == numFrames, "frame ring consume counters");
+  }
+
+  // Each frame is the previous one shifted by a pixel
+
+  const int width = 67;
+  const int height = 45;
+  const int numFrames = 6;
+
+  const char *tmpDir = getenv("TMPDIR");
+  const string pathPrefix = string((tmpDir != NULL) ? tmpDir : "/tmp") + "/metalrice_check_frame";
+
+  vector<vector<uint8_t> > frames(numFrames);
+
+  for (int framei = 0; framei < numFrames; framei++) {
+    frames[framei].resize(width * height);
+
+    for (int i = 0; i < width * height; i++) {
+      frames[framei][i] = (uint8_t) ((((i % width) + framei) * 5) ^ ((i / width) * 3));
+    }
+
+    Rice2PlanesContainer container;
+    container.width = width;
+    container.height = height;
+    container.planes.resize(1);
+    rice2_encode_plane(frames[framei].data(), width, height, container.planes[0]);
+
+    // A frame with a tid table is not a basic plane and fails to read
+
+    if (framei == 2) {
+      rice2_plane_balance_tids(container.planes[0], 8);
+    }
+
+    vector<uint8_t> bytes = container.encode();
+
+    FILE *fp = fopen((pathPrefix + to_string(framei) + ".r2pl").c_str(), "wb");
+    CHECK(fp != NULL, "frame ring write %d", framei);
+    if (fp == NULL) {
+      return;
+    }
+    fwrite(bytes.data(), 1, bytes.size(), fp);
+    fclose(fp);
+  }
+
+  RiceFrameRing<Rice2FrameSlot> ring(3);
+
+  vector<const uint8_t *> outPtrs(ring.slots.size(), nullptr);
+  bool sameBuffers = true;
+  int numMatched = 0;
+
+  // The last frame does not exist
+
+  int numFailed = ring.run(numFrames + 1, [&](int frameIndex, Rice2FrameSlot & slot) {
+    return rice2_frame_read_file(pathPrefix + to_string(frameIndex) + ".r2pl", slot);
+  }, [&](Rice2FrameSlot & slot) {
+    return rice2_frame_decode(slot, &pool);
+  }, [&](int frameIndex, Rice2FrameSlot & slot, bool ok) {
+    if (!ok) {
+      return;
+    }
+
+    const int si = (int) (&slot - ring.slots.data());
+    if (outPtrs[si] != nullptr) {
+      sameBuffers = sameBuffers && (outPtrs[si] == slot.outPixels.data());
+    }
+    outPtrs[si] = slot.outPixels.data();
+
+    numMatched += (slot.outPixels == frames[frameIndex]) ? 1 : 0;
+  });
+
+  CHECK(numFailed == 2, "frame ring files failed %d", numFailed);
+  CHECK(numMatched == numFrames - 1, "frame ring files matched %d", numMatched);
+  CHECK(sameBuffers, "frame ring files reuse buffers");
+
+  for (int framei = 0; framei < numFrames; framei++) {
+    remove((pathPrefix + to_string(framei) + ".r2pl").c_str());
+  }
+}
+
+// A prebuilt asset loads into the same plane as an encode on launch,
+// planes the original shader can not decode are rejected, and the
+// bundled BigBridge.r2pl still decodes to the BigBridge pixels.
+
+static
+void checkAssets(const string & imagesDir, const string & assetsDir)
+{
+  vector<uint8_t> pixels;
+  int width, height;
+
+  bool worked = metalrice_read_pgm(imagesDir + "/Lenna_B.pgm", pixels, width, height);
+  CHECK(worked, "asset read Lenna_B.pgm");
+
+  if (!worked) {
+    return;
+  }
+
+  Rice2PlanesContainer container;
+  container.width = width;
+  container.height = height;
+  container.planes.resize(1);
+  rice2_encode_plane(pixels.data(), width, height, container.planes[0]);
+
+  const Rice2EncodedPlane & plane = container.planes[0];
+
+  {
+    Rice2EncodedPlane loaded;
+    worked = rice2_asset_load_gray(container.encode(), loaded);
+
+    CHECK(worked, "asset load");
+    CHECK(loaded.width == width && loaded.height == height, "asset dims %d x %d", loaded.width, loaded.height);
+    CHECK(loaded.numBigBlocksInWidth == plane.numBigBlocksInWidth && loaded.numBigBlocksInHeight == plane.numBigBlocksInHeight, "asset big blocks");
+    CHECK(loaded.blockOptimalKTable == plane.blockOptimalKTable, "asset k table");
+    CHECK(loaded.halfBlockOffsetTable == plane.halfBlockOffsetTable, "asset offsets");
+    CHECK(loaded.riceEncodedBits == plane.riceEncodedBits, "asset bits");
+
+    vector<uint8_t> decoded(pixels.size());
+    rice2_decode_plane(loaded, decoded.data());
+    CHECK(decoded == pixels, "asset decode");
+  }
+
+  // Features the original shader does not decode
+
+  {
+    Rice2PlanesContainer predictorContainer = container;
+    rice2_encode_plane(pixels.data(), width, height, predictorContainer.planes[0], BlockDeltaPredictorGradient);
+
+    Rice2EncodedPlane loaded;
+    CHECK(!rice2_asset_load_gray(predictorContainer.encode(), loaded), "asset predictor");
+  }
+
+  {
+    Rice2PlanesContainer tidContainer = container;
+    rice2_plane_balance_tids(tidContainer.planes[0], 8);
+
+    Rice2EncodedPlane loaded;
+    CHECK(tidContainer.hasTidTables() && !rice2_asset_load_gray(tidContainer.encode(), loaded), "asset tid table");
+  }
+
+  {
+    Rice2PlanesContainer escContainer = container;
+    vector<uint8_t> imageOrderDeltas;
+    rice2_image_order_deltas(pixels.data(), width, height,
+                             plane.numBigBlocksInWidth, plane.numBigBlocksInHeight,
+                             imageOrderDeltas);
+    rice2_encode_plane_symbols<12>(imageOrderDeltas, width, height, escContainer.planes[0]);
+
+    Rice2EncodedPlane loaded;
+    CHECK(rice2_asset_read_plane(escContainer.encode(), loaded) && loaded.escapeNumBits == 12, "asset escape read");
+    CHECK(!rice2_asset_load_gray(escContainer.encode(), loaded), "asset escape");
+  }
+
+  {
+    Rice2PlanesContainer colorContainer = container;
+    colorContainer.planes.push_back(plane);
+    colorContainer.planes.push_back(plane);
+
+    Rice2EncodedPlane loaded;
+    CHECK(!rice2_asset_load_gray(colorContainer.encode(), loaded), "asset 3 planes");
+  }
+
+  {
+    vector<uint8_t> bytes = container.encode();
+    bytes[0] ^= 0xFF;
+
+    Rice2EncodedPlane loaded;
+    CHECK(!rice2_asset_load_gray(bytes, loaded), "asset bad magic");
+  }
+
+  // Tables that would send the GPU decode out of bounds
+
+  {
+    Rice2PlanesContainer badKContainer = container;
+    badKContainer.planes[0].blockOptimalKTable[3] = 9;
+
+    Rice2PlanesContainer badOffsetContainer = container;
+    badOffsetContainer.planes[0].halfBlockOffsetTable[5] = (uint32_t) (plane.riceEncodedBits.size() * 8);
+
+    Rice2EncodedPlane loaded;
+    CHECK(!rice2_asset_load_gray(badKContainer.encode(), loaded), "asset bad k");
+    CHECK(!rice2_asset_load_gray(badOffsetContainer.encode(), loaded), "asset bad offset");
+  }
+
+  {
+    Rice2PlanesContainer truncatedContainer = container;
+    truncatedContainer.planes[0].blockOptimalKTable.pop_back();
+
+    Rice2EncodedPlane loaded;
+    CHECK(!rice2_asset_load_gray(truncatedContainer.encode(), loaded), "asset k table size");
+  }
+
+  // Bundled asset, regenerate with metalrice-enc if the format changes
+
+  {
+    vector<uint8_t> bytes;
+    worked = metalrice_read_pgm(imagesDir + "/BigBridge.pgm", pixels, width, height) &&
+             metalrice_read_file(assetsDir + "/BigBridge.r2pl", bytes);
+    CHECK(worked, "asset read BigBridge");
+
+    Rice2EncodedPlane loaded;
+    worked = worked && rice2_asset_load_gray(bytes, loaded);
+    CHECK(worked, "asset load BigBridge.r2pl");
+
+    if (worked) {
+      vector<uint8_t> decoded(pixels.size());
+      rice2_decode_plane(loaded, decoded.data());
+      CHECK(loaded.width == width && loaded.height == height && decoded == pixels, "asset decode BigBridge.r2pl");
+    }
+  }
+}
+
+int main(int argc, const char **argv)
+{
+  string imagesDir = (argc > 1) ? argv[1] : METALRICE_IMAGES_DIR;
+
+  const char *names[] = { "Image", "ImageHuge", "BigBridge", "Lenna_B" };
+
+  RiceThreadPool pool;
+
+  for ( const char *name : names ) {
+    checkImage(imagesDir + "/" + name + ".pgm", pool);
+  }
+
+  checkSkipBlocks(pool);
+
+  checkWideSamples<10>(67, 41);
+  checkWideSamples<12>(67, 41);
+  checkWideSamples<16>(130, 70);
+
+  checkPlanes();
+
+  checkLargePlane(pool);
+
+  checkAssets(imagesDir, METALRICE_ASSETS_DIR);
+
+  checkPipeline();
+
+  checkFrameRing(pool);
+
+  checkBigBlockHashTable(pool);
+
+  checkByteDeltas();
+
+  checkChecksums(pool);
+
+  checkReorderTables<8, 4>(256, 256);
+  checkReorderTables<8, 4>(70, 41);
+  checkReorderTables<2, 2>(10, 6);
+  checkReorderTables<1, 3>(7, 5);
+
+  checkBlockSplitFlatten<8>(67, 45, pool);
+  checkBlockSplitFlatten<8>(64, 64, pool);
+  checkBlockSplitFlatten<32>(100, 33, pool);
+  checkBlockSplitFlatten<32>(7, 5, pool);
+
+  if (numFailed > 0) {
+    printf("%d checks failed\n", numFailed);
+    return 1;
+  }
+
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,33 @@
+//
+//  metalrice_core.cpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Non-template symbols that Rice.mm provides in the Xcode build.
+
+#include "metalrice_core.hpp"
+
+// Find optimal K for rice coding, see Rice.mm
+
+int optimalRiceK(
+                 const uint8_t * inBytes,
+                 int inNumBytes,
+                 int /* blocki */)
+{
+  RiceSplit16Encoder<false, true, BitWriterByteStream> encoder;
+  
+  int minBlockSize = 0x7FFFFFFF;
+  int minBlockK = -1;
+  
+  for (int k = 0 ; k < 8; k++) {
+    int numBitsForBlock = encoder.numBits(inBytes, inNumBytes, k);
+    
+    if (numBitsForBlock < minBlockSize) {
+      minBlockSize = numBitsForBlock;
+      minBlockK = k;
+    }
+  }
+  
+  return minBlockK;
+}
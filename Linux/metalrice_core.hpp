@@ -0,0 +1,119 @@
+//
+//  metalrice_core.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Objective-C free entry point to the header only codec core. The
+//  CachedBits and RiceDecodeBlocks headers need a couple of defines
+//  set before they are included, this header includes everything in
+//  the required order so that a plain C++ program can encode and
+//  decode Rice2 planes on the CPU.
+
+#ifndef _metalrice_core_hpp
+#define _metalrice_core_hpp
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "zigzag.h"
+#include "prefix_sum.h"
+#include "checksum.h"
+#include "EncDec.hpp"
+#include "block.hpp"
+#include "block_process.hpp"
+#include "rice.hpp"
+
+#if !defined(EMIT_CACHEDBITS_DEBUG_OUTPUT)
+#define EMIT_CACHEDBITS_DEBUG_OUTPUT
+#endif
+#include "CachedBits.hpp"
+#if !defined(EMIT_RICEDECODEBLOCKS_DEBUG_OUTPUT)
+#define EMIT_RICEDECODEBLOCKS_DEBUG_OUTPUT
+#endif
+#include "RiceDecodeBlocks.hpp"
+
+// RiceDecodeBlocksImpl.hpp has no include guard, it is included
+// once by Rice2Codec.hpp
+
+#include "Rice2Codec.hpp"
+#include "Rice2Checksum.hpp"
+#include "Rice2Balance.hpp"
+#include "Rice2Planes.hpp"
+#include "Rice2Large.hpp"
+#include "Rice2Asset.hpp"
+#include "Rice2Stream.hpp"
+#include "Rice2Preview.hpp"
+#include "Rice2Temporal.hpp"
+#include "RiceKernelSim.hpp"
+#include "RicePipeline.hpp"
+#include "RiceFrameRing.hpp"
+
+// Read a binary PGM (P5) file with 8 bit samples. Returns false
+// if the file could not be read or is not a supported PGM.
+
+static inline
+bool metalrice_read_pgm(const string & path,
+                        vector<uint8_t> & outPixels,
+                        int & outWidth,
+                        int & outHeight)
+{
+  FILE *fp = fopen(path.c_str(), "rb");
+
+  if (fp == NULL) {
+    return false;
+  }
+
+  int maxVal = 0;
+  int numRead = fscanf(fp, "P5 %d %d %d", &outWidth, &outHeight, &maxVal);
+
+  // Exactly one whitespace char follows the max value
+
+  if (numRead != 3 || maxVal != 255 || fgetc(fp) == EOF || outWidth <= 0 || outHeight <= 0) {
+    fclose(fp);
+    return false;
+  }
+
+  outPixels.resize(outWidth * outHeight);
+  size_t numBytes = fread(outPixels.data(), 1, outPixels.size(), fp);
+  fclose(fp);
+
+  return numBytes == outPixels.size();
+}
+
+// Read an entire file into outBytes. Returns false if the file could
+// not be read.
+
+static inline
+bool metalrice_read_file(const string & path,
+                         vector<uint8_t> & outBytes)
+{
+  FILE *fp = fopen(path.c_str(), "rb");
+
+  if (fp == NULL) {
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long numBytes = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if (numBytes < 0) {
+    fclose(fp);
+    return false;
+  }
+
+  outBytes.resize(numBytes);
+  size_t numRead = fread(outBytes.data(), 1, numBytes, fp);
+  fclose(fp);
+
+  return numRead == (size_t) numBytes;
+}
+
+#endif // _metalrice_core_hpp
@@ -0,0 +1,537 @@
+//
+//  metalrice_enc.cpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Batch encode images into Rice2 containers. Each input is a PGM file,
+//  a PNG file when built with libpng, a raw file of 8 bit gray or BGRA
+//  pixels with the dimensions given by --raw=WxH, or a directory of such
+//  files. Gray images are written as a container with 1 plane and color
+//  images as B G R or Y Co Cg planes with optional alpha. Images run
+//  through a pipeline of load, block delta, k table, rice encode and
+//  write stages connected by bounded queues, the per stage counters
+//  are printed at the end.
+//
+//  metalrice-enc [--out=DIR] [--raw=WxH] [--ycocg] [--alpha]
+//                [--predictor=left|gradient|med] [--decode-cost]
+//                [--queue=N] [--workers=N] [--verify] PATH...
+
+#include "metalrice_core.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#if defined(METALRICE_HAVE_PNG)
+#include <png.h>
+#endif // METALRICE_HAVE_PNG
+
+// Options shared by all stages
+
+class EncodeOptions
+{
+public:
+  string outDir;
+  int rawWidth;
+  int rawHeight;
+  bool ycocg;
+  bool includeAlpha;
+  BlockDeltaPredictor predictor;
+  Rice2KSearch kSearch;
+  bool verify;
+
+  EncodeOptions()
+  : rawWidth(0),
+  rawHeight(0),
+  ycocg(false),
+  includeAlpha(false),
+  predictor(BlockDeltaPredictorLeft),
+  kSearch(Rice2KSearchMinBits),
+  verify(false)
+  {
+  }
+};
+
+// One image as it moves through the stages. Each stage fills in the
+// state used by the next one and releases the state it consumed. Once
+// error is set the remaining stages skip the job.
+
+class EncodeJob
+{
+public:
+  string inPath;
+  string outPath;
+  string error;
+
+  int width;
+  int height;
+  int numPlanes;
+
+  // Planes of width x height bytes, one after another
+  vector<uint8_t> planeBytes;
+
+  vector<vector<uint8_t> > imageOrderDeltas;
+  vector<vector<uint8_t> > s32OrderSymbols;
+
+  Rice2PlanesContainer container;
+
+  EncodeJob()
+  : width(0),
+  height(0),
+  numPlanes(0)
+  {
+  }
+};
+
+static
+bool endsWith(const string & str, const string & suffix)
+{
+  if (str.size() < suffix.size()) {
+    return false;
+  }
+  string end = str.substr(str.size() - suffix.size());
+  transform(end.begin(), end.end(), end.begin(), ::tolower);
+  return end == suffix;
+}
+
+static
+bool isImagePath(const string & path)
+{
+  return endsWith(path, ".pgm") || endsWith(path, ".raw") || endsWith(path, ".png");
+}
+
+// Gray pixels are one plane, BGRA pixels are split into 3 or 4 planes
+
+static
+void setGrayPixels(EncodeJob & job, vector<uint8_t> && pixels)
+{
+  job.numPlanes = 1;
+  job.planeBytes = std::move(pixels);
+}
+
+static
+void setBGRAPixels(EncodeJob & job, const uint32_t * pixels, const EncodeOptions & options)
+{
+  const int numPixels = job.width * job.height;
+
+  job.planeBytes.resize(numPixels * 4);
+  rice2_bgra_split_planes(pixels, numPixels, options.ycocg, job.planeBytes.data());
+
+  job.numPlanes = options.includeAlpha ? 4 : 3;
+  job.planeBytes.resize(numPixels * job.numPlanes);
+}
+
+#if defined(METALRICE_HAVE_PNG)
+
+static
+bool readPNG(EncodeJob & job, const EncodeOptions & options)
+{
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+
+  if (!png_image_begin_read_from_file(&image, job.inPath.c_str())) {
+    return false;
+  }
+
+  const bool gray = (image.format & PNG_FORMAT_FLAG_COLOR) == 0 && (image.format & PNG_FORMAT_FLAG_ALPHA) == 0;
+
+  image.format = gray ? PNG_FORMAT_GRAY : PNG_FORMAT_BGRA;
+
+  job.width = image.width;
+  job.height = image.height;
+
+  vector<uint8_t> pixels(PNG_IMAGE_SIZE(image));
+
+  if (!png_image_finish_read(&image, NULL, pixels.data(), 0, NULL)) {
+    png_image_free(&image);
+    return false;
+  }
+
+  if (gray) {
+    setGrayPixels(job, std::move(pixels));
+  } else {
+    setBGRAPixels(job, (const uint32_t *) pixels.data(), options);
+  }
+
+  return true;
+}
+
+#endif // METALRICE_HAVE_PNG
+
+// Stage 1: read the file and split the pixels into planes
+
+static
+size_t loadStage(EncodeJob & job, const EncodeOptions & options)
+{
+  if (endsWith(job.inPath, ".pgm")) {
+    vector<uint8_t> pixels;
+    if (!metalrice_read_pgm(job.inPath, pixels, job.width, job.height)) {
+      job.error = "could not read PGM";
+      return 0;
+    }
+    setGrayPixels(job, std::move(pixels));
+  } else if (endsWith(job.inPath, ".png")) {
+#if defined(METALRICE_HAVE_PNG)
+    if (!readPNG(job, options)) {
+      job.error = "could not read PNG";
+      return 0;
+    }
+#else
+    job.error = "built without PNG support";
+    return 0;
+#endif // METALRICE_HAVE_PNG
+  } else {
+    vector<uint8_t> bytes;
+    const size_t numPixels = (size_t) options.rawWidth * options.rawHeight;
+
+    if (numPixels == 0) {
+      job.error = "raw input needs --raw=WxH";
+      return 0;
+    }
+    if (!metalrice_read_file(job.inPath, bytes) || (bytes.size() != numPixels && bytes.size() != numPixels * 4)) {
+      job.error = "raw size does not match --raw=WxH";
+      return 0;
+    }
+
+    job.width = options.rawWidth;
+    job.height = options.rawHeight;
+
+    if (bytes.size() == numPixels) {
+      setGrayPixels(job, std::move(bytes));
+    } else {
+      setBGRAPixels(job, (const uint32_t *) bytes.data(), options);
+    }
+  }
+
+  return job.planeBytes.size();
+}
+
+// Stage 2: 32x32 block deltas in padded image order
+
+static
+size_t blockDeltaStage(EncodeJob & job, const EncodeOptions & options)
+{
+  if (!job.error.empty()) {
+    return 0;
+  }
+
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+  const int numPixels = job.width * job.height;
+
+  job.imageOrderDeltas.resize(job.numPlanes);
+
+  for (int planei = 0; planei < job.numPlanes; planei++) {
+    rice2_image_order_deltas(job.planeBytes.data() + (planei * numPixels), job.width, job.height,
+                             (job.width + bigBlockDim - 1) / bigBlockDim,
+                             (job.height + bigBlockDim - 1) / bigBlockDim,
+                             job.imageOrderDeltas[planei],
+                             options.predictor);
+  }
+
+  return job.planeBytes.size();
+}
+
+// Stage 3: s32 layout and the k table of each plane
+
+static
+size_t kTableStage(EncodeJob & job, const EncodeOptions & options)
+{
+  if (!job.error.empty()) {
+    return 0;
+  }
+
+  size_t numBytes = 0;
+
+  job.container.width = job.width;
+  job.container.height = job.height;
+  job.container.ycocg = options.ycocg && job.numPlanes > 1;
+  job.container.planes.resize(job.numPlanes);
+  job.s32OrderSymbols.resize(job.numPlanes);
+
+  for (int planei = 0; planei < job.numPlanes; planei++) {
+    numBytes += job.imageOrderDeltas[planei].size();
+    rice2_plane_k_table(job.imageOrderDeltas[planei], job.width, job.height,
+                        job.container.planes[planei], job.s32OrderSymbols[planei],
+                        options.kSearch);
+    vector<uint8_t>().swap(job.imageOrderDeltas[planei]);
+  }
+
+  return numBytes;
+}
+
+// Stage 4: rice encode each plane and generate the half block offsets
+
+static
+size_t encodeStage(EncodeJob & job, const EncodeOptions & options)
+{
+  if (!job.error.empty()) {
+    return 0;
+  }
+
+  size_t numBytes = 0;
+
+  for (int planei = 0; planei < job.numPlanes; planei++) {
+    Rice2EncodedPlane & plane = job.container.planes[planei];
+    numBytes += job.s32OrderSymbols[planei].size();
+    rice2_encode_plane_bits(job.s32OrderSymbols[planei], plane);
+    plane.predictor = options.predictor;
+    vector<uint8_t>().swap(job.s32OrderSymbols[planei]);
+  }
+
+  return numBytes;
+}
+
+// Stage 5: serialize the container and write it, optionally decoding
+// each plane to verify the round trip first.
+
+static
+size_t writeStage(EncodeJob & job, const EncodeOptions & options)
+{
+  if (!job.error.empty()) {
+    return 0;
+  }
+
+  if (options.verify) {
+    const int numPixels = job.width * job.height;
+    vector<uint8_t> decoded(numPixels);
+
+    for (int planei = 0; planei < job.numPlanes; planei++) {
+      rice2_decode_plane(job.container.planes[planei], decoded.data());
+      if (memcmp(decoded.data(), job.planeBytes.data() + (planei * numPixels), numPixels) != 0) {
+        job.error = "verify failed";
+        return 0;
+      }
+    }
+  }
+
+  vector<uint8_t> bytes = job.container.encode();
+
+  FILE *fp = fopen(job.outPath.c_str(), "wb");
+
+  if (fp == NULL) {
+    job.error = "could not write " + job.outPath;
+    return 0;
+  }
+
+  size_t numWritten = fwrite(bytes.data(), 1, bytes.size(), fp);
+  fclose(fp);
+
+  if (numWritten != bytes.size()) {
+    job.error = "could not write " + job.outPath;
+    return 0;
+  }
+
+  return bytes.size();
+}
+
+// Expand directories into the image files they contain, sorted by name
+
+static
+bool collectInputs(const string & path, vector<string> & outPaths)
+{
+  struct stat st;
+
+  if (stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    outPaths.push_back(path);
+    return true;
+  }
+
+  DIR *dir = opendir(path.c_str());
+
+  if (dir == NULL) {
+    return false;
+  }
+
+  vector<string> names;
+
+  while (struct dirent *entry = readdir(dir)) {
+    string name = entry->d_name;
+    if (isImagePath(name)) {
+      names.push_back(name);
+    }
+  }
+
+  closedir(dir);
+
+  sort(names.begin(), names.end());
+
+  for ( const string & name : names ) {
+    outPaths.push_back(path + "/" + name);
+  }
+
+  return true;
+}
+
+static
+string outputPath(const string & inPath, const string & outDir)
+{
+  string base = inPath;
+  size_t dot = base.find_last_of('.');
+  if (dot != string::npos && base.find('/', dot) == string::npos) {
+    base = base.substr(0, dot);
+  }
+
+  if (!outDir.empty()) {
+    size_t slash = base.find_last_of('/');
+    if (slash != string::npos) {
+      base = base.substr(slash + 1);
+    }
+    base = outDir + "/" + base;
+  }
+
+  return base + ".r2pl";
+}
+
+static
+void usage()
+{
+  fprintf(stderr, "usage: metalrice-enc [--out=DIR] [--raw=WxH] [--ycocg] [--alpha]\n"
+                  "                     [--predictor=left|gradient|med] [--decode-cost]\n"
+                  "                     [--queue=N] [--workers=N] [--verify] PATH...\n");
+}
+
+int main(int argc, const char **argv)
+{
+  EncodeOptions options;
+  int queueCapacity = 2;
+  int numWorkers = 1;
+  vector<string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg.rfind("--out=", 0) == 0) {
+      options.outDir = arg.substr(6);
+    } else if (arg.rfind("--raw=", 0) == 0) {
+      if (sscanf(arg.c_str() + 6, "%dx%d", &options.rawWidth, &options.rawHeight) != 2) {
+        usage();
+        return 1;
+      }
+    } else if (arg == "--ycocg") {
+      options.ycocg = true;
+    } else if (arg == "--alpha") {
+      options.includeAlpha = true;
+    } else if (arg == "--predictor=left") {
+      options.predictor = BlockDeltaPredictorLeft;
+    } else if (arg == "--predictor=gradient") {
+      options.predictor = BlockDeltaPredictorGradient;
+    } else if (arg == "--predictor=med") {
+      options.predictor = BlockDeltaPredictorMED;
+    } else if (arg == "--decode-cost") {
+      options.kSearch = Rice2KSearchDecodeCost;
+    } else if (arg.rfind("--queue=", 0) == 0) {
+      queueCapacity = atoi(arg.c_str() + 8);
+    } else if (arg.rfind("--workers=", 0) == 0) {
+      numWorkers = atoi(arg.c_str() + 10);
+    } else if (arg == "--verify") {
+      options.verify = true;
+    } else if (arg.rfind("--", 0) == 0) {
+      usage();
+      return 1;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+
+  if (inputs.empty() || queueCapacity < 1 || numWorkers < 1) {
+    usage();
+    return 1;
+  }
+
+  vector<string> paths;
+
+  for ( const string & input : inputs ) {
+    if (!collectInputs(input, paths)) {
+      fprintf(stderr, "could not read %s\n", input.c_str());
+      return 1;
+    }
+  }
+
+  if (!options.outDir.empty()) {
+    mkdir(options.outDir.c_str(), 0755);
+  }
+
+  // Jobs are kept so that errors can be reported in input order
+
+  vector<shared_ptr<EncodeJob> > jobs;
+
+  for ( const string & path : paths ) {
+    shared_ptr<EncodeJob> job = make_shared<EncodeJob>();
+    job->inPath = path;
+    job->outPath = outputPath(path, options.outDir);
+    jobs.push_back(job);
+  }
+
+  // Load and write are I/O bound and keep one worker, the compute
+  // stages run numWorkers each.
+
+  RicePipeline<shared_ptr<EncodeJob> > pipeline(queueCapacity);
+
+  pipeline.addStage("load", [&](shared_ptr<EncodeJob> & job) {
+    return loadStage(*job, options);
+  });
+  pipeline.addStage("block delta", [&](shared_ptr<EncodeJob> & job) {
+    return blockDeltaStage(*job, options);
+  }, numWorkers);
+  pipeline.addStage("k table", [&](shared_ptr<EncodeJob> & job) {
+    return kTableStage(*job, options);
+  }, numWorkers);
+  pipeline.addStage("rice encode", [&](shared_ptr<EncodeJob> & job) {
+    return encodeStage(*job, options);
+  }, numWorkers);
+  pipeline.addStage("write", [&](shared_ptr<EncodeJob> & job) {
+    size_t numBytes = writeStage(*job, options);
+    // Release the pixels as soon as the container is written
+    job->planeBytes = vector<uint8_t>();
+    job->container = Rice2PlanesContainer();
+    return numBytes;
+  });
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  pipeline.run((int) jobs.size(), [&](int i) {
+    return jobs[i];
+  });
+
+  const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  int numFailed = 0;
+
+  for ( const shared_ptr<EncodeJob> & job : jobs ) {
+    if (!job->error.empty()) {
+      fprintf(stderr, "%s: %s\n", job->inPath.c_str(), job->error.c_str());
+      numFailed += 1;
+    }
+  }
+
+  printf("%-12s %7s %7s %10s %9s %9s %9s %9s\n",
+         "stage", "workers", "items", "MB", "busy s", "MB/s", "wait in", "wait out");
+
+  for ( const RicePipelineCounters & counters : pipeline.counters() ) {
+    printf("%-12s %7d %7llu %10.2f %9.3f %9.1f %9.3f %9.3f\n",
+           counters.name.c_str(),
+           counters.numWorkers,
+           (unsigned long long) counters.numItems,
+           counters.numBytes / 1e6,
+           counters.busySeconds,
+           counters.bytesPerSecond() / 1e6,
+           counters.waitInSeconds,
+           counters.waitOutSeconds);
+  }
+
+  printf("%d images in %.3f s, %.1f images/s, %d failed\n",
+         (int) jobs.size(), seconds, (seconds == 0.0) ? 0.0 : jobs.size() / seconds, numFailed);
+
+  return (numFailed == 0) ? 0 : 1;
+}
@@ -89,6 +89,12 @@ const static unsigned int blockDim = RICE_SMALL_BLOCK_DIM;
   
   int renderBlockWidth;
   int renderBlockHeight;
+  
+  // Set when the rice buffers were loaded from a prebuilt asset
+  BOOL _loadedRiceAsset;
+  
+  CFTimeInterval _launchTime;
+  BOOL _firstFrameLogged;
 }
 
 + (NSString*) getResourcePath:(NSString*)resFilename
@@ -327,17 +333,7 @@ blockOptimalKTableData:blockOptimalKTableData
   uint8_t *encodedRiceBytesPtr = _encodedRice2Bits.mutableBytes;
   int encodedRiceBytesNumBytes = (int) _encodedRice2Bits.length;
   
-  // Allocate a buffer large enough to contain the suffix bit buffer as bytes for each frame
-  
-  for (int i = 0; i < MetalRenderContextMaxBuffersInFlight; i++) {
-    CombinedMetalRiceRenderFrame *combinedRenderFrame = self.combinedFrames[i];
-    
-    assert(self.metalRiceRenderContext);
-    
-    [self.metalRiceRenderContext ensureBitsBuffCapacity:self.metalRenderContext
-                                               numBytes:encodedRiceBytesNumBytes
-                                            renderFrame:combinedRenderFrame.metalRiceRenderFrame];
-  }
+  [self setupRiceBitsBuffers];
     
   if ((0)) {
     // Encoded rice symbols as hex?
@@ -356,6 +352,23 @@ blockOptimalKTableData:blockOptimalKTableData
   return;
 }
 
+// Allocate a buffer large enough to contain the suffix bit buffer as bytes for each frame
+
+- (void) setupRiceBitsBuffers
+{
+  int encodedRiceBytesNumBytes = (int) _encodedRice2Bits.length;
+  
+  for (int i = 0; i < MetalRenderContextMaxBuffersInFlight; i++) {
+    CombinedMetalRiceRenderFrame *combinedRenderFrame = self.combinedFrames[i];
+    
+    assert(self.metalRiceRenderContext);
+    
+    [self.metalRiceRenderContext ensureBitsBuffCapacity:self.metalRenderContext
+                                               numBytes:encodedRiceBytesNumBytes
+                                            renderFrame:combinedRenderFrame.metalRiceRenderFrame];
+  }
+}
+
 // Initialize with the MetalKit view from which we'll obtain our metal device
 
 - (nonnull instancetype)initWithMetalKitView:(nonnull MTKView *)mtkView
@@ -363,6 +376,8 @@ blockOptimalKTableData:blockOptimalKTableData
     self = [super init];
     if(self)
     {
+      _launchTime = CACurrentMediaTime();
+      
       isCaptureRenderedTextureEnabled = 0;
       
       mtkView.depthStencilPixelFormat = MTLPixelFormatInvalid;
@@ -432,7 +447,62 @@ blockOptimalKTableData:blockOptimalKTableData
       hcfg = TEST_IMAGE4;  // 3145728 -> 1687605
       //hcfg = TEST_IMAGE_LENNA_B;   // 262144 -> 178570
       
-      InputImageRenderFrame *renderFrame = [InputImageRenderFrame renderFrameForConfig:hcfg];
+      // Load a prebuilt asset when one was added to the bundle, this skips
+      // the PNG decode and the encode steps in setupRiceEncoding. Generate
+      // an asset with metalrice-enc from the grayscale PNG.
+      
+      InputImageRenderFrame *renderFrame = nil;
+      
+      int assetNumBigBlocksInWidth = 0;
+      int assetNumBigBlocksInHeight = 0;
+      
+      {
+        NSString *assetPath = [InputImageRenderFrame assetPathForConfig:hcfg];
+        NSData *assetData = (assetPath == nil) ? nil : [NSData dataWithContentsOfFile:assetPath];
+        
+        int assetWidth = 0;
+        int assetHeight = 0;
+        
+        _encodedRice2Bits = [NSMutableData data];
+        _blockOptimalKTable = [NSMutableData data];
+        _halfBlockOffsetTableData = [NSMutableData data];
+        
+        _loadedRiceAsset = (assetData != nil) &&
+        [Rice loadRice2Asset:assetData
+                       width:&assetWidth
+                      height:&assetHeight
+         numBigBlocksInWidth:&assetNumBigBlocksInWidth
+        numBigBlocksInHeight:&assetNumBigBlocksInHeight
+           riceEncodedStream:_encodedRice2Bits
+          blockOptimalKTable:_blockOptimalKTable
+        halfBlockOffsetTable:_halfBlockOffsetTableData];
+        
+        // An asset that does not match the PNG of this config was built
+        // from another image, the image is then loaded and encoded. The
+        // PNG dimensions are read without decoding the pixels.
+        
+        int imageWidth = 0;
+        int imageHeight = 0;
+        
+        if (_loadedRiceAsset &&
+            (![InputImageRenderFrame imageSizeForConfig:hcfg width:&imageWidth height:&imageHeight] ||
+             imageWidth != assetWidth || imageHeight != assetHeight)) {
+          NSLog(@"asset %d x %d does not match image %d x %d, encoding instead", assetWidth, assetHeight, imageWidth, imageHeight);
+          _loadedRiceAsset = FALSE;
+          _encodedRice2Bits = [NSMutableData data];
+          _blockOptimalKTable = [NSMutableData data];
+          _halfBlockOffsetTableData = [NSMutableData data];
+        }
+        
+        if (_loadedRiceAsset && !isCaptureRenderedTextureEnabled) {
+          renderFrame = [[InputImageRenderFrame alloc] init];
+          renderFrame.renderWidth = assetWidth;
+          renderFrame.renderHeight = assetHeight;
+        } else {
+          // The capture compare and the encode on launch need the pixels
+          renderFrame = [InputImageRenderFrame renderFrameForConfig:hcfg];
+        }
+      }
       
       self.inputImageRenderFrame = renderFrame;
       
@@ -479,6 +549,12 @@ blockOptimalKTableData:blockOptimalKTableData
       
       // In the case where a 4x stream
       
+      if (_loadedRiceAsset) {
+        // An asset is always encoded as whole 32x32 big blocks
+        blockWidth = assetNumBigBlocksInWidth * minNumBlocksInBigBlockDim;
+        blockHeight = assetNumBigBlocksInHeight * minNumBlocksInBigBlockDim;
+      }
+      
       renderFrame.renderBlockWidth = blockWidth;
       renderFrame.renderBlockHeight = blockHeight;
       
@@ -552,7 +628,11 @@ blockOptimalKTableData:blockOptimalKTableData
       
       _imageInputBytes = renderFrame.inputData;
       
-      [self setupRiceEncoding];
+      if (_loadedRiceAsset) {
+        [self setupRiceBitsBuffers];
+      } else {
+        [self setupRiceEncoding];
+      }
       
     } // end of init if block
   
@@ -671,6 +751,13 @@ blockOptimalKTableData:blockOptimalKTableData
   id <MTLCommandBuffer> commandBuffer = [self.metalRenderContext.commandQueue commandBuffer];
   commandBuffer.label = @"RenderBGRACommand";
   
+  // Log the time from init until the GPU completes the first frame
+  
+  const BOOL logFirstFrame = !_firstFrameLogged;
+  const CFTimeInterval launchTime = _launchTime;
+  const BOOL loadedRiceAsset = _loadedRiceAsset;
+  _firstFrameLogged = TRUE;
+  
   // Release semaphore
   
   __block dispatch_semaphore_t block_sema = inFlightSemaphore;
@@ -678,6 +765,11 @@ blockOptimalKTableData:blockOptimalKTableData
   [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> buffer){
     dispatch_semaphore_signal(block_sema);
     
+    if (logFirstFrame) {
+      CFTimeInterval elapsed = (CACurrentMediaTime() - launchTime) * 1000;
+      printf("time to first frame ms %.2f : %s\n", elapsed, loadedRiceAsset ? "prebuilt asset" : "encode on launch");
+    }
+    
 //#if defined(DEBUG)
     if (debugDisplayFrameNumber) {
       CFTimeInterval debugDisplayFrameEndTime;
@@ -7,7 +7,12 @@ Header containing types and enum constants shared between Metal shaders and C/Ob
 #ifndef ShaderTypes_h
 #define ShaderTypes_h
 
+#if defined(__APPLE__) || defined(__METAL_VERSION__)
 #include <simd/simd.h>
+#else
+// Non Apple builds only need the vertex position type
+typedef struct { float x, y; } vector_float2;
+#endif
 
 // Buffer index values shared between shader and C code to ensure Metal shader buffer inputs match
 //   Metal API buffer set calls
@@ -116,6 +121,9 @@ typedef struct
   uint16_t numBlocksInHeight;
 } RicePrefixRenderUniform;
 
+// Dimensions are 16 bit, images larger than 65535 pixels on a side
+// are encoded as segments of ordinary planes, see Rice2Large.hpp.
+
 typedef struct
 {
   uint16_t numBlocksInWidth;
@@ -129,6 +137,11 @@ typedef struct
 #define RICE_LARGE_BLOCK_DIM 32
 #define RICE_SMALL_BLOCK_DIM 8
 
+// Reserved k table value for an 8x8 block where every symbol is zero,
+// no bits are stored for either half block.
+
+#define RICE2_SKIP_BLOCK_K 0xF
+
 // On both an A7 and A10 device, a primary table of 8 bits
 // and a secondary table that is 8 bits seems to result
 // in the best performance. T1 table sizes of 7,9,10,11
@@ -11,6 +11,7 @@
 #include <cstdint>
 
 #import "EncDec.hpp"
+#import "zigzag.h"
 
 using namespace std;
 
@@ -37,62 +38,6 @@ string get_code_bits_as_string(uint32_t code, const int width)
     return bitsStr;
 }
 
-// zerod representation
-
-// 0 = 0, -1 = 1, 1 = 2, -2 = 3, 2 = 4, -3 = 5, 3 = 6
-
-uint32_t
-pixelpack_num_neg_to_offset(int32_t value) {
-    if (value == 0) {
-        return value;
-    } else if (value < 0) {
-        return (value * -2) - 1;
-    } else {
-        return value * 2;
-    }
-}
-
-int32_t
-pixelpack_offset_to_num_neg(uint32_t value) {
-    if (value == 0) {
-        return value;
-    } else if ((value & 0x1) != 0) {
-        // odd numbers are negative values
-        return ((int)value + 1) / -2;
-    } else {
-        return value / 2;
-    }
-}
-
-int8_t
-pixelpack_offset_uint8_to_int8(uint8_t value)
-{
-    int offset = (int) value;
-    int iVal = pixelpack_offset_to_num_neg(offset);
-    assert(iVal >= -128);
-    assert(iVal <= 127);
-    int8_t sVal = (int8_t) iVal;
-    return sVal;
-}
-
-uint8_t
-pixelpack_int8_to_offset_uint8(int8_t value)
-{
-    int iVal = (int) value;
-    int offset = pixelpack_num_neg_to_offset(iVal);
-    assert(offset >= 0);
-    assert(offset <= 255);
-    uint8_t offset8 = offset;
-#if defined(DEBUG)
-    {
-        // Validate reverse operation, it must regenerate value
-        int8_t decoded = pixelpack_offset_uint8_to_int8(offset8);
-        assert(decoded == value);
-    }
-#endif // DEBUG
-    return offset8;
-}
-
 // Main class performing the rendering
 
 @implementation DeltaEncoder
@@ -103,25 +48,16 @@ pixelpack_int8_to_offset_uint8(int8_t value)
 
 + (NSData*) encodeByteDeltas:(NSData*)data
 {
-  vector<int8_t> inBytes;
-  inBytes.resize(data.length);
-  memcpy(inBytes.data(), data.bytes, data.length);
+  NSMutableData *outDeltaBytes = [NSMutableData dataWithLength:data.length];
   
-  vector<int8_t> outSignedDeltaBytes = encodeDelta(inBytes);
-    
-  NSMutableData *outZerodDeltaBytes = [NSMutableData data];
-  [outZerodDeltaBytes setLength:outSignedDeltaBytes.size()];
-  uint8_t *outZerodDeltaPtr = (uint8_t *) outZerodDeltaBytes.mutableBytes;
-    
-  // Convert signed delta to zerod (unsigned) deltas
-  const int maxNumBytes = (int) outSignedDeltaBytes.size();
-
-  for (int i = 0; i < maxNumBytes; i++) {
-      int8_t sVal = outSignedDeltaBytes[i];
-      *outZerodDeltaPtr++ = sVal;
-  }
-
-  return [NSData dataWithData:outZerodDeltaBytes];
+  // Single pass signed deltas directly into the output buffer
+  
+  byte_deltas_encode((const uint8_t *) data.bytes,
+                     (uint8_t *) outDeltaBytes.mutableBytes,
+                     (int) data.length,
+                     0);
+  
+  return outDeltaBytes;
 }
 
 // Decode symbols by reversing zigzag mapping and then applying
@@ -137,9 +137,9 @@ void
 decode(const vector<uint8_t> &buf, int & offset, uint64_t & iVal)
 {
   iVal = buf[offset++];
-  iVal |= (buf[offset++] << 8);
-  iVal |= (buf[offset++] << 16);
-  iVal |= (buf[offset++] << 24);
+  iVal |= (((uint64_t) buf[offset++]) << 8);
+  iVal |= (((uint64_t) buf[offset++]) << 16);
+  iVal |= (((uint64_t) buf[offset++]) << 24);
   iVal |= (((uint64_t) buf[offset++]) << 32);
   iVal |= (((uint64_t) buf[offset++]) << 40);
   iVal |= (((uint64_t) buf[offset++]) << 48);
@@ -188,19 +188,36 @@ decodeN(const vector<uint8_t> &buf, int & offset, vector<T> &vec)
 {
   uint32_t N;
   
-  vec.clear();
-  
   decode(buf, offset, N);
   
+  vec.resize(N);
+  
   for ( int i = 0; i < N; i++ ) {
-    T val;
-    decode(buf, offset, val);
-    vec.push_back(val);
+    decode(buf, offset, vec[i]);
   }
   
   return;
 }
 
+// Decode a 32 bit N and then N bytes, the bytes are copied in one step
+// since large buffers like rice encoded bits are stored this way.
+
+static inline
+void
+decodeN(const vector<uint8_t> &buf, int & offset, vector<uint8_t> &vec)
+{
+  uint32_t N;
+  
+  decode(buf, offset, N);
+  
+  assert((offset + (size_t)N) <= buf.size());
+  
+  vec.assign(buf.begin() + offset, buf.begin() + offset + N);
+  offset += N;
+  
+  return;
+}
+
 // Encode pairs of nibbles (4bits) stored as uint8_t values in a vector
 
 template <typename T>
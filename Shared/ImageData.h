@@ -66,6 +66,11 @@
 
 @property (nonatomic, assign) BOOL useComponentAdlers;
 
+// When TRUE the bgraH64w0 and bgraH64w1 fields are set to a 64 bit
+// hash of the BGRA pixels. This property defaults to FALSE.
+
+@property (nonatomic, assign) BOOL useBgraH64;
+
 + (ImageData*) imageData;
 
 // Scan should be invoked when encoding and only the input pixels
@@ -17,19 +17,9 @@
 
 //#import "xxhash.h"
 
-// adler32
+#import "checksum.h"
 
-// largest prime smaller than 65536
-#define BASE 65521L
-
-// NMAX is the largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1
-#define NMAX 5552
-
-#define DO1(buf, i)  { s1 += buf[i]; s2 += s1; }
-#define DO2(buf, i)  DO1(buf, i); DO1(buf, i + 1);
-#define DO4(buf, i)  DO2(buf, i); DO2(buf, i + 2);
-#define DO8(buf, i)  DO4(buf, i); DO4(buf, i + 4);
-#define DO16(buf)    DO8(buf, 0); DO8(buf, 8);
+// adler32, the SIMD update in checksum.h replaces the DO16 loop
 
 uint32_t my_adler32(
                     uint32_t adler,
@@ -37,38 +27,17 @@ uint32_t my_adler32(
                     uint32_t len,
                     uint32_t singleCallMode)
 {
-	int k;
-	uint32_t s1 = adler & 0xffff;
-	uint32_t s2 = (adler >> 16) & 0xffff;
-  
-	if (!buf)
-		return 1;
-  
-	while (len > 0) {
-		k = len < NMAX ? len :NMAX;
-		len -= k;
-		while (k >= 16) {
-			DO16(buf);
-			buf += 16;
-			k -= 16;
-		}
-		if (k != 0)
-			do {
-				s1 += *buf++;
-				s2 += s1;
-			} while (--k);
-		s1 %= BASE;
-		s2 %= BASE;
-	}
+  if (!buf)
+    return 1;
   
-  uint32_t result = (s2 << 16) | s1;
+  uint32_t result = adler32_update(adler, buf, len);
   
   if (singleCallMode && (result == 0)) {
     // All zero input, use 0xFFFFFFFF instead
     result = 0xFFFFFFFF;
   }
   
-	return result;
+  return result;
 }
 
 static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
@@ -99,6 +68,18 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
     self.bgraAdler = bgraAdler;
 }
 
+// Optional 64 bit hash of the final BGRA pixels, split into two words.
+
+- (void) calculateBgraH64
+{
+  CGFrameBuffer *frameBuffer = self.frameBuffer;
+  
+  uint64_t h64 = hash64((const uint8_t*)frameBuffer.pixels, (size_t)frameBuffer.numBytes, 0);
+  
+  self.bgraH64w0 = (uint32_t) h64;
+  self.bgraH64w1 = (uint32_t) (h64 >> 32);
+}
+
 #if !defined(CLIENT_ONLY_IMPL)
 
 - (void) calculateComponentAdlers
@@ -131,6 +112,10 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
   
   [self calculateBgraAdler];
   
+  if (self.useBgraH64) {
+    [self calculateBgraH64];
+  }
+  
   if (self.useComponentAdlers) {
     [self calculateComponentAdlers];
   }
@@ -155,6 +140,10 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
   if (self.frameBuffer != nil) {
     [self calculateBgraAdler];
     
+    if (self.useBgraH64) {
+      [self calculateBgraH64];
+    }
+    
 #if !defined(CLIENT_ONLY_IMPL)
     
     if (self.useComponentAdlers) {
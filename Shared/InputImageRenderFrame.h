@@ -44,4 +44,18 @@ typedef enum {
 
 + (InputImageRenderFrame*) renderFrameForConfig:(InputImageRenderFrameConfig)config;
 
+// Path of a prebuilt .r2pl asset for an image config, this is the PNG
+// name with a .r2pl extension. Returns nil when the config is not an
+// image or no asset was added to the bundle.
+
++ (NSString*) assetPathForConfig:(InputImageRenderFrameConfig)config;
+
+// Dimensions of the PNG for an image config, read from the image
+// properties without decoding the pixels. Returns NO when the config
+// is not an image or the PNG can not be read.
+
++ (BOOL) imageSizeForConfig:(InputImageRenderFrameConfig)config
+                      width:(int*)outWidth
+                     height:(int*)outHeight;
+
 @end
@@ -699,4 +699,102 @@ appendXYCoordPixelsAsData(NSMutableArray * mArr, NSArray * values)
   return renderFrame;
 }
 
++ (NSString*) assetPathForConfig:(InputImageRenderFrameConfig)config
+{
+  NSString *resFilename = nil;
+  
+  switch (config) {
+    case TEST_IMAGE1: {
+      resFilename = @"Image.r2pl";
+      break;
+    }
+    case TEST_IMAGE2: {
+      resFilename = @"ImageHuge.r2pl";
+      break;
+    }
+    case TEST_IMAGE3: {
+      resFilename = @"ImageIpadSize.r2pl";
+      break;
+    }
+    case TEST_IMAGE4: {
+      resFilename = @"BigBridge.r2pl";
+      break;
+    }
+    case TEST_IMAGE_LENNA_B: {
+      resFilename = @"Lenna_B.r2pl";
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  
+  if (resFilename == nil) {
+    return nil;
+  }
+  
+  return [[NSBundle mainBundle] pathForResource:resFilename ofType:nil];
+}
+
++ (BOOL) imageSizeForConfig:(InputImageRenderFrameConfig)config
+                      width:(int*)outWidth
+                     height:(int*)outHeight
+{
+  NSString *resFilename = nil;
+  
+  switch (config) {
+    case TEST_IMAGE1: {
+      resFilename = @"Image.png";
+      break;
+    }
+    case TEST_IMAGE2: {
+      resFilename = @"ImageHuge.png";
+      break;
+    }
+    case TEST_IMAGE3: {
+      resFilename = @"ImageIpadSize.png";
+      break;
+    }
+    case TEST_IMAGE4: {
+      resFilename = @"BigBridge.png";
+      break;
+    }
+    case TEST_IMAGE_LENNA_B: {
+      resFilename = @"Lenna_B.png";
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  
+  NSString *path = (resFilename == nil) ? nil : [[NSBundle mainBundle] pathForResource:resFilename ofType:nil];
+  
+  if (path == nil) {
+    return NO;
+  }
+  
+  CGImageSourceRef sourceRef = CGImageSourceCreateWithURL((__bridge CFURLRef)[NSURL fileURLWithPath:path], NULL);
+  
+  if (sourceRef == NULL) {
+    return NO;
+  }
+  
+  NSDictionary *properties = (__bridge_transfer NSDictionary*) CGImageSourceCopyPropertiesAtIndex(sourceRef, 0, NULL);
+  
+  CFRelease(sourceRef);
+  
+  NSNumber *width = properties[(__bridge NSString*)kCGImagePropertyPixelWidth];
+  NSNumber *height = properties[(__bridge NSString*)kCGImagePropertyPixelHeight];
+  
+  if (width == nil || height == nil) {
+    return NO;
+  }
+  
+  *outWidth = [width intValue];
+  *outHeight = [height intValue];
+  
+  return YES;
+}
+
 @end
@@ -0,0 +1,61 @@
+//
+//  MetalRice2FrameRing.h
+//
+//  Copyright 2018 Mo DeJong.
+//
+//  See LICENSE for terms.
+//
+//  Fixed ring of render frames used to render a sequence of compressed
+//  frames. A reader thread reads the next frame file into the bits, k
+//  table and offset buffers of a free render frame while the GPU renders
+//  the current one. Every buffer is allocated when the ring is created,
+//  a frame goes back to the ring once its command buffer has completed.
+
+//@import MetalKit;
+#include <MetalKit/MetalKit.h>
+
+@class MetalRenderContext;
+@class MetalRice2RenderContext;
+@class MetalRice2RenderFrame;
+
+@interface MetalRice2FrameRing : NSObject
+
+// Render frames in the ring, one for each frame in flight
+
+@property (nonatomic, readonly) NSArray<MetalRice2RenderFrame*> *renderFrames;
+
+// Allocate numFrames render frames for frames of renderSize pixels, the
+// bits buffer of each frame holds maxNumBitsBytes plus padding. A frame
+// that does not have these dimensions, has more bits than this or is
+// rejected by rice2_asset_load_gray() fails to read.
+
+- (instancetype) initWithRenderContext:(MetalRice2RenderContext*)renderContext
+                                   mrc:(MetalRenderContext*)mrc
+                             numFrames:(int)numFrames
+                            renderSize:(CGSize)renderSize
+                             blockSize:(CGSize)blockSize
+                       maxNumBitsBytes:(int)maxNumBitsBytes;
+
+// Start reading frames [0, numFrames) on a background thread, pathBlock
+// returns the path of the single plane container for a frame index.
+
+- (void) startReading:(int)numFrames
+         pathForFrame:(NSString* (^)(int frameIndex))pathBlock;
+
+// Wait until the next frame has been read, returns nil after the last
+// frame. ok is set to NO when the frame could not be read, the frame
+// must still be handed back with releaseFrame.
+
+- (MetalRice2RenderFrame*) nextFrame:(int*)frameIndex
+                                  ok:(BOOL*)ok;
+
+// Hand a frame back to the ring once the GPU is done with it, this can
+// be invoked from a command buffer completed handler.
+
+- (void) releaseFrame:(MetalRice2RenderFrame*)renderFrame;
+
+// Stop reading and wait for the reader thread to exit
+
+- (void) stop;
+
+@end
@@ -0,0 +1,250 @@
+//
+//  MetalRice2FrameRing.mm
+//
+//  Copyright 2018 Mo DeJong.
+//
+//  See LICENSE for terms.
+//
+//  Fixed ring of render frames used to render a sequence of compressed
+//  frames, see MetalRice2FrameRing.h
+
+#import "MetalRice2FrameRing.h"
+
+#import "MetalRenderContext.h"
+
+#import "MetalRice2RenderContext.h"
+#import "MetalRice2RenderFrame.h"
+
+#import "AAPLShaderTypes.h"
+
+#include <assert.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define EMIT_CACHEDBITS_DEBUG_OUTPUT
+#import "CachedBits.hpp"
+#define EMIT_RICEDECODEBLOCKS_DEBUG_OUTPUT
+#define RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
+#import "RiceDecodeBlocks.hpp"
+
+#import "RiceDecodeBlocksImpl.hpp"
+
+#import "RiceFrameRing.hpp"
+
+using namespace std;
+
+@interface MetalRice2FrameRing ()
+{
+  // Parsed frame for each render frame, the buffers keep their capacity
+  vector<Rice2FrameSlot> slots;
+
+  // Frame index and read result for each render frame
+  vector<int> slotFrame;
+  vector<char> slotOk;
+
+  unique_ptr<RiceBoundedQueue<int> > freeSlots;
+  unique_ptr<RiceBoundedQueue<int> > filledSlots;
+
+  thread reader;
+}
+
+@property (nonatomic, retain) NSArray<MetalRice2RenderFrame*> *renderFrames;
+
+@end
+
+@implementation MetalRice2FrameRing
+
+- (instancetype) initWithRenderContext:(MetalRice2RenderContext*)renderContext
+                                   mrc:(MetalRenderContext*)mrc
+                             numFrames:(int)numFrames
+                            renderSize:(CGSize)renderSize
+                             blockSize:(CGSize)blockSize
+                       maxNumBitsBytes:(int)maxNumBitsBytes
+{
+  self = [super init];
+
+  if (self == nil) {
+    return nil;
+  }
+
+  if (numFrames < 1) {
+    numFrames = 1;
+  }
+
+  NSMutableArray *renderFrames = [NSMutableArray arrayWithCapacity:numFrames];
+
+  for (int i = 0; i < numFrames; i++) {
+    MetalRice2RenderFrame *renderFrame = [[MetalRice2RenderFrame alloc] init];
+
+    [renderContext setupRenderTextures:mrc
+                            renderSize:renderSize
+                             blockSize:blockSize
+                           renderFrame:renderFrame];
+
+    // Room for the bits rounded up to words and the padding words
+
+    const int numPaddingBytes = (RICE2_HALF_BLOCK_MAX_NUM_WORDS + 1) * (int) sizeof(uint32_t);
+
+    [renderContext ensureBitsBuffCapacity:mrc
+                                 numBytes:maxNumBitsBytes + numPaddingBytes
+                              renderFrame:renderFrame];
+
+    [renderFrames addObject:renderFrame];
+  }
+
+  self.renderFrames = [NSArray arrayWithArray:renderFrames];
+
+  slots.resize(numFrames);
+  slotFrame.resize(numFrames);
+  slotOk.resize(numFrames);
+
+  return self;
+}
+
+- (void) dealloc
+{
+  [self stop];
+}
+
+// Copy a parsed frame into the buffers of a render frame, returns NO
+// when the frame does not fit. rice2_frame_read_file() only reads basic
+// planes, the bits are copied with their padding words.
+
+- (BOOL) copyFrameSlot:(int)si
+{
+  MetalRice2RenderFrame *renderFrame = self.renderFrames[si];
+  const Rice2EncodedPlane & plane = slots[si].plane;
+  const vector<uint32_t> & paddedBits = slots[si].paddedBits;
+
+  if (plane.paddedWidth() != (int) renderFrame.width ||
+      plane.paddedHeight() != (int) renderFrame.height) {
+    return NO;
+  }
+
+  const size_t numKBytes = plane.blockOptimalKTable.size();
+  const size_t numOffsetBytes = plane.halfBlockOffsetTable.size() * sizeof(uint32_t);
+  const size_t numBitsBytes = paddedBits.size() * sizeof(uint32_t);
+
+  if (numKBytes != renderFrame.blockOptimalKTable.length ||
+      numOffsetBytes != renderFrame.blockOffsetTableBuff.length ||
+      numBitsBytes > renderFrame.bitsBuff.length) {
+    return NO;
+  }
+
+  memcpy(renderFrame.bitsBuff.contents, paddedBits.data(), numBitsBytes);
+  memcpy(renderFrame.blockOptimalKTable.contents, plane.blockOptimalKTable.data(), numKBytes);
+  memcpy(renderFrame.blockOffsetTableBuff.contents, plane.halfBlockOffsetTable.data(), numOffsetBytes);
+
+  renderFrame.useHalfBlockTidTable = NO;
+
+  RiceRenderUniform *riceRenderUniformPtr = (RiceRenderUniform*) renderFrame.riceRenderUniform.contents;
+
+  riceRenderUniformPtr->numBlocksInWidth = renderFrame.numBlocksInWidth;
+  riceRenderUniformPtr->numBlocksInHeight = renderFrame.numBlocksInHeight;
+  riceRenderUniformPtr->cropWidth = plane.width;
+  riceRenderUniformPtr->cropHeight = plane.height;
+
+  return YES;
+}
+
+- (void) startReading:(int)numFrames
+         pathForFrame:(NSString* (^)(int frameIndex))pathBlock
+{
+  [self stop];
+
+  const int numSlots = (int) slots.size();
+
+  freeSlots.reset(new RiceBoundedQueue<int>(numSlots));
+  filledSlots.reset(new RiceBoundedQueue<int>(numSlots));
+
+  for (int i = 0; i < numSlots; i++) {
+    freeSlots->push(int(i));
+  }
+
+  // Resolve every path up front so that the reader thread does not
+  // call back into the block.
+
+  vector<string> paths;
+  paths.reserve(numFrames);
+
+  for (int i = 0; i < numFrames; i++) {
+    NSString *path = pathBlock(i);
+    paths.push_back(path == nil ? string() : string([path UTF8String]));
+  }
+
+  // The reader does not retain the ring, dealloc joins the reader
+  // before the ring goes away.
+
+  __unsafe_unretained MetalRice2FrameRing *ring = self;
+
+  reader = thread([ring, paths, numFrames]() {
+    for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+      int si;
+      if (!ring->freeSlots->pop(si)) {
+        break;
+      }
+
+      @autoreleasepool {
+        bool ok = rice2_frame_read_file(paths[frameIndex], ring->slots[si]) > 0;
+        ring->slotFrame[si] = frameIndex;
+        ring->slotOk[si] = ok && [ring copyFrameSlot:si];
+      }
+
+      if (!ring->filledSlots->push(int(si))) {
+        break;
+      }
+    }
+
+    ring->filledSlots->close();
+  });
+}
+
+- (MetalRice2RenderFrame*) nextFrame:(int*)frameIndex
+                                  ok:(BOOL*)ok
+{
+  int si;
+
+  if (filledSlots.get() == nullptr || !filledSlots->pop(si)) {
+    return nil;
+  }
+
+  if (frameIndex) {
+    *frameIndex = slotFrame[si];
+  }
+  if (ok) {
+    *ok = slotOk[si] ? YES : NO;
+  }
+
+  return self.renderFrames[si];
+}
+
+- (void) releaseFrame:(MetalRice2RenderFrame*)renderFrame
+{
+  NSUInteger si = [self.renderFrames indexOfObjectIdenticalTo:renderFrame];
+
+#if defined(DEBUG)
+  assert(si != NSNotFound);
+#endif // DEBUG
+
+  if (si != NSNotFound && freeSlots.get() != nullptr) {
+    freeSlots->push(int(si));
+  }
+}
+
+- (void) stop
+{
+  if (freeSlots.get() != nullptr) {
+    freeSlots->close();
+  }
+  if (filledSlots.get() != nullptr) {
+    filledSlots->close();
+  }
+  if (reader.joinable()) {
+    reader.join();
+  }
+}
+
+@end
@@ -17,7 +17,9 @@
 
 @interface MetalRice2RenderContext : NSObject
 
-// Name of Metal kernel function to use (initialized by default)
+// Name of Metal kernel function to use (initialized by default). Planes
+// encoded with the gradient or MED predictor must be rendered with
+// kernel_render_rice2_undelta_gradient_sync or _med_sync.
 
 @property (nonatomic, copy) NSString *computeKernelFunction;
 
@@ -34,6 +36,13 @@
 
 @property (nonatomic, retain) id<MTLComputePipelineState> computePipelineState;
 
+// Variant of the compute pipeline that reads the tid table of a balanced
+// plane, used only for frames with useHalfBlockTidTable set. This is nil
+// when the kernel has no _tid_sync variant, such frames then render with
+// computePipelineState and no tid table.
+
+@property (nonatomic, retain) id<MTLComputePipelineState> tidComputePipelineState;
+
 #if defined(DEBUG)
 #endif // DEBUG
 
@@ -61,4 +70,10 @@
                        numBytes:(int)numBytes
                     renderFrame:(MetalRice2RenderFrame*)renderFrame;
 
+// Allocate the tid table of a render frame, this is only needed for
+// frames that render planes with a tid table.
+
+- (void) ensureHalfBlockTidTable:(MetalRenderContext*)mrc
+                     renderFrame:(MetalRice2RenderFrame*)renderFrame;
+
 @end
@@ -73,6 +73,29 @@
   }
 
   NSAssert(self.computePipelineState, @"computePipelineState");
+  
+  // Planes with a tid table render with the _tid_sync variant of the
+  // kernel, for example kernel_render_rice2_undelta_tid_sync.
+  
+  NSString *tidShader = shader;
+  
+  if ([tidShader isEqualToString:@"kernel_render_rice2_undelta"]) {
+    tidShader = @"kernel_render_rice2_undelta_sync";
+  }
+  
+  if ([tidShader hasSuffix:@"_sync"]) {
+    tidShader = [[tidShader substringToIndex:tidShader.length - 5] stringByAppendingString:@"_tid_sync"];
+  } else {
+    tidShader = nil;
+  }
+  
+  self.tidComputePipelineState = nil;
+  
+  if (tidShader != nil && [mrc.defaultLibrary newFunctionWithName:tidShader] != nil) {
+    self.tidComputePipelineState = [mrc makePipeline:MTLPixelFormatR8Unorm
+                                       pipelineLabel:@"RenderRice2 Tid Pipeline"
+                                  kernelFunctionName:tidShader];
+  }
 }
 
 // Render textures initialization
@@ -251,6 +274,7 @@
     }
   }
 
+
   return;
 }
 
@@ -296,7 +320,20 @@
     computeEncoder.label = debugLabel;
     [computeEncoder pushDebugGroup:debugLabel];
     
-    [computeEncoder setComputePipelineState:self.computePipelineState];
+    // A frame with a tid table renders with the tid variant, other
+    // frames do not bind a tid table at all. The tid table only balances
+    // the threads, so when the kernel has no tid variant the frame
+    // renders the same pixels with the plain kernel.
+    
+    const BOOL useHalfBlockTidTable = renderFrame.useHalfBlockTidTable &&
+      self.tidComputePipelineState != nil &&
+      renderFrame.halfBlockTidTable != nil;
+    
+    if (useHalfBlockTidTable) {
+      [computeEncoder setComputePipelineState:self.tidComputePipelineState];
+    } else {
+      [computeEncoder setComputePipelineState:self.computePipelineState];
+    }
     
     [computeEncoder setTexture:outputTexture atIndex:0];
     
@@ -305,6 +342,10 @@
     [computeEncoder setBuffer:renderFrame.bitsBuff offset:0 atIndex:2];
     [computeEncoder setBuffer:renderFrame.blockOptimalKTable offset:0 atIndex:3];
     
+    if (useHalfBlockTidTable) {
+      [computeEncoder setBuffer:renderFrame.halfBlockTidTable offset:0 atIndex:5];
+    }
+    
     if (self.computeKernelPassArg32) {
       if (renderFrame.out32Buff == nil) {
         const int numBytes = ((int) renderFrame.width * (int) renderFrame.height) * sizeof(uint32_t);
@@ -347,4 +388,13 @@
   }
 }
 
+- (void) ensureHalfBlockTidTable:(MetalRenderContext*)mrc
+                     renderFrame:(MetalRice2RenderFrame*)renderFrame
+{
+  if (renderFrame.halfBlockTidTable == nil) {
+    const int numBytes = sizeof(uint8_t) * ((int) renderFrame.numBlocksInWidth * (int) renderFrame.numBlocksInHeight * 2);
+    renderFrame.halfBlockTidTable = [mrc.device newBufferWithLength:numBytes options:MTLResourceStorageModeShared];
+  }
+}
+
 @end
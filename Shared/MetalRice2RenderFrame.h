@@ -55,6 +55,16 @@
 
 @property (nonatomic, retain) id<MTLBuffer> blockOffsetTableBuff;
 
+// uint8_t half block decoded by each thread indexed by bbid+tid, this
+// is nil until a plane with a tid table is copied in (see Rice2Balance.hpp)
+
+@property (nonatomic, retain) id<MTLBuffer> halfBlockTidTable;
+
+// Set when halfBlockTidTable holds the tid table of the current plane,
+// the frame is then rendered with the tid variant of the kernel
+
+@property (nonatomic, assign) BOOL useHalfBlockTidTable;
+
 // uint32_t output buffer for values like blocki emitted by shader
 
 @property (nonatomic, retain) id<MTLBuffer> out32Buff;
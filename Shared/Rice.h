@@ -129,4 +129,22 @@ blockOptimalKTableData:(NSMutableData*)blockOptimalKTableData
     halfBlockOptimalKTable:(NSMutableData*)halfBlockOptimalKTable
       halfBlockOffsetTable:(NSMutableData*)halfBlockOffsetTable;
 
+// Load a prebuilt grayscale asset written offline by metalrice-enc. The
+// k table is in big block order, the 16 k values of each 32x32 big block
+// together and one padding entry at the end. This is the layout that
+// encodeRice2Stream writes only because an asset covers whole big blocks
+// and blockiLookupVec is then the identity. The rice bits are followed by
+// RICE2_HALF_BLOCK_MAX_NUM_WORDS padding words. Returns NO when the asset
+// is not a single plane that the MetalRiceRenderContext shader can decode
+// or its tables are not valid for its dimensions.
+
++ (BOOL) loadRice2Asset:(NSData*)assetData
+                  width:(int*)width
+                 height:(int*)height
+    numBigBlocksInWidth:(int*)numBigBlocksInWidth
+   numBigBlocksInHeight:(int*)numBigBlocksInHeight
+      riceEncodedStream:(NSMutableData*)riceEncodedStream
+     blockOptimalKTable:(NSMutableData*)blockOptimalKTable
+   halfBlockOffsetTable:(NSMutableData*)halfBlockOffsetTable;
+
 @end
@@ -27,6 +27,8 @@
 
 #import "RiceDecodeBlocksImpl.hpp"
 
+#import "Rice2Asset.hpp"
+
 using namespace std;
 
 //#define USE_MULTIPLEXER
@@ -690,26 +692,16 @@ blockOptimalKTableDataLength:(int)blockOptimalKTableDataLength
 
 + (NSData*) encodeSignedByteDeltas:(NSData*)data
 {
-  vector<int8_t> inBytes;
-  inBytes.resize(data.length);
-  memcpy(inBytes.data(), data.bytes, data.length);
+  NSMutableData *outZerodDeltaBytes = [NSMutableData dataWithLength:data.length];
   
-  vector<int8_t> outSignedDeltaBytes = encodeDelta(inBytes);
-    
-  NSMutableData *outZerodDeltaBytes = [NSMutableData data];
-  [outZerodDeltaBytes setLength:outSignedDeltaBytes.size()];
-  uint8_t *outZerodDeltaPtr = (uint8_t *) outZerodDeltaBytes.mutableBytes;
-    
-  // Convert signed delta to zerod (unsigned) deltas
-  const int maxNumBytes = (int) outSignedDeltaBytes.size();
-
-  for (int i = 0; i < maxNumBytes; i++) {
-      int8_t sVal = outSignedDeltaBytes[i];
-      uint8_t zerodVal = pixelpack_int8_to_offset_uint8(sVal);
-      *outZerodDeltaPtr++ = zerodVal;
-  }
-
-  return [NSData dataWithData:outZerodDeltaBytes];
+  // Single pass delta and zigzag directly into the output buffer
+  
+  zigzag_byte_deltas_encode((const uint8_t *) data.bytes,
+                            (uint8_t *) outZerodDeltaBytes.mutableBytes,
+                            (int) data.length,
+                            0);
+  
+  return outZerodDeltaBytes;
 }
 
 // Decode symbols by reversing zerod mapping and then applying
@@ -1024,10 +1016,8 @@ blockOptimalKTableData:(NSMutableData*)blockOptimalKTableData
   
   // Generate blocki ordering
   
-  vector<uint32_t> blockiVec;
-  vector<uint32_t> blockiLookupVec;
-  
-  block_reorder_blocki<blockDim,blockiDim>(width, height, blockiVec, blockiLookupVec);
+  shared_ptr<const BlockReorderTables<blockDim,blockiDim> > reorderTables =
+    block_reorder_blocki_tables<blockDim,blockiDim>(width, height);
   
   // Invoke s32 layout logic with ordered blocki generated above
   
@@ -1035,7 +1025,7 @@ blockOptimalKTableData:(NSMutableData*)blockOptimalKTableData
   
   vector<uint8_t> s32OrderPixelsVec(width*height);
   
-  uint32_t *blockiPtr = blockiLookupVec.data();
+  const uint32_t *blockiPtr = reorderTables->blockiLookupVec.data();
 
   vector<uint8_t> blockOptimalKTableVec;
   
@@ -1225,5 +1215,51 @@ blockOptimalKTableData:(NSMutableData*)blockOptimalKTableData
   return;
 }
 
++ (BOOL) loadRice2Asset:(NSData*)assetData
+                  width:(int*)width
+                 height:(int*)height
+    numBigBlocksInWidth:(int*)numBigBlocksInWidth
+   numBigBlocksInHeight:(int*)numBigBlocksInHeight
+      riceEncodedStream:(NSMutableData*)riceEncodedStream
+     blockOptimalKTable:(NSMutableData*)blockOptimalKTable
+   halfBlockOffsetTable:(NSMutableData*)halfBlockOffsetTable
+{
+  const uint8_t *assetPtr = (const uint8_t *) assetData.bytes;
+  vector<uint8_t> assetVec(assetPtr, assetPtr + assetData.length);
+  
+  Rice2EncodedPlane plane;
+  
+  if (!rice2_asset_load_gray(assetVec, plane)) {
+    return FALSE;
+  }
+  
+  *width = plane.width;
+  *height = plane.height;
+  *numBigBlocksInWidth = plane.numBigBlocksInWidth;
+  *numBigBlocksInHeight = plane.numBigBlocksInHeight;
+  
+  // The bits are padded so that a half block that decodes garbage can
+  // not read past the end of the Metal buffer.
+  
+  {
+    vector<uint32_t> paddedBits;
+    rice2_plane_padded_bits(plane, paddedBits);
+    
+    const int numBytes = (int) (paddedBits.size() * sizeof(uint32_t));
+    [riceEncodedStream setLength:numBytes];
+    memcpy(riceEncodedStream.mutableBytes, paddedBits.data(), numBytes);
+  }
+  
+  [blockOptimalKTable setLength:plane.blockOptimalKTable.size()];
+  memcpy(blockOptimalKTable.mutableBytes, plane.blockOptimalKTable.data(), plane.blockOptimalKTable.size());
+  
+  {
+    int numBytes = (int) (plane.halfBlockOffsetTable.size() * sizeof(uint32_t));
+    [halfBlockOffsetTable setLength:numBytes];
+    memcpy(halfBlockOffsetTable.mutableBytes, plane.halfBlockOffsetTable.data(), numBytes);
+  }
+  
+  return TRUE;
+}
 
 @end
@@ -0,0 +1,91 @@
+//
+//  Rice2Asset.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Prebuilt grayscale assets. An asset is a Rice2PlanesContainer with
+//  one plane that was encoded offline, for example with metalrice-enc,
+//  so that the k table, half block offsets and rice bits can be copied
+//  straight into render buffers at launch instead of running the block
+//  delta, k table and rice encode steps before the first frame.
+
+#ifndef _Rice2Asset_hpp
+#define _Rice2Asset_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include "Rice2Planes.hpp"
+
+using namespace std;
+
+// True when a plane only needs what the original MetalRiceRenderContext
+// shader decodes, that is the Left predictor, a 16 bit escape and no
+// tid table.
+
+static inline
+bool rice2_asset_plane_is_basic(const Rice2EncodedPlane & plane)
+{
+  return plane.predictor == BlockDeltaPredictorLeft &&
+         plane.escapeNumBits == 16 &&
+         plane.halfBlockTidTable.empty();
+}
+
+// Parse a container with exactly one plane into outPlane. The buffers
+// of outPlane keep their capacity, so parsing a sequence of frames with
+// the same dimensions into the same plane does not allocate.
+
+static inline
+bool rice2_asset_read_plane(const vector<uint8_t> & buf,
+                            Rice2EncodedPlane & outPlane)
+{
+  int offset = 0;
+  uint32_t magic, w, h;
+  uint8_t flags, numPlanes;
+
+  if (buf.size() < 14) {
+    return false;
+  }
+
+  ::decode(buf, offset, magic);
+  ::decode(buf, offset, w);
+  ::decode(buf, offset, h);
+  ::decode(buf, offset, flags);
+  ::decode(buf, offset, numPlanes);
+
+  // A single plane is never YCoCg
+
+  if (magic != 0x4c503252 || numPlanes != 1 || (flags & 0x1) != 0) {
+    return false;
+  }
+
+  const bool withHashes = (flags & 0x2) != 0;
+  const bool withPredictor = (flags & 0x4) != 0;
+  const bool withTids = (flags & 0x8) != 0;
+  const bool withEscape = (flags & 0x10) != 0;
+
+  if (!rice2_plane_read(buf, offset, w, h, outPlane, withHashes, withPredictor, withTids, withEscape)) {
+    return false;
+  }
+
+  return offset == (int) buf.size();
+}
+
+// Parse a grayscale asset into outPlane. Returns false when the buffer
+// is not a valid container, does not hold exactly one plane, the plane
+// is not basic, or a k value or half block offset is out of range. The
+// caller then falls back to encoding on launch. The bits must still be
+// padded with RICE2_HALF_BLOCK_MAX_NUM_WORDS words before a GPU decode,
+// see rice2_plane_tile_is_valid().
+
+static inline
+bool rice2_asset_load_gray(const vector<uint8_t> & buf,
+                           Rice2EncodedPlane & outPlane)
+{
+  return rice2_asset_read_plane(buf, outPlane) &&
+         rice2_asset_plane_is_basic(outPlane) &&
+         rice2_plane_tables_are_valid(outPlane);
+}
+
+#endif // _Rice2Asset_hpp
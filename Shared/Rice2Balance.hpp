@@ -0,0 +1,381 @@
+//
+//  Rice2Balance.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Load balance of the 32 half block substreams in each big block. The
+//  32 threads of a threadgroup all wait on the longest half block, and
+//  on a GPU with a SIMD width of 8 or 16 each simdgroup also waits on
+//  its own longest half block. The report gives the max to mean ratio
+//  of the bits in each big block along with histograms. A plane can
+//  carry a tid table that maps each thread to the half block it decodes
+//  so that long half blocks share a simdgroup. The table only changes
+//  which thread decodes a half block, every half block is still written
+//  to the same place, so a decoder that ignores the table decodes the
+//  same pixels.
+
+#ifndef _Rice2Balance_hpp
+#define _Rice2Balance_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "EncDec.hpp"
+#include "Rice2Codec.hpp"
+#include "RiceDecodeStats.hpp"
+
+using namespace std;
+
+// Bits read by each half block, indexed by (bbid * 32) + tid
+
+static inline
+void rice2_half_block_num_bits(const Rice2EncodedPlane & inPlane,
+                               vector<uint32_t> & outHalfBlockNumBits)
+{
+  RiceDecodeStatsReport stats;
+  vector<uint8_t> imageOrderDeltas;
+
+  rice2_decode_plane_deltas(inPlane, imageOrderDeltas, &stats);
+
+  outHalfBlockNumBits = std::move(stats.halfBlockNumBits);
+  outHalfBlockNumBits.resize(inPlane.numBlocks() * 2);
+}
+
+// Half block decoded by thread tid of big block bbid
+
+static inline
+int rice2_half_block_for_tid(const vector<uint8_t> & halfBlockTidTable,
+                             const int bbid,
+                             const int tid)
+{
+  return halfBlockTidTable.empty() ? tid : halfBlockTidTable[(bbid * 32) + tid];
+}
+
+// Sum over the simdgroups of one big block of the most bits read by a
+// thread in that simdgroup, a simdWidth of 32 gives the longest thread.
+
+static inline
+uint32_t rice2_big_block_simd_num_bits(const vector<uint32_t> & halfBlockNumBits,
+                                       const vector<uint8_t> & halfBlockTidTable,
+                                       const int bbid,
+                                       const int simdWidth)
+{
+  uint32_t sum = 0;
+
+  for (int tid0 = 0; tid0 < 32; tid0 += simdWidth) {
+    uint32_t maxBits = 0;
+    for (int tid = tid0; tid < tid0 + simdWidth; tid++) {
+      const int halfBlocki = (bbid * 32) + rice2_half_block_for_tid(halfBlockTidTable, bbid, tid);
+      maxBits = max(maxBits, halfBlockNumBits[halfBlocki]);
+    }
+    sum += maxBits;
+  }
+
+  return sum;
+}
+
+// Per big block load balance of the half block bit lengths in a plane
+
+class Rice2BalanceReport
+{
+public:
+  // Width of a simdgroup used for simdNumBits
+  int simdWidth;
+
+  int numBigBlocks;
+
+  // Big blocks where every 8x8 block is a skip block
+  int numEmptyBigBlocks;
+
+  // Sum of the bits read by every half block
+  uint64_t numBits;
+
+  // Sum over big blocks of the longest half block
+  uint64_t maxNumBits;
+
+  // Sum over big blocks and simdgroups of the longest half block in
+  // the simdgroup, with the plane tid table applied
+  uint64_t simdNumBits;
+
+  // Mean over non empty big blocks of max / mean half block bits
+  double meanMaxToMeanRatio;
+
+  // Big blocks by max / mean ratio, bins of 0.25 starting at 1.0,
+  // the last bin counts every ratio from 2.75 up
+  uint32_t ratioHistogram[8];
+
+  // Half blocks by number of bits, bins of 32 bits, the last bin
+  // counts every half block of 480 bits or more
+  uint32_t halfBlockBitsHistogram[16];
+
+  // Max and mean half block bits, indexed by bbid
+  vector<uint32_t> bigBlockMaxNumBits;
+  vector<double> bigBlockMeanNumBits;
+
+  Rice2BalanceReport()
+  {
+    clear();
+  }
+
+  void clear() {
+    simdWidth = 32;
+    numBigBlocks = 0;
+    numEmptyBigBlocks = 0;
+    numBits = 0;
+    maxNumBits = 0;
+    simdNumBits = 0;
+    meanMaxToMeanRatio = 0.0;
+    memset(ratioHistogram, 0, sizeof(ratioHistogram));
+    memset(halfBlockBitsHistogram, 0, sizeof(halfBlockBitsHistogram));
+    bigBlockMaxNumBits.clear();
+    bigBlockMeanNumBits.clear();
+  }
+
+  // Export as a JSON object, the per big block values are not included
+
+  string toJSON() const {
+    string json;
+    char buffer[128];
+
+    auto appendArray = [&](const char *name, const uint32_t *values, const int n, bool comma) {
+      snprintf(buffer, sizeof(buffer), "  \"%s\": [", name);
+      json += buffer;
+      for (int i = 0; i < n; i++) {
+        snprintf(buffer, sizeof(buffer), "%s%u", (i == 0) ? "" : ", ", values[i]);
+        json += buffer;
+      }
+      json += comma ? "],\n" : "]\n";
+    };
+
+    json += "{\n";
+    snprintf(buffer, sizeof(buffer), "  \"simdWidth\": %d,\n", simdWidth);
+    json += buffer;
+    snprintf(buffer, sizeof(buffer), "  \"numBigBlocks\": %d,\n", numBigBlocks);
+    json += buffer;
+    snprintf(buffer, sizeof(buffer), "  \"numEmptyBigBlocks\": %d,\n", numEmptyBigBlocks);
+    json += buffer;
+    snprintf(buffer, sizeof(buffer), "  \"numBits\": %llu,\n", (unsigned long long) numBits);
+    json += buffer;
+    snprintf(buffer, sizeof(buffer), "  \"maxNumBits\": %llu,\n", (unsigned long long) maxNumBits);
+    json += buffer;
+    snprintf(buffer, sizeof(buffer), "  \"simdNumBits\": %llu,\n", (unsigned long long) simdNumBits);
+    json += buffer;
+    snprintf(buffer, sizeof(buffer), "  \"meanMaxToMeanRatio\": %.4f,\n", meanMaxToMeanRatio);
+    json += buffer;
+    appendArray("ratioHistogram", ratioHistogram, 8, true);
+    appendArray("halfBlockBitsHistogram", halfBlockBitsHistogram, 16, false);
+    json += "}\n";
+
+    return json;
+  }
+};
+
+// Fill in the balance report for a plane, simdWidth must be 8, 16 or 32
+
+static inline
+void rice2_balance_report(const Rice2EncodedPlane & inPlane,
+                          const int simdWidth,
+                          Rice2BalanceReport & report)
+{
+#if defined(DEBUG)
+  assert(simdWidth == 8 || simdWidth == 16 || simdWidth == 32);
+#endif // DEBUG
+
+  vector<uint32_t> halfBlockNumBits;
+  rice2_half_block_num_bits(inPlane, halfBlockNumBits);
+
+  const int numBigBlocks = inPlane.numBigBlocksInWidth * inPlane.numBigBlocksInHeight;
+
+  report.clear();
+  report.simdWidth = simdWidth;
+  report.numBigBlocks = numBigBlocks;
+  report.bigBlockMaxNumBits.resize(numBigBlocks);
+  report.bigBlockMeanNumBits.resize(numBigBlocks);
+
+  double ratioSum = 0.0;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    const uint32_t *bitsPtr = &halfBlockNumBits[bbid * 32];
+    uint32_t sum = 0;
+    uint32_t maxBits = 0;
+
+    for (int tid = 0; tid < 32; tid++) {
+      sum += bitsPtr[tid];
+      maxBits = max(maxBits, bitsPtr[tid]);
+      report.halfBlockBitsHistogram[min(15, (int) (bitsPtr[tid] / 32))] += 1;
+    }
+
+    const double mean = sum / 32.0;
+
+    report.bigBlockMaxNumBits[bbid] = maxBits;
+    report.bigBlockMeanNumBits[bbid] = mean;
+    report.numBits += sum;
+    report.maxNumBits += maxBits;
+    report.simdNumBits += rice2_big_block_simd_num_bits(halfBlockNumBits, inPlane.halfBlockTidTable, bbid, simdWidth);
+
+    if (sum == 0) {
+      report.numEmptyBigBlocks += 1;
+      continue;
+    }
+
+    const double ratio = maxBits / mean;
+    ratioSum += ratio;
+    report.ratioHistogram[min(7, (int) ((ratio - 1.0) * 4))] += 1;
+  }
+
+  const int numNonEmpty = numBigBlocks - report.numEmptyBigBlocks;
+  report.meanMaxToMeanRatio = (numNonEmpty == 0) ? 0.0 : (ratioSum / numNonEmpty);
+}
+
+// Set the plane tid table so that in each big block the threads of a
+// simdgroup decode half blocks of about the same length. Half blocks
+// are sorted longest first, which gives the smallest sum over the
+// simdgroups of the longest half block. A big block keeps the identity
+// mapping unless the sum drops by at least 1/16. The table is left
+// empty when no big block changes or simdWidth is 32, since all 32
+// threads then wait on the same longest half block. Returns the number
+// of big blocks with a permuted mapping.
+
+static inline
+int rice2_plane_balance_tids(Rice2EncodedPlane & plane,
+                             const int simdWidth)
+{
+#if defined(DEBUG)
+  assert(simdWidth == 8 || simdWidth == 16 || simdWidth == 32);
+#endif // DEBUG
+
+  plane.halfBlockTidTable.clear();
+
+  if (simdWidth == 32) {
+    return 0;
+  }
+
+  vector<uint32_t> halfBlockNumBits;
+  rice2_half_block_num_bits(plane, halfBlockNumBits);
+
+  const int numBigBlocks = plane.numBigBlocksInWidth * plane.numBigBlocksInHeight;
+
+  vector<uint8_t> tidTable(numBigBlocks * 32);
+  int numPermuted = 0;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    uint8_t *tablePtr = &tidTable[bbid * 32];
+    const uint32_t *bitsPtr = &halfBlockNumBits[bbid * 32];
+
+    for (int tid = 0; tid < 32; tid++) {
+      tablePtr[tid] = tid;
+    }
+
+    const uint32_t identityNumBits = rice2_big_block_simd_num_bits(halfBlockNumBits, vector<uint8_t>(), bbid, simdWidth);
+
+    stable_sort(tablePtr, tablePtr + 32, [&](uint8_t a, uint8_t b) {
+      return bitsPtr[a] > bitsPtr[b];
+    });
+
+    const uint32_t sortedNumBits = rice2_big_block_simd_num_bits(halfBlockNumBits, tidTable, bbid, simdWidth);
+
+    if ((sortedNumBits + (identityNumBits / 16)) > identityNumBits || sortedNumBits == identityNumBits) {
+      for (int tid = 0; tid < 32; tid++) {
+        tablePtr[tid] = tid;
+      }
+    } else {
+      numPermuted += 1;
+    }
+  }
+
+  if (numPermuted > 0) {
+    plane.halfBlockTidTable = std::move(tidTable);
+  }
+
+  return numPermuted;
+}
+
+// Serialize the tid table of a plane as one byte for each big block,
+// 1 when the big block is permuted and then followed by its 32 entries.
+// An empty table is written as every big block not permuted.
+
+static inline
+void rice2_tid_table_write(const Rice2EncodedPlane & plane,
+                           vector<uint8_t> & buf)
+{
+  const int numBigBlocks = plane.numBigBlocksInWidth * plane.numBigBlocksInHeight;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    bool permuted = false;
+
+    for (int tid = 0; tid < 32 && !plane.halfBlockTidTable.empty(); tid++) {
+      if (plane.halfBlockTidTable[(bbid * 32) + tid] != tid) {
+        permuted = true;
+      }
+    }
+
+    ::encode(buf, (uint8_t) (permuted ? 1 : 0));
+
+    if (permuted) {
+      buf.insert(buf.end(), &plane.halfBlockTidTable[bbid * 32], &plane.halfBlockTidTable[bbid * 32] + 32);
+    }
+  }
+}
+
+// Read a table written by rice2_tid_table_write(), the table is left
+// empty when no big block is permuted. Returns false when the buffer is
+// too short or a permuted big block is not a permutation of 0 to 31.
+
+static inline
+bool rice2_tid_table_read(const vector<uint8_t> & buf,
+                          int & offset,
+                          Rice2EncodedPlane & plane)
+{
+  const int numBigBlocks = plane.numBigBlocksInWidth * plane.numBigBlocksInHeight;
+
+  vector<uint8_t> tidTable(numBigBlocks * 32);
+  bool anyPermuted = false;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    if (offset < 0 || (size_t) offset >= buf.size()) {
+      return false;
+    }
+
+    uint8_t permuted = 0;
+    ::decode(buf, offset, permuted);
+
+    if (permuted && (buf.size() - offset) < 32) {
+      return false;
+    }
+
+    uint32_t seenBits = 0;
+
+    for (int tid = 0; tid < 32; tid++) {
+      uint8_t halfBlockTid = tid;
+      if (permuted) {
+        ::decode(buf, offset, halfBlockTid);
+      }
+      if (halfBlockTid >= 32) {
+        return false;
+      }
+      seenBits |= (1u << halfBlockTid);
+      tidTable[(bbid * 32) + tid] = halfBlockTid;
+    }
+
+    if (seenBits != 0xFFFFFFFF) {
+      return false;
+    }
+
+    anyPermuted = anyPermuted || permuted;
+  }
+
+  if (anyPermuted) {
+    plane.halfBlockTidTable = std::move(tidTable);
+  } else {
+    plane.halfBlockTidTable.clear();
+  }
+
+  return true;
+}
+
+#endif // _Rice2Balance_hpp
@@ -0,0 +1,208 @@
+//
+//  Rice2Checksum.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Per big block hashes of decoded pixels. Each 32x32 big block,
+//  zero padded past the image edge, is hashed on its own with the
+//  bbid as the seed, so a tile can be checked as soon as it has been
+//  decoded and tiles can be checked in parallel. An encoded plane can
+//  carry a table of these hashes, a decoder then reports the tiles
+//  that did not decode to the original pixels so that only those big
+//  blocks need to be fetched again.
+
+#ifndef _Rice2Checksum_hpp
+#define _Rice2Checksum_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "checksum.h"
+#include "Rice2Codec.hpp"
+#include "RiceThreadPool.hpp"
+
+using namespace std;
+
+// Hash of big block bbid in pixels, each pixel is bytesPerPixel bytes.
+
+static inline
+uint64_t rice2_big_block_hash(const uint8_t * pixels,
+                              const int width,
+                              const int height,
+                              const int bytesPerPixel,
+                              const int bbid)
+{
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+  const int numBigBlocksInWidth = (width + bigBlockDim - 1) / bigBlockDim;
+
+#if defined(DEBUG)
+  assert(bytesPerPixel >= 1 && bytesPerPixel <= 4);
+#endif // DEBUG
+
+  const int x0 = (bbid % numBigBlocksInWidth) * bigBlockDim;
+  const int y0 = (bbid / numBigBlocksInWidth) * bigBlockDim;
+  const int rowNumBytes = bigBlockDim * bytesPerPixel;
+  const int numCopyBytes = min(bigBlockDim, width - x0) * bytesPerPixel;
+  const int numCopyRows = min(bigBlockDim, height - y0);
+
+  uint8_t blockBytes[RICE_LARGE_BLOCK_DIM * RICE_LARGE_BLOCK_DIM * 4];
+
+  if (numCopyBytes < rowNumBytes || numCopyRows < bigBlockDim) {
+    memset(blockBytes, 0, rowNumBytes * bigBlockDim);
+  }
+
+  for (int row = 0; row < numCopyRows; row++) {
+    const uint8_t *rowPtr = pixels + ((((y0 + row) * width) + x0) * bytesPerPixel);
+    memcpy(blockBytes + (row * rowNumBytes), rowPtr, numCopyBytes);
+  }
+
+  return hash64(blockBytes, rowNumBytes * bigBlockDim, (uint64_t) bbid);
+}
+
+// Hash every big block in pixels, one entry for each bbid.
+
+static inline
+void rice2_big_block_hashes(const uint8_t * pixels,
+                            const int width,
+                            const int height,
+                            const int bytesPerPixel,
+                            vector<uint64_t> & outHashes,
+                            RiceThreadPool *pool = nullptr)
+{
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+  const int numBigBlocks = ((width + bigBlockDim - 1) / bigBlockDim) * ((height + bigBlockDim - 1) / bigBlockDim);
+
+  outHashes.resize(numBigBlocks);
+
+  auto hashBigBlock = [&](int bbid) {
+    outHashes[bbid] = rice2_big_block_hash(pixels, width, height, bytesPerPixel, bbid);
+  };
+
+  if (pool) {
+    pool->parallelFor(numBigBlocks, hashBigBlock, 16);
+  } else {
+    for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+      hashBigBlock(bbid);
+    }
+  }
+}
+
+// Check each big block in pixels against the expected hashes and
+// return the number of blocks that do not match. The bbid of each
+// failed block is appended to outBadBlocks in bbid order when passed.
+
+static inline
+int rice2_verify_big_block_hashes(const uint8_t * pixels,
+                                  const int width,
+                                  const int height,
+                                  const int bytesPerPixel,
+                                  const vector<uint64_t> & expectedHashes,
+                                  RiceThreadPool *pool = nullptr,
+                                  vector<int> *outBadBlocks = nullptr)
+{
+  const int numBigBlocks = (int) expectedHashes.size();
+
+  vector<uint8_t> isBad(numBigBlocks, 0);
+  atomic<int> numBad(0);
+
+  auto verifyBigBlock = [&](int bbid) {
+    if (rice2_big_block_hash(pixels, width, height, bytesPerPixel, bbid) != expectedHashes[bbid]) {
+      isBad[bbid] = 1;
+      numBad += 1;
+    }
+  };
+
+  if (pool) {
+    pool->parallelFor(numBigBlocks, verifyBigBlock, 16);
+  } else {
+    for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+      verifyBigBlock(bbid);
+    }
+  }
+
+  if (outBadBlocks) {
+    for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+      if (isBad[bbid]) {
+        outBadBlocks->push_back(bbid);
+      }
+    }
+  }
+
+  return numBad;
+}
+
+// Store the hash of each big block of the input pixels in the plane
+
+static inline
+void rice2_plane_add_big_block_hashes(const uint8_t * inBytes,
+                                      Rice2EncodedPlane & plane,
+                                      RiceThreadPool *pool = nullptr)
+{
+  rice2_big_block_hashes(inBytes, plane.width, plane.height, 1, plane.bigBlockHashTable, pool);
+}
+
+// Decode one plane a big block at a time and check each tile against
+// the plane hash table as soon as it has been decoded, so verification
+// runs on the same threads as the decode. Returns the number of big
+// blocks that do not match, the bbid of each one is appended to
+// outBadBlocks in bbid order when passed. A plane without a hash table
+// is decoded with rice2_decode_plane_checked(), so only big blocks with
+// out of range tables are reported.
+//
+// The hash covers the decoded pixels, so a k value or offset that is in
+// range but wrong fails the hash of its tile. A k value or offset that
+// is out of range fails rice2_plane_tile_is_valid(), that tile is not
+// decoded and is reported as bad. The bits are decoded from a padded
+// copy, so a corrupt tile can not read past the end of the bits.
+
+static inline
+int rice2_decode_plane_verified(const Rice2EncodedPlane & inPlane,
+                                uint8_t * outBytes,
+                                RiceThreadPool *pool = nullptr,
+                                vector<int> *outBadBlocks = nullptr)
+{
+  const int numBigBlocks = inPlane.numBigBlocksInWidth * inPlane.numBigBlocksInHeight;
+  const bool verify = !inPlane.bigBlockHashTable.empty();
+
+  if (!verify) {
+    return rice2_decode_plane_checked(inPlane, outBytes, pool, outBadBlocks);
+  }
+
+  // A hash table of the wrong size can not vouch for any tile
+
+  if ((int) inPlane.bigBlockHashTable.size() != numBigBlocks) {
+    for (int bbid = 0; outBadBlocks && bbid < numBigBlocks; bbid++) {
+      outBadBlocks->push_back(bbid);
+    }
+    return numBigBlocks;
+  }
+
+  vector<uint8_t> isBad(numBigBlocks, 0);
+  atomic<int> numBad(0);
+
+  vector<uint32_t> paddedBits;
+  rice2_plane_padded_bits(inPlane, paddedBits);
+
+  rice2_decode_plane_tiles(inPlane, outBytes, [&](int bbid) {
+    if (!rice2_plane_tile_is_valid(inPlane, bbid) ||
+        rice2_big_block_hash(outBytes, inPlane.width, inPlane.height, 1, bbid) != inPlane.bigBlockHashTable[bbid]) {
+      isBad[bbid] = 1;
+      numBad += 1;
+    }
+  }, pool, nullptr, &paddedBits);
+
+  if (outBadBlocks && numBad > 0) {
+    for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+      if (isBad[bbid]) {
+        outBadBlocks->push_back(bbid);
+      }
+    }
+  }
+
+  return numBad;
+}
+
+#endif // _Rice2Checksum_hpp
@@ -0,0 +1,1059 @@
+//
+//  Rice2Codec.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  C++ only encode and decode logic for a single 8 bit plane in the
+//  Rice2 format. Encoding runs the 2 stage block delta, optimal k
+//  selection, s32 layout, rice encoding, and half block bit offset
+//  generation steps. Decoding runs the same per thread logic as the
+//  kernel_render_rice2 compute shader and then reverses the 32x32
+//  block deltas on the CPU. Note that CachedBits.hpp and
+//  RiceDecodeBlocks.hpp must be included before this header.
+
+#ifndef _Rice2Codec_hpp
+#define _Rice2Codec_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "block.hpp"
+#include "block_process.hpp"
+#include "rice.hpp"
+
+#include "RiceDecodeBlocksImpl.hpp"
+#include "RiceDecodeStats.hpp"
+
+using namespace std;
+
+// Encoded state for one plane, each vector maps directly to a Metal
+// buffer used by kernel_render_rice2. The width and height are the
+// original dimensions, the encoded data is zero padded to 32x32 blocks.
+
+class Rice2EncodedPlane
+{
+public:
+  int width;
+  int height;
+
+  // Number of 32x32 blocks in width and height
+  int numBigBlocksInWidth;
+  int numBigBlocksInHeight;
+
+  // Rice encoded bits rewritten as 32 bit words
+  vector<uint8_t> riceEncodedBits;
+
+  // Optimal k for each 8x8 block in big block order, with 1 zero pad entry
+  vector<uint8_t> blockOptimalKTable;
+
+  // Starting bit offset for each half block, indexed as (bbid * 32) + tid
+  vector<uint32_t> halfBlockOffsetTable;
+
+  // Number of zero bits in the escape code, one of 8, 12, or 16. The
+  // Metal shaders only decode the default 16 bit escape.
+  int escapeNumBits;
+
+  // Optional hash64 of the decoded pixels in each big block, indexed
+  // by bbid. Empty unless hashes were added after encoding.
+  vector<uint64_t> bigBlockHashTable;
+
+  // Predictor used for the 32x32 block deltas
+  BlockDeltaPredictor predictor;
+
+  // Optional half block decoded by each thread, indexed as
+  // (bbid * 32) + tid. Empty when thread tid decodes half block tid,
+  // see Rice2Balance.hpp.
+  vector<uint8_t> halfBlockTidTable;
+
+  Rice2EncodedPlane()
+  : width(0),
+  height(0),
+  numBigBlocksInWidth(0),
+  numBigBlocksInHeight(0),
+  escapeNumBits(16),
+  predictor(BlockDeltaPredictorLeft)
+  {
+  }
+
+  int paddedWidth() const {
+    return numBigBlocksInWidth * RICE_LARGE_BLOCK_DIM;
+  }
+
+  int paddedHeight() const {
+    return numBigBlocksInHeight * RICE_LARGE_BLOCK_DIM;
+  }
+
+  int numBlocks() const {
+    const int blockDim = RICE_SMALL_BLOCK_DIM;
+    return (paddedWidth() / blockDim) * (paddedHeight() / blockDim);
+  }
+};
+
+// 32x32 block deltas reordered back to padded image order
+
+static inline
+void rice2_image_order_deltas(const uint8_t * inBytes,
+                              const int width,
+                              const int height,
+                              const int numBigBlocksInWidth,
+                              const int numBigBlocksInHeight,
+                              vector<uint8_t> & outImageOrderDeltas,
+                              const BlockDeltaPredictor predictor = BlockDeltaPredictorLeft)
+{
+  const int blockDim = RICE_LARGE_BLOCK_DIM;
+
+  const int paddedWidth = numBigBlocksInWidth * blockDim;
+  const int paddedHeight = numBigBlocksInHeight * blockDim;
+
+  vector<uint8_t> bigBlockDeltas;
+  int numBaseValues, numBlockValues;
+
+  block_delta_process_encode<blockDim>(inBytes, width * height,
+                                       width, height,
+                                       numBigBlocksInWidth, numBigBlocksInHeight,
+                                       bigBlockDeltas,
+                                       &numBaseValues,
+                                       &numBlockValues,
+                                       predictor);
+
+  outImageOrderDeltas.resize(paddedWidth * paddedHeight);
+
+  block_process_decode<blockDim>(bigBlockDeltas.data(), (int)bigBlockDeltas.size(),
+                                 paddedWidth, paddedHeight,
+                                 numBigBlocksInWidth, numBigBlocksInHeight,
+                                 outImageOrderDeltas.data(), (int)outImageOrderDeltas.size());
+
+  return;
+}
+
+// Two stage delta encoding, 32x32 block deltas are reordered back to image
+// order and then split into 8x8 blocks. The output is in 8x8 block order
+// with zero padding out to the 32x32 block size.
+
+static inline
+void rice2_block_delta_encoding_2stage(const uint8_t * inBytes,
+                                       const int width,
+                                       const int height,
+                                       const int numBigBlocksInWidth,
+                                       const int numBigBlocksInHeight,
+                                       vector<uint8_t> & outBlockOrderSymbols)
+{
+  const int blockDim = RICE_LARGE_BLOCK_DIM;
+  const int smallBlockDim = RICE_SMALL_BLOCK_DIM;
+
+  const int paddedWidth = numBigBlocksInWidth * blockDim;
+  const int paddedHeight = numBigBlocksInHeight * blockDim;
+
+  vector<uint8_t> imageOrderDeltas;
+
+  rice2_image_order_deltas(inBytes, width, height,
+                           numBigBlocksInWidth, numBigBlocksInHeight,
+                           imageOrderDeltas);
+
+  block_process_encode<smallBlockDim>(imageOrderDeltas.data(), (int)imageOrderDeltas.size(),
+                                      paddedWidth, paddedHeight,
+                                      paddedWidth / smallBlockDim, paddedHeight / smallBlockDim,
+                                      outBlockOrderSymbols);
+
+  return;
+}
+
+// True when every symbol in an 8x8 block is zero, the block is then
+// coded with RICE2_SKIP_BLOCK_K and emits no bits.
+
+static inline
+bool rice2_is_skip_block(const uint8_t * blockSymbols, const int numSymbols)
+{
+  for (int i = 0; i < numSymbols; i++) {
+    if (blockSymbols[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// How the encoder picks k for each 8x8 block. MinBits keeps the k that
+// emits the fewest bits. DecodeCost weighs each k by the work done on a
+// decoder thread, see rice2_block_k_decode_cost().
+
+typedef enum {
+  Rice2KSearchMinBits = 0,
+  Rice2KSearchDecodeCost = 1,
+} Rice2KSearch;
+
+// Cost of one escape in bits on top of the bits it emits, an escape
+// takes the slow path in the decoder and usually forces a refill.
+
+#define RICE2_ESCAPE_COST_BITS 16
+
+// Pick k for each coded 8x8 block in s32 order by decoder cost. A half
+// block costs its bits plus RICE2_ESCAPE_COST_BITS for each escape and
+// a block first takes the k with the lowest cost for both halves. All
+// 32 threads of a big block wait on the costliest half block, so the
+// block that holds it then moves to the k that minimizes the cost of
+// its costlier half. This repeats until the costliest half block can
+// not get cheaper or the big block would grow by more than 1/32 of its
+// bits. k stays per 8x8 block, so the format and shaders are unchanged.
+
+template <const int ESC = 16>
+static inline
+void rice2_block_k_decode_cost(const uint8_t * s32OrderSymbols,
+                               const int numBigBlocks,
+                               uint8_t * blockKTable)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int numValuesInBlock = blockDim * blockDim;
+  const int numValuesInHalfBlock = numValuesInBlock / 2;
+  const int numK = 8;
+
+  RiceSplit16EncoderG4<false, true, BitWriterByteStream, 8, ESC> encoder;
+
+  // Bits and cost of each half block in one big block for each k
+
+  int halfBlockBits[32][numK];
+  int halfBlockCost[32][numK];
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    uint8_t *kPtr = blockKTable + (bbid * 16);
+    int budget = 0;
+
+    for (int tid = 0; tid < 32; tid++) {
+      if (kPtr[tid / 2] == RICE2_SKIP_BLOCK_K) {
+        continue;
+      }
+
+      const uint8_t *halfBlockPtr = s32OrderSymbols + (((bbid * 32) + tid) * numValuesInHalfBlock);
+
+      for (int k = 0; k < numK; k++) {
+        int numEscapes = 0;
+        for (int i = 0; i < numValuesInHalfBlock; i++) {
+          if ((halfBlockPtr[i] >> k) >= ESC) {
+            numEscapes += 1;
+          }
+        }
+        halfBlockBits[tid][k] = encoder.numBits(halfBlockPtr, numValuesInHalfBlock, k);
+        halfBlockCost[tid][k] = halfBlockBits[tid][k] + (numEscapes * RICE2_ESCAPE_COST_BITS);
+      }
+    }
+
+    for (int blocki = 0; blocki < 16; blocki++) {
+      if (kPtr[blocki] == RICE2_SKIP_BLOCK_K) {
+        continue;
+      }
+
+      const int t0 = blocki * 2;
+      int bestK = 0;
+
+      for (int k = 1; k < numK; k++) {
+        if ((halfBlockCost[t0][k] + halfBlockCost[t0+1][k]) < (halfBlockCost[t0][bestK] + halfBlockCost[t0+1][bestK])) {
+          bestK = k;
+        }
+      }
+
+      kPtr[blocki] = bestK;
+      budget += halfBlockBits[t0][bestK] + halfBlockBits[t0+1][bestK];
+    }
+
+    budget /= 32;
+
+    while (true) {
+      int maxTid = -1;
+      int maxCost = 0;
+
+      for (int tid = 0; tid < 32; tid++) {
+        const int k = kPtr[tid / 2];
+        if (k != RICE2_SKIP_BLOCK_K && halfBlockCost[tid][k] > maxCost) {
+          maxTid = tid;
+          maxCost = halfBlockCost[tid][k];
+        }
+      }
+
+      if (maxTid == -1) {
+        break;
+      }
+
+      const int blocki = maxTid / 2;
+      const int t0 = blocki * 2;
+      const int k = kPtr[blocki];
+      int bestK = k;
+
+      for (int otherK = 0; otherK < numK; otherK++) {
+        if (max(halfBlockCost[t0][otherK], halfBlockCost[t0+1][otherK]) < max(halfBlockCost[t0][bestK], halfBlockCost[t0+1][bestK])) {
+          bestK = otherK;
+        }
+      }
+
+      const int numExtraBits = (halfBlockBits[t0][bestK] + halfBlockBits[t0+1][bestK]) - (halfBlockBits[t0][k] + halfBlockBits[t0+1][k]);
+
+      if (bestK == k || numExtraBits > budget) {
+        break;
+      }
+
+      kPtr[blocki] = bestK;
+      budget -= numExtraBits;
+    }
+  }
+}
+
+// Gather padded image order symbols for a width x height plane into s32
+// layout and select the k for each 8x8 block. This sets the dimensions
+// and k table of outPlane, rice2_encode_plane_bits() then writes the bits.
+
+template <const int ESC = 16>
+static inline
+void rice2_plane_k_table(const vector<uint8_t> & imageOrderDeltas,
+                         const int width,
+                         const int height,
+                         Rice2EncodedPlane & outPlane,
+                         vector<uint8_t> & s32OrderSymbols,
+                         const Rice2KSearch kSearch = Rice2KSearchMinBits)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+  const int numValuesInBlock = blockDim * blockDim;
+
+  outPlane.width = width;
+  outPlane.height = height;
+  outPlane.numBigBlocksInWidth = (width + bigBlockDim - 1) / bigBlockDim;
+  outPlane.numBigBlocksInHeight = (height + bigBlockDim - 1) / bigBlockDim;
+  outPlane.escapeNumBits = ESC;
+
+  const int blockN = outPlane.numBlocks();
+
+  assert(imageOrderDeltas.size() == (size_t) (blockN * numValuesInBlock));
+
+  // Image order deltas are gathered directly into s32 layout, each 8x8
+  // block is 64 contiguous bytes in big block order.
+
+  s32OrderSymbols.resize(blockN * numValuesInBlock);
+
+  block_s32_format_image_order(imageOrderDeltas.data(),
+                               s32OrderSymbols.data(),
+                               outPlane.numBigBlocksInWidth,
+                               outPlane.numBigBlocksInHeight);
+
+  // Optimal k for each 8x8 block in big block order, with a zero pad entry.
+  // A block where every symbol is zero is marked with RICE2_SKIP_BLOCK_K
+  // and emits no bits.
+
+  outPlane.blockOptimalKTable.resize(blockN + 1);
+
+  for (int blocki = 0; blocki < blockN; blocki++) {
+    const uint8_t *blockPtr = &s32OrderSymbols[blocki * numValuesInBlock];
+
+    if (rice2_is_skip_block(blockPtr, numValuesInBlock)) {
+      outPlane.blockOptimalKTable[blocki] = RICE2_SKIP_BLOCK_K;
+    } else if (kSearch == Rice2KSearchMinBits) {
+      outPlane.blockOptimalKTable[blocki] = optimalRiceKG4<8, ESC>(blockPtr, numValuesInBlock);
+    } else {
+      outPlane.blockOptimalKTable[blocki] = 0;
+    }
+  }
+
+  if (kSearch == Rice2KSearchDecodeCost) {
+    rice2_block_k_decode_cost<ESC>(s32OrderSymbols.data(), blockN / 16, outPlane.blockOptimalKTable.data());
+  }
+
+  outPlane.blockOptimalKTable[blockN] = 0;
+
+  return;
+}
+
+// Rice encode s32 order symbols with the k table of outPlane and generate
+// the half block offsets.
+
+template <const int ESC = 16>
+static inline
+void rice2_encode_plane_bits(const vector<uint8_t> & s32OrderSymbols,
+                             Rice2EncodedPlane & outPlane)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int numValuesInBlock = blockDim * blockDim;
+
+  const int blockN = outPlane.numBlocks();
+
+  assert(s32OrderSymbols.size() == (size_t) (blockN * numValuesInBlock));
+  assert(outPlane.escapeNumBits == ESC);
+
+  vector<uint8_t> codedSymbols;
+  vector<uint8_t> halfBlockOptimalKTable;
+
+  codedSymbols.reserve(s32OrderSymbols.size());
+  halfBlockOptimalKTable.reserve((blockN * 2) + 1);
+
+  // Blocks other than skip blocks are gathered into a compacted symbol
+  // buffer with the same k for both half blocks.
+
+  for (int blocki = 0; blocki < blockN; blocki++) {
+    const uint8_t *blockPtr = &s32OrderSymbols[blocki * numValuesInBlock];
+    const uint8_t k = outPlane.blockOptimalKTable[blocki];
+
+    if (k == RICE2_SKIP_BLOCK_K) {
+      continue;
+    }
+
+    halfBlockOptimalKTable.push_back(k);
+    halfBlockOptimalKTable.push_back(k);
+    codedSymbols.insert(codedSymbols.end(), blockPtr, blockPtr + numValuesInBlock);
+  }
+
+  halfBlockOptimalKTable.push_back(0);
+
+  // Rice encode with the half block k table and rewrite as 32 bit words
+
+  RiceSplit16EncoderG4<false, true, BitWriterByteStream, 8, ESC> encoder;
+
+  vector<uint32_t> countTable;
+  vector<uint32_t> nTable;
+
+  const int numHalfBlocks = blockN * 2;
+  const int numCodedHalfBlocks = (int)halfBlockOptimalKTable.size() - 1;
+  const int numValuesInHalfBlock = numValuesInBlock / 2;
+
+  if (numCodedHalfBlocks > 0) {
+    countTable.push_back(numCodedHalfBlocks);
+    nTable.push_back(numValuesInHalfBlock);
+  }
+
+  encoder.encode(codedSymbols.data(), (int)codedSymbols.size(),
+                 halfBlockOptimalKTable.data(), (int)halfBlockOptimalKTable.size(),
+                 countTable, nTable);
+
+  vector<uint8_t> plainBytes = encoder.bitWriter.moveBytes();
+
+  outPlane.riceEncodedBits = PrefixBitStreamRewrite32(plainBytes);
+
+  // Bit offset at the start of each half block, a skip block starts at
+  // the offset of the next coded block.
+
+  outPlane.halfBlockOffsetTable.clear();
+  outPlane.halfBlockOffsetTable.reserve(numHalfBlocks);
+
+  uint32_t bitOffset = 0;
+
+  for ( int i = 0; i < (int)s32OrderSymbols.size(); i++ ) {
+    if ((i % numValuesInHalfBlock) == 0) {
+      outPlane.halfBlockOffsetTable.push_back(bitOffset);
+    }
+
+    int k = outPlane.blockOptimalKTable[i / numValuesInBlock];
+    if (k != RICE2_SKIP_BLOCK_K) {
+#if defined(DEBUG)
+      // Encode very large images with Rice2Large.hpp so that offsets fit
+      {
+        uint64_t offset64 = bitOffset;
+        offset64 += encoder.numBits(s32OrderSymbols[i], k);
+        assert(offset64 <= 0xFFFFFFFF);
+      }
+#endif // DEBUG
+      bitOffset += encoder.numBits(s32OrderSymbols[i], k);
+    }
+  }
+
+  return;
+}
+
+// Encode padded image order symbols for a width x height plane, this is
+// every step after the 32x32 block deltas. ESC is the escape bit width.
+
+template <const int ESC = 16>
+static inline
+void rice2_encode_plane_symbols(const vector<uint8_t> & imageOrderDeltas,
+                                const int width,
+                                const int height,
+                                Rice2EncodedPlane & outPlane,
+                                const Rice2KSearch kSearch = Rice2KSearchMinBits)
+{
+  vector<uint8_t> s32OrderSymbols;
+
+  rice2_plane_k_table<ESC>(imageOrderDeltas, width, height, outPlane, s32OrderSymbols, kSearch);
+  rice2_encode_plane_bits<ESC>(s32OrderSymbols, outPlane);
+
+  return;
+}
+
+// Encode one 8 bit plane of width x height pixels into outPlane
+
+static inline
+void rice2_encode_plane(const uint8_t * inBytes,
+                        const int width,
+                        const int height,
+                        Rice2EncodedPlane & outPlane,
+                        const BlockDeltaPredictor predictor = BlockDeltaPredictorLeft,
+                        const Rice2KSearch kSearch = Rice2KSearchMinBits)
+{
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+  vector<uint8_t> imageOrderDeltas;
+
+  rice2_image_order_deltas(inBytes, width, height,
+                           (width + bigBlockDim - 1) / bigBlockDim,
+                           (height + bigBlockDim - 1) / bigBlockDim,
+                           imageOrderDeltas,
+                           predictor);
+
+  rice2_encode_plane_symbols(imageOrderDeltas, width, height, outPlane, kSearch);
+
+  outPlane.predictor = predictor;
+
+  return;
+}
+
+// Encode with each predictor and keep the smallest result, ties keep
+// the simpler predictor in Left, Gradient, MED order.
+
+static inline
+void rice2_encode_plane_best_predictor(const uint8_t * inBytes,
+                                       const int width,
+                                       const int height,
+                                       Rice2EncodedPlane & outPlane)
+{
+  rice2_encode_plane(inBytes, width, height, outPlane, BlockDeltaPredictorLeft);
+
+  for ( BlockDeltaPredictor predictor : { BlockDeltaPredictorGradient, BlockDeltaPredictorMED } ) {
+    Rice2EncodedPlane plane;
+
+    rice2_encode_plane(inBytes, width, height, plane, predictor);
+
+    if (plane.riceEncodedBits.size() < outPlane.riceEncodedBits.size()) {
+      outPlane = std::move(plane);
+    }
+  }
+
+  return;
+}
+
+// Encode with each escape bit width and keep the smallest result, ties
+// keep the wider escape. A shorter escape bounds the bits read for each
+// symbol in noisy regions where long unary prefixes stall the decoder.
+
+static inline
+void rice2_encode_plane_best_escape(const uint8_t * inBytes,
+                                    const int width,
+                                    const int height,
+                                    Rice2EncodedPlane & outPlane)
+{
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+  vector<uint8_t> imageOrderDeltas;
+
+  rice2_image_order_deltas(inBytes, width, height,
+                           (width + bigBlockDim - 1) / bigBlockDim,
+                           (height + bigBlockDim - 1) / bigBlockDim,
+                           imageOrderDeltas);
+
+  rice2_encode_plane_symbols<16>(imageOrderDeltas, width, height, outPlane);
+
+  Rice2EncodedPlane plane;
+
+  rice2_encode_plane_symbols<12>(imageOrderDeltas, width, height, plane);
+
+  if (plane.riceEncodedBits.size() < outPlane.riceEncodedBits.size()) {
+    outPlane = std::move(plane);
+  }
+
+  rice2_encode_plane_symbols<8>(imageOrderDeltas, width, height, plane);
+
+  if (plane.riceEncodedBits.size() < outPlane.riceEncodedBits.size()) {
+    outPlane = std::move(plane);
+  }
+
+  return;
+}
+
+// Run the per thread decode logic for every (bbid, tid) pair with the
+// given escape bit width.
+
+template <const int ESC, typename REPORT>
+static inline
+void rice2_decode_big_blocks(const Rice2EncodedPlane & inPlane,
+                             RiceRenderUniform & riceRenderUniform,
+                             uint32_t *outPixels32,
+                             REPORT *report)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+
+  uint32_t *halfBlockOffsetTablePtr = (uint32_t *) inPlane.halfBlockOffsetTable.data();
+  const uint32_t *bitsPtr = (const uint32_t *) inPlane.riceEncodedBits.data();
+
+  const int numBigBlocks = inPlane.numBigBlocksInWidth * inPlane.numBigBlocksInHeight;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    for (int tid = 0; tid < 32; tid++) {
+      kernel_render_rice_typed<blockDim, REPORT, ESC>(outPixels32,
+                                                      riceRenderUniform,
+                                                      halfBlockOffsetTablePtr,
+                                                      bitsPtr,
+                                                      inPlane.blockOptimalKTable.data(),
+                                                      RenderRiceTypedDecode,
+                                                      bbid,
+                                                      tid,
+                                                      NULL,
+                                                      report);
+    }
+  }
+}
+
+// Decode rice bits for all big blocks into padded image order deltas.
+// Each (bbid, tid) pair executes the same logic as one shader thread.
+// Pass a RiceDecodeStatsReport to collect decode statistics.
+
+template <typename REPORT = RiceDecodeStatsNone>
+static inline
+void rice2_decode_plane_deltas(const Rice2EncodedPlane & inPlane,
+                               vector<uint8_t> & outImageOrderDeltas,
+                               REPORT *report = nullptr)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+
+  const int paddedWidth = inPlane.paddedWidth();
+  const int paddedHeight = inPlane.paddedHeight();
+
+  RiceRenderUniform riceRenderUniform;
+  riceRenderUniform.numBlocksInWidth = paddedWidth / blockDim;
+  riceRenderUniform.numBlocksInHeight = paddedHeight / blockDim;
+  riceRenderUniform.numBlocksEachSegment = 1;
+
+  outImageOrderDeltas.resize(paddedWidth * paddedHeight);
+
+  uint32_t *outPixels32 = (uint32_t *) outImageOrderDeltas.data();
+
+  switch (inPlane.escapeNumBits) {
+    case 8:
+      rice2_decode_big_blocks<8>(inPlane, riceRenderUniform, outPixels32, report);
+      break;
+    case 12:
+      rice2_decode_big_blocks<12>(inPlane, riceRenderUniform, outPixels32, report);
+      break;
+    default:
+      assert(inPlane.escapeNumBits == 16);
+      rice2_decode_big_blocks<16>(inPlane, riceRenderUniform, outPixels32, report);
+      break;
+  }
+
+  return;
+}
+
+// Expand the big block order k table into one k value for each coded
+// half block, this is the k table layout used when the bits were encoded.
+// Skip blocks have no bits and are not included.
+
+static inline
+void rice2_half_block_k_table(const Rice2EncodedPlane & inPlane,
+                              vector<uint8_t> & outHalfBlockKTable)
+{
+  const int blockN = inPlane.numBlocks();
+
+  outHalfBlockKTable.clear();
+  outHalfBlockKTable.reserve((blockN * 2) + 1);
+
+  for (int blocki = 0; blocki < blockN; blocki++) {
+    uint8_t k = inPlane.blockOptimalKTable[blocki];
+    if (k == RICE2_SKIP_BLOCK_K) {
+      continue;
+    }
+    outHalfBlockKTable.push_back(k);
+    outHalfBlockKTable.push_back(k);
+  }
+
+  outHalfBlockKTable.push_back(0);
+}
+
+// Serial decode of all half blocks in stream order with RiceSplit16DecoderG4.
+// The output is in s32 order, one half block of 32 symbols after another,
+// with skip blocks filled in as zeros.
+
+static inline
+void rice2_decode_plane_serial(const Rice2EncodedPlane & inPlane,
+                               vector<uint8_t> & outS32Symbols)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int numValuesInBlock = blockDim * blockDim;
+  const int blockN = inPlane.numBlocks();
+  const int numSymbols = blockN * numValuesInBlock;
+
+  vector<uint8_t> halfBlockKTable;
+  rice2_half_block_k_table(inPlane, halfBlockKTable);
+
+  const int numCodedHalfBlocks = (int)halfBlockKTable.size() - 1;
+  const int numCodedSymbols = numCodedHalfBlocks * (numValuesInBlock / 2);
+
+  // Convert buffer of uint32_t words back to plain byte order
+
+  const int numBytes = (int) inPlane.riceEncodedBits.size();
+  assert((numBytes % sizeof(uint32_t)) == 0);
+
+  vector<uint8_t> plainBytes(numBytes);
+  const uint32_t *wordPtr = (const uint32_t *) inPlane.riceEncodedBits.data();
+  uint8_t *bytePtr = plainBytes.data();
+
+  for (int i = 0; i < numBytes/4; i++) {
+    uint32_t word = wordPtr[i];
+    *bytePtr++ = (word >> 24) & 0xFF;
+    *bytePtr++ = (word >> 16) & 0xFF;
+    *bytePtr++ = (word >> 8) & 0xFF;
+    *bytePtr++ = word & 0xFF;
+  }
+
+  vector<uint8_t> codedSymbols(numCodedSymbols);
+
+  if (numCodedHalfBlocks > 0) {
+    vector<uint32_t> countTable;
+    vector<uint32_t> nTable;
+    countTable.push_back(numCodedHalfBlocks);
+    nTable.push_back(numValuesInBlock / 2);
+
+    auto decode = [&](auto & decoder) {
+      decoder.decode(plainBytes.data(), numBytes,
+                     codedSymbols.data(), numCodedSymbols,
+                     halfBlockKTable.data(), (int)halfBlockKTable.size(),
+                     countTable, nTable);
+    };
+
+    if (inPlane.escapeNumBits == 8) {
+      RiceSplit16DecoderG4<false, true, BitReaderByteStream, 8, 8> decoder;
+      decode(decoder);
+    } else if (inPlane.escapeNumBits == 12) {
+      RiceSplit16DecoderG4<false, true, BitReaderByteStream, 8, 12> decoder;
+      decode(decoder);
+    } else {
+      RiceSplit16DecoderG4<false, true, BitReaderByteStream> decoder;
+      decode(decoder);
+    }
+  }
+
+  // Expand coded blocks back into place
+
+  outS32Symbols.assign(numSymbols, 0);
+
+  const uint8_t *codedPtr = codedSymbols.data();
+
+  for (int blocki = 0; blocki < blockN; blocki++) {
+    if (inPlane.blockOptimalKTable[blocki] == RICE2_SKIP_BLOCK_K) {
+      continue;
+    }
+    memcpy(&outS32Symbols[blocki * numValuesInBlock], codedPtr, numValuesInBlock);
+    codedPtr += numValuesInBlock;
+  }
+
+  return;
+}
+
+// Reverse 32x32 block deltas in padded image order and crop to width x height
+
+static inline
+void rice2_undelta_plane(const uint8_t * inImageOrderDeltas,
+                         const int width,
+                         const int height,
+                         const int numBigBlocksInWidth,
+                         const int numBigBlocksInHeight,
+                         uint8_t * outBytes,
+                         const BlockDeltaPredictor predictor = BlockDeltaPredictorLeft)
+{
+  const int blockDim = RICE_LARGE_BLOCK_DIM;
+
+  const int paddedWidth = numBigBlocksInWidth * blockDim;
+  const int paddedHeight = numBigBlocksInHeight * blockDim;
+
+  vector<uint8_t> bigBlockDeltas;
+
+  block_process_encode<blockDim>(inImageOrderDeltas, paddedWidth * paddedHeight,
+                                 paddedWidth, paddedHeight,
+                                 numBigBlocksInWidth, numBigBlocksInHeight,
+                                 bigBlockDeltas);
+
+  block_delta_process_decode<blockDim>(bigBlockDeltas.data(), (int)bigBlockDeltas.size(),
+                                       width, height,
+                                       numBigBlocksInWidth, numBigBlocksInHeight,
+                                       outBytes, width * height,
+                                       predictor);
+
+  return;
+}
+
+// Decode one plane into width x height output bytes
+
+static inline
+void rice2_decode_plane(const Rice2EncodedPlane & inPlane,
+                        uint8_t * outBytes)
+{
+  vector<uint8_t> imageOrderDeltas;
+
+  rice2_decode_plane_deltas(inPlane, imageOrderDeltas);
+
+  rice2_undelta_plane(imageOrderDeltas.data(),
+                      inPlane.width, inPlane.height,
+                      inPlane.numBigBlocksInWidth, inPlane.numBigBlocksInHeight,
+                      outBytes,
+                      inPlane.predictor);
+
+  return;
+}
+
+// Upper bound on the words one thread reads past the start of its half
+// block, 32 symbols of at most 32 bits each plus the words CachedBits
+// loads ahead of the register. Bits padded with this many words can be
+// decoded from any start offset without reading past the end.
+
+#define RICE2_HALF_BLOCK_MAX_NUM_WORDS (32 + 4)
+
+// True when the k values and half block offsets of big block bbid can
+// be decoded from bits padded with RICE2_HALF_BLOCK_MAX_NUM_WORDS, that
+// is each k is a valid k or RICE2_SKIP_BLOCK_K and each coded half
+// block starts inside the bits. A tile that passes can still decode to
+// the wrong pixels, the big block hash catches that.
+
+static inline
+bool rice2_plane_tile_is_valid(const Rice2EncodedPlane & inPlane,
+                               const int bbid)
+{
+  const size_t numBits = inPlane.riceEncodedBits.size() * 8;
+
+  if (bbid < 0 ||
+      inPlane.blockOptimalKTable.size() < (size_t) ((bbid + 1) * 16) ||
+      inPlane.halfBlockOffsetTable.size() < (size_t) ((bbid + 1) * 32)) {
+    return false;
+  }
+
+  const uint8_t *kPtr = inPlane.blockOptimalKTable.data() + (bbid * 16);
+  const uint32_t *offsetPtr = inPlane.halfBlockOffsetTable.data() + (bbid * 32);
+
+  for (int tid = 0; tid < 32; tid++) {
+    const uint8_t k = kPtr[tid / 2];
+
+    if (k == RICE2_SKIP_BLOCK_K) {
+      continue;
+    }
+    if (k >= 8 || offsetPtr[tid] >= numBits) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// True when every big block of a plane passes rice2_plane_tile_is_valid(),
+// needed before the tables are handed to a GPU decode that has no per
+// tile check.
+
+static inline
+bool rice2_plane_tables_are_valid(const Rice2EncodedPlane & inPlane)
+{
+  const int numBigBlocks = inPlane.numBigBlocksInWidth * inPlane.numBigBlocksInHeight;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    if (!rice2_plane_tile_is_valid(inPlane, bbid)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Decode big block bbid into its 32x32 region of the padded image order
+// deltas, then reverse the deltas of that big block and write the pixels
+// inside width x height to outBytes. Big blocks are independent, so
+// any number of them can be decoded at the same time. Pass bitsPtr to
+// read the rice bits from a padded copy instead of the plane.
+
+template <const int ESC>
+static inline
+void rice2_decode_big_block(const Rice2EncodedPlane & inPlane,
+                            RiceRenderUniform & riceRenderUniform,
+                            const int bbid,
+                            uint8_t * imageOrderDeltas,
+                            uint8_t * outBytes,
+                            const uint32_t * bitsPtr = nullptr)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+  uint32_t *halfBlockOffsetTablePtr = (uint32_t *) inPlane.halfBlockOffsetTable.data();
+
+  if (bitsPtr == nullptr) {
+    bitsPtr = (const uint32_t *) inPlane.riceEncodedBits.data();
+  }
+
+  for (int tid = 0; tid < 32; tid++) {
+    kernel_render_rice_typed<blockDim, RiceDecodeStatsNone, ESC>((uint32_t *) imageOrderDeltas,
+                                                                 riceRenderUniform,
+                                                                 halfBlockOffsetTablePtr,
+                                                                 bitsPtr,
+                                                                 inPlane.blockOptimalKTable.data(),
+                                                                 RenderRiceTypedDecode,
+                                                                 bbid,
+                                                                 tid,
+                                                                 NULL,
+                                                                 (RiceDecodeStatsNone *) nullptr);
+  }
+
+  const int width = inPlane.width;
+  const int height = inPlane.height;
+  const int paddedWidth = inPlane.paddedWidth();
+  const int x0 = (bbid % inPlane.numBigBlocksInWidth) * bigBlockDim;
+  const int y0 = (bbid / inPlane.numBigBlocksInWidth) * bigBlockDim;
+  const int numCols = min(bigBlockDim, width - x0);
+  const int numRows = min(bigBlockDim, height - y0);
+
+  if (inPlane.predictor != BlockDeltaPredictorLeft) {
+    uint8_t pixels[RICE_LARGE_BLOCK_DIM * RICE_LARGE_BLOCK_DIM];
+
+    block_delta_predict_decode(inPlane.predictor, bigBlockDim,
+                               imageOrderDeltas + (y0 * paddedWidth) + x0, paddedWidth,
+                               pixels, bigBlockDim);
+
+    for (int row = 0; row < numRows; row++) {
+      memcpy(outBytes + ((y0 + row) * width) + x0, pixels + (row * bigBlockDim), numCols);
+    }
+
+    return;
+  }
+
+  // Column 0 is a prefix sum down from (0,0), then each row is a prefix
+  // sum from column 0. Only the cropped pixels are needed.
+
+  uint8_t above = 0;
+
+  for (int row = 0; row < numRows; row++) {
+    const uint8_t *deltaRowPtr = imageOrderDeltas + ((y0 + row) * paddedWidth) + x0;
+    uint8_t *outRowPtr = outBytes + ((y0 + row) * width) + x0;
+
+    if (row == 0) {
+      above = deltaRowPtr[0];
+    } else {
+      above += (uint8_t) zigzag_offset_to_num_neg(deltaRowPtr[0]);
+    }
+
+    uint8_t left = above;
+    outRowPtr[0] = left;
+
+    for (int col = 1; col < numCols; col++) {
+      left += (uint8_t) zigzag_offset_to_num_neg(deltaRowPtr[col]);
+      outRowPtr[col] = left;
+    }
+  }
+
+  return;
+}
+
+// Copy the rice bits of a plane followed by RICE2_HALF_BLOCK_MAX_NUM_WORDS
+// padding words, see rice2_plane_tile_is_valid(). The padding is all
+// ones, so a thread that runs past the bits decodes 1 bit prefixes and
+// never an escape.
+
+static inline
+void rice2_plane_padded_bits(const Rice2EncodedPlane & inPlane,
+                             vector<uint32_t> & outBits)
+{
+  const int numWords = (int) ((inPlane.riceEncodedBits.size() + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+  outBits.assign(numWords + RICE2_HALF_BLOCK_MAX_NUM_WORDS, 0xFFFFFFFF);
+
+  if (numWords > 0) {
+    outBits[numWords - 1] = 0;
+    memcpy(outBits.data(), inPlane.riceEncodedBits.data(), inPlane.riceEncodedBits.size());
+  }
+}
+
+// Decode one plane a big block at a time. tileDone(bbid) is invoked as
+// soon as the pixels of big block bbid have been written to outBytes.
+// Big blocks are run on the pool when one is passed. Pass scratch to
+// reuse the padded deltas buffer between calls, so that decoding a
+// sequence of frames with the same dimensions does not allocate.
+// Pass paddedBits from rice2_plane_padded_bits() to decode untrusted
+// tables, a big block that fails rice2_plane_tile_is_valid() is then
+// not decoded but tileDone(bbid) is still invoked.
+
+template <typename F>
+static inline
+void rice2_decode_plane_tiles(const Rice2EncodedPlane & inPlane,
+                              uint8_t * outBytes,
+                              F tileDone,
+                              RiceThreadPool *pool = nullptr,
+                              vector<uint8_t> *scratch = nullptr,
+                              const vector<uint32_t> *paddedBits = nullptr)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+
+  const int paddedWidth = inPlane.paddedWidth();
+  const int paddedHeight = inPlane.paddedHeight();
+  const int numBigBlocks = inPlane.numBigBlocksInWidth * inPlane.numBigBlocksInHeight;
+
+  RiceRenderUniform riceRenderUniform;
+  riceRenderUniform.numBlocksInWidth = paddedWidth / blockDim;
+  riceRenderUniform.numBlocksInHeight = paddedHeight / blockDim;
+  riceRenderUniform.numBlocksEachSegment = 1;
+
+  vector<uint8_t> localDeltas;
+  vector<uint8_t> & imageOrderDeltas = (scratch != nullptr) ? *scratch : localDeltas;
+  imageOrderDeltas.resize(paddedWidth * paddedHeight);
+
+  const uint32_t *bitsPtr = (paddedBits != nullptr) ? paddedBits->data() : nullptr;
+
+  auto decodeTile = [&](int bbid) {
+    if (paddedBits != nullptr && !rice2_plane_tile_is_valid(inPlane, bbid)) {
+      tileDone(bbid);
+      return;
+    }
+    switch (inPlane.escapeNumBits) {
+      case 8:
+        rice2_decode_big_block<8>(inPlane, riceRenderUniform, bbid, imageOrderDeltas.data(), outBytes, bitsPtr);
+        break;
+      case 12:
+        rice2_decode_big_block<12>(inPlane, riceRenderUniform, bbid, imageOrderDeltas.data(), outBytes, bitsPtr);
+        break;
+      default:
+        assert(inPlane.escapeNumBits == 16);
+        rice2_decode_big_block<16>(inPlane, riceRenderUniform, bbid, imageOrderDeltas.data(), outBytes, bitsPtr);
+        break;
+    }
+    tileDone(bbid);
+  };
+
+  if (pool) {
+    pool->parallelFor(numBigBlocks, decodeTile, 4);
+  } else {
+    for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+      decodeTile(bbid);
+    }
+  }
+
+  return;
+}
+
+// Decode a plane parsed from untrusted bytes. The bits are decoded from
+// a padded copy and a big block that fails rice2_plane_tile_is_valid()
+// is not decoded. Returns the number of big blocks that were not
+// decoded, the bbid of each one is appended to outBadBlocks in bbid
+// order when passed.
+
+static inline
+int rice2_decode_plane_checked(const Rice2EncodedPlane & inPlane,
+                               uint8_t * outBytes,
+                               RiceThreadPool *pool = nullptr,
+                               vector<int> *outBadBlocks = nullptr)
+{
+  const int numBigBlocks = inPlane.numBigBlocksInWidth * inPlane.numBigBlocksInHeight;
+
+  vector<uint32_t> paddedBits;
+  rice2_plane_padded_bits(inPlane, paddedBits);
+
+  rice2_decode_plane_tiles(inPlane, outBytes, [](int) {}, pool, nullptr, &paddedBits);
+
+  int numBad = 0;
+
+  for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+    if (!rice2_plane_tile_is_valid(inPlane, bbid)) {
+      numBad += 1;
+      if (outBadBlocks) {
+        outBadBlocks->push_back(bbid);
+      }
+    }
+  }
+
+  return numBad;
+}
+
+#endif // _Rice2Codec_hpp
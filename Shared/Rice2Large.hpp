@@ -0,0 +1,376 @@
+//
+//  Rice2Large.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Large image mode for a single 8 bit plane. The Metal uniforms store
+//  dimensions and block counts as 16 bit values and the half block
+//  offsets are 32 bit bit offsets, so one Rice2EncodedPlane is limited
+//  to 65535 pixels on a side and 512 MB of bits. A large plane has 32
+//  bit dimensions and is split into a grid of square segments, each
+//  segment is an ordinary Rice2 plane with offsets relative to the
+//  start of its own bits. Segments are stored in one buffer with a 64
+//  bit base offset for each segment. Segment edges fall on big block
+//  edges and big blocks never predict across an edge, so the segments
+//  can be encoded and decoded on the CPU in any order.
+
+#ifndef _Rice2Large_hpp
+#define _Rice2Large_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "EncDec.hpp"
+#include "Rice2Codec.hpp"
+#include "Rice2Planes.hpp"
+#include "RiceThreadPool.hpp"
+
+using namespace std;
+
+// Default and max segment dimension. An 8192x8192 segment is at most
+// 64M symbols, and with the 16 bit escape no symbol takes more than 25
+// bits, so the relative half block offsets always fit in 32 bits.
+
+#define RICE2_LARGE_SEGMENT_DIM 8192
+
+class Rice2LargePlane
+{
+public:
+  uint32_t width;
+  uint32_t height;
+
+  // Segment width and height, a multiple of the big block dimension.
+  // Segments in the last column and row are cropped to the image.
+  int segmentDim;
+
+  int numSegmentsInWidth;
+  int numSegmentsInHeight;
+
+  // Segments in row major order
+
+  vector<Rice2EncodedPlane> segments;
+
+  Rice2LargePlane()
+  : width(0),
+  height(0),
+  segmentDim(RICE2_LARGE_SEGMENT_DIM),
+  numSegmentsInWidth(0),
+  numSegmentsInHeight(0)
+  {
+  }
+
+  int numSegments() const {
+    return numSegmentsInWidth * numSegmentsInHeight;
+  }
+
+  uint32_t segmentX(const int segi) const {
+    return (uint32_t) (segi % numSegmentsInWidth) * segmentDim;
+  }
+
+  uint32_t segmentY(const int segi) const {
+    return (uint32_t) (segi / numSegmentsInWidth) * segmentDim;
+  }
+
+  int segmentWidth(const int segi) const {
+    return (int) min((uint32_t) segmentDim, width - segmentX(segi));
+  }
+
+  int segmentHeight(const int segi) const {
+    return (int) min((uint32_t) segmentDim, height - segmentY(segi));
+  }
+
+  // Total number of bytes of rice bits in all segments
+
+  uint64_t numBitsBytes() const {
+    uint64_t numBytes = 0;
+    for ( const Rice2EncodedPlane & segment : segments ) {
+      numBytes += segment.riceEncodedBits.size();
+    }
+    return numBytes;
+  }
+
+  // Serialize as a header, a table of 64 bit segment base offsets, and
+  // each segment written with rice2_plane_write(). A base offset is
+  // relative to the first segment, the table has one extra entry that
+  // holds the end offset.
+
+  vector<uint8_t> encode() const {
+    vector<uint8_t> buf;
+    vector<uint8_t> segmentsBuf;
+    vector<uint64_t> baseOffsets;
+
+    baseOffsets.reserve(segments.size() + 1);
+
+    for ( const Rice2EncodedPlane & segment : segments ) {
+      baseOffsets.push_back(segmentsBuf.size());
+      rice2_plane_write(segment, segmentsBuf, false, true);
+    }
+    baseOffsets.push_back(segmentsBuf.size());
+
+    ::encode(buf, (uint32_t) 0x474c3252); // "R2LG"
+    ::encode(buf, width);
+    ::encode(buf, height);
+    ::encode(buf, (uint32_t) segmentDim);
+
+    for ( uint64_t baseOffset : baseOffsets ) {
+      ::encode(buf, baseOffset);
+    }
+
+    append(buf, segmentsBuf);
+
+    return buf;
+  }
+
+  // Parse a buffer created by encode(), returns false if the buffer
+  // does not contain a valid large plane. Each segment is parsed from
+  // its own copy of the segment bytes, since the byte offsets used by
+  // rice2_plane_read() are 32 bit.
+
+  bool decode(const vector<uint8_t> & buf) {
+    const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+    int offset = 0;
+    uint32_t magic, w, h, dim;
+
+    if (buf.size() < 16) {
+      return false;
+    }
+
+    ::decode(buf, offset, magic);
+
+    if (magic != 0x474c3252) {
+      return false;
+    }
+
+    ::decode(buf, offset, w);
+    ::decode(buf, offset, h);
+    ::decode(buf, offset, dim);
+
+    if (w == 0 || h == 0 || dim == 0 || (dim % bigBlockDim) != 0 || dim > RICE2_LARGE_SEGMENT_DIM) {
+      return false;
+    }
+
+    // The segment count must fit in an int and the base offset table
+    // must fit in the buffer before anything is allocated
+
+    const uint64_t numSegsInWidth = (w + (uint64_t) dim - 1) / dim;
+    const uint64_t numSegsInHeight = (h + (uint64_t) dim - 1) / dim;
+    const uint64_t numSegs64 = numSegsInWidth * numSegsInHeight;
+
+    if (numSegs64 >= INT_MAX ||
+        ((numSegs64 + 1) * sizeof(uint64_t)) > (buf.size() - offset)) {
+      return false;
+    }
+
+    width = w;
+    height = h;
+    segmentDim = dim;
+    numSegmentsInWidth = (int) numSegsInWidth;
+    numSegmentsInHeight = (int) numSegsInHeight;
+
+    const int numSegs = (int) numSegs64;
+
+    vector<uint64_t> baseOffsets(numSegs + 1);
+
+    for ( uint64_t & baseOffset : baseOffsets ) {
+      ::decode(buf, offset, baseOffset);
+    }
+
+    const uint64_t segmentsStart = offset;
+
+    if (baseOffsets[0] != 0 || (segmentsStart + baseOffsets[numSegs]) != buf.size()) {
+      return false;
+    }
+
+    segments.clear();
+    segments.resize(numSegs);
+
+    for (int segi = 0; segi < numSegs; segi++) {
+      if (baseOffsets[segi+1] < baseOffsets[segi]) {
+        return false;
+      }
+
+      vector<uint8_t> segmentBuf(buf.begin() + (segmentsStart + baseOffsets[segi]),
+                                 buf.begin() + (segmentsStart + baseOffsets[segi+1]));
+
+      int segmentOffset = 0;
+      bool worked = rice2_plane_read(segmentBuf, segmentOffset,
+                                     segmentWidth(segi), segmentHeight(segi),
+                                     segments[segi], false, true);
+
+      if (!worked || segmentOffset != (int) segmentBuf.size()) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+};
+
+// Encode one 8 bit plane of width x height pixels as a large plane.
+// Each segment is copied out of the input and encoded with
+// rice2_encode_plane(), segments run on the pool when one is passed.
+
+static inline
+void rice2_large_encode_plane(const uint8_t * inBytes,
+                              const uint32_t width,
+                              const uint32_t height,
+                              Rice2LargePlane & outPlane,
+                              const BlockDeltaPredictor predictor = BlockDeltaPredictorLeft,
+                              const Rice2KSearch kSearch = Rice2KSearchMinBits,
+                              const int segmentDim = RICE2_LARGE_SEGMENT_DIM,
+                              RiceThreadPool *pool = nullptr)
+{
+  assert(width > 0 && height > 0);
+  assert(segmentDim > 0 && (segmentDim % RICE_LARGE_BLOCK_DIM) == 0);
+  assert(segmentDim <= RICE2_LARGE_SEGMENT_DIM);
+
+  outPlane.width = width;
+  outPlane.height = height;
+  outPlane.segmentDim = segmentDim;
+  outPlane.numSegmentsInWidth = (int) ((width + (uint64_t) segmentDim - 1) / segmentDim);
+  outPlane.numSegmentsInHeight = (int) ((height + (uint64_t) segmentDim - 1) / segmentDim);
+
+  outPlane.segments.clear();
+  outPlane.segments.resize(outPlane.numSegments());
+
+  auto encodeSegment = [&](int segi) {
+    const uint32_t x0 = outPlane.segmentX(segi);
+    const uint32_t y0 = outPlane.segmentY(segi);
+    const int segWidth = outPlane.segmentWidth(segi);
+    const int segHeight = outPlane.segmentHeight(segi);
+
+    vector<uint8_t> segmentBytes(segWidth * segHeight);
+
+    for (int row = 0; row < segHeight; row++) {
+      memcpy(segmentBytes.data() + (row * segWidth),
+             inBytes + (((size_t) (y0 + row)) * width) + x0,
+             segWidth);
+    }
+
+    rice2_encode_plane(segmentBytes.data(), segWidth, segHeight,
+                       outPlane.segments[segi], predictor, kSearch);
+  };
+
+  if (pool) {
+    pool->parallelFor(outPlane.numSegments(), encodeSegment, 1);
+  } else {
+    for (int segi = 0; segi < outPlane.numSegments(); segi++) {
+      encodeSegment(segi);
+    }
+  }
+
+  return;
+}
+
+// Decode the region (x, y, regionWidth, regionHeight) of a large plane,
+// pixel (x, y) is written to outBytes[0] and rows are outStride bytes
+// apart. Only the big blocks that overlap the region are decoded, one
+// segment at a time or one segment per pool thread. Segments come from
+// untrusted bytes, so the bits are decoded from a padded copy and a big
+// block that fails rice2_plane_tile_is_valid() is left as zeros. Returns
+// the number of big blocks in the region that were not decoded.
+
+static inline
+int rice2_large_decode_region(const Rice2LargePlane & inPlane,
+                               const uint32_t x,
+                               const uint32_t y,
+                               const uint32_t regionWidth,
+                               const uint32_t regionHeight,
+                               uint8_t * outBytes,
+                               const size_t outStride,
+                               RiceThreadPool *pool = nullptr)
+{
+  assert(regionWidth > 0 && regionHeight > 0);
+  assert(x + (uint64_t) regionWidth <= inPlane.width);
+  assert(y + (uint64_t) regionHeight <= inPlane.height);
+
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const uint32_t bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+  const uint32_t segmentDim = inPlane.segmentDim;
+
+  const int firstCol = (int) (x / segmentDim);
+  const int lastCol = (int) ((x + regionWidth - 1) / segmentDim);
+  const int firstRow = (int) (y / segmentDim);
+  const int lastRow = (int) ((y + regionHeight - 1) / segmentDim);
+
+  const int numCols = lastCol - firstCol + 1;
+  const int numRows = lastRow - firstRow + 1;
+
+  atomic<int> numBad(0);
+
+  auto decodeSegment = [&](int i) {
+    const int segi = ((firstRow + (i / numCols)) * inPlane.numSegmentsInWidth) + firstCol + (i % numCols);
+    const Rice2EncodedPlane & segment = inPlane.segments[segi];
+
+    const uint32_t x0 = inPlane.segmentX(segi);
+    const uint32_t y0 = inPlane.segmentY(segi);
+
+    // Intersection of the segment and the region in image coordinates
+
+    const uint32_t minX = max(x, x0);
+    const uint32_t maxX = min(x + regionWidth, x0 + segment.width);
+    const uint32_t minY = max(y, y0);
+    const uint32_t maxY = min(y + regionHeight, y0 + segment.height);
+
+    RiceRenderUniform riceRenderUniform;
+    riceRenderUniform.numBlocksInWidth = segment.paddedWidth() / blockDim;
+    riceRenderUniform.numBlocksInHeight = segment.paddedHeight() / blockDim;
+    riceRenderUniform.numBlocksEachSegment = 1;
+
+    vector<uint8_t> imageOrderDeltas(segment.paddedWidth() * segment.paddedHeight());
+    vector<uint8_t> segmentBytes(segment.width * segment.height);
+
+    vector<uint32_t> paddedBits;
+    rice2_plane_padded_bits(segment, paddedBits);
+
+    assert(segment.escapeNumBits == 16);
+
+    for (uint32_t bigBlockY = (minY - y0) / bigBlockDim; bigBlockY <= (maxY - 1 - y0) / bigBlockDim; bigBlockY++) {
+      for (uint32_t bigBlockX = (minX - x0) / bigBlockDim; bigBlockX <= (maxX - 1 - x0) / bigBlockDim; bigBlockX++) {
+        const int bbid = (bigBlockY * segment.numBigBlocksInWidth) + bigBlockX;
+        if (!rice2_plane_tile_is_valid(segment, bbid)) {
+          numBad += 1;
+          continue;
+        }
+        rice2_decode_big_block<16>(segment, riceRenderUniform, bbid, imageOrderDeltas.data(), segmentBytes.data(), paddedBits.data());
+      }
+    }
+
+    for (uint32_t rowY = minY; rowY < maxY; rowY++) {
+      memcpy(outBytes + ((rowY - y) * outStride) + (minX - x),
+             segmentBytes.data() + ((rowY - y0) * segment.width) + (minX - x0),
+             maxX - minX);
+    }
+  };
+
+  if (pool) {
+    pool->parallelFor(numCols * numRows, decodeSegment, 1);
+  } else {
+    for (int i = 0; i < numCols * numRows; i++) {
+      decodeSegment(i);
+    }
+  }
+
+  return numBad;
+}
+
+// Decode a large plane into width x height output bytes, returns the
+// number of big blocks that were not decoded
+
+static inline
+int rice2_large_decode_plane(const Rice2LargePlane & inPlane,
+                             uint8_t * outBytes,
+                             RiceThreadPool *pool = nullptr)
+{
+  return rice2_large_decode_region(inPlane, 0, 0, inPlane.width, inPlane.height,
+                                   outBytes, inPlane.width, pool);
+}
+
+#endif // _Rice2Large_hpp
@@ -0,0 +1,625 @@
+//
+//  Rice2Planes.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Multi plane encode and decode for interleaved BGRA pixels. Input
+//  pixels are split into 8 bit planes in a single pass, optionally
+//  with a reversible YCoCg-R transform, and each plane is encoded
+//  in the Rice2 format. All planes are stored in one container that
+//  includes the per plane k and half block offset tables. Planes are
+//  independent so decoding runs one thread per plane. Planes can carry
+//  optional per big block hashes, each tile is checked as it decodes,
+//  and an optional tid table that balances the work of GPU threads.
+
+#ifndef _Rice2Planes_hpp
+#define _Rice2Planes_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <thread>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "EncDec.hpp"
+#include "Rice2Balance.hpp"
+#include "Rice2Codec.hpp"
+#include "Rice2Checksum.hpp"
+
+using namespace std;
+
+// Reversible YCoCg-R transform implemented with lifting steps modulo 256.
+// Each lifting step adds or subtracts a function of another channel, so
+// the transform is lossless with 8 bit Co and Cg even though the full
+// range transform would require 9 bits.
+
+static inline
+int8_t rice2_ycocg_half(uint8_t v) {
+  return ((int8_t) v) >> 1;
+}
+
+static inline
+void rice2_ycocg_forward(uint8_t R, uint8_t G, uint8_t B,
+                         uint8_t & Y, uint8_t & Co, uint8_t & Cg)
+{
+  Co = R - B;
+  uint8_t t = B + rice2_ycocg_half(Co);
+  Cg = G - t;
+  Y = t + rice2_ycocg_half(Cg);
+}
+
+static inline
+void rice2_ycocg_reverse(uint8_t Y, uint8_t Co, uint8_t Cg,
+                         uint8_t & R, uint8_t & G, uint8_t & B)
+{
+  uint8_t t = Y - rice2_ycocg_half(Cg);
+  G = Cg + t;
+  B = t - rice2_ycocg_half(Co);
+  R = B + Co;
+}
+
+// Split BGRA pixels into 4 planes in B G R A order. SIMD implementations
+// process 16 pixels per loop, the remaining pixels use the scalar loop.
+
+static inline
+void rice2_bgra_deinterleave(const uint32_t * inPixels,
+                             const int numPixels,
+                             uint8_t * outB,
+                             uint8_t * outG,
+                             uint8_t * outR,
+                             uint8_t * outA)
+{
+  const uint8_t *inBytes = (const uint8_t *) inPixels;
+  int i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for ( ; (i + 16) <= numPixels; i += 16) {
+    uint8x16x4_t v = vld4q_u8(inBytes + (i * 4));
+    vst1q_u8(outB + i, v.val[0]);
+    vst1q_u8(outG + i, v.val[1]);
+    vst1q_u8(outR + i, v.val[2]);
+    vst1q_u8(outA + i, v.val[3]);
+  }
+#elif defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi32(0xFF);
+
+  for ( ; (i + 16) <= numPixels; i += 16) {
+    const __m128i *inPtr = (const __m128i *) (inBytes + (i * 4));
+    __m128i p0 = _mm_loadu_si128(inPtr + 0);
+    __m128i p1 = _mm_loadu_si128(inPtr + 1);
+    __m128i p2 = _mm_loadu_si128(inPtr + 2);
+    __m128i p3 = _mm_loadu_si128(inPtr + 3);
+
+    __m128i *outPtrs[4] = { (__m128i *) (outB + i), (__m128i *) (outG + i), (__m128i *) (outR + i), (__m128i *) (outA + i) };
+
+    for (int c = 0; c < 4; c++) {
+      const int shift = c * 8;
+      __m128i c0 = _mm_and_si128(_mm_srli_epi32(p0, shift), mask);
+      __m128i c1 = _mm_and_si128(_mm_srli_epi32(p1, shift), mask);
+      __m128i c2 = _mm_and_si128(_mm_srli_epi32(p2, shift), mask);
+      __m128i c3 = _mm_and_si128(_mm_srli_epi32(p3, shift), mask);
+      __m128i c01 = _mm_packs_epi32(c0, c1);
+      __m128i c23 = _mm_packs_epi32(c2, c3);
+      _mm_storeu_si128(outPtrs[c], _mm_packus_epi16(c01, c23));
+    }
+  }
+#endif
+
+  for ( ; i < numPixels; i++) {
+    const uint8_t *pixelPtr = inBytes + (i * 4);
+    outB[i] = pixelPtr[0];
+    outG[i] = pixelPtr[1];
+    outR[i] = pixelPtr[2];
+    outA[i] = pixelPtr[3];
+  }
+}
+
+// True for the escape widths the decoder supports
+
+static inline
+bool rice2_escape_is_valid(const int escapeNumBits)
+{
+  return escapeNumBits == 8 || escapeNumBits == 12 || escapeNumBits == 16;
+}
+
+// Serialize one plane as the number of big blocks, the k table, the
+// half block offset table, and the bits. The width and height are
+// stored by the caller. When withHashes is set the big block hash
+// table follows the half block offset table. When withPredictor is
+// set a predictor byte follows the dimensions, otherwise the plane
+// must use the Left predictor. When withEscape is set an escape bits
+// byte follows, otherwise the plane must use the default 16 bit escape.
+// When withTids is set the tid table follows the offset table, see
+// rice2_tid_table_write(). Returns false and writes nothing when the
+// plane cannot be represented with these options.
+
+static inline
+bool rice2_plane_write(const Rice2EncodedPlane & plane,
+                       vector<uint8_t> & buf,
+                       const bool withHashes = false,
+                       const bool withPredictor = false,
+                       const bool withTids = false,
+                       const bool withEscape = false)
+{
+  if (!rice2_escape_is_valid(plane.escapeNumBits) ||
+      (!withEscape && plane.escapeNumBits != 16) ||
+      (!withPredictor && plane.predictor != BlockDeltaPredictorLeft) ||
+      (!withTids && !plane.halfBlockTidTable.empty())) {
+    return false;
+  }
+  ::encode(buf, (uint32_t) plane.numBigBlocksInWidth);
+  ::encode(buf, (uint32_t) plane.numBigBlocksInHeight);
+  if (withPredictor) {
+    ::encode(buf, (uint8_t) plane.predictor);
+  }
+  if (withEscape) {
+    ::encode(buf, (uint8_t) plane.escapeNumBits);
+  }
+  append(buf, encodeN(plane.blockOptimalKTable));
+  append(buf, encodeN(plane.halfBlockOffsetTable));
+  if (withTids) {
+    rice2_tid_table_write(plane, buf);
+  }
+  if (withHashes) {
+    append(buf, encodeN(plane.bigBlockHashTable));
+  }
+  append(buf, encodeN(plane.riceEncodedBits));
+  return true;
+}
+
+// Number of bytes left in buf after offset
+
+static inline
+size_t rice2_buf_remaining(const vector<uint8_t> & buf, const int offset)
+{
+  return (offset < 0 || (size_t) offset > buf.size()) ? 0 : (buf.size() - offset);
+}
+
+// Read a 32 bit count N and then N values of valueSize bytes. The count
+// is checked against expectedN, unless it is -1, and against the bytes
+// left before anything is allocated.
+
+template <typename T>
+bool rice2_decodeN_checked(const vector<uint8_t> & buf,
+                           int & offset,
+                           vector<T> & vec,
+                           const size_t valueSize,
+                           const int64_t expectedN = -1)
+{
+  if (rice2_buf_remaining(buf, offset) < sizeof(uint32_t)) {
+    return false;
+  }
+
+  int countOffset = offset;
+  uint32_t N;
+  ::decode(buf, countOffset, N);
+
+  if (expectedN != -1 && (int64_t) N != expectedN) {
+    return false;
+  }
+  if (((uint64_t) N * valueSize) > rice2_buf_remaining(buf, countOffset)) {
+    return false;
+  }
+
+  decodeN(buf, offset, vec);
+
+  return true;
+}
+
+// True when the number of big blocks matches width x height
+
+static inline
+bool rice2_plane_dimensions_match(const Rice2EncodedPlane & plane)
+{
+  const int64_t bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+  if (plane.width <= 0 || plane.height <= 0) {
+    return false;
+  }
+
+  return plane.numBigBlocksInWidth == ((plane.width + bigBlockDim - 1) / bigBlockDim) &&
+         plane.numBigBlocksInHeight == ((plane.height + bigBlockDim - 1) / bigBlockDim);
+}
+
+// True when the table sizes of a plane match its dimensions, so that
+// the decoder only indexes entries that exist. The k values and bit
+// offsets themselves are checked a tile at a time, see
+// rice2_plane_tile_is_valid().
+
+static inline
+bool rice2_plane_is_valid(const Rice2EncodedPlane & plane)
+{
+  if (!rice2_plane_dimensions_match(plane)) {
+    return false;
+  }
+
+  if (plane.predictor < BlockDeltaPredictorLeft || plane.predictor > BlockDeltaPredictorMED ||
+      !rice2_escape_is_valid(plane.escapeNumBits)) {
+    return false;
+  }
+
+  const size_t numBigBlocks = (size_t) plane.numBigBlocksInWidth * plane.numBigBlocksInHeight;
+  const size_t numBlocks = numBigBlocks * 16;
+
+  if (plane.blockOptimalKTable.size() != (numBlocks + 1) ||
+      plane.halfBlockOffsetTable.size() != (numBigBlocks * 32) ||
+      (!plane.halfBlockTidTable.empty() && plane.halfBlockTidTable.size() != (numBigBlocks * 32)) ||
+      (!plane.bigBlockHashTable.empty() && plane.bigBlockHashTable.size() != numBigBlocks) ||
+      (plane.riceEncodedBits.size() % sizeof(uint32_t)) != 0) {
+    return false;
+  }
+
+  return true;
+}
+
+// Parse a plane written by rice2_plane_write(), returns false when the
+// buffer is too short or the tables do not match width x height. Each
+// count is checked before the table it describes is allocated.
+
+static inline
+bool rice2_plane_read(const vector<uint8_t> & buf,
+                      int & offset,
+                      const int width,
+                      const int height,
+                      Rice2EncodedPlane & plane,
+                      const bool withHashes = false,
+                      const bool withPredictor = false,
+                      const bool withTids = false,
+                      const bool withEscape = false)
+{
+  uint32_t bw, bh;
+  if (rice2_buf_remaining(buf, offset) < (2 * sizeof(uint32_t) + (withPredictor ? 1 : 0) + (withEscape ? 1 : 0))) {
+    return false;
+  }
+  ::decode(buf, offset, bw);
+  ::decode(buf, offset, bh);
+  plane.width = width;
+  plane.height = height;
+  plane.numBigBlocksInWidth = (int) bw;
+  plane.numBigBlocksInHeight = (int) bh;
+  if (bw > 0xFFFF || bh > 0xFFFF || !rice2_plane_dimensions_match(plane)) {
+    return false;
+  }
+  plane.predictor = BlockDeltaPredictorLeft;
+  if (withPredictor) {
+    uint8_t predictor;
+    ::decode(buf, offset, predictor);
+    plane.predictor = (BlockDeltaPredictor) predictor;
+  }
+  plane.escapeNumBits = 16;
+  if (withEscape) {
+    uint8_t escapeNumBits;
+    ::decode(buf, offset, escapeNumBits);
+    plane.escapeNumBits = escapeNumBits;
+  }
+  const int64_t numBigBlocks = (int64_t) bw * bh;
+  if (!rice2_decodeN_checked(buf, offset, plane.blockOptimalKTable, sizeof(uint8_t), (numBigBlocks * 16) + 1) ||
+      !rice2_decodeN_checked(buf, offset, plane.halfBlockOffsetTable, sizeof(uint32_t), numBigBlocks * 32)) {
+    return false;
+  }
+  if (withTids) {
+    if (!rice2_tid_table_read(buf, offset, plane)) {
+      return false;
+    }
+  } else {
+    plane.halfBlockTidTable.clear();
+  }
+  if (withHashes) {
+    if (!rice2_decodeN_checked(buf, offset, plane.bigBlockHashTable, sizeof(uint64_t), numBigBlocks)) {
+      return false;
+    }
+  } else {
+    plane.bigBlockHashTable.clear();
+  }
+  if (!rice2_decodeN_checked(buf, offset, plane.riceEncodedBits, sizeof(uint8_t))) {
+    return false;
+  }
+  return rice2_plane_is_valid(plane);
+}
+
+// Container of encoded planes. Plane order is B G R A, or Y Co Cg A when
+// the YCoCg-R transform is enabled. The alpha plane is optional.
+
+class Rice2PlanesContainer
+{
+public:
+  int width;
+  int height;
+  bool ycocg;
+
+  vector<Rice2EncodedPlane> planes;
+
+  Rice2PlanesContainer()
+  : width(0),
+  height(0),
+  ycocg(false)
+  {
+  }
+
+  // True when every plane has a big block hash table
+
+  bool hasBigBlockHashes() const {
+    for ( const Rice2EncodedPlane & plane : planes ) {
+      if (plane.bigBlockHashTable.empty()) {
+        return false;
+      }
+    }
+    return !planes.empty();
+  }
+
+  // True when any plane uses a predictor other than Left
+
+  bool hasPredictors() const {
+    for ( const Rice2EncodedPlane & plane : planes ) {
+      if (plane.predictor != BlockDeltaPredictorLeft) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // True when any plane has a tid table
+
+  bool hasTidTables() const {
+    for ( const Rice2EncodedPlane & plane : planes ) {
+      if (!plane.halfBlockTidTable.empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // True when any plane uses an escape other than 16 bits
+
+  bool hasEscapes() const {
+    for ( const Rice2EncodedPlane & plane : planes ) {
+      if (plane.escapeNumBits != 16) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Serialize as a byte buffer, each plane is written with rice2_plane_write().
+  // Flag bit 0x2 marks planes that include big block hashes, 0x4 marks
+  // planes that include a predictor byte, 0x8 planes with a tid table
+  // and 0x10 planes that include an escape bits byte. Returns an empty
+  // buffer when a plane has an escape the decoder does not support.
+
+  vector<uint8_t> encode() const {
+    vector<uint8_t> buf;
+    const bool withHashes = hasBigBlockHashes();
+    const bool withPredictor = hasPredictors();
+    const bool withTids = hasTidTables();
+    const bool withEscape = hasEscapes();
+
+    ::encode(buf, (uint32_t) 0x4c503252); // "R2PL"
+    ::encode(buf, (uint32_t) width);
+    ::encode(buf, (uint32_t) height);
+    ::encode(buf, (uint8_t) ((ycocg ? 0x1 : 0) | (withHashes ? 0x2 : 0) | (withPredictor ? 0x4 : 0) | (withTids ? 0x8 : 0) | (withEscape ? 0x10 : 0)));
+    ::encode(buf, (uint8_t) planes.size());
+
+    for ( const Rice2EncodedPlane & plane : planes ) {
+      if (!rice2_plane_write(plane, buf, withHashes, withPredictor, withTids, withEscape)) {
+        return vector<uint8_t>();
+      }
+    }
+
+    return buf;
+  }
+
+  // Parse a buffer created by encode(), returns false if the buffer
+  // does not contain a valid container.
+
+  bool decode(const vector<uint8_t> & buf) {
+    int offset = 0;
+    uint32_t magic, w, h;
+    uint8_t flags, numPlanes;
+
+    if (buf.size() < 14) {
+      return false;
+    }
+
+    ::decode(buf, offset, magic);
+
+    if (magic != 0x4c503252) {
+      return false;
+    }
+
+    ::decode(buf, offset, w);
+    ::decode(buf, offset, h);
+    ::decode(buf, offset, flags);
+    ::decode(buf, offset, numPlanes);
+
+    if (numPlanes == 0 || numPlanes > 4) {
+      return false;
+    }
+
+    width = w;
+    height = h;
+    ycocg = (flags & 0x1) != 0;
+    const bool withHashes = (flags & 0x2) != 0;
+    const bool withPredictor = (flags & 0x4) != 0;
+    const bool withTids = (flags & 0x8) != 0;
+    const bool withEscape = (flags & 0x10) != 0;
+
+    planes.clear();
+    planes.resize(numPlanes);
+
+    for ( Rice2EncodedPlane & plane : planes ) {
+      if (!rice2_plane_read(buf, offset, width, height, plane, withHashes, withPredictor, withTids, withEscape)) {
+        return false;
+      }
+    }
+
+    return offset == (int) buf.size();
+  }
+};
+
+// Split BGRA pixels into 4 planes of numPixels bytes each, in B G R A
+// order or Y Co Cg A order when ycocg is set.
+
+static inline
+void rice2_bgra_split_planes(const uint32_t * inPixels,
+                             const int numPixels,
+                             const bool ycocg,
+                             uint8_t * outPlaneBytes)
+{
+  uint8_t *p0 = outPlaneBytes;
+  uint8_t *p1 = p0 + numPixels;
+  uint8_t *p2 = p1 + numPixels;
+  uint8_t *p3 = p2 + numPixels;
+
+  rice2_bgra_deinterleave(inPixels, numPixels, p0, p1, p2, p3);
+
+  if (ycocg) {
+    // B G R -> Y Co Cg in place
+
+    for (int i = 0; i < numPixels; i++) {
+      uint8_t Y, Co, Cg;
+      rice2_ycocg_forward(p2[i], p1[i], p0[i], Y, Co, Cg);
+      p0[i] = Y;
+      p1[i] = Co;
+      p2[i] = Cg;
+    }
+  }
+}
+
+// Encode BGRA pixels as 3 or 4 planes in one pass over the input.
+// Pass bigBlockHashes to store per big block hashes of each plane.
+// Each plane is encoded with predictor, or with whichever predictor
+// gives the smallest plane when bestPredictor is set. A simdWidth of
+// 8 or 16 adds a tid table to each plane that balances the threads.
+
+static inline
+void rice2_encode_bgra(const uint32_t * inPixels,
+                       const int width,
+                       const int height,
+                       const bool ycocg,
+                       const bool includeAlpha,
+                       Rice2PlanesContainer & outContainer,
+                       const bool bigBlockHashes = false,
+                       const BlockDeltaPredictor predictor = BlockDeltaPredictorLeft,
+                       const bool bestPredictor = false,
+                       const int simdWidth = 32)
+{
+  const int numPixels = width * height;
+
+  vector<uint8_t> planeBytes(numPixels * 4);
+
+  uint8_t *p0 = planeBytes.data();
+
+  rice2_bgra_split_planes(inPixels, numPixels, ycocg, p0);
+
+  const int numPlanes = includeAlpha ? 4 : 3;
+
+  outContainer.width = width;
+  outContainer.height = height;
+  outContainer.ycocg = ycocg;
+  outContainer.planes.clear();
+  outContainer.planes.resize(numPlanes);
+
+  for (int planei = 0; planei < numPlanes; planei++) {
+    if (bestPredictor) {
+      rice2_encode_plane_best_predictor(p0 + (planei * numPixels), width, height, outContainer.planes[planei]);
+    } else {
+      rice2_encode_plane(p0 + (planei * numPixels), width, height, outContainer.planes[planei], predictor);
+    }
+
+    if (bigBlockHashes) {
+      rice2_plane_add_big_block_hashes(p0 + (planei * numPixels), outContainer.planes[planei]);
+    }
+
+    rice2_plane_balance_tids(outContainer.planes[planei], simdWidth);
+  }
+
+  return;
+}
+
+// Decode all planes in parallel and interleave back into BGRA pixels.
+// When the container does not include alpha, the alpha is set to 0xFF.
+// Each plane is decoded with rice2_decode_plane_verified(), so a big
+// block with out of range tables is never decoded and planes with big
+// block hashes are verified a tile at a time as they decode. Returns
+// the number of big blocks that failed in any plane, the bbid of each
+// one is appended to outBadBlocks when passed.
+
+static inline
+int rice2_decode_bgra(const Rice2PlanesContainer & inContainer,
+                      uint32_t * outPixels,
+                      vector<int> *outBadBlocks = nullptr)
+{
+  const int numPixels = inContainer.width * inContainer.height;
+  const int numPlanes = (int) inContainer.planes.size();
+
+  assert(numPlanes == 3 || numPlanes == 4);
+
+  vector<uint8_t> planeBytes(numPixels * 4);
+
+  uint8_t *p0 = planeBytes.data();
+  uint8_t *p1 = p0 + numPixels;
+  uint8_t *p2 = p1 + numPixels;
+  uint8_t *p3 = p2 + numPixels;
+
+  vector<thread> threads;
+  vector<vector<int> > planeBadBlocks(numPlanes);
+
+  for (int planei = 0; planei < numPlanes; planei++) {
+    const Rice2EncodedPlane *planePtr = &inContainer.planes[planei];
+    uint8_t *outPtr = p0 + (planei * numPixels);
+    vector<int> *badBlocksPtr = &planeBadBlocks[planei];
+
+    threads.push_back(thread([planePtr, outPtr, badBlocksPtr]() {
+      rice2_decode_plane_verified(*planePtr, outPtr, nullptr, badBlocksPtr);
+    }));
+  }
+
+  for ( thread & t : threads ) {
+    t.join();
+  }
+
+  // A big block is counted once even when more than one plane failed
+
+  vector<int> badBlocks;
+
+  for ( const vector<int> & planeBad : planeBadBlocks ) {
+    badBlocks.insert(badBlocks.end(), planeBad.begin(), planeBad.end());
+  }
+
+  sort(badBlocks.begin(), badBlocks.end());
+  badBlocks.erase(unique(badBlocks.begin(), badBlocks.end()), badBlocks.end());
+
+  if (outBadBlocks) {
+    outBadBlocks->insert(outBadBlocks->end(), badBlocks.begin(), badBlocks.end());
+  }
+
+  if (numPlanes == 3) {
+    memset(p3, 0xFF, numPixels);
+  }
+
+  uint8_t *outBytes = (uint8_t *) outPixels;
+
+  for (int i = 0; i < numPixels; i++) {
+    uint8_t B = p0[i], G = p1[i], R = p2[i];
+
+    if (inContainer.ycocg) {
+      rice2_ycocg_reverse(p0[i], p1[i], p2[i], R, G, B);
+    }
+
+    uint8_t *pixelPtr = outBytes + (i * 4);
+    pixelPtr[0] = B;
+    pixelPtr[1] = G;
+    pixelPtr[2] = R;
+    pixelPtr[3] = p3[i];
+  }
+
+  return (int) badBlocks.size();
+}
+
+#endif // _Rice2Planes_hpp
@@ -0,0 +1,193 @@
+//
+//  Rice2Preview.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Progressive layout for a single 8 bit plane. The base value of each
+//  8x8 block (the top left pixel) forms a 1/8 scale image that is Rice2
+//  encoded on its own and stored before the full resolution plane. A
+//  reader that only needs a thumbnail reads the header and the preview
+//  prefix, about 1/64 of the symbols, and decodes it with the same CPU
+//  or GPU decoders. The full plane can be read and decoded later.
+
+#ifndef _Rice2Preview_hpp
+#define _Rice2Preview_hpp
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "Rice2Codec.hpp"
+#include "Rice2Planes.hpp"
+
+using namespace std;
+
+#define RICE2_PREVIEW_MAGIC 0x56503252 // "R2PV"
+
+// Size of the fixed header: magic, width, height, preview byte count
+#define RICE2_PREVIEW_HEADER_NUM_BYTES 16
+
+static inline
+void rice2_preview_dimensions(const int width,
+                              const int height,
+                              int & outPreviewWidth,
+                              int & outPreviewHeight)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  outPreviewWidth = (width + blockDim - 1) / blockDim;
+  outPreviewHeight = (height + blockDim - 1) / blockDim;
+}
+
+// Gather the base value of each 8x8 block into a 1/8 scale image
+
+static inline
+void rice2_preview_base_values(const uint8_t * inBytes,
+                               const int width,
+                               const int height,
+                               vector<uint8_t> & outPreviewBytes)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+
+  int previewWidth, previewHeight;
+  rice2_preview_dimensions(width, height, previewWidth, previewHeight);
+
+  outPreviewBytes.resize(previewWidth * previewHeight);
+
+  for (int by = 0; by < previewHeight; by++) {
+    const uint8_t *rowPtr = inBytes + (by * blockDim * width);
+    uint8_t *outRowPtr = outPreviewBytes.data() + (by * previewWidth);
+
+    for (int bx = 0; bx < previewWidth; bx++) {
+      outRowPtr[bx] = rowPtr[bx * blockDim];
+    }
+  }
+}
+
+// Encode the preview plane followed by the full plane
+
+static inline
+void rice2_progressive_encode_plane(const uint8_t * inBytes,
+                                    const int width,
+                                    const int height,
+                                    vector<uint8_t> & outBuf)
+{
+  int previewWidth, previewHeight;
+  rice2_preview_dimensions(width, height, previewWidth, previewHeight);
+
+  vector<uint8_t> previewBytes;
+  rice2_preview_base_values(inBytes, width, height, previewBytes);
+
+  Rice2EncodedPlane previewPlane;
+  rice2_encode_plane(previewBytes.data(), previewWidth, previewHeight, previewPlane);
+
+  Rice2EncodedPlane plane;
+  rice2_encode_plane(inBytes, width, height, plane);
+
+  vector<uint8_t> previewSection;
+  rice2_plane_write(previewPlane, previewSection);
+
+  outBuf.clear();
+  ::encode(outBuf, (uint32_t) RICE2_PREVIEW_MAGIC);
+  ::encode(outBuf, (uint32_t) width);
+  ::encode(outBuf, (uint32_t) height);
+  ::encode(outBuf, (uint32_t) previewSection.size());
+  append(outBuf, previewSection);
+  rice2_plane_write(plane, outBuf);
+}
+
+// Given at least the header bytes, return the number of bytes from the
+// start of the buffer needed to decode the preview. Returns 0 if the
+// header is not complete or not valid, including a preview byte count
+// that does not fit in an int after the header.
+
+static inline
+int rice2_progressive_preview_num_bytes(const vector<uint8_t> & buf,
+                                        int * outWidth = nullptr,
+                                        int * outHeight = nullptr)
+{
+  if (buf.size() < RICE2_PREVIEW_HEADER_NUM_BYTES) {
+    return 0;
+  }
+
+  int offset = 0;
+  uint32_t magic, w, h, previewNumBytes;
+  ::decode(buf, offset, magic);
+  ::decode(buf, offset, w);
+  ::decode(buf, offset, h);
+  ::decode(buf, offset, previewNumBytes);
+
+  if (magic != RICE2_PREVIEW_MAGIC || w == 0 || h == 0 || w > INT_MAX || h > INT_MAX ||
+      previewNumBytes > (uint32_t) (INT_MAX - RICE2_PREVIEW_HEADER_NUM_BYTES)) {
+    return 0;
+  }
+
+  if (outWidth) {
+    *outWidth = w;
+  }
+  if (outHeight) {
+    *outHeight = h;
+  }
+
+  return RICE2_PREVIEW_HEADER_NUM_BYTES + previewNumBytes;
+}
+
+// Decode the 1/8 scale preview from a prefix of the buffer, the full
+// plane bytes need not be present. Returns false if the prefix is
+// too short or not valid, or a big block can not be decoded.
+
+static inline
+bool rice2_progressive_decode_preview(const vector<uint8_t> & buf,
+                                      vector<uint8_t> & outPreviewBytes,
+                                      int & outPreviewWidth,
+                                      int & outPreviewHeight)
+{
+  int width, height;
+  const int numBytes = rice2_progressive_preview_num_bytes(buf, &width, &height);
+
+  if (numBytes == 0 || (int)buf.size() < numBytes) {
+    return false;
+  }
+
+  rice2_preview_dimensions(width, height, outPreviewWidth, outPreviewHeight);
+
+  int offset = RICE2_PREVIEW_HEADER_NUM_BYTES;
+
+  Rice2EncodedPlane previewPlane;
+  if (!rice2_plane_read(buf, offset, outPreviewWidth, outPreviewHeight, previewPlane) ||
+      offset != numBytes) {
+    return false;
+  }
+
+  outPreviewBytes.resize(outPreviewWidth * outPreviewHeight);
+
+  return rice2_decode_plane_checked(previewPlane, outPreviewBytes.data()) == 0;
+}
+
+// Decode the full resolution plane, the preview section is skipped.
+// Returns false if the plane is not valid or a big block can not be
+// decoded, see rice2_decode_plane_checked().
+
+static inline
+bool rice2_progressive_decode_plane(const vector<uint8_t> & buf,
+                                    uint8_t * outBytes)
+{
+  int width, height;
+  const int numBytes = rice2_progressive_preview_num_bytes(buf, &width, &height);
+
+  if (numBytes == 0 || (int)buf.size() < numBytes) {
+    return false;
+  }
+
+  int offset = numBytes;
+
+  Rice2EncodedPlane plane;
+  if (!rice2_plane_read(buf, offset, width, height, plane) ||
+      offset != (int)buf.size()) {
+    return false;
+  }
+
+  return rice2_decode_plane_checked(plane, outBytes) == 0;
+}
+
+#endif // _Rice2Preview_hpp
@@ -0,0 +1,586 @@
+//
+//  Rice2Stream.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Streaming encode of a single 8 bit plane in the Rice2 format. The
+//  32x32 block deltas do not depend on pixels outside the big block,
+//  so each row of big blocks (a band of 32 rows) can be delta encoded,
+//  k optimized and rice encoded as soon as its rows have been read.
+//  Whole 32 bit words of the stream are emitted after each band, only
+//  the bits of a partial word carry over to the next band. Peak memory
+//  is a few band sized buffers no matter how tall the image is, and
+//  the emitted bands concatenate to the same plane as rice2_encode_plane().
+//
+//  Bands can be serialized one record at a time, Rice2StreamDecoder
+//  accepts these bytes in chunks of any size and decodes each band as
+//  soon as the bits for that band have arrived.
+
+#ifndef _Rice2Stream_hpp
+#define _Rice2Stream_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "EncDec.hpp"
+#include "Rice2Codec.hpp"
+
+using namespace std;
+
+// Encoded output for one band, bits are rewritten 32 bit words in the
+// same format as Rice2EncodedPlane.riceEncodedBits. The words emitted
+// for a band can contain the first bits of the next band.
+
+class Rice2EncodedBand
+{
+public:
+  // Index of the big block row and the image rows it covers
+  int bandIndex;
+  int y;
+  int numRows;
+
+  // Whole 32 bit words completed while encoding this band, the last
+  // band also includes the zero padding words.
+  vector<uint8_t> riceEncodedBits;
+
+  // Optimal k for each 8x8 block of the band in big block order, the
+  // zero pad entry is not included.
+  vector<uint8_t> blockOptimalKTable;
+
+  // Starting bit offset of each half block from the start of the stream
+  vector<uint32_t> halfBlockOffsetTable;
+
+  bool isLast;
+
+  Rice2EncodedBand()
+  : bandIndex(0),
+  y(0),
+  numRows(0),
+  isLast(false)
+  {
+  }
+};
+
+// Accepts image rows in any number of rows at a time and invokes the
+// band callback each time 32 rows (or the final rows) are ready.
+
+class Rice2StreamEncoder
+{
+public:
+  typedef function<void(const Rice2EncodedBand & band)> BandCallback;
+
+  Rice2StreamEncoder(const int width, const int height, BandCallback bandCallback)
+  : width(width),
+  height(height),
+  numBigBlocksInWidth((width + RICE_LARGE_BLOCK_DIM - 1) / RICE_LARGE_BLOCK_DIM),
+  numBigBlocksInHeight((height + RICE_LARGE_BLOCK_DIM - 1) / RICE_LARGE_BLOCK_DIM),
+  bandCallback(bandCallback),
+  numRowsAppended(0),
+  numRowsInBand(0),
+  bandIndex(0)
+  {
+#if defined(DEBUG)
+    assert(width > 0);
+    assert(height > 0);
+#endif // DEBUG
+
+    bandBytes.resize(width * RICE_LARGE_BLOCK_DIM);
+  }
+
+  // Append numRows rows of width bytes, a band is encoded and emitted
+  // as soon as it is complete.
+
+  void appendRows(const uint8_t * rowBytes, int numRows)
+  {
+    assert((numRowsAppended + numRows) <= height);
+
+    while (numRows > 0) {
+      const int bandRowsLeft = bandHeight(bandIndex) - numRowsInBand;
+      const int numRowsToCopy = (numRows < bandRowsLeft) ? numRows : bandRowsLeft;
+
+      memcpy(bandBytes.data() + (numRowsInBand * width), rowBytes, numRowsToCopy * width);
+
+      rowBytes += numRowsToCopy * width;
+      numRows -= numRowsToCopy;
+      numRowsInBand += numRowsToCopy;
+      numRowsAppended += numRowsToCopy;
+
+      if (numRowsInBand == bandHeight(bandIndex)) {
+        encodeBand();
+        numRowsInBand = 0;
+        bandIndex += 1;
+      }
+    }
+  }
+
+  bool isFinished() const {
+    return numRowsAppended == height;
+  }
+
+  int getNumBigBlocksInWidth() const {
+    return numBigBlocksInWidth;
+  }
+
+  int getNumBigBlocksInHeight() const {
+    return numBigBlocksInHeight;
+  }
+
+private:
+  const int width;
+  const int height;
+  const int numBigBlocksInWidth;
+  const int numBigBlocksInHeight;
+
+  BandCallback bandCallback;
+
+  int numRowsAppended;
+  int numRowsInBand;
+  int bandIndex;
+
+  // Band sized buffers reused for each band
+  vector<uint8_t> bandBytes;
+  vector<uint8_t> imageOrderDeltas;
+  vector<uint8_t> s32OrderSymbols;
+
+  // The bit writer holds at most 3 bytes between bands
+  RiceSplit16EncoderG4<false, true, BitWriterByteStream> encoder;
+
+  Rice2EncodedBand band;
+
+  int bandHeight(int bandi) const {
+    const int y = bandi * RICE_LARGE_BLOCK_DIM;
+    return ((height - y) < RICE_LARGE_BLOCK_DIM) ? (height - y) : RICE_LARGE_BLOCK_DIM;
+  }
+
+  void encodeBand()
+  {
+    const int blockDim = RICE_SMALL_BLOCK_DIM;
+    const int numValuesInBlock = blockDim * blockDim;
+    const int numValuesInHalfBlock = numValuesInBlock / 2;
+    const int pN = 4;
+
+    const int numRows = bandHeight(bandIndex);
+    const int blockN = (numBigBlocksInWidth * RICE_LARGE_BLOCK_DIM * RICE_LARGE_BLOCK_DIM) / numValuesInBlock;
+
+    band.bandIndex = bandIndex;
+    band.y = bandIndex * RICE_LARGE_BLOCK_DIM;
+    band.numRows = numRows;
+    band.isLast = (bandIndex == (numBigBlocksInHeight - 1));
+
+    // One row of big blocks is the same as a width x numRows image
+
+    rice2_image_order_deltas(bandBytes.data(), width, numRows,
+                             numBigBlocksInWidth, 1,
+                             imageOrderDeltas);
+
+    s32OrderSymbols.resize(blockN * numValuesInBlock);
+
+    block_s32_format_image_order(imageOrderDeltas.data(),
+                                 s32OrderSymbols.data(),
+                                 numBigBlocksInWidth, 1);
+
+    band.blockOptimalKTable.resize(blockN);
+    band.halfBlockOffsetTable.resize(blockN * 2);
+
+    int halfBlocki = 0;
+
+    for (int blocki = 0; blocki < blockN; blocki++) {
+      const uint8_t *blockPtr = &s32OrderSymbols[blocki * numValuesInBlock];
+
+      if (rice2_is_skip_block(blockPtr, numValuesInBlock)) {
+        // No bits, both half blocks start at the current offset
+        band.blockOptimalKTable[blocki] = RICE2_SKIP_BLOCK_K;
+        band.halfBlockOffsetTable[halfBlocki++] = encoder.bitWriter.numEncodedBits;
+        band.halfBlockOffsetTable[halfBlocki++] = encoder.bitWriter.numEncodedBits;
+        continue;
+      }
+
+      const uint8_t k = optimalRiceKG4<8>(blockPtr, numValuesInBlock);
+      band.blockOptimalKTable[blocki] = k;
+
+      // Each half block is encoded 4 symbols at a time, prefix bits
+      // and then suffix bits, as in RiceSplit16EncoderG4::encode()
+
+      for (int half = 0; half < 2; half++, halfBlocki++) {
+        band.halfBlockOffsetTable[halfBlocki] = encoder.bitWriter.numEncodedBits;
+
+        const uint8_t *halfBlockPtr = blockPtr + (half * numValuesInHalfBlock);
+
+        for (int i = 0; i < numValuesInHalfBlock; i += pN) {
+          for (int j = 0; j < pN; j++) {
+            encoder.encode(halfBlockPtr[i + j], k, true, false);
+          }
+          for (int j = 0; j < pN; j++) {
+            encoder.encode(halfBlockPtr[i + j], k, false, true);
+          }
+        }
+      }
+    }
+
+    vector<uint8_t> & bytes = encoder.bitWriter.byteWriter.bytes;
+
+    if (band.isLast) {
+      // Same trailing bits and padding as encode() followed
+      // by PrefixBitStreamRewrite32()
+
+      encoder.finish();
+
+      while ((bytes.size() % sizeof(uint32_t)) != 0) {
+        bytes.push_back(0);
+      }
+
+      for (int i = 0; i < (int) sizeof(uint32_t); i++) {
+        bytes.push_back(0);
+      }
+    }
+
+    // Emit whole words in the rewritten byte order and keep any
+    // bytes of a partial word for the next band.
+
+    const int numWholeBytes = (int) (bytes.size() - (bytes.size() % sizeof(uint32_t)));
+
+    band.riceEncodedBits.resize(numWholeBytes);
+
+    for (int i = 0; i < numWholeBytes; i += 4) {
+      band.riceEncodedBits[i + 0] = bytes[i + 3];
+      band.riceEncodedBits[i + 1] = bytes[i + 2];
+      band.riceEncodedBits[i + 2] = bytes[i + 1];
+      band.riceEncodedBits[i + 3] = bytes[i + 0];
+    }
+
+    bytes.erase(bytes.begin(), bytes.begin() + numWholeBytes);
+
+    bandCallback(band);
+  }
+};
+
+// Append an emitted band to a plane, once the last band has been appended
+// the plane is the same as the result of rice2_encode_plane().
+
+static inline
+void rice2_stream_append_band(const Rice2EncodedBand & band,
+                              const int width,
+                              const int height,
+                              Rice2EncodedPlane & outPlane)
+{
+  if (band.bandIndex == 0) {
+    outPlane.width = width;
+    outPlane.height = height;
+    outPlane.numBigBlocksInWidth = (width + RICE_LARGE_BLOCK_DIM - 1) / RICE_LARGE_BLOCK_DIM;
+    outPlane.numBigBlocksInHeight = (height + RICE_LARGE_BLOCK_DIM - 1) / RICE_LARGE_BLOCK_DIM;
+    outPlane.riceEncodedBits.clear();
+    outPlane.blockOptimalKTable.clear();
+    outPlane.halfBlockOffsetTable.clear();
+  }
+
+  outPlane.riceEncodedBits.insert(outPlane.riceEncodedBits.end(), band.riceEncodedBits.begin(), band.riceEncodedBits.end());
+  outPlane.blockOptimalKTable.insert(outPlane.blockOptimalKTable.end(), band.blockOptimalKTable.begin(), band.blockOptimalKTable.end());
+  outPlane.halfBlockOffsetTable.insert(outPlane.halfBlockOffsetTable.end(), band.halfBlockOffsetTable.begin(), band.halfBlockOffsetTable.end());
+
+  if (band.isLast) {
+    outPlane.blockOptimalKTable.push_back(0);
+  }
+}
+
+// Stream encode a plane that is already in memory, rows are appended
+// numRowsEachAppend rows at a time.
+
+static inline
+void rice2_stream_encode_plane(const uint8_t * inBytes,
+                               const int width,
+                               const int height,
+                               const int numRowsEachAppend,
+                               Rice2EncodedPlane & outPlane)
+{
+  Rice2StreamEncoder streamEncoder(width, height, [&](const Rice2EncodedBand & band) {
+    rice2_stream_append_band(band, width, height, outPlane);
+  });
+
+  for (int y = 0; y < height; y += numRowsEachAppend) {
+    const int numRows = ((height - y) < numRowsEachAppend) ? (height - y) : numRowsEachAppend;
+    streamEncoder.appendRows(inBytes + (y * width), numRows);
+  }
+
+  assert(streamEncoder.isFinished());
+}
+
+// Serialized stream is a header followed by one record for each band.
+// Each record starts with the number of bytes that follow so that a
+// reader can tell when a whole record is available.
+
+#define RICE2_STREAM_MAGIC 0x54533252 // "R2ST"
+
+static inline
+void rice2_stream_write_header(const int width,
+                               const int height,
+                               vector<uint8_t> & outBuf)
+{
+  ::encode(outBuf, (uint32_t) RICE2_STREAM_MAGIC);
+  ::encode(outBuf, (uint32_t) width);
+  ::encode(outBuf, (uint32_t) height);
+}
+
+static inline
+void rice2_stream_write_band(const Rice2EncodedBand & band,
+                             vector<uint8_t> & outBuf)
+{
+  vector<uint8_t> record;
+  append(record, encodeN(band.blockOptimalKTable));
+  append(record, encodeN(band.halfBlockOffsetTable));
+  append(record, encodeN(band.riceEncodedBits));
+
+  ::encode(outBuf, (uint32_t) record.size());
+  append(outBuf, record);
+}
+
+// Push style decoder for a serialized band stream. Bytes are appended
+// as they are read, when the record after a band has been parsed the
+// bits for that band are complete and the band is decoded and passed
+// to the rows callback. Only the words of the last two bands are kept.
+
+class Rice2StreamDecoder
+{
+public:
+  typedef function<void(int y, int numRows, const uint8_t * rowBytes)> RowsCallback;
+
+  Rice2StreamDecoder(RowsCallback rowsCallback)
+  : rowsCallback(rowsCallback),
+  failed(false),
+  parsedHeader(false),
+  numBandsParsed(0),
+  numBandsDecoded(0),
+  bitsWordBase(0),
+  lastBitOffset(0)
+  {
+  }
+
+  // Append bytes read from a file or pipe. Returns false if the
+  // stream is not valid, no more bytes are accepted after a failure.
+
+  bool appendBytes(const uint8_t * bytes, const int numBytes)
+  {
+    if (failed) {
+      return false;
+    }
+
+    pending.insert(pending.end(), bytes, bytes + numBytes);
+
+    int offset = 0;
+
+    if (!parsedHeader) {
+      if (pending.size() < 12) {
+        return true;
+      }
+
+      uint32_t magic, w, h;
+      ::decode(pending, offset, magic);
+      ::decode(pending, offset, w);
+      ::decode(pending, offset, h);
+
+      if (magic != RICE2_STREAM_MAGIC || w == 0 || h == 0) {
+        failed = true;
+        return false;
+      }
+
+      bandPlane.width = w;
+      bandPlane.numBigBlocksInWidth = (w + RICE_LARGE_BLOCK_DIM - 1) / RICE_LARGE_BLOCK_DIM;
+      bandPlane.numBigBlocksInHeight = 1;
+      numBands = (h + RICE_LARGE_BLOCK_DIM - 1) / RICE_LARGE_BLOCK_DIM;
+      height = h;
+      parsedHeader = true;
+    }
+
+    while (!failed && numBandsParsed < numBands && (pending.size() - offset) >= 4) {
+      int recordOffset = offset;
+      uint32_t recordSize;
+      ::decode(pending, recordOffset, recordSize);
+
+      if ((pending.size() - recordOffset) < recordSize) {
+        break;
+      }
+
+      if (!parseRecord(recordOffset, recordSize)) {
+        failed = true;
+        break;
+      }
+
+      offset = recordOffset + recordSize;
+      numBandsParsed += 1;
+
+      // Bits for the previous band end in the words of this record
+
+      if (numBandsParsed >= 2 && !decodeBand()) {
+        failed = true;
+        break;
+      }
+      if (numBandsParsed == numBands && !decodeBand()) {
+        failed = true;
+        break;
+      }
+    }
+
+    pending.erase(pending.begin(), pending.begin() + offset);
+
+    return !failed;
+  }
+
+  bool isFinished() const {
+    return parsedHeader && numBandsDecoded == numBands;
+  }
+
+  int getWidth() const {
+    return bandPlane.width;
+  }
+
+  int getHeight() const {
+    return parsedHeader ? height : 0;
+  }
+
+private:
+  RowsCallback rowsCallback;
+
+  bool failed;
+  bool parsedHeader;
+  int height;
+  int numBands;
+  int numBandsParsed;
+  int numBandsDecoded;
+
+  // Bytes not yet parsed as a whole record
+  vector<uint8_t> pending;
+
+  // Tables for parsed bands that have not been decoded yet
+  vector<vector<uint8_t> > kTables;
+  vector<vector<uint32_t> > offsetTables;
+
+  // Words starting at word bitsWordBase of the stream, rebased
+  // offsets and the k table are set for the band being decoded.
+  Rice2EncodedPlane bandPlane;
+  uint32_t bitsWordBase;
+
+  // Last half block offset parsed, offsets never decrease
+  uint32_t lastBitOffset;
+
+  vector<uint8_t> bandRows;
+
+  bool parseRecord(int offset, const uint32_t recordSize)
+  {
+    const int endOffset = offset + recordSize;
+    const int blockN = bandPlane.numBigBlocksInWidth * (RICE_LARGE_BLOCK_DIM / RICE_SMALL_BLOCK_DIM) * (RICE_LARGE_BLOCK_DIM / RICE_SMALL_BLOCK_DIM);
+
+    // Validate each count before reading the values
+
+    const uint32_t expectedCounts[2] = { (uint32_t) blockN, (uint32_t) (blockN * 2) };
+    const uint32_t valueSizes[3] = { 1, 4, 1 };
+
+    kTables.push_back(vector<uint8_t>());
+    offsetTables.push_back(vector<uint32_t>());
+    vector<uint8_t> words;
+
+    for (int i = 0; i < 3; i++) {
+      if ((endOffset - offset) < 4) {
+        return false;
+      }
+
+      int countOffset = offset;
+      uint32_t N;
+      ::decode(pending, countOffset, N);
+
+      if (i < 2 && N != expectedCounts[i]) {
+        return false;
+      }
+      if (((uint64_t) N * valueSizes[i]) > (uint64_t) (endOffset - countOffset)) {
+        return false;
+      }
+
+      if (i == 0) {
+        decodeN(pending, offset, kTables.back());
+      } else if (i == 1) {
+        decodeN(pending, offset, offsetTables.back());
+      } else {
+        decodeN(pending, offset, words);
+      }
+    }
+
+    if (offset != endOffset || (words.size() % sizeof(uint32_t)) != 0) {
+      return false;
+    }
+
+    bandPlane.riceEncodedBits.insert(bandPlane.riceEncodedBits.end(), words.begin(), words.end());
+
+    // Each k is a valid k or a skip block. Offsets are stream bit offsets
+    // that never decrease and never start before the buffered words. The
+    // last half blocks can start in the partial word that is emitted with
+    // the next record, so an offset can be up to 31 bits past the words.
+
+    for ( uint8_t k : kTables.back() ) {
+      if (k >= 8 && k != RICE2_SKIP_BLOCK_K) {
+        return false;
+      }
+    }
+
+    const uint64_t minBitOffset = (uint64_t) bitsWordBase * 32;
+    const uint64_t endBitOffset = minBitOffset + (bandPlane.riceEncodedBits.size() * 8) + 32;
+
+    for ( uint32_t bitOffset : offsetTables.back() ) {
+      if (bitOffset < lastBitOffset || bitOffset < minBitOffset || bitOffset >= endBitOffset) {
+        return false;
+      }
+      lastBitOffset = bitOffset;
+    }
+
+    return true;
+  }
+
+  // Decode the next band, returns false when a tile can not be decoded
+
+  bool decodeBand()
+  {
+    const int bandi = numBandsDecoded;
+    const int y = bandi * RICE_LARGE_BLOCK_DIM;
+    const int numRows = ((height - y) < RICE_LARGE_BLOCK_DIM) ? (height - y) : RICE_LARGE_BLOCK_DIM;
+
+    // Offsets are relative to the first word still in the buffer
+
+    vector<uint32_t> & offsets = offsetTables.front();
+
+    for ( uint32_t & bitOffset : offsets ) {
+      bitOffset -= bitsWordBase * 32;
+    }
+
+    bandPlane.height = numRows;
+    bandPlane.halfBlockOffsetTable = std::move(offsets);
+    bandPlane.blockOptimalKTable = std::move(kTables.front());
+    bandPlane.blockOptimalKTable.push_back(0);
+
+    kTables.erase(kTables.begin());
+    offsetTables.erase(offsetTables.begin());
+
+    bandRows.resize(bandPlane.width * numRows);
+
+    if (rice2_decode_plane_checked(bandPlane, bandRows.data()) != 0) {
+      return false;
+    }
+
+    numBandsDecoded += 1;
+
+    // Drop words that end before the first bit of the next band
+
+    if (!offsetTables.empty()) {
+      const uint32_t numWords = (uint32_t) (bandPlane.riceEncodedBits.size() / sizeof(uint32_t));
+      const uint32_t firstWord = min((offsetTables.front()[0] / 32) - bitsWordBase, numWords);
+      bandPlane.riceEncodedBits.erase(bandPlane.riceEncodedBits.begin(),
+                                      bandPlane.riceEncodedBits.begin() + (firstWord * sizeof(uint32_t)));
+      bitsWordBase += firstWord;
+    }
+
+    rowsCallback(y, numRows, bandRows.data());
+
+    return true;
+  }
+};
+
+#endif // _Rice2Stream_hpp
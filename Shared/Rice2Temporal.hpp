@@ -0,0 +1,246 @@
+//
+//  Rice2Temporal.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Inter frame encoding for a sequence of 8 bit planes. Each 8x8 block
+//  is either intra, the usual 32x32 block deltas, or inter, where each
+//  symbol is the residual against the same pixel in the previous frame.
+//  The encoder picks whichever costs fewer bits and records the choice
+//  in a side bitmap. The rice stream, k table and offsets have the same
+//  layout as any other plane so symbols decode with the same CPU and GPU
+//  decoders. Only the undelta step reads the bitmap, inter pixels are
+//  known directly and the 32x32 prefix sums restart from them.
+
+#ifndef _Rice2Temporal_hpp
+#define _Rice2Temporal_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include "zigzag.h"
+#include "Rice2Codec.hpp"
+
+using namespace std;
+
+// Encoded plane and the inter flag for each 8x8 block
+
+class Rice2TemporalPlane
+{
+public:
+  Rice2EncodedPlane plane;
+
+  // One bit for each 8x8 block in big block order, the same order as
+  // the k table. A set bit marks an inter block.
+  vector<uint8_t> interBlockBitmap;
+
+  int numInterBlocks;
+
+  Rice2TemporalPlane()
+  : numInterBlocks(0)
+  {
+  }
+
+  bool isInterBlock(const int blocki) const {
+    return (interBlockBitmap[blocki / 8] & (1 << (blocki % 8))) != 0;
+  }
+};
+
+// Index of the 8x8 block that contains padded pixel (x, y), the blocks
+// in each big block are in row order.
+
+static inline
+int rice2_temporal_blocki(const int x,
+                          const int y,
+                          const int numBigBlocksInWidth)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+  const int blockiDim = bigBlockDim / blockDim;
+
+  const int bbid = ((y / bigBlockDim) * numBigBlocksInWidth) + (x / bigBlockDim);
+  const int blockiInBigBlock = (((y % bigBlockDim) / blockDim) * blockiDim) + ((x % bigBlockDim) / blockDim);
+
+  return (bbid * blockiDim * blockiDim) + blockiInBigBlock;
+}
+
+// Number of bits needed to encode a block of symbols with its optimal k,
+// an all zero block is a skip block and costs nothing.
+
+static inline
+int rice2_temporal_block_num_bits(const uint8_t * symbols, const int numSymbols)
+{
+  if (rice2_is_skip_block(symbols, numSymbols)) {
+    return 0;
+  }
+
+  const unsigned int k = optimalRiceKG4<8>(symbols, numSymbols);
+
+  int numBits = 0;
+
+  for (int i = 0; i < numSymbols; i++) {
+    const unsigned int unaryNumBits = (symbols[i] >> k) + 1;
+    numBits += (unaryNumBits > 16) ? (16 + 8) : (unaryNumBits + k);
+  }
+
+  return numBits;
+}
+
+// Encode inBytes with each 8x8 block either intra or inter against
+// prevBytes. Pass nullptr for prevBytes to encode a key frame.
+
+static inline
+void rice2_temporal_encode_plane(const uint8_t * inBytes,
+                                 const uint8_t * prevBytes,
+                                 const int width,
+                                 const int height,
+                                 Rice2TemporalPlane & outPlane)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+  const int numValuesInBlock = blockDim * blockDim;
+
+  const int numBigBlocksInWidth = (width + bigBlockDim - 1) / bigBlockDim;
+  const int numBigBlocksInHeight = (height + bigBlockDim - 1) / bigBlockDim;
+  const int paddedWidth = numBigBlocksInWidth * bigBlockDim;
+  const int paddedHeight = numBigBlocksInHeight * bigBlockDim;
+  const int blockN = (paddedWidth / blockDim) * (paddedHeight / blockDim);
+
+  vector<uint8_t> imageOrderSymbols;
+
+  rice2_image_order_deltas(inBytes, width, height,
+                           numBigBlocksInWidth, numBigBlocksInHeight,
+                           imageOrderSymbols);
+
+  outPlane.interBlockBitmap.assign((blockN + 7) / 8, 0);
+  outPlane.numInterBlocks = 0;
+
+  if (prevBytes != nullptr) {
+    uint8_t intraSymbols[numValuesInBlock];
+    uint8_t interSymbols[numValuesInBlock];
+
+    for (int y0 = 0; y0 < paddedHeight; y0 += blockDim) {
+      for (int x0 = 0; x0 < paddedWidth; x0 += blockDim) {
+        for (int i = 0; i < numValuesInBlock; i++) {
+          const int x = x0 + (i % blockDim);
+          const int y = y0 + (i / blockDim);
+          const bool inside = (x < width) && (y < height);
+
+          // Padding is zero in both frames
+
+          const uint8_t cur = inside ? inBytes[(y * width) + x] : 0;
+          const uint8_t prev = inside ? prevBytes[(y * width) + x] : 0;
+
+          intraSymbols[i] = imageOrderSymbols[(y * paddedWidth) + x];
+          interSymbols[i] = pixelpack_int8_to_offset_uint8((int8_t) (cur - prev));
+        }
+
+        if (rice2_temporal_block_num_bits(interSymbols, numValuesInBlock) >= rice2_temporal_block_num_bits(intraSymbols, numValuesInBlock)) {
+          continue;
+        }
+
+        for (int i = 0; i < numValuesInBlock; i++) {
+          const int x = x0 + (i % blockDim);
+          const int y = y0 + (i / blockDim);
+          imageOrderSymbols[(y * paddedWidth) + x] = interSymbols[i];
+        }
+
+        const int blocki = rice2_temporal_blocki(x0, y0, numBigBlocksInWidth);
+        outPlane.interBlockBitmap[blocki / 8] |= (1 << (blocki % 8));
+        outPlane.numInterBlocks += 1;
+      }
+    }
+  }
+
+  rice2_encode_plane_symbols(imageOrderSymbols, width, height, outPlane.plane);
+
+  return;
+}
+
+// Reverse intra deltas and inter residuals in padded image order and
+// crop to width x height. An intra pixel adds its delta to the pixel
+// above (column 0) or to the left, that pixel is already known when it
+// is in an inter block, so each prefix sum restarts at inter pixels.
+
+static inline
+void rice2_temporal_undelta_plane(const uint8_t * inImageOrderSymbols,
+                                  const Rice2TemporalPlane & inPlane,
+                                  const uint8_t * prevBytes,
+                                  uint8_t * outBytes)
+{
+  const int bigBlockDim = RICE_LARGE_BLOCK_DIM;
+
+  const int width = inPlane.plane.width;
+  const int height = inPlane.plane.height;
+  const int numBigBlocksInWidth = inPlane.plane.numBigBlocksInWidth;
+  const int paddedWidth = inPlane.plane.paddedWidth();
+  const int paddedHeight = inPlane.plane.paddedHeight();
+
+  vector<uint8_t> pixels(paddedWidth * paddedHeight);
+
+  auto isInter = [&](int x, int y) -> bool {
+    return (inPlane.numInterBlocks > 0) && inPlane.isInterBlock(rice2_temporal_blocki(x, y, numBigBlocksInWidth));
+  };
+
+  auto decodePixel = [&](int x, int y, uint8_t predicted, bool isFirst) -> uint8_t {
+    const uint8_t symbol = inImageOrderSymbols[(y * paddedWidth) + x];
+
+    if (isInter(x, y)) {
+      const bool inside = (x < width) && (y < height);
+      const uint8_t prev = inside ? prevBytes[(y * width) + x] : 0;
+      return prev + (uint8_t) pixelpack_offset_uint8_to_int8(symbol);
+    } else if (isFirst) {
+      return symbol;
+    } else {
+      return predicted + (uint8_t) pixelpack_offset_uint8_to_int8(symbol);
+    }
+  };
+
+  for (int by = 0; by < paddedHeight; by += bigBlockDim) {
+    for (int bx = 0; bx < paddedWidth; bx += bigBlockDim) {
+      // Column 0 of the big block, then each row from column 0
+
+      uint8_t above = 0;
+
+      for (int y = by; y < (by + bigBlockDim); y++) {
+        above = decodePixel(bx, y, above, (y == by));
+        pixels[(y * paddedWidth) + bx] = above;
+      }
+
+      for (int y = by; y < (by + bigBlockDim); y++) {
+        uint8_t left = pixels[(y * paddedWidth) + bx];
+
+        for (int x = bx + 1; x < (bx + bigBlockDim); x++) {
+          left = decodePixel(x, y, left, false);
+          pixels[(y * paddedWidth) + x] = left;
+        }
+      }
+    }
+  }
+
+  for (int y = 0; y < height; y++) {
+    memcpy(outBytes + (y * width), &pixels[y * paddedWidth], width);
+  }
+
+  return;
+}
+
+// Decode a plane encoded by rice2_temporal_encode_plane(), prevBytes
+// is the previously decoded frame and is not read for a key frame.
+
+static inline
+void rice2_temporal_decode_plane(const Rice2TemporalPlane & inPlane,
+                                 const uint8_t * prevBytes,
+                                 uint8_t * outBytes)
+{
+  vector<uint8_t> imageOrderSymbols;
+
+  rice2_decode_plane_deltas(inPlane.plane, imageOrderSymbols);
+
+  rice2_temporal_undelta_plane(imageOrderSymbols.data(), inPlane, prevBytes, outBytes);
+
+  return;
+}
+
+#endif // _Rice2Temporal_hpp
@@ -32,6 +32,46 @@
 
 //#define EMIT_RICEDECODEBLOCKS_DEBUG_OUTPUT
 
+// Decode statistics are CPU only, the Metal shaders compile the decoder
+// without a stats member or any stats calls.
+
+#if !defined(__METAL_VERSION__)
+#define RICEDECODEBLOCKS_STATS
+#endif // __METAL_VERSION__
+
+#if defined(RICEDECODEBLOCKS_STATS)
+
+// Decode statistics policy, RiceDecodeBlocks invokes these methods on
+// refill, escape and symbol events. This default policy is empty so
+// that every call is inlined away and a build without stats has the
+// same codegen as before. See RiceDecodeStats.hpp for a CPU policy
+// that counts each event.
+
+class RiceDecodeStatsNone
+{
+public:
+  // Also used as the empty report type for kernel_render_rice_typed()
+  typedef RiceDecodeStatsNone counters_type;
+  
+  // Register refilled from c1, numWordsRead is the number of
+  // reads from the input stream into c2 (0 or 1).
+  inline void countRefill(const int) {}
+  
+  // ESC zero bits escape prefix was parsed
+  inline void countEscape() {}
+  
+  // Prefix of one symbol with the given k was parsed
+  inline void countSymbol(const uint8_t) {}
+  
+  // Bits consumed from the stream
+  inline void countBits(const int) {}
+  
+  template <typename C>
+  inline void addHalfBlock(const int, const int, const C &) {}
+};
+
+#endif // RICEDECODEBLOCKS_STATS
+
 // Read suffix from symbol input, note that this method is not optimal
 // for the k = 0 case since the whole block is not skipped.
 
@@ -45,9 +85,15 @@
 //  return prefixByte;
 //}
 
-// RiceDecodeBlocks
+// RiceDecodeBlocks, ESC is the number of zero bits in the escape code
+// and must match the escape width the stream was encoded with. The
+// Metal shaders use the default 16 bit escape.
 
-template <typename T, typename R, const bool ALWAYS_REFILL = false>
+#if defined(RICEDECODEBLOCKS_STATS)
+template <typename T, typename R, const bool ALWAYS_REFILL = false, typename STATS = RiceDecodeStatsNone, const int ESC = 16>
+#else
+template <typename T, typename R, const bool ALWAYS_REFILL = false, typename STATS = void, const int ESC = 16>
+#endif // RICEDECODEBLOCKS_STATS
 class RiceDecodeBlocks
 {
 public:
@@ -56,6 +102,10 @@ public:
   R reg;
   uint8_t regN;
   
+#if defined(RICEDECODEBLOCKS_STATS)
+  STATS stats;
+#endif // RICEDECODEBLOCKS_STATS
+  
 #if defined(RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL)
   uint32_t totalNumBitsRead;
 #endif // RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
@@ -75,7 +125,8 @@ public:
   // Parse a prefix byte from the stream, returns CLZ+1
   // and shifts modified bits out of the register. This
   // logic must assume that at least 1 bit is always
-  // consumed by a method invocation.
+  // consumed by a method invocation. The escape case
+  // returns ESC+1.
   
   uint8_t parsePrefixByte() {
 #if defined(EMIT_RICEDECODEBLOCKS_DEBUG_OUTPUT)
@@ -119,7 +170,7 @@ public:
       assert(regN < numRegBits());
 #endif // DEBUG
       
-      cachedBits.refill(reg, regN);
+      refillReg();
       
 #if defined(DEBUG)
       assert(regN == numRegBits());
@@ -163,20 +214,32 @@ public:
     }
 #endif // EMIT_RICEDECODEBLOCKS_DEBUG_OUTPUT
     
+    // A shorter escape code ends at ESC zero bits
+    
+    if (ESC < 16 && prefixCount > ESC) {
+      prefixCount = ESC + 1;
+    }
+    
 #if defined(DEBUG)
-    // valid prefixCount range (1, 16) not that in the
-    // case of 16 zeros the prefixCount result would be 17
-    if ((reg >> (numRegBits() - 16)) == 0) {
-      assert(prefixCount == 17);
+    // valid prefixCount range (1, ESC) not that in the
+    // case of ESC zeros the prefixCount result would be ESC+1
+    if ((reg >> (numRegBits() - ESC)) == 0) {
+      assert(prefixCount == (ESC + 1));
     } else {
-      assert(prefixCount >= 1 && prefixCount <= 16);
+      assert(prefixCount >= 1 && prefixCount <= ESC);
     }
 #endif // DEBUG
     
-    // Special case of 17 indicates that 16 bits should be
+    // Special case of ESC+1 indicates that ESC bits should be
     // removed from the register.
     
-    uint16_t shiftNumBits = (prefixCount == 17) ? 16 : prefixCount;
+    uint16_t shiftNumBits = (prefixCount == (ESC + 1)) ? ESC : prefixCount;
+    
+#if defined(RICEDECODEBLOCKS_STATS)
+    if (prefixCount == (ESC + 1)) {
+      stats.countEscape();
+    }
+#endif // RICEDECODEBLOCKS_STATS
     
     // Shift reg bits to drop prefixCount bits off the left
     
@@ -205,6 +268,10 @@ public:
     totalNumBitsRead += shiftNumBits;
 #endif // RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
     
+#if defined(RICEDECODEBLOCKS_STATS)
+    stats.countBits(shiftNumBits);
+#endif // RICEDECODEBLOCKS_STATS
+    
 #if defined(EMIT_RICEDECODEBLOCKS_DEBUG_OUTPUT)
     if (debug) {
       printf("post shift by %2d bits : reg is 0x%04X : regN %2d\n", shiftNumBits, reg, regN);
@@ -222,6 +289,21 @@ public:
     return sizeof(reg) * 8;
   }
   
+  // Refill reg from cached bits and report the refill to the stats
+  // policy. The word read count is derived from the input pointer
+  // and is dead code when the policy does not use it.
+  
+  inline
+  void refillReg(const bool allowRefillWhenFull = false) {
+#if defined(RICEDECODEBLOCKS_STATS)
+    auto inPtrBefore = cachedBits.inPtr;
+    cachedBits.refill(reg, regN, allowRefillWhenFull);
+    stats.countRefill((int) (cachedBits.inPtr - inPtrBefore));
+#else
+    cachedBits.refill(reg, regN, allowRefillWhenFull);
+#endif // RICEDECODEBLOCKS_STATS
+  }
+  
   // Execute clz on 16 or 32 bit register, returns q.
   // When successful this method returns a value in the range
   // (0, 15) otherwise a value larger than 15 can be returned.
@@ -288,7 +370,7 @@ public:
     
 #if defined(DEBUG)
     if (numBitsRead == (q+1)) {
-      assert(q < 16);
+      assert(q < ESC);
     }
 #endif // DEBUG
     
@@ -326,6 +408,10 @@ public:
     totalNumBitsRead += numBitsRead;
 #endif // RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
     
+#if defined(RICEDECODEBLOCKS_STATS)
+    stats.countBits(numBitsRead);
+#endif // RICEDECODEBLOCKS_STATS
+    
     return symbol;
   }
   
@@ -365,7 +451,7 @@ public:
 //      assert(regN < numRegBits());
 //#endif // DEBUG
       
-      cachedBits.refill(reg, regN, true);
+      refillReg(true);
       
 #if defined(DEBUG)
       assert(regN == numRegBits());
@@ -380,7 +466,7 @@ public:
       assert(regN < numRegBits());
 #endif // DEBUG
       
-      cachedBits.refill(reg, regN);
+      refillReg();
       
 #if defined(DEBUG)
       assert(regN == numRegBits());
@@ -392,18 +478,18 @@ public:
     
     ushort symbol, q, numBitsRead;
     
-    // If clz is in the range (0, 15) then a prefix value was parsed successfully.
+    // If clz is in the range (0, ESC-1) then a prefix value was parsed successfully.
     
     q = clzImpl();
     
-    if (q < 16) {
+    if (q < ESC) {
       // A successful clz is the most likely case by far, so this logic need
       // not require that a full 16 bit be available when at least one of the
       // next 16 bits is on.
       numBitsRead = q + 1;
     } else {
       // clz was not successful, there are not enough bits or
-      // there could be 16 zeros in a row, either way refill
+      // there could be ESC zeros in a row, either way refill
       // and then check for the escape special case followed
       // by cleanup path where clz would be executed again.
       
@@ -412,42 +498,50 @@ public:
       // when register is already full.
       
       {
-        cachedBits.refill(reg, regN, true);
+        refillReg(true);
         
 #if defined(DEBUG)
         assert(regN == numRegBits());
 #endif // DEBUG
       }
       
-      if ((reg >> (numRegBits() - 16)) == 0) {
+      if ((reg >> (numRegBits() - ESC)) == 0) {
         // Escape special case
 #if defined(DEBUG)
-        assert(regN >= 16);
+        assert(regN >= ESC);
 #endif // DEBUG
         
-        if (numRegBits() == 16) {
+        if (numRegBits() == ESC) {
           // 16 bits
           regN = 0;
           //reg = 0;
-        } else {
+        } else if (ESC == 16) {
           // 32 bits
           regN -= 16;
           reg <<= 8;
           reg <<= 8;
+        } else {
+          regN -= ESC;
+          reg <<= ESC;
         }
         
 #if defined(RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL)
-        totalNumBitsRead += 16;
+        totalNumBitsRead += ESC;
 #endif // RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
         
+#if defined(RICEDECODEBLOCKS_STATS)
+        stats.countEscape();
+        stats.countBits(ESC);
+#endif // RICEDECODEBLOCKS_STATS
+        
 #if defined(DEBUG)
         if (debug) {
-          printf("bits (del16): %s\n", get_code_bits_as_string64(reg, numRegBits()).c_str());
+          printf("bits (delESC): %s\n", get_code_bits_as_string64(reg, numRegBits()).c_str());
         }
 #endif // DEBUG
         
         if (numRegBits() == 16) {
-          cachedBits.refill(reg, regN, false);
+          refillReg(false);
           
 #if defined(DEBUG)
           assert(regN == numRegBits());
@@ -477,7 +571,7 @@ public:
       } else {
         // prefix parse 2nd check, a reload means
         // that clz op must be executed again.
-        // The result must be LT 16.
+        // The result must be LT ESC.
         
 # if defined(DEBUG)
         if (numRegBits() == 16) {
@@ -501,6 +595,10 @@ public:
     
     symbol = parseSymbolFromQ(k, q, numBitsRead);
     
+#if defined(RICEDECODEBLOCKS_STATS)
+    stats.countSymbol(k);
+#endif // RICEDECODEBLOCKS_STATS
+    
 #if defined(DEBUG)
     if (debug) {
       printf("append decoded prefix symbol = %d\n", symbol);
@@ -550,7 +648,7 @@ public:
 //      assert(regN < numRegBits());
 //#endif // DEBUG
       
-      cachedBits.refill(reg, regN, true);
+      refillReg(true);
       
 #if defined(DEBUG)
       assert(regN == numRegBits());
@@ -562,7 +660,7 @@ public:
       assert(regN < numRegBits());
 #endif // DEBUG
       
-      cachedBits.refill(reg, regN);
+      refillReg();
       
 #if defined(DEBUG)
       assert(regN == numRegBits());
@@ -612,6 +710,10 @@ public:
 #if defined(RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL)
       totalNumBitsRead += k;
 #endif // RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
+      
+#if defined(RICEDECODEBLOCKS_STATS)
+      stats.countBits(k);
+#endif // RICEDECODEBLOCKS_STATS
     }
     
 #if defined(DEBUG)
@@ -665,7 +767,7 @@ public:
       assert(regN < numRegBits());
 #endif // DEBUG
       
-      cachedBits.refill(reg, regN);
+      refillReg();
       
 #if defined(DEBUG)
       assert(regN == numRegBits());
@@ -677,7 +779,7 @@ public:
       assert(regN < numRegBits());
 #endif // DEBUG
       
-      cachedBits.refill(reg, regN);
+      refillReg();
       
 #if defined(DEBUG)
       assert(regN == numRegBits());
@@ -757,6 +859,10 @@ public:
     totalNumBitsRead += k4;
 #endif // RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
     
+#if defined(RICEDECODEBLOCKS_STATS)
+    stats.countBits(k4);
+#endif // RICEDECODEBLOCKS_STATS
+    
     return;
   }
   
@@ -7,8 +7,13 @@
 //
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #import "AAPLShaderTypes.h"
 #import "block.hpp"
 #import "block_process.hpp"
@@ -502,6 +507,111 @@ void block_s32_flatten_block_layout(
   return;
 }
 
+// Gather s32 layout directly from padded image order bytes. The s32 offset
+// of symbol i in the half block decoded by thread tid of big block bbid is
+// (bbid * 1024) + (tid * 32) + i, the same layout block_s32_format_block_layout
+// creates from 8x8 block order input and the big block blocki lookup. Each
+// half block row is 8 contiguous bytes in image order, so one 32 byte row
+// of a big block is split into 4 half block rows.
+
+static inline
+void block_s32_format_image_order(
+                                  const uint8_t *inImageOrderBytes,
+                                  uint8_t *outs32BlockBytes,
+                                  const int numBigBlocksInWidth,
+                                  const int numBigBlocksInHeight)
+{
+  const int bigBlockDim = 32;
+  const int blockDim = 8;
+  const int paddedWidth = numBigBlocksInWidth * bigBlockDim;
+  
+  int bbid = 0;
+  
+  for (int bigBlockY = 0; bigBlockY < numBigBlocksInHeight; bigBlockY++) {
+    for (int bigBlockX = 0; bigBlockX < numBigBlocksInWidth; bigBlockX++, bbid++) {
+      const uint8_t *bigBlockPtr = inImageOrderBytes + (bigBlockY * bigBlockDim * paddedWidth) + (bigBlockX * bigBlockDim);
+      uint8_t *outBigBlockPtr = outs32BlockBytes + (bbid * bigBlockDim * bigBlockDim);
+      
+      for (int y = 0; y < bigBlockDim; y++) {
+        const uint8_t *rowPtr = bigBlockPtr + (y * paddedWidth);
+        
+        // tid for block column 0, each block column adds 2
+        
+        const int blockY = y / blockDim;
+        const int half = (y % blockDim) / (blockDim/2);
+        const int tid0 = (blockY * 4 * 2) + half;
+        
+        uint8_t *outRowPtr = outBigBlockPtr + (tid0 * 32) + ((y % (blockDim/2)) * blockDim);
+        
+#if defined(__AVX2__)
+        __m256i row = _mm256_loadu_si256((const __m256i *) rowPtr);
+        __m128i lo = _mm256_castsi256_si128(row);
+        __m128i hi = _mm256_extracti128_si256(row, 1);
+        _mm_storel_epi64((__m128i *) (outRowPtr + (0 * 64)), lo);
+        _mm_storel_epi64((__m128i *) (outRowPtr + (1 * 64)), _mm_unpackhi_epi64(lo, lo));
+        _mm_storel_epi64((__m128i *) (outRowPtr + (2 * 64)), hi);
+        _mm_storel_epi64((__m128i *) (outRowPtr + (3 * 64)), _mm_unpackhi_epi64(hi, hi));
+#else
+        for (int blockX = 0; blockX < 4; blockX++) {
+          memcpy(outRowPtr + (blockX * 64), rowPtr + (blockX * blockDim), blockDim);
+        }
+#endif // __AVX2__
+      }
+    }
+  }
+  
+  return;
+}
+
+// Scatter s32 layout back to padded image order, inverse of
+// block_s32_format_image_order().
+
+static inline
+void block_s32_flatten_image_order(
+                                   const uint8_t *inS32BlockBytes,
+                                   uint8_t *outImageOrderBytes,
+                                   const int numBigBlocksInWidth,
+                                   const int numBigBlocksInHeight)
+{
+  const int bigBlockDim = 32;
+  const int blockDim = 8;
+  const int paddedWidth = numBigBlocksInWidth * bigBlockDim;
+  
+  int bbid = 0;
+  
+  for (int bigBlockY = 0; bigBlockY < numBigBlocksInHeight; bigBlockY++) {
+    for (int bigBlockX = 0; bigBlockX < numBigBlocksInWidth; bigBlockX++, bbid++) {
+      uint8_t *bigBlockPtr = outImageOrderBytes + (bigBlockY * bigBlockDim * paddedWidth) + (bigBlockX * bigBlockDim);
+      const uint8_t *inBigBlockPtr = inS32BlockBytes + (bbid * bigBlockDim * bigBlockDim);
+      
+      for (int y = 0; y < bigBlockDim; y++) {
+        uint8_t *rowPtr = bigBlockPtr + (y * paddedWidth);
+        
+        const int blockY = y / blockDim;
+        const int half = (y % blockDim) / (blockDim/2);
+        const int tid0 = (blockY * 4 * 2) + half;
+        
+        const uint8_t *inRowPtr = inBigBlockPtr + (tid0 * 32) + ((y % (blockDim/2)) * blockDim);
+        
+#if defined(__AVX2__)
+        __m128i b0 = _mm_loadl_epi64((const __m128i *) (inRowPtr + (0 * 64)));
+        __m128i b1 = _mm_loadl_epi64((const __m128i *) (inRowPtr + (1 * 64)));
+        __m128i b2 = _mm_loadl_epi64((const __m128i *) (inRowPtr + (2 * 64)));
+        __m128i b3 = _mm_loadl_epi64((const __m128i *) (inRowPtr + (3 * 64)));
+        __m256i row = _mm256_set_m128i(_mm_unpacklo_epi64(b2, b3), _mm_unpacklo_epi64(b0, b1));
+        _mm256_storeu_si256((__m256i *) rowPtr, row);
+#else
+        for (int blockX = 0; blockX < 4; blockX++) {
+          memcpy(rowPtr + (blockX * blockDim), inRowPtr + (blockX * 64), blockDim);
+        }
+#endif // __AVX2__
+      }
+    }
+  }
+  
+  return;
+}
+
 // Decode API where a block of 32x32 bytes is decoded, this method accepts
 // the same parameters as the bit parsing API and outputs the threadid
 // for a given pixel in image order.
@@ -548,7 +658,11 @@ typedef CachedBits<uint32_t, const uint32_t *, uint32_t, uint8_t> CachedBits3232
 //typedef RiceDecodeBlocks<CachedBits3216, uint16_t, false> RiceDecodeBlocksT;
 typedef RiceDecodeBlocks<CachedBits3232, uint32_t, false> RiceDecodeBlocksT;
 
-template <const int D>
+// Pass a RiceDecodeStatsReport as the optional report argument to collect
+// decode statistics, the default report type compiles to nothing. ESC is
+// the escape bit width the stream was encoded with.
+
+template <const int D, typename REPORT = RiceDecodeStatsNone, const int ESC = 16>
 void kernel_render_rice_typed(
                               uint32_t *outTexturePtr,
                               RiceRenderUniform & riceRenderUniform,
@@ -559,7 +673,8 @@ void kernel_render_rice_typed(
                               unsigned int bbid, // big block blocki
                               int tid, // thread id
                               // output blocki, big blocki, or bit offset on a per pixel basis
-                              uint32_t *out32Ptr
+                              uint32_t *out32Ptr,
+                              REPORT *report = nullptr
                               ) // thread id
 {
   const bool debug = false;
@@ -569,7 +684,7 @@ void kernel_render_rice_typed(
   // correspond to a half block.
   
   // Thread specific bit stream and registers
-  RiceDecodeBlocksT rdb;
+  RiceDecodeBlocks<CachedBits3232, uint32_t, false, typename REPORT::counters_type, ESC> rdb;
   
   //const ushort blockDim = RICE_SMALL_BLOCK_DIM;
   const ushort blockDim = D;
@@ -606,7 +721,9 @@ void kernel_render_rice_typed(
     halfBlockStartBitOffset = inoutBlockOffsetTablePtr[(bbid * 32) + tid];
   }
 
-  if (rType == RenderRiceTypedDecode) {
+  // A skip block reads no bits, the stream may end at its offset
+  
+  if (rType == RenderRiceTypedDecode && k != RICE2_SKIP_BLOCK_K) {
     if (debug) {
       printf("rdb.cachedBits.initBits(ptr, %d)\n", halfBlockStartBitOffset);
     }
@@ -839,6 +956,17 @@ void kernel_render_rice_typed(
           out32Ptr[offset+3] = halfBlockStartBitOffset;
           
           continue;
+        } else if (rType == RenderRiceTypedDecode && k == RICE2_SKIP_BLOCK_K) {
+          // Every symbol in a skip block is zero, no bits are read
+          
+          prefixByte0 = 0;
+          prefixByte1 = 0;
+          prefixByte2 = 0;
+          prefixByte3 = 0;
+          
+          for (int i = 0; i < 4; i++) {
+            rdb.stats.countSymbol(k);
+          }
         } else if (rType == RenderRiceTypedDecode) {
           prefixByte0  = rdb.decodePrefixByte(k, false, 0, true);
           prefixByte1  = rdb.decodePrefixByte(k, false, 0, false);
@@ -882,5 +1010,9 @@ void kernel_render_rice_typed(
     }
   }
   
+  if (report && (rType == RenderRiceTypedDecode)) {
+    report->addHalfBlock(bbid, tid, rdb.stats);
+  }
+  
   return;
 }
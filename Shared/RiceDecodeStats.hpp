@@ -0,0 +1,195 @@
+//
+//  RiceDecodeStats.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Decode statistics for the CPU decoder. RiceDecodeStatsCounters is a
+//  stats policy for RiceDecodeBlocks that counts register refills,
+//  stream word reads, escapes, symbols by k and bits. The report type
+//  collects the counters from each half block decode so that totals,
+//  a k histogram, symbols and bits per half block and bits per big block can
+//  be inspected as a struct or exported as JSON.
+
+#ifndef _RiceDecodeStats_hpp
+#define _RiceDecodeStats_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Counters updated by RiceDecodeBlocks for one half block decode
+
+class RiceDecodeStatsCounters
+{
+public:
+  uint32_t numRefills;
+  uint32_t numWordReads;
+  uint32_t numEscapes;
+  uint32_t numSymbols;
+  uint32_t numBits;
+
+  // Number of symbols decoded with each k value
+  uint32_t kHistogram[16];
+
+  RiceDecodeStatsCounters()
+  : numRefills(0),
+  numWordReads(0),
+  numEscapes(0),
+  numSymbols(0),
+  numBits(0)
+  {
+    memset(kHistogram, 0, sizeof(kHistogram));
+  }
+
+  inline void countRefill(const int numWordsRead) {
+    numRefills += 1;
+    numWordReads += numWordsRead;
+  }
+
+  inline void countEscape() {
+    numEscapes += 1;
+  }
+
+  inline void countSymbol(const uint8_t k) {
+    numSymbols += 1;
+    kHistogram[k & 0xF] += 1;
+  }
+
+  inline void countBits(const int n) {
+    numBits += n;
+  }
+};
+
+// Stats for a complete decode, pass to kernel_render_rice_typed() to
+// collect the counters from each (bbid, tid) half block.
+
+class RiceDecodeStatsReport
+{
+public:
+  typedef RiceDecodeStatsCounters counters_type;
+
+  // Totals over all half blocks
+  uint64_t numRefills;
+  uint64_t numWordReads;
+  uint64_t numEscapes;
+  uint64_t numSymbols;
+  uint64_t numBits;
+
+  // Symbols decoded with each k value
+  uint64_t kHistogram[16];
+
+  // Indexed by (bbid * 32) + tid
+  vector<uint32_t> halfBlockNumSymbols;
+  vector<uint32_t> halfBlockNumBits;
+
+  // Indexed by bbid
+  vector<uint32_t> bigBlockNumBits;
+
+  RiceDecodeStatsReport()
+  {
+    clear();
+  }
+
+  void clear() {
+    numRefills = 0;
+    numWordReads = 0;
+    numEscapes = 0;
+    numSymbols = 0;
+    numBits = 0;
+    memset(kHistogram, 0, sizeof(kHistogram));
+    halfBlockNumSymbols.clear();
+    halfBlockNumBits.clear();
+    bigBlockNumBits.clear();
+  }
+
+  // Add the counters for one half block, the decode for each
+  // (bbid, tid) pair must be added only once.
+
+  void addHalfBlock(const int bbid, const int tid, const RiceDecodeStatsCounters & counters) {
+    numRefills += counters.numRefills;
+    numWordReads += counters.numWordReads;
+    numEscapes += counters.numEscapes;
+    numSymbols += counters.numSymbols;
+    numBits += counters.numBits;
+
+    for (int k = 0; k < 16; k++) {
+      kHistogram[k] += counters.kHistogram[k];
+    }
+
+    const int halfBlocki = (bbid * 32) + tid;
+
+    if (halfBlockNumSymbols.size() <= (size_t) halfBlocki) {
+      halfBlockNumSymbols.resize(halfBlocki + 1);
+      halfBlockNumBits.resize(halfBlocki + 1);
+    }
+    halfBlockNumSymbols[halfBlocki] += counters.numSymbols;
+    halfBlockNumBits[halfBlocki] += counters.numBits;
+
+    if (bigBlockNumBits.size() <= (size_t) bbid) {
+      bigBlockNumBits.resize(bbid + 1);
+    }
+    bigBlockNumBits[bbid] += counters.numBits;
+  }
+
+  // Export as a JSON object
+
+  string toJSON() const {
+    string json;
+    char buffer[128];
+
+    auto appendU64 = [&](const char *name, uint64_t value, bool comma) {
+      snprintf(buffer, sizeof(buffer), "  \"%s\": %llu%s\n", name, (unsigned long long)value, comma ? "," : "");
+      json += buffer;
+    };
+
+    auto appendArray = [&](const char *name, const auto *values, const int n, bool comma) {
+      snprintf(buffer, sizeof(buffer), "  \"%s\": [", name);
+      json += buffer;
+      for (int i = 0; i < n; i++) {
+        snprintf(buffer, sizeof(buffer), "%s%llu", (i == 0) ? "" : ", ", (unsigned long long)values[i]);
+        json += buffer;
+      }
+      json += comma ? "],\n" : "]\n";
+    };
+
+    json += "{\n";
+    appendU64("numRefills", numRefills, true);
+    appendU64("numWordReads", numWordReads, true);
+    appendU64("numEscapes", numEscapes, true);
+    appendU64("numSymbols", numSymbols, true);
+    appendU64("numBits", numBits, true);
+    appendArray("kHistogram", kHistogram, 16, true);
+    appendArray("halfBlockNumSymbols", halfBlockNumSymbols.data(), (int) halfBlockNumSymbols.size(), true);
+    appendArray("halfBlockNumBits", halfBlockNumBits.data(), (int) halfBlockNumBits.size(), true);
+    appendArray("bigBlockNumBits", bigBlockNumBits.data(), (int) bigBlockNumBits.size(), false);
+    json += "}\n";
+
+    return json;
+  }
+
+  // Mean over big blocks of the most bits read by one of the 32 half
+  // block decodes, a threadgroup finishes when its longest thread does.
+
+  double meanMaxHalfBlockNumBits() const {
+    const int numBigBlocks = (int) halfBlockNumBits.size() / 32;
+    uint64_t sum = 0;
+
+    for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+      uint32_t maxBits = 0;
+      for (int tid = 0; tid < 32; tid++) {
+        maxBits = max(maxBits, halfBlockNumBits[(bbid * 32) + tid]);
+      }
+      sum += maxBits;
+    }
+
+    return (numBigBlocks == 0) ? 0.0 : ((double) sum / numBigBlocks);
+  }
+};
+
+#endif // _RiceDecodeStats_hpp
@@ -0,0 +1,248 @@
+//
+//  RiceFrameRing.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Fixed ring of frame slots for decoding a sequence of compressed
+//  frames. A reader thread fills free slots with the next compressed
+//  frame, a decode thread decodes filled slots and the consumer takes
+//  decoded slots in frame order and hands each one back to the ring.
+//  At most numSlots frames are in flight, with 3 slots the read of
+//  frame i+2 overlaps the decode of frame i+1 and the consumption of
+//  frame i. Slots are allocated once and the buffers in a slot keep
+//  their capacity from frame to frame.
+
+#ifndef _RiceFrameRing_hpp
+#define _RiceFrameRing_hpp
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RicePipeline.hpp"
+#include "Rice2Asset.hpp"
+
+using namespace std;
+
+template <typename S>
+class RiceFrameRing
+{
+public:
+  // Read frame frameIndex into the input buffers of slot, returns the
+  // number of bytes read or 0 when the frame could not be read.
+  typedef function<size_t(int frameIndex, S & slot)> ReadFn;
+
+  // Decode the input buffers of slot, returns the number of bytes decoded
+  typedef function<size_t(S & slot)> DecodeFn;
+
+  // Use the decoded slot, ok is false when the read failed. The slot is
+  // handed back to the ring as soon as this returns.
+  typedef function<void(int frameIndex, S & slot, bool ok)> ConsumeFn;
+
+  vector<S> slots;
+
+  RiceFrameRing(int numSlots = 3)
+  : slots(numSlots < 1 ? 1 : numSlots)
+  {
+  }
+
+  // Read, decode and consume frames [0, numFrames) in order. Reads and
+  // decodes run on their own threads, consume runs on the calling
+  // thread. Returns the number of frames that could not be read.
+
+  int run(const int numFrames,
+          const ReadFn & read,
+          const DecodeFn & decode,
+          const ConsumeFn & consume)
+  {
+    typedef chrono::steady_clock Clock;
+
+    const int numSlots = (int) slots.size();
+
+    RiceBoundedQueue<int> freeSlots(numSlots);
+    RiceBoundedQueue<int> filledSlots(numSlots);
+    RiceBoundedQueue<int> decodedSlots(numSlots);
+
+    vector<int> slotFrame(numSlots);
+    vector<char> slotOk(numSlots);
+
+    for (int i = 0; i < numSlots; i++) {
+      freeSlots.push(int(i));
+    }
+
+    stepCounters.clear();
+    stepCounters.resize(3);
+    stepCounters[0].name = "read";
+    stepCounters[1].name = "decode";
+    stepCounters[2].name = "consume";
+
+    for ( RicePipelineCounters & counters : stepCounters ) {
+      counters.numWorkers = 1;
+    }
+
+    // Each step waits on its input queue, works on one slot and then
+    // passes the slot to its output queue.
+
+    auto timeStep = [](RicePipelineCounters & counters, Clock::time_point t0, Clock::time_point t1, Clock::time_point t2, Clock::time_point t3) {
+      counters.numItems += 1;
+      counters.waitInSeconds += chrono::duration<double>(t1 - t0).count();
+      counters.busySeconds += chrono::duration<double>(t2 - t1).count();
+      counters.waitOutSeconds += chrono::duration<double>(t3 - t2).count();
+    };
+
+    thread reader([&]() {
+      RicePipelineCounters & counters = stepCounters[0];
+
+      for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+        int si;
+        Clock::time_point t0 = Clock::now();
+        if (!freeSlots.pop(si)) {
+          break;
+        }
+        Clock::time_point t1 = Clock::now();
+        size_t numBytes = read(frameIndex, slots[si]);
+        slotFrame[si] = frameIndex;
+        slotOk[si] = (numBytes > 0);
+        counters.numBytes += numBytes;
+        Clock::time_point t2 = Clock::now();
+        filledSlots.push(int(si));
+        timeStep(counters, t0, t1, t2, Clock::now());
+      }
+
+      filledSlots.close();
+    });
+
+    thread decoder([&]() {
+      RicePipelineCounters & counters = stepCounters[1];
+
+      while (true) {
+        int si;
+        Clock::time_point t0 = Clock::now();
+        if (!filledSlots.pop(si)) {
+          break;
+        }
+        Clock::time_point t1 = Clock::now();
+        if (slotOk[si]) {
+          counters.numBytes += decode(slots[si]);
+        }
+        Clock::time_point t2 = Clock::now();
+        decodedSlots.push(int(si));
+        timeStep(counters, t0, t1, t2, Clock::now());
+      }
+
+      decodedSlots.close();
+    });
+
+    int numFailed = 0;
+
+    {
+      RicePipelineCounters & counters = stepCounters[2];
+
+      while (true) {
+        int si;
+        Clock::time_point t0 = Clock::now();
+        if (!decodedSlots.pop(si)) {
+          break;
+        }
+        Clock::time_point t1 = Clock::now();
+        consume(slotFrame[si], slots[si], slotOk[si] != 0);
+        numFailed += slotOk[si] ? 0 : 1;
+        Clock::time_point t2 = Clock::now();
+        freeSlots.push(int(si));
+        timeStep(counters, t0, t1, t2, Clock::now());
+      }
+    }
+
+    reader.join();
+    decoder.join();
+
+    return numFailed;
+  }
+
+  // Counters for the read, decode and consume steps of the last run
+
+  vector<RicePipelineCounters> counters() const {
+    return stepCounters;
+  }
+
+private:
+  vector<RicePipelineCounters> stepCounters;
+};
+
+// Slot for a sequence of grayscale frames stored as single plane
+// containers, see Rice2Asset.hpp
+
+class Rice2FrameSlot
+{
+public:
+  // Compressed bytes of the frame
+  vector<uint8_t> assetBytes;
+
+  // Rice bits, k table and offsets parsed from assetBytes
+  Rice2EncodedPlane plane;
+
+  // Rice bits followed by RICE2_HALF_BLOCK_MAX_NUM_WORDS padding words
+  vector<uint32_t> paddedBits;
+
+  // Padded deltas used while decoding
+  vector<uint8_t> imageOrderDeltas;
+
+  // Decoded width x height pixels
+  vector<uint8_t> outPixels;
+};
+
+// Read a frame file into slot.assetBytes and parse it into slot.plane,
+// returns the file size or 0 when the file could not be read or parsed.
+// Frames are untrusted, a plane that rice2_asset_load_gray() rejects is
+// not read, so the tables of a read frame can be decoded on the GPU.
+
+static inline
+size_t rice2_frame_read_file(const string & path, Rice2FrameSlot & slot)
+{
+  FILE *fp = fopen(path.c_str(), "rb");
+
+  if (fp == NULL) {
+    return 0;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long numBytes = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if (numBytes <= 0) {
+    fclose(fp);
+    return 0;
+  }
+
+  slot.assetBytes.resize(numBytes);
+  size_t numRead = fread(slot.assetBytes.data(), 1, numBytes, fp);
+  fclose(fp);
+
+  if (numRead != (size_t) numBytes || !rice2_asset_load_gray(slot.assetBytes, slot.plane)) {
+    return 0;
+  }
+
+  rice2_plane_padded_bits(slot.plane, slot.paddedBits);
+
+  return numRead;
+}
+
+// Decode slot.plane into slot.outPixels, returns the number of pixels
+
+static inline
+size_t rice2_frame_decode(Rice2FrameSlot & slot, RiceThreadPool *pool = nullptr)
+{
+  const Rice2EncodedPlane & plane = slot.plane;
+
+  slot.outPixels.resize(plane.width * plane.height);
+
+  rice2_decode_plane_tiles(plane, slot.outPixels.data(), [](int) {}, pool, &slot.imageOrderDeltas, &slot.paddedBits);
+
+  return slot.outPixels.size();
+}
+
+#endif // _RiceFrameRing_hpp
@@ -0,0 +1,689 @@
+//
+//  RiceKernelSim.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  CPU executor for the compute kernels in RiceShaders.metal. Each
+//  dispatch runs whole threadgroups of 32 threads, one threadgroup for
+//  each 32x32 big block. Threadgroup memory is emulated per threadgroup
+//  and the threads in a group run one phase at a time, a phase ends
+//  where the kernel has a threadgroup barrier. This is the same order
+//  the threads of one simdgroup execute in on the GPU, so kernels that
+//  do not sync still decode correctly. When hazard checking is enabled
+//  each read of threadgroup memory written by another thread since the
+//  last barrier is counted, the _sync variants must report zero.
+//  Threadgroups are independent and can be scheduled over a thread pool.
+//  Note that CachedBits.hpp and RiceDecodeBlocks.hpp must be included
+//  before this header.
+
+#ifndef _RiceKernelSim_hpp
+#define _RiceKernelSim_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "zigzag.h"
+#include "Rice2Codec.hpp"
+#include "RiceDecodeStats.hpp"
+#include "RiceThreadPool.hpp"
+
+using namespace std;
+
+// One entry for each kernel in RiceShaders.metal
+
+typedef enum {
+  RiceKernelRenderRice2,
+  RiceKernelRenderRice2Undelta,
+  RiceKernelRenderRice2UndeltaSync,
+  RiceKernelRenderRice2UndeltaGradientSync,
+  RiceKernelRenderRice2UndeltaMEDSync,
+  RiceKernelRenderRiceUndelta,
+  RiceKernelRenderRiceUndeltaSync,
+  RiceKernelRenderRice2Blocki,
+  RiceKernelRenderRice2BlockBitOffset,
+} RiceKernelType;
+
+static inline
+const char* rice_kernel_sim_name(const RiceKernelType type) {
+  switch (type) {
+    case RiceKernelRenderRice2:
+      return "kernel_render_rice2";
+    case RiceKernelRenderRice2Undelta:
+      return "kernel_render_rice2_undelta";
+    case RiceKernelRenderRice2UndeltaSync:
+      return "kernel_render_rice2_undelta_sync";
+    case RiceKernelRenderRice2UndeltaGradientSync:
+      return "kernel_render_rice2_undelta_gradient_sync";
+    case RiceKernelRenderRice2UndeltaMEDSync:
+      return "kernel_render_rice2_undelta_med_sync";
+    case RiceKernelRenderRiceUndelta:
+      return "kernel_render_rice_undelta";
+    case RiceKernelRenderRiceUndeltaSync:
+      return "kernel_render_rice_undelta_sync";
+    case RiceKernelRenderRice2Blocki:
+      return "kernel_render_rice2_blocki";
+    case RiceKernelRenderRice2BlockBitOffset:
+      return "kernel_render_rice2_block_bit_offset";
+  }
+  return "";
+}
+
+// Buffers bound to a kernel. The output texture is simulated with
+// 32 bit BGRA pixels, writes outside the texture are dropped like
+// writes to a Metal texture. The kernel_render_rice2 variants write
+// 4 bytes to each pixel so the texture is (width/4, height) while
+// kernel_render_rice_undelta writes grayscale pixels cropped to
+// (cropWidth, cropHeight). The blocki and bit offset kernels write
+// one word for each byte to out32Ptr. When halfBlockTidTable is set
+// each thread decodes the half block given in the table.
+
+class RiceKernelBuffers
+{
+public:
+  RiceRenderUniform riceRenderUniform;
+
+  uint32_t *inoutBlockOffsetTable;
+  const uint32_t *inS32Bits;
+  const uint8_t *blockOptimalKTable;
+  const uint8_t *halfBlockTidTable;
+
+  uint32_t *outTexture;
+  int outTextureWidth;
+  int outTextureHeight;
+
+  uint32_t *out32Ptr;
+
+  RiceKernelBuffers()
+  : inoutBlockOffsetTable(nullptr),
+  inS32Bits(nullptr),
+  blockOptimalKTable(nullptr),
+  halfBlockTidTable(nullptr),
+  outTexture(nullptr),
+  outTextureWidth(0),
+  outTextureHeight(0),
+  out32Ptr(nullptr)
+  {
+    memset(&riceRenderUniform, 0, sizeof(riceRenderUniform));
+  }
+
+  int numBigBlocksInWidth() const {
+    return riceRenderUniform.numBlocksInWidth / 4;
+  }
+
+  int numBigBlocks() const {
+    return (riceRenderUniform.numBlocksInWidth / 4) * (riceRenderUniform.numBlocksInHeight / 4);
+  }
+
+  inline void writeTexture(const int x, const int y, const uint32_t pixel) const {
+    if (x < outTextureWidth && y < outTextureHeight) {
+      outTexture[(y * outTextureWidth) + x] = pixel;
+    }
+  }
+};
+
+// Emulates threadgroup uchar4 writeCache[(32/4)*32] for one threadgroup
+
+class RiceThreadgroupMemory
+{
+public:
+  static const int numWords = (32/4) * 32;
+
+  uint8_t writeCache[numWords][4];
+
+  bool checkHazards;
+
+  // Incremented by each barrier
+  int epoch;
+
+  int numBarriers;
+
+  // Reads of a word written by another thread in the same epoch
+  int numUnsyncedReads;
+
+  int8_t writerTid[numWords];
+  int writerEpoch[numWords];
+
+  RiceThreadgroupMemory()
+  : checkHazards(false)
+  {
+    reset();
+  }
+
+  void reset() {
+    epoch = 0;
+    numBarriers = 0;
+    numUnsyncedReads = 0;
+    if (checkHazards) {
+      memset(writerTid, -1, sizeof(writerTid));
+      memset(writerEpoch, 0, sizeof(writerEpoch));
+    }
+  }
+
+  inline uint8_t* read(const int tid, const int offset) {
+    if (checkHazards && writerTid[offset] != -1 && writerTid[offset] != tid && writerEpoch[offset] == epoch) {
+      numUnsyncedReads += 1;
+    }
+    return writeCache[offset];
+  }
+
+  inline void write(const int tid, const int offset, const uint8_t *vec) {
+    memcpy(writeCache[offset], vec, 4);
+    if (checkHazards) {
+      writerTid[offset] = tid;
+      writerEpoch[offset] = epoch;
+    }
+  }
+
+  // threadgroup_barrier(mem_flags::mem_threadgroup)
+
+  inline void barrier() {
+    epoch += 1;
+    numBarriers += 1;
+  }
+};
+
+// Holds the decode counters for each thread in one threadgroup so that
+// threadgroups can run concurrently, the counters are added to the
+// shared report once the threadgroup has completed.
+
+template <typename REPORT>
+class RiceThreadgroupReport
+{
+public:
+  typedef typename REPORT::counters_type counters_type;
+
+  counters_type counters[32];
+
+  void addHalfBlock(const int, const int tid, const counters_type & c) {
+    counters[tid] = c;
+  }
+
+  void addTo(REPORT *report, const int bbid) const {
+    for (int tid = 0; tid < 32; tid++) {
+      report->addHalfBlock(bbid, tid, counters[tid]);
+    }
+  }
+};
+
+// Totals for one dispatch
+
+class RiceKernelSimResult
+{
+public:
+  int numThreadgroups;
+  int numBarriers;
+  int numUnsyncedReads;
+
+  RiceKernelSimResult()
+  : numThreadgroups(0),
+  numBarriers(0),
+  numUnsyncedReads(0)
+  {
+  }
+};
+
+// Decode the 32 symbols for one thread and pass each group of 4 bytes
+// to store(col, row) with big block relative coordinates, col is in
+// units of 4 bytes.
+
+template <const int D, typename STATS, typename STORE>
+static inline
+void rice_kernel_sim_decode_half_block(const RiceKernelBuffers & buffers,
+                                       const int bbid,
+                                       const int tid,
+                                       STATS & stats,
+                                       STORE store)
+{
+  const int blockDim = D;
+  const int bigBlocksDim = 4;
+
+  RiceDecodeBlocks<CachedBits3232, uint32_t, false, STATS> rdb;
+
+  const int halfBlockTid = buffers.halfBlockTidTable ? buffers.halfBlockTidTable[(bbid * 32) + tid] : tid;
+
+  const int blockiInBigBlock = halfBlockTid >> 1;
+  const int blocki = (bbid * bigBlocksDim * bigBlocksDim) + blockiInBigBlock;
+
+  const uint8_t k = buffers.blockOptimalKTable[blocki];
+
+  const uint32_t halfBlockStartBitOffset = buffers.inoutBlockOffsetTable[(bbid * 32) + halfBlockTid];
+  if (k != RICE2_SKIP_BLOCK_K) {
+    rdb.cachedBits.initBits(buffers.inS32Bits, halfBlockStartBitOffset);
+  }
+
+#if defined(RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL)
+  rdb.totalNumBitsRead = halfBlockStartBitOffset;
+#endif // RICEDECODEBLOCKS_NUM_BITS_READ_TOTAL
+
+  // Odd threads render to the half block on the bottom
+
+  const int blockX = (blockiInBigBlock % bigBlocksDim) * (blockDim/4);
+  const int blockY = ((blockiInBigBlock / bigBlocksDim) * blockDim) + ((halfBlockTid & 0x1) ? blockDim/2 : 0);
+
+  for (int row = 0; row < blockDim/2; row++) {
+    for (int col = 0; col < blockDim/4; col++) {
+      uint8_t vec[4];
+
+      if (k == RICE2_SKIP_BLOCK_K) {
+        memset(vec, 0, sizeof(vec));
+        for (int i = 0; i < 4; i++) {
+          rdb.stats.countSymbol(k);
+        }
+        store(blockX + col, blockY + row, vec);
+        continue;
+      }
+
+      vec[0] = rdb.decodePrefixByte(k, false, 0, true);
+      vec[1] = rdb.decodePrefixByte(k, false, 0, false);
+      vec[2] = rdb.decodePrefixByte(k, false, 0, false);
+      vec[3] = rdb.decodePrefixByte(k, false, 0, false);
+
+      uint16_t p0 = vec[0], p1 = vec[1], p2 = vec[2], p3 = vec[3];
+      rdb.decodeSuffixByte4x(k, p0, p1, p2, p3);
+
+      vec[0] = p0;
+      vec[1] = p1;
+      vec[2] = p2;
+      vec[3] = p3;
+
+      store(blockX + col, blockY + row, vec);
+    }
+  }
+
+  stats = rdb.stats;
+}
+
+// kernel_render_rice2_undelta and kernel_render_rice_undelta, the
+// barriers are only executed by the _sync variants.
+
+template <const int D, typename REPORT>
+static inline
+void rice_kernel_sim_undelta(const RiceKernelBuffers & buffers,
+                             const int bbid,
+                             const bool expandGray,
+                             const bool sync,
+                             RiceThreadgroupMemory & tgm,
+                             RiceThreadgroupReport<REPORT> & tgReport)
+{
+  const int THREADGROUP_1D_DIM = 32;
+  const int THREADGROUP_1D_DIM4 = 32/4;
+  const int THREADGROUP_2D_NUM_ROWS = 32;
+
+  const int numBigBlocksInWidth = buffers.numBigBlocksInWidth();
+  const int bigBlockRootX = (bbid % numBigBlocksInWidth) * THREADGROUP_1D_DIM4;
+  const int bigBlockRootY = (bbid / numBigBlocksInWidth) * THREADGROUP_1D_DIM;
+
+  // Each thread decodes 1/2 of an 8x8 block into the write cache
+
+  for (int tid = 0; tid < 32; tid++) {
+    rice_kernel_sim_decode_half_block<D>(buffers, bbid, tid, tgReport.counters[tid],
+                                         [&](int col, int row, const uint8_t *vec) {
+      tgm.write(tid, (row * THREADGROUP_1D_DIM4) + col, vec);
+    });
+  }
+
+  if (sync) {
+    tgm.barrier();
+  }
+
+  // Sum column 0 row by row on thread 0, (0,0) is not a delta
+
+  {
+    const int tid = 0;
+    uint8_t sum = tgm.read(tid, 0)[0];
+
+    for (int i = 1; i < THREADGROUP_2D_NUM_ROWS; i++) {
+      const int offsetT = (i * THREADGROUP_1D_DIM4);
+      uint8_t vec[4];
+      memcpy(vec, tgm.read(tid, offsetT), 4);
+      sum += (uint8_t) zigzag_offset_to_num_neg(vec[0]);
+      vec[0] = sum;
+      tgm.write(tid, offsetT, vec);
+    }
+  }
+
+  if (sync) {
+    tgm.barrier();
+  }
+
+  // Sum each row on one thread, column 0 is not zigzag encoded
+
+  for (int tid = 0; tid < 32; tid++) {
+    const int rowStartSharedWordOffset = (tid * THREADGROUP_1D_DIM4);
+    uint8_t sum = 0;
+
+    for (int i = 0; i < THREADGROUP_1D_DIM4; i++) {
+      uint8_t vec[4];
+      memcpy(vec, tgm.read(tid, rowStartSharedWordOffset+i), 4);
+
+      for (int j = 0; j < 4; j++) {
+        if (i == 0 && j == 0) {
+          sum += vec[j];
+        } else {
+          sum += (uint8_t) zigzag_offset_to_num_neg(vec[j]);
+        }
+        vec[j] = sum;
+      }
+
+      tgm.write(tid, rowStartSharedWordOffset+i, vec);
+    }
+  }
+
+  if (sync) {
+    tgm.barrier();
+  }
+
+  // Copy 4 rows with 32 threads in each of 8 passes
+
+  for (int tid = 0; tid < 32; tid++) {
+    for (int rw = 0; rw < 8; rw++) {
+      const int offset = (rw * THREADGROUP_1D_DIM) + tid;
+      const int row = offset / THREADGROUP_1D_DIM4;
+      const int col = offset % THREADGROUP_1D_DIM4;
+
+      const uint8_t *vec = tgm.read(tid, offset);
+
+      if (expandGray) {
+        const int x = (bigBlockRootX + col) * 4;
+        const int y = bigBlockRootY + row;
+
+        for (int i = 0; i < 4; i++) {
+          if ((x + i) < buffers.riceRenderUniform.cropWidth && y < buffers.riceRenderUniform.cropHeight) {
+            const uint32_t v = vec[i];
+            buffers.writeTexture(x + i, y, (0xFFu << 24) | (v << 16) | (v << 8) | v);
+          }
+        }
+      } else {
+        uint32_t pixel;
+        memcpy(&pixel, vec, sizeof(uint32_t));
+        buffers.writeTexture(bigBlockRootX + col, bigBlockRootY + row, pixel);
+      }
+    }
+  }
+}
+
+// kernel_render_rice2_undelta_gradient_sync and _med_sync, the symbols
+// are residuals from BlockDeltaPredictorGradient or BlockDeltaPredictorMED.
+// Gradient reverses as a 2D prefix sum, each thread sums one row and
+// then 8 threads sum the 8 uchar4 columns. MED runs as a wavefront over
+// uchar4 words, thread tid decodes word (step - tid) of row tid so the
+// words above and to the left were decoded in earlier steps.
+
+template <const int D, typename REPORT>
+static inline
+void rice_kernel_sim_undelta_predictor(const RiceKernelBuffers & buffers,
+                                       const int bbid,
+                                       const BlockDeltaPredictor predictor,
+                                       RiceThreadgroupMemory & tgm,
+                                       RiceThreadgroupReport<REPORT> & tgReport)
+{
+  const int THREADGROUP_1D_DIM = 32;
+  const int THREADGROUP_1D_DIM4 = 32/4;
+  const int THREADGROUP_2D_NUM_ROWS = 32;
+
+  const int numBigBlocksInWidth = buffers.numBigBlocksInWidth();
+  const int bigBlockRootX = (bbid % numBigBlocksInWidth) * THREADGROUP_1D_DIM4;
+  const int bigBlockRootY = (bbid / numBigBlocksInWidth) * THREADGROUP_1D_DIM;
+
+  for (int tid = 0; tid < 32; tid++) {
+    rice_kernel_sim_decode_half_block<D>(buffers, bbid, tid, tgReport.counters[tid],
+                                         [&](int col, int row, const uint8_t *vec) {
+      tgm.write(tid, (row * THREADGROUP_1D_DIM4) + col, vec);
+    });
+  }
+
+  tgm.barrier();
+
+  if (predictor == BlockDeltaPredictorGradient) {
+    // Row prefix sums of the residuals, (0,0) is not zigzag encoded
+
+    for (int tid = 0; tid < 32; tid++) {
+      const int rowStartSharedWordOffset = (tid * THREADGROUP_1D_DIM4);
+      uint8_t sum = 0;
+
+      for (int i = 0; i < THREADGROUP_1D_DIM4; i++) {
+        uint8_t vec[4];
+        memcpy(vec, tgm.read(tid, rowStartSharedWordOffset+i), 4);
+
+        for (int j = 0; j < 4; j++) {
+          if (tid == 0 && i == 0 && j == 0) {
+            sum += vec[j];
+          } else {
+            sum += (uint8_t) zigzag_offset_to_num_neg(vec[j]);
+          }
+          vec[j] = sum;
+        }
+
+        tgm.write(tid, rowStartSharedWordOffset+i, vec);
+      }
+    }
+
+    tgm.barrier();
+
+    // Column prefix sums, 4 columns at a time
+
+    for (int tid = 0; tid < THREADGROUP_1D_DIM4; tid++) {
+      uint8_t sum[4] = { 0, 0, 0, 0 };
+
+      for (int row = 0; row < THREADGROUP_2D_NUM_ROWS; row++) {
+        const int offset = (row * THREADGROUP_1D_DIM4) + tid;
+        uint8_t vec[4];
+        memcpy(vec, tgm.read(tid, offset), 4);
+
+        for (int j = 0; j < 4; j++) {
+          sum[j] += vec[j];
+          vec[j] = sum[j];
+        }
+
+        tgm.write(tid, offset, vec);
+      }
+    }
+
+    tgm.barrier();
+  } else {
+    const int numSteps = THREADGROUP_1D_DIM4 + THREADGROUP_2D_NUM_ROWS - 1;
+
+    for (int step = 0; step < numSteps; step++) {
+      for (int tid = 0; tid < 32; tid++) {
+        const int i = step - tid;
+
+        if (i < 0 || i >= THREADGROUP_1D_DIM4) {
+          continue;
+        }
+
+        const int offset = (tid * THREADGROUP_1D_DIM4) + i;
+
+        uint8_t vec[4];
+        memcpy(vec, tgm.read(tid, offset), 4);
+
+        uint8_t above[4] = { 0, 0, 0, 0 };
+        uint8_t aboveLeft = 0;
+        uint8_t left = 0;
+
+        if (tid > 0) {
+          memcpy(above, tgm.read(tid, offset - THREADGROUP_1D_DIM4), 4);
+          if (i > 0) {
+            aboveLeft = tgm.read(tid, offset - THREADGROUP_1D_DIM4 - 1)[3];
+          }
+        }
+
+        if (i > 0) {
+          left = tgm.read(tid, offset - 1)[3];
+        }
+
+        for (int j = 0; j < 4; j++) {
+          const int col = (i * 4) + j;
+          uint8_t pred;
+
+          if (tid == 0 && col == 0) {
+            left = vec[j];
+            aboveLeft = above[j];
+            continue;
+          } else if (tid == 0) {
+            pred = left;
+          } else if (col == 0) {
+            pred = above[j];
+          } else {
+            pred = block_delta_predict(predictor, left, above[j], aboveLeft);
+          }
+
+          vec[j] = pred + (uint8_t) zigzag_offset_to_num_neg(vec[j]);
+          left = vec[j];
+          aboveLeft = above[j];
+        }
+
+        tgm.write(tid, offset, vec);
+      }
+
+      tgm.barrier();
+    }
+  }
+
+  // Copy 4 rows with 32 threads in each of 8 passes
+
+  for (int tid = 0; tid < 32; tid++) {
+    for (int rw = 0; rw < 8; rw++) {
+      const int offset = (rw * THREADGROUP_1D_DIM) + tid;
+      const int row = offset / THREADGROUP_1D_DIM4;
+      const int col = offset % THREADGROUP_1D_DIM4;
+
+      uint32_t pixel;
+      memcpy(&pixel, tgm.read(tid, offset), sizeof(uint32_t));
+      buffers.writeTexture(bigBlockRootX + col, bigBlockRootY + row, pixel);
+    }
+  }
+}
+
+// Run all 32 threads of the threadgroup for big block bbid
+
+template <const int D, typename REPORT>
+static inline
+void rice_kernel_sim_threadgroup(const RiceKernelType type,
+                                 const RiceKernelBuffers & buffers,
+                                 const int bbid,
+                                 RiceThreadgroupMemory & tgm,
+                                 RiceThreadgroupReport<REPORT> & tgReport)
+{
+  RiceRenderUniform riceRenderUniform = buffers.riceRenderUniform;
+
+  tgm.reset();
+
+  switch (type) {
+    case RiceKernelRenderRice2: {
+#if defined(DEBUG)
+      assert(buffers.outTextureWidth == (riceRenderUniform.numBlocksInWidth * D)/4);
+#endif // DEBUG
+      for (int tid = 0; tid < 32; tid++) {
+        kernel_render_rice_typed<D>(buffers.outTexture, riceRenderUniform,
+                                    buffers.inoutBlockOffsetTable, buffers.inS32Bits,
+                                    buffers.blockOptimalKTable,
+                                    RenderRiceTypedDecode, bbid, tid, nullptr, &tgReport);
+      }
+      break;
+    }
+    case RiceKernelRenderRice2Undelta:
+    case RiceKernelRenderRice2UndeltaSync: {
+      const bool sync = (type == RiceKernelRenderRice2UndeltaSync);
+      rice_kernel_sim_undelta<D>(buffers, bbid, false, sync, tgm, tgReport);
+      break;
+    }
+    case RiceKernelRenderRice2UndeltaGradientSync:
+    case RiceKernelRenderRice2UndeltaMEDSync: {
+      const BlockDeltaPredictor predictor = (type == RiceKernelRenderRice2UndeltaGradientSync) ? BlockDeltaPredictorGradient : BlockDeltaPredictorMED;
+      rice_kernel_sim_undelta_predictor<D>(buffers, bbid, predictor, tgm, tgReport);
+      break;
+    }
+    case RiceKernelRenderRiceUndelta:
+    case RiceKernelRenderRiceUndeltaSync: {
+      const bool sync = (type == RiceKernelRenderRiceUndeltaSync);
+      rice_kernel_sim_undelta<D>(buffers, bbid, true, sync, tgm, tgReport);
+      break;
+    }
+    case RiceKernelRenderRice2Blocki:
+    case RiceKernelRenderRice2BlockBitOffset: {
+      RenderRiceTyped rType = (type == RiceKernelRenderRice2Blocki) ? RenderRiceTypedBlocki : RenderRiceTypedBlockBitOffset;
+      for (int tid = 0; tid < 32; tid++) {
+        kernel_render_rice_typed<D>(nullptr, riceRenderUniform,
+                                    buffers.inoutBlockOffsetTable, buffers.inS32Bits,
+                                    buffers.blockOptimalKTable,
+                                    rType, bbid, tid, buffers.out32Ptr);
+      }
+      break;
+    }
+  }
+}
+
+// Dispatch one threadgroup for each big block. Threadgroups are run
+// on the pool when one is passed, otherwise on the calling thread.
+// Pass a result to collect barrier counts and check for hazards.
+
+template <typename REPORT = RiceDecodeStatsNone>
+static inline
+void rice_kernel_sim_dispatch(const RiceKernelType type,
+                              const RiceKernelBuffers & buffers,
+                              RiceThreadPool *pool = nullptr,
+                              REPORT *report = nullptr,
+                              RiceKernelSimResult *result = nullptr)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+  const int numBigBlocks = buffers.numBigBlocks();
+
+  mutex resultMutex;
+
+  auto runThreadgroup = [&](int bbid) {
+    RiceThreadgroupMemory tgm;
+    tgm.checkHazards = (result != nullptr);
+
+    RiceThreadgroupReport<REPORT> tgReport;
+
+    rice_kernel_sim_threadgroup<blockDim>(type, buffers, bbid, tgm, tgReport);
+
+    if (report || result) {
+      unique_lock<mutex> lock(resultMutex);
+      if (report) {
+        tgReport.addTo(report, bbid);
+      }
+      if (result) {
+        result->numThreadgroups += 1;
+        result->numBarriers += tgm.numBarriers;
+        result->numUnsyncedReads += tgm.numUnsyncedReads;
+      }
+    }
+  };
+
+  if (pool) {
+    pool->parallelFor(numBigBlocks, runThreadgroup, 4);
+  } else {
+    for (int bbid = 0; bbid < numBigBlocks; bbid++) {
+      runThreadgroup(bbid);
+    }
+  }
+}
+
+// Bind the buffers of an encoded plane, output pointers are set by the caller
+
+static inline
+void rice_kernel_sim_plane_buffers(const Rice2EncodedPlane & inPlane,
+                                   RiceKernelBuffers & buffers)
+{
+  const int blockDim = RICE_SMALL_BLOCK_DIM;
+
+  // The simulated kernels decode the same 16 bit escape as the shaders
+  assert(inPlane.escapeNumBits == 16);
+
+  buffers.riceRenderUniform.numBlocksInWidth = inPlane.paddedWidth() / blockDim;
+  buffers.riceRenderUniform.numBlocksInHeight = inPlane.paddedHeight() / blockDim;
+  buffers.riceRenderUniform.numBlocksEachSegment = 1;
+  buffers.riceRenderUniform.cropWidth = inPlane.width;
+  buffers.riceRenderUniform.cropHeight = inPlane.height;
+
+  buffers.inoutBlockOffsetTable = (uint32_t *) inPlane.halfBlockOffsetTable.data();
+  buffers.inS32Bits = (const uint32_t *) inPlane.riceEncodedBits.data();
+  buffers.blockOptimalKTable = inPlane.blockOptimalKTable.data();
+  buffers.halfBlockTidTable = inPlane.halfBlockTidTable.empty() ? nullptr : inPlane.halfBlockTidTable.data();
+}
+
+#endif // _RiceKernelSim_hpp
@@ -0,0 +1,260 @@
+//
+//  RicePipeline.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Bounded queue and a pipeline of thread stages connected by bounded
+//  queues. Each stage runs on its own worker threads and processes one
+//  item at a time, so I/O in one stage overlaps compute in the others
+//  while a full queue holds back the stage that feeds it. Each stage
+//  counts items, bytes, time spent working and time spent waiting on
+//  its input and output queues.
+
+#ifndef _RicePipeline_hpp
+#define _RicePipeline_hpp
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Queue that holds at most capacity items. push() blocks while the queue
+// is full and pop() blocks while it is empty. Once close() is invoked
+// push() fails and pop() returns the remaining items and then fails.
+
+template <typename T>
+class RiceBoundedQueue
+{
+public:
+  RiceBoundedQueue(int capacity)
+  : capacity(capacity < 1 ? 1 : capacity),
+  closed(false)
+  {
+  }
+
+  bool push(T && item)
+  {
+    unique_lock<mutex> lock(queueMutex);
+    notFull.wait(lock, [this]() {
+      return closed || (int) items.size() < capacity;
+    });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+  }
+
+  bool pop(T & outItem)
+  {
+    unique_lock<mutex> lock(queueMutex);
+    notEmpty.wait(lock, [this]() {
+      return closed || !items.empty();
+    });
+    if (items.empty()) {
+      return false;
+    }
+    outItem = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    {
+      unique_lock<mutex> lock(queueMutex);
+      closed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+  }
+
+  int size()
+  {
+    unique_lock<mutex> lock(queueMutex);
+    return (int) items.size();
+  }
+
+private:
+  const int capacity;
+  bool closed;
+  deque<T> items;
+  mutex queueMutex;
+  condition_variable notEmpty;
+  condition_variable notFull;
+};
+
+// Totals for one stage, the times are summed over the stage workers
+
+class RicePipelineCounters
+{
+public:
+  string name;
+  int numWorkers;
+  uint64_t numItems;
+  uint64_t numBytes;
+  double busySeconds;
+  double waitInSeconds;
+  double waitOutSeconds;
+
+  RicePipelineCounters()
+  : numWorkers(0),
+  numItems(0),
+  numBytes(0),
+  busySeconds(0.0),
+  waitInSeconds(0.0),
+  waitOutSeconds(0.0)
+  {
+  }
+
+  // Bytes per second of busy time for each worker
+
+  double bytesPerSecond() const {
+    return (busySeconds == 0.0) ? 0.0 : (numBytes / (busySeconds / numWorkers));
+  }
+};
+
+// Items of type T are created by the caller of run() and move through
+// each stage in turn. A stage function processes one item in place and
+// returns the number of bytes it processed for the counters. Items are
+// dropped after the last stage. With more than one worker in a stage,
+// items can leave that stage in a different order than they entered.
+
+template <typename T>
+class RicePipeline
+{
+public:
+  RicePipeline(int queueCapacity = 2)
+  : queueCapacity(queueCapacity)
+  {
+  }
+
+  void addStage(const string & name, const function<size_t(T &)> & fn, int numWorkers = 1)
+  {
+    Stage stage;
+    stage.fn = fn;
+    stage.counters.name = name;
+    stage.counters.numWorkers = (numWorkers < 1) ? 1 : numWorkers;
+    stages.push_back(stage);
+  }
+
+  // Push makeItem(i) for each i in [0, n) into the first stage from the
+  // calling thread and return once every item has left the last stage.
+
+  void run(const int n, const function<T(int)> & makeItem)
+  {
+    typedef chrono::steady_clock Clock;
+
+    const int numStages = (int) stages.size();
+
+    if (numStages == 0) {
+      return;
+    }
+
+    // queues[i] feeds stage i
+
+    vector<unique_ptr<RiceBoundedQueue<T> > > queues;
+    for (int i = 0; i < numStages; i++) {
+      queues.push_back(unique_ptr<RiceBoundedQueue<T> >(new RiceBoundedQueue<T>(queueCapacity)));
+    }
+
+    vector<thread> threads;
+    vector<unique_ptr<atomic<int> > > numRunning;
+    mutex countersMutex;
+
+    for (int stagei = 0; stagei < numStages; stagei++) {
+      numRunning.push_back(unique_ptr<atomic<int> >(new atomic<int>(stages[stagei].counters.numWorkers)));
+    }
+
+    for (int stagei = 0; stagei < numStages; stagei++) {
+      for (int workeri = 0; workeri < stages[stagei].counters.numWorkers; workeri++) {
+        threads.push_back(thread([&, stagei]() {
+          Stage & stage = stages[stagei];
+          RiceBoundedQueue<T> & inQueue = *queues[stagei];
+          RiceBoundedQueue<T> *outQueue = (stagei + 1 < numStages) ? queues[stagei + 1].get() : nullptr;
+
+          RicePipelineCounters counters;
+
+          while (true) {
+            T item;
+
+            Clock::time_point t0 = Clock::now();
+            if (!inQueue.pop(item)) {
+              break;
+            }
+            Clock::time_point t1 = Clock::now();
+            counters.numBytes += stage.fn(item);
+            Clock::time_point t2 = Clock::now();
+            if (outQueue) {
+              outQueue->push(std::move(item));
+            }
+            Clock::time_point t3 = Clock::now();
+
+            counters.numItems += 1;
+            counters.waitInSeconds += chrono::duration<double>(t1 - t0).count();
+            counters.busySeconds += chrono::duration<double>(t2 - t1).count();
+            counters.waitOutSeconds += chrono::duration<double>(t3 - t2).count();
+          }
+
+          {
+            unique_lock<mutex> lock(countersMutex);
+            stage.counters.numItems += counters.numItems;
+            stage.counters.numBytes += counters.numBytes;
+            stage.counters.busySeconds += counters.busySeconds;
+            stage.counters.waitInSeconds += counters.waitInSeconds;
+            stage.counters.waitOutSeconds += counters.waitOutSeconds;
+          }
+
+          // The last worker of a stage closes the queue of the next stage
+
+          if (numRunning[stagei]->fetch_sub(1) == 1 && outQueue) {
+            outQueue->close();
+          }
+        }));
+      }
+    }
+
+    for (int i = 0; i < n; i++) {
+      queues[0]->push(makeItem(i));
+    }
+    queues[0]->close();
+
+    for ( thread & t : threads ) {
+      t.join();
+    }
+  }
+
+  vector<RicePipelineCounters> counters() const {
+    vector<RicePipelineCounters> result;
+    for ( const Stage & stage : stages ) {
+      result.push_back(stage.counters);
+    }
+    return result;
+  }
+
+private:
+  class Stage
+  {
+  public:
+    function<size_t(T &)> fn;
+    RicePipelineCounters counters;
+  };
+
+  const int queueCapacity;
+  vector<Stage> stages;
+};
+
+#endif // _RicePipeline_hpp
@@ -175,7 +175,13 @@ kernel void kernel_render_rice2(
           prefixByte3 = bigBlockY;
         }
         
-        if (true) {
+        if (k == RICE2_SKIP_BLOCK_K) {
+          // Every symbol in a skip block is zero, no bits are read
+          prefixByte0 = 0;
+          prefixByte1 = 0;
+          prefixByte2 = 0;
+          prefixByte3 = 0;
+        } else {
           prefixByte0  = rdb.decodePrefixByte(k, false, 0, true);
           prefixByte1  = rdb.decodePrefixByte(k, false, 0, false);
           prefixByte2  = rdb.decodePrefixByte(k, false, 0, false);
@@ -340,7 +346,13 @@ kernel void kernel_render_rice2_undelta(
           prefixByte3 = bigBlockY;
         }
         
-        if (true) {
+        if (k == RICE2_SKIP_BLOCK_K) {
+          // Every symbol in a skip block is zero, no bits are read
+          prefixByte0 = 0;
+          prefixByte1 = 0;
+          prefixByte2 = 0;
+          prefixByte3 = 0;
+        } else {
           prefixByte0  = rdb.decodePrefixByte(k, false, 0, true);
           prefixByte1  = rdb.decodePrefixByte(k, false, 0, false);
           prefixByte2  = rdb.decodePrefixByte(k, false, 0, false);
@@ -722,7 +734,13 @@ kernel void kernel_render_rice_undelta(
           prefixByte3 = bigBlockY;
         }
         
-        if (true) {
+        if (k == RICE2_SKIP_BLOCK_K) {
+          // Every symbol in a skip block is zero, no bits are read
+          prefixByte0 = 0;
+          prefixByte1 = 0;
+          prefixByte2 = 0;
+          prefixByte3 = 0;
+        } else {
           prefixByte0  = rdb.decodePrefixByte(k, false, 0, true);
           prefixByte1  = rdb.decodePrefixByte(k, false, 0, false);
           prefixByte2  = rdb.decodePrefixByte(k, false, 0, false);
@@ -1203,7 +1221,13 @@ kernel void kernel_render_rice2_undelta_sync(
           prefixByte3 = bigBlockY;
         }
         
-        if (true) {
+        if (k == RICE2_SKIP_BLOCK_K) {
+          // Every symbol in a skip block is zero, no bits are read
+          prefixByte0 = 0;
+          prefixByte1 = 0;
+          prefixByte2 = 0;
+          prefixByte3 = 0;
+        } else {
           prefixByte0  = rdb.decodePrefixByte(k, false, 0, true);
           prefixByte1  = rdb.decodePrefixByte(k, false, 0, false);
           prefixByte2  = rdb.decodePrefixByte(k, false, 0, false);
@@ -1589,7 +1613,13 @@ kernel void kernel_render_rice_undelta_sync(
           prefixByte3 = bigBlockY;
         }
         
-        if (true) {
+        if (k == RICE2_SKIP_BLOCK_K) {
+          // Every symbol in a skip block is zero, no bits are read
+          prefixByte0 = 0;
+          prefixByte1 = 0;
+          prefixByte2 = 0;
+          prefixByte3 = 0;
+        } else {
           prefixByte0  = rdb.decodePrefixByte(k, false, 0, true);
           prefixByte1  = rdb.decodePrefixByte(k, false, 0, false);
           prefixByte2  = rdb.decodePrefixByte(k, false, 0, false);
@@ -2204,3 +2234,395 @@ kernel void kernel_render_rice2_block_bit_offset(
   
   return;
 }
+
+// Predictor variants of kernel_render_rice2_undelta_sync, the symbols are
+// zigzag residuals from the gradient or MED predictor over each 32x32
+// big block. Both decode half blocks into the threadgroup write cache
+// exactly as the left predictor kernel does, only the undelta differs.
+// halfBlockTid is the half block a thread decodes, that is tid unless
+// the plane carries a tid table (see Rice2Balance.hpp).
+
+static inline
+void rice2_decode_half_block_write_cache(threadgroup uchar4 *writeCache,
+                                         constant RiceRenderUniform & riceRenderUniform,
+                                         device uint32_t *inoutBlockOffsetTable,
+                                         const device uint32_t *inS32Bits,
+                                         const device uint8_t *blockOptimalKTable,
+                                         const ushort halfBlockTid,
+                                         const int bbid)
+{
+  thread RiceDecodeBlocksT rdb;
+  
+  const ushort blockDim = RICE_SMALL_BLOCK_DIM;
+  const ushort bigBlocksDim = 4;
+  
+  const ushort blockiInBigBlock = halfBlockTid >> 1; // halfBlockTid / 2
+  const int blocki = (bbid * bigBlocksDim * bigBlocksDim) + blockiInBigBlock;
+  
+  uint8_t k = blockOptimalKTable[blocki];
+  
+  uint32_t halfBlockStartBitOffset = inoutBlockOffsetTable[int(bbid * 32) + halfBlockTid];
+  
+  rdb.cachedBits.initBits(inS32Bits, halfBlockStartBitOffset);
+  
+  // Odd half blocks render to the half block on the bottom
+  
+  const ushort blockX = blockiInBigBlock % bigBlocksDim;
+  const ushort blockY = blockiInBigBlock / bigBlocksDim;
+  const ushort rowOffset = (blockY * blockDim) + ((halfBlockTid & 0x1) ? blockDim/2 : 0);
+  const ushort colOffset = blockX * (blockDim/4);
+  
+  for (ushort row = rowOffset; row < rowOffset + blockDim/2; row++) {
+    for (ushort col = colOffset; col < colOffset + blockDim/4; col++) {
+      ushort prefixByte0, prefixByte1, prefixByte2, prefixByte3;
+      
+      if (k == RICE2_SKIP_BLOCK_K) {
+        // Every symbol in a skip block is zero, no bits are read
+        prefixByte0 = 0;
+        prefixByte1 = 0;
+        prefixByte2 = 0;
+        prefixByte3 = 0;
+      } else {
+        prefixByte0  = rdb.decodePrefixByte(k, false, 0, true);
+        prefixByte1  = rdb.decodePrefixByte(k, false, 0, false);
+        prefixByte2  = rdb.decodePrefixByte(k, false, 0, false);
+        prefixByte3  = rdb.decodePrefixByte(k, false, 0, false);
+        
+        rdb.decodeSuffixByte4x(k, prefixByte0, prefixByte1, prefixByte2, prefixByte3);
+      }
+      
+      writeCache[(row * 32/4) + col] = uchar4(prefixByte0, prefixByte1, prefixByte2, prefixByte3);
+    }
+  }
+}
+
+// Copy 4 rows of the write cache to the texture with 32 threads in each of 8 passes
+
+static inline
+void rice2_write_cache_to_texture(threadgroup uchar4 *writeCache,
+                                  texture2d<half, access::write> outTexture,
+                                  constant RiceRenderUniform & riceRenderUniform,
+                                  const ushort tid,
+                                  const int bbid)
+{
+  const ushort THREADGROUP_1D_DIM = 32;
+  const ushort THREADGROUP_1D_DIM4 = 32/4;
+  const ushort numBigBlocksInWidth = (riceRenderUniform.numBlocksInWidth / 4);
+  
+  const ushort2 bigBlockRootCoords = ushort2((bbid % numBigBlocksInWidth) * THREADGROUP_1D_DIM4, (bbid / numBigBlocksInWidth) * THREADGROUP_1D_DIM);
+  
+  for ( ushort rw = 0; rw < 8; rw++ ) {
+    const ushort offset = (rw * THREADGROUP_1D_DIM) + tid;
+    const ushort row = offset / THREADGROUP_1D_DIM4;
+    const ushort col = offset % THREADGROUP_1D_DIM4;
+    
+    uchar4 vec = writeCache[offset];
+    
+    half4 outPixelsVec;
+    outPixelsVec[0] = uint8_to_half(vec[2]); // R
+    outPixelsVec[1] = uint8_to_half(vec[1]); // G
+    outPixelsVec[2] = uint8_to_half(vec[0]); // B
+    outPixelsVec[3] = uint8_to_half(vec[3]); // A
+    
+    outTexture.write(outPixelsVec, bigBlockRootCoords + ushort2(col, row));
+  }
+}
+
+// Left residuals reverse as a prefix sum down column 0 on thread 0, then
+// each thread sums one row starting from column 0.
+
+static inline
+void rice2_undelta_left_write_cache(threadgroup uchar4 *writeCache,
+                                    const ushort tid)
+{
+  const ushort THREADGROUP_1D_DIM4 = 32/4;
+  const ushort THREADGROUP_2D_NUM_ROWS = 32;
+  
+  if (tid == 0) {
+    // Value (0,0) is not zigzag encoded
+    
+    uint8_t sum = writeCache[0][0];
+    
+    for (int row = 1; row < THREADGROUP_2D_NUM_ROWS; row++) {
+      const int offset = row * THREADGROUP_1D_DIM4;
+      uchar4 vec = writeCache[offset];
+      sum += (uint8_t) zigzag_offset_to_num_neg(vec[0]);
+      vec[0] = sum;
+      writeCache[offset] = vec;
+    }
+  }
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  const int rowStartSharedWordOffset = (tid * THREADGROUP_1D_DIM4);
+  uint8_t sum = 0;
+  
+  for (int i = 0; i < THREADGROUP_1D_DIM4; i++) {
+    uchar4 vec = writeCache[rowStartSharedWordOffset+i];
+    
+    for (int j = 0; j < 4; j++) {
+      if (i == 0 && j == 0) {
+        sum = vec[j];
+      } else {
+        sum += (uint8_t) zigzag_offset_to_num_neg(vec[j]);
+      }
+      vec[j] = sum;
+    }
+    
+    writeCache[rowStartSharedWordOffset+i] = vec;
+  }
+}
+
+// Gradient residuals reverse as a 2D prefix sum. Each thread sums one
+// row, then 8 threads each sum one column of uchar4 words.
+
+static inline
+void rice2_undelta_gradient_write_cache(threadgroup uchar4 *writeCache,
+                                        const ushort tid)
+{
+  const ushort THREADGROUP_1D_DIM4 = 32/4;
+  const ushort THREADGROUP_2D_NUM_ROWS = 32;
+  
+  {
+    // Value (0,0) is not zigzag encoded
+    
+    const int rowStartSharedWordOffset = (tid * THREADGROUP_1D_DIM4);
+    uint8_t sum = 0;
+    
+    for (int i = 0; i < THREADGROUP_1D_DIM4; i++) {
+      uchar4 vec = writeCache[rowStartSharedWordOffset+i];
+      
+      for (int j = 0; j < 4; j++) {
+        if (tid == 0 && i == 0 && j == 0) {
+          sum += vec[j];
+        } else {
+          sum += (uint8_t) zigzag_offset_to_num_neg(vec[j]);
+        }
+        vec[j] = sum;
+      }
+      
+      writeCache[rowStartSharedWordOffset+i] = vec;
+    }
+  }
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  if (tid < THREADGROUP_1D_DIM4) {
+    uchar4 sum = uchar4(0);
+    
+    for (int row = 0; row < THREADGROUP_2D_NUM_ROWS; row++) {
+      const int offset = (row * THREADGROUP_1D_DIM4) + tid;
+      sum += writeCache[offset];
+      writeCache[offset] = sum;
+    }
+  }
+}
+
+// MED residuals decode as a wavefront over uchar4 words, at each step
+// thread tid decodes word (step - tid) of row tid so that the words
+// above, above left and to the left were decoded in earlier steps.
+
+static inline
+void rice2_undelta_med_write_cache(threadgroup uchar4 *writeCache,
+                                   const ushort tid)
+{
+  const short THREADGROUP_1D_DIM4 = 32/4;
+  const short THREADGROUP_2D_NUM_ROWS = 32;
+  
+  const short numSteps = THREADGROUP_1D_DIM4 + THREADGROUP_2D_NUM_ROWS - 1;
+  
+  for (short step = 0; step < numSteps; step++) {
+    const short i = step - short(tid);
+    
+    if (i >= 0 && i < THREADGROUP_1D_DIM4) {
+      const int offset = (tid * THREADGROUP_1D_DIM4) + i;
+      
+      uchar4 vec = writeCache[offset];
+      uchar4 above = uchar4(0);
+      uint8_t aboveLeft = 0;
+      uint8_t left = 0;
+      
+      if (tid > 0) {
+        above = writeCache[offset - THREADGROUP_1D_DIM4];
+        if (i > 0) {
+          aboveLeft = writeCache[offset - THREADGROUP_1D_DIM4 - 1][3];
+        }
+      }
+      
+      if (i > 0) {
+        left = writeCache[offset - 1][3];
+      }
+      
+      for (int j = 0; j < 4; j++) {
+        const int col = (i * 4) + j;
+        uint8_t pred;
+        
+        if (tid == 0 && col == 0) {
+          // Value (0,0) is not zigzag encoded
+          left = vec[j];
+          aboveLeft = above[j];
+          continue;
+        } else if (tid == 0) {
+          pred = left;
+        } else if (col == 0) {
+          pred = above[j];
+        } else {
+          const uint8_t minVal = min(left, above[j]);
+          const uint8_t maxVal = max(left, above[j]);
+          if (aboveLeft >= maxVal) {
+            pred = minVal;
+          } else if (aboveLeft <= minVal) {
+            pred = maxVal;
+          } else {
+            pred = (uint8_t) (left + above[j] - aboveLeft);
+          }
+        }
+        
+        vec[j] = pred + (uint8_t) zigzag_offset_to_num_neg(vec[j]);
+        left = vec[j];
+        aboveLeft = above[j];
+      }
+      
+      writeCache[offset] = vec;
+    }
+    
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+  }
+}
+
+// Decode and undelta one big block of a gradient plane
+
+kernel void kernel_render_rice2_undelta_gradient_sync(
+                                        texture2d<half, access::write> outTexture [[ texture(0) ]],
+                                        constant RiceRenderUniform & riceRenderUniform [[ buffer(0) ]],
+                                        device uint32_t *inoutBlockOffsetTable [[ buffer(1) ]],
+                                        const device uint32_t *inS32Bits [[ buffer(2) ]],
+                                        const device uint8_t *blockOptimalKTable [[ buffer(3) ]],
+                                        ushort tid [[ thread_index_in_threadgroup ]],
+                                        ushort2 bid [[ threadgroup_position_in_grid ]] // big block blocki
+                                        )
+{
+  threadgroup uchar4 writeCache[(32/4)*32];
+  
+  const int bbid = coords_to_offset((riceRenderUniform.numBlocksInWidth / 4), bid);
+  
+  rice2_decode_half_block_write_cache(writeCache, riceRenderUniform, inoutBlockOffsetTable, inS32Bits, blockOptimalKTable, tid, bbid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_undelta_gradient_write_cache(writeCache, tid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_write_cache_to_texture(writeCache, outTexture, riceRenderUniform, tid, bbid);
+}
+
+// Decode and undelta one big block of a MED plane
+
+kernel void kernel_render_rice2_undelta_med_sync(
+                                        texture2d<half, access::write> outTexture [[ texture(0) ]],
+                                        constant RiceRenderUniform & riceRenderUniform [[ buffer(0) ]],
+                                        device uint32_t *inoutBlockOffsetTable [[ buffer(1) ]],
+                                        const device uint32_t *inS32Bits [[ buffer(2) ]],
+                                        const device uint8_t *blockOptimalKTable [[ buffer(3) ]],
+                                        ushort tid [[ thread_index_in_threadgroup ]],
+                                        ushort2 bid [[ threadgroup_position_in_grid ]] // big block blocki
+                                        )
+{
+  threadgroup uchar4 writeCache[(32/4)*32];
+  
+  const int bbid = coords_to_offset((riceRenderUniform.numBlocksInWidth / 4), bid);
+  
+  rice2_decode_half_block_write_cache(writeCache, riceRenderUniform, inoutBlockOffsetTable, inS32Bits, blockOptimalKTable, tid, bbid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_undelta_med_write_cache(writeCache, tid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_write_cache_to_texture(writeCache, outTexture, riceRenderUniform, tid, bbid);
+}
+
+// Variants that read the half block each thread decodes from the tid
+// table of a balanced plane at buffer(5). These are only selected when
+// a frame has a tid table, so the kernels above do not pay for the
+// extra load (see MetalRice2RenderContext).
+
+kernel void kernel_render_rice2_undelta_tid_sync(
+                                        texture2d<half, access::write> outTexture [[ texture(0) ]],
+                                        constant RiceRenderUniform & riceRenderUniform [[ buffer(0) ]],
+                                        device uint32_t *inoutBlockOffsetTable [[ buffer(1) ]],
+                                        const device uint32_t *inS32Bits [[ buffer(2) ]],
+                                        const device uint8_t *blockOptimalKTable [[ buffer(3) ]],
+                                        const device uint8_t *halfBlockTidTable [[ buffer(5) ]],
+                                        ushort tid [[ thread_index_in_threadgroup ]],
+                                        ushort2 bid [[ threadgroup_position_in_grid ]] // big block blocki
+                                        )
+{
+  threadgroup uchar4 writeCache[(32/4)*32];
+  
+  const int bbid = coords_to_offset((riceRenderUniform.numBlocksInWidth / 4), bid);
+  
+  rice2_decode_half_block_write_cache(writeCache, riceRenderUniform, inoutBlockOffsetTable, inS32Bits, blockOptimalKTable, halfBlockTidTable[int(bbid * 32) + tid], bbid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_undelta_left_write_cache(writeCache, tid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_write_cache_to_texture(writeCache, outTexture, riceRenderUniform, tid, bbid);
+}
+
+kernel void kernel_render_rice2_undelta_gradient_tid_sync(
+                                        texture2d<half, access::write> outTexture [[ texture(0) ]],
+                                        constant RiceRenderUniform & riceRenderUniform [[ buffer(0) ]],
+                                        device uint32_t *inoutBlockOffsetTable [[ buffer(1) ]],
+                                        const device uint32_t *inS32Bits [[ buffer(2) ]],
+                                        const device uint8_t *blockOptimalKTable [[ buffer(3) ]],
+                                        const device uint8_t *halfBlockTidTable [[ buffer(5) ]],
+                                        ushort tid [[ thread_index_in_threadgroup ]],
+                                        ushort2 bid [[ threadgroup_position_in_grid ]] // big block blocki
+                                        )
+{
+  threadgroup uchar4 writeCache[(32/4)*32];
+  
+  const int bbid = coords_to_offset((riceRenderUniform.numBlocksInWidth / 4), bid);
+  
+  rice2_decode_half_block_write_cache(writeCache, riceRenderUniform, inoutBlockOffsetTable, inS32Bits, blockOptimalKTable, halfBlockTidTable[int(bbid * 32) + tid], bbid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_undelta_gradient_write_cache(writeCache, tid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_write_cache_to_texture(writeCache, outTexture, riceRenderUniform, tid, bbid);
+}
+
+kernel void kernel_render_rice2_undelta_med_tid_sync(
+                                        texture2d<half, access::write> outTexture [[ texture(0) ]],
+                                        constant RiceRenderUniform & riceRenderUniform [[ buffer(0) ]],
+                                        device uint32_t *inoutBlockOffsetTable [[ buffer(1) ]],
+                                        const device uint32_t *inS32Bits [[ buffer(2) ]],
+                                        const device uint8_t *blockOptimalKTable [[ buffer(3) ]],
+                                        const device uint8_t *halfBlockTidTable [[ buffer(5) ]],
+                                        ushort tid [[ thread_index_in_threadgroup ]],
+                                        ushort2 bid [[ threadgroup_position_in_grid ]] // big block blocki
+                                        )
+{
+  threadgroup uchar4 writeCache[(32/4)*32];
+  
+  const int bbid = coords_to_offset((riceRenderUniform.numBlocksInWidth / 4), bid);
+  
+  rice2_decode_half_block_write_cache(writeCache, riceRenderUniform, inoutBlockOffsetTable, inS32Bits, blockOptimalKTable, halfBlockTidTable[int(bbid * 32) + tid], bbid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_undelta_med_write_cache(writeCache, tid);
+  
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  
+  rice2_write_cache_to_texture(writeCache, outTexture, riceRenderUniform, tid, bbid);
+}
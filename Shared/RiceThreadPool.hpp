@@ -0,0 +1,183 @@
+//
+//  RiceThreadPool.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Fixed size pool of worker threads used to run CPU versions of the
+//  compute kernels. parallelFor() splits a range of work items into
+//  chunks, the calling thread works on chunks along with the workers
+//  and the call returns once every item has been processed.
+
+#ifndef _RiceThreadPool_hpp
+#define _RiceThreadPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class RiceThreadPool
+{
+public:
+  // Pass 0 to create one thread for each hardware thread, the
+  // calling thread counts as one of the threads.
+
+  RiceThreadPool(int numThreads = 0)
+  : job(nullptr),
+  jobGeneration(0),
+  numActiveWorkers(0),
+  stopping(false)
+  {
+    if (numThreads <= 0) {
+      numThreads = (int) thread::hardware_concurrency();
+    }
+    if (numThreads <= 0) {
+      numThreads = 1;
+    }
+
+    for (int i = 1; i < numThreads; i++) {
+      workers.push_back(thread([this]() {
+        workerLoop();
+      }));
+    }
+  }
+
+  ~RiceThreadPool()
+  {
+    {
+      unique_lock<mutex> lock(jobMutex);
+      stopping = true;
+    }
+    jobCondition.notify_all();
+
+    for ( thread & t : workers ) {
+      t.join();
+    }
+  }
+
+  int numThreads() const {
+    return (int) workers.size() + 1;
+  }
+
+  // Invoke fn(i) for each i in [0, n), items are claimed in chunks of
+  // grainSize. Only one parallelFor() can run on a pool at a time.
+
+  void parallelFor(const int n, const function<void(int)> & fn, int grainSize = 1)
+  {
+    if (n <= 0) {
+      return;
+    }
+
+    if (grainSize < 1) {
+      grainSize = 1;
+    }
+
+    if (workers.empty() || n <= grainSize) {
+      for (int i = 0; i < n; i++) {
+        fn(i);
+      }
+      return;
+    }
+
+    Job thisJob(n, grainSize, fn);
+
+    {
+      unique_lock<mutex> lock(jobMutex);
+      job = &thisJob;
+      jobGeneration += 1;
+    }
+    jobCondition.notify_all();
+
+    runChunks(thisJob);
+
+    // Wait until no worker is still running a chunk of this job
+
+    {
+      unique_lock<mutex> lock(jobMutex);
+      job = nullptr;
+      doneCondition.wait(lock, [this]() {
+        return numActiveWorkers == 0;
+      });
+    }
+  }
+
+private:
+  class Job
+  {
+  public:
+    const int n;
+    const int grainSize;
+    const function<void(int)> & fn;
+    atomic<int> next;
+
+    Job(int n, int grainSize, const function<void(int)> & fn)
+    : n(n),
+    grainSize(grainSize),
+    fn(fn),
+    next(0)
+    {
+    }
+  };
+
+  vector<thread> workers;
+
+  mutex jobMutex;
+  condition_variable jobCondition;
+  condition_variable doneCondition;
+
+  Job *job;
+  uint64_t jobGeneration;
+  int numActiveWorkers;
+  bool stopping;
+
+  static void runChunks(Job & j)
+  {
+    while (1) {
+      const int start = j.next.fetch_add(j.grainSize);
+      if (start >= j.n) {
+        break;
+      }
+      const int end = (start + j.grainSize < j.n) ? (start + j.grainSize) : j.n;
+      for (int i = start; i < end; i++) {
+        j.fn(i);
+      }
+    }
+  }
+
+  void workerLoop()
+  {
+    uint64_t seenGeneration = 0;
+
+    while (1) {
+      Job *j;
+
+      {
+        unique_lock<mutex> lock(jobMutex);
+        jobCondition.wait(lock, [this, seenGeneration]() {
+          return stopping || (job != nullptr && jobGeneration != seenGeneration);
+        });
+        if (stopping) {
+          return;
+        }
+        seenGeneration = jobGeneration;
+        j = job;
+        numActiveWorkers += 1;
+      }
+
+      runChunks(*j);
+
+      {
+        unique_lock<mutex> lock(jobMutex);
+        numActiveWorkers -= 1;
+      }
+      doneCondition.notify_all();
+    }
+  }
+};
+
+#endif // _RiceThreadPool_hpp
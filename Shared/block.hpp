@@ -18,6 +18,17 @@
 #include <cinttypes>
 #include <vector>
 #include <bitset>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "RiceThreadPool.hpp"
 
 using namespace std;
 
@@ -226,6 +237,213 @@ void flattenBlocksOfSize(
     return;
 }
 
+// Copy one row of a D x D block of bytes with a single wide load
+// and store, D must be 8 or 32.
+
+template <const int D>
+static inline
+void blockCopyByteRow(uint8_t *dst, const uint8_t *src)
+{
+    static_assert(D == 8 || D == 32, "blockDim must be 8 or 32");
+    
+    if (D == 8) {
+        uint64_t row;
+        memcpy(&row, src, sizeof(row));
+        memcpy(dst, &row, sizeof(row));
+        return;
+    }
+    
+#if defined(__AVX2__)
+    _mm256_storeu_si256((__m256i *) dst, _mm256_loadu_si256((const __m256i *) src));
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    vst1q_u8(dst + 0, vld1q_u8(src + 0));
+    vst1q_u8(dst + 16, vld1q_u8(src + 16));
+#elif defined(__SSE2__)
+    __m128i lo = _mm_loadu_si128((const __m128i *) (src + 0));
+    __m128i hi = _mm_loadu_si128((const __m128i *) (src + 16));
+    _mm_storeu_si128((__m128i *) (dst + 0), lo);
+    _mm_storeu_si128((__m128i *) (dst + 16), hi);
+#else
+    memcpy(dst, src, D);
+#endif
+}
+
+// Byte specialized split for 8x8 and 32x32 blocks. Each block is
+// written whole, one block row at a time, so that interior blocks are
+// a run of D wide copies and only blocks on the right or bottom edge
+// need to pad with zeroValue. When a pool is passed the rows of blocks
+// are split across threads. Output matches splitIntoBlocksOfSize().
+
+template <const int D>
+static inline
+void splitIntoBlocksOfDim(
+                          const uint8_t *inPixels,
+                          unsigned int width,
+                          unsigned int height,
+                          unsigned int inNumBlocksWidth,
+                          unsigned int inNumBlocksHeight,
+                          uint8_t *outPixels,
+                          unsigned int outNumBlocksWidth,
+                          unsigned int outNumBlocksHeight,
+                          uint8_t zeroValue,
+                          RiceThreadPool *pool = nullptr)
+{
+    const unsigned int numPixelsInOneBlock = D * D;
+    const unsigned int inBlockMax = inNumBlocksWidth * inNumBlocksHeight;
+    const unsigned int outBlockMax = outNumBlocksWidth * outNumBlocksHeight;
+    
+#if defined(DEBUG)
+    assert(inBlockMax <= outBlockMax);
+    assert((inNumBlocksWidth * D) >= width);
+    assert((inNumBlocksHeight * D) >= height);
+#endif // DEBUG
+    
+    // Whole blocks that need no padding
+    
+    const unsigned int numFullBlocksWidth = width / D;
+    const unsigned int numFullBlocksHeight = height / D;
+    
+    auto splitRowOfBlocks = [&](int rowOfBlocksi) {
+        const uint8_t *inRowPtr = inPixels + (rowOfBlocksi * D * width);
+        uint8_t *outRowPtr = outPixels + (rowOfBlocksi * inNumBlocksWidth * numPixelsInOneBlock);
+        
+        if ((unsigned int) rowOfBlocksi < numFullBlocksHeight) {
+            for (unsigned int columnBlocki = 0; columnBlocki < numFullBlocksWidth; columnBlocki++) {
+                const uint8_t *inBlockPtr = inRowPtr + (columnBlocki * D);
+                uint8_t *outBlockPtr = outRowPtr + (columnBlocki * numPixelsInOneBlock);
+                
+                for (int rowi = 0; rowi < D; rowi++) {
+                    blockCopyByteRow<D>(outBlockPtr + (rowi * D), inBlockPtr + (rowi * width));
+                }
+            }
+        }
+        
+        // Edge blocks along the right side and the bottom row of blocks
+        
+        const unsigned int firstEdgeColumn = ((unsigned int) rowOfBlocksi < numFullBlocksHeight) ? numFullBlocksWidth : 0;
+        
+        for (unsigned int columnBlocki = firstEdgeColumn; columnBlocki < inNumBlocksWidth; columnBlocki++) {
+            uint8_t *outBlockPtr = outRowPtr + (columnBlocki * numPixelsInOneBlock);
+            
+            const unsigned int x = columnBlocki * D;
+            const unsigned int numPixelsToCopy = (x < width) ? min((unsigned int) D, width - x) : 0;
+            
+            for (int rowi = 0; rowi < D; rowi++) {
+                const unsigned int y = (rowOfBlocksi * D) + rowi;
+                uint8_t *outBlockRowPtr = outBlockPtr + (rowi * D);
+                
+                if (y >= height) {
+                    memset(outBlockRowPtr, zeroValue, D);
+                    continue;
+                }
+                
+                memcpy(outBlockRowPtr, inRowPtr + (rowi * width) + x, numPixelsToCopy);
+                memset(outBlockRowPtr + numPixelsToCopy, zeroValue, D - numPixelsToCopy);
+            }
+        }
+    };
+    
+    if (pool != nullptr) {
+        pool->parallelFor(inNumBlocksHeight, splitRowOfBlocks);
+    } else {
+        for (unsigned int rowOfBlocksi = 0; rowOfBlocksi < inNumBlocksHeight; rowOfBlocksi++) {
+            splitRowOfBlocks(rowOfBlocksi);
+        }
+    }
+    
+    // Output blocks past the input blocks are all padding
+    
+    if (outBlockMax > inBlockMax) {
+        memset(outPixels + (inBlockMax * numPixelsInOneBlock), zeroValue, (outBlockMax - inBlockMax) * numPixelsInOneBlock);
+    }
+    
+    return;
+}
+
+// Byte specialized flatten for 8x8 and 32x32 blocks, each row of blocks
+// writes D output rows and rows of blocks can be processed in parallel.
+
+template <const int D>
+static inline
+void flattenBlocksOfDim(
+                        const uint8_t *inPixels,
+                        uint8_t *outPixels,
+                        const unsigned int numBlocksInWidth,
+                        const unsigned int numBlocksInHeight,
+                        RiceThreadPool *pool = nullptr)
+{
+    const unsigned int numPixelsInBlock = D * D;
+    const unsigned int numPixelsInRow = numBlocksInWidth * D;
+    
+    auto flattenRowOfBlocks = [&](int rowOfBlocksi) {
+        const uint8_t *inRowPtr = inPixels + (rowOfBlocksi * numBlocksInWidth * numPixelsInBlock);
+        uint8_t *outRowPtr = outPixels + (rowOfBlocksi * D * numPixelsInRow);
+        
+        for (unsigned int columnBlocki = 0; columnBlocki < numBlocksInWidth; columnBlocki++) {
+            const uint8_t *inBlockPtr = inRowPtr + (columnBlocki * numPixelsInBlock);
+            uint8_t *outBlockPtr = outRowPtr + (columnBlocki * D);
+            
+            for (int rowi = 0; rowi < D; rowi++) {
+                blockCopyByteRow<D>(outBlockPtr + (rowi * numPixelsInRow), inBlockPtr + (rowi * D));
+            }
+        }
+    };
+    
+    if (pool != nullptr) {
+        pool->parallelFor(numBlocksInHeight, flattenRowOfBlocks);
+    } else {
+        for (unsigned int rowOfBlocksi = 0; rowOfBlocksi < numBlocksInHeight; rowOfBlocksi++) {
+            flattenRowOfBlocks(rowOfBlocksi);
+        }
+    }
+    
+    return;
+}
+
+// Byte overloads are selected over the templates above for uint8_t
+// input and dispatch to the 8x8 and 32x32 fast paths.
+
+static inline
+void splitIntoBlocksOfSize(
+                           const unsigned int blockSize,
+                           const uint8_t *inPixels,
+                           unsigned int width,
+                           unsigned int height,
+                           unsigned int inNumBlocksWidth,
+                           unsigned int inNumBlocksHeight,
+                           uint8_t *outPixels,
+                           unsigned int outNumBlocksWidth,
+                           unsigned int outNumBlocksHeight,
+                           uint8_t zeroValue,
+                           RiceThreadPool *pool = nullptr)
+{
+    if (blockSize == 8) {
+        splitIntoBlocksOfDim<8>(inPixels, width, height, inNumBlocksWidth, inNumBlocksHeight, outPixels, outNumBlocksWidth, outNumBlocksHeight, zeroValue, pool);
+    } else if (blockSize == 32) {
+        splitIntoBlocksOfDim<32>(inPixels, width, height, inNumBlocksWidth, inNumBlocksHeight, outPixels, outNumBlocksWidth, outNumBlocksHeight, zeroValue, pool);
+    } else {
+        splitIntoBlocksOfSize<uint8_t>(blockSize, inPixels, width, height, inNumBlocksWidth, inNumBlocksHeight, outPixels, outNumBlocksWidth, outNumBlocksHeight, zeroValue);
+    }
+}
+
+static inline
+void flattenBlocksOfSize(
+                         const unsigned int blockDim,
+                         const uint8_t *inPixels,
+                         uint8_t *outPixels,
+                         const unsigned int numBlocksInWidth,
+                         const unsigned int numBlocksInHeight,
+                         RiceThreadPool *pool = nullptr)
+{
+    if (blockDim == 8) {
+        flattenBlocksOfDim<8>(inPixels, outPixels, numBlocksInWidth, numBlocksInHeight, pool);
+    } else if (blockDim == 32) {
+        flattenBlocksOfDim<32>(inPixels, outPixels, numBlocksInWidth, numBlocksInHeight, pool);
+    } else {
+        flattenBlocksOfSize<uint8_t>(blockDim, inPixels, outPixels, numBlocksInWidth, numBlocksInHeight);
+    }
+}
+
 // Given a flat array of pixels that might have been zero padded, crop off
 // any zero padding by doing a copy only for the pixels that are inside
 // the crop rectangle. The result is a buffer that is width x height pixels.
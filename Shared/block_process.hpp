@@ -16,8 +16,11 @@
 #include <stdio.h>
 
 #include <cinttypes>
+#include <algorithm>
 #include <vector>
 #include <bitset>
+#include <memory>
+#include <mutex>
 
 #include  "zigzag.h"
 #include "EncDec.hpp"
@@ -30,6 +33,114 @@ int optimalRiceK(
                  int inNumBytes,
                  int blocki);
 
+// Prediction used for each value inside a block. Every predictor
+// stores (0,0) as is, predicts column 0 from the value above and row 0
+// from the value to the left. Inside the block Left predicts from the
+// value to the left, Gradient from left + above - upper left, and MED
+// is the LOCO-I median edge detector. Gradient decodes as a 2D prefix
+// sum, so the row and column sums can each run in parallel.
+
+typedef enum {
+    BlockDeltaPredictorLeft = 0,
+    BlockDeltaPredictorGradient = 1,
+    BlockDeltaPredictorMED = 2,
+} BlockDeltaPredictor;
+
+static inline
+uint8_t block_delta_predict(const BlockDeltaPredictor predictor,
+                            const uint8_t left,
+                            const uint8_t above,
+                            const uint8_t aboveLeft)
+{
+    switch (predictor) {
+        case BlockDeltaPredictorGradient:
+            return (uint8_t) (left + above - aboveLeft);
+        case BlockDeltaPredictorMED: {
+            const uint8_t minVal = min(left, above);
+            const uint8_t maxVal = max(left, above);
+            if (aboveLeft >= maxVal) {
+                return minVal;
+            } else if (aboveLeft <= minVal) {
+                return maxVal;
+            } else {
+                return (uint8_t) (left + above - aboveLeft);
+            }
+        }
+        default:
+            return left;
+    }
+}
+
+// Predict each value of a dim x dim block and write zigzag residuals,
+// inBytes and outBytes can be the same buffer with the same stride.
+// Values are processed from the bottom right so that the neighbours
+// of each value are still the input values.
+
+static inline
+void block_delta_predict_encode(const BlockDeltaPredictor predictor,
+                                const int dim,
+                                const uint8_t * inBytes,
+                                const int inStride,
+                                uint8_t * outBytes,
+                                const int outStride)
+{
+    for ( int row = dim - 1; row >= 0; row-- ) {
+        const uint8_t *inRowPtr = inBytes + (row * inStride);
+        const uint8_t *aboveRowPtr = inRowPtr - inStride;
+        uint8_t *outRowPtr = outBytes + (row * outStride);
+        const int firstCol = (row == 0) ? 1 : 0;
+
+        for ( int col = dim - 1; col >= firstCol; col-- ) {
+            uint8_t pred;
+
+            if (row == 0) {
+                pred = inRowPtr[col-1];
+            } else if (col == 0) {
+                pred = aboveRowPtr[0];
+            } else {
+                pred = block_delta_predict(predictor, inRowPtr[col-1], aboveRowPtr[col], aboveRowPtr[col-1]);
+            }
+
+            outRowPtr[col] = zigzag_num_neg_to_offset((int8_t) (inRowPtr[col] - pred));
+        }
+    }
+
+    outBytes[0] = inBytes[0];
+}
+
+// Reverse block_delta_predict_encode() in raster order
+
+static inline
+void block_delta_predict_decode(const BlockDeltaPredictor predictor,
+                                const int dim,
+                                const uint8_t * inResiduals,
+                                const int inStride,
+                                uint8_t * outBytes,
+                                const int outStride)
+{
+    outBytes[0] = inResiduals[0];
+
+    for ( int row = 0; row < dim; row++ ) {
+        const uint8_t *inRowPtr = inResiduals + (row * inStride);
+        uint8_t *outRowPtr = outBytes + (row * outStride);
+        const uint8_t *aboveRowPtr = outRowPtr - outStride;
+
+        for ( int col = (row == 0) ? 1 : 0; col < dim; col++ ) {
+            uint8_t pred;
+
+            if (row == 0) {
+                pred = outRowPtr[col-1];
+            } else if (col == 0) {
+                pred = aboveRowPtr[0];
+            } else {
+                pred = block_delta_predict(predictor, outRowPtr[col-1], aboveRowPtr[col], aboveRowPtr[col-1]);
+            }
+
+            outRowPtr[col] = pred + (uint8_t) zigzag_offset_to_num_neg(inRowPtr[col]);
+        }
+    }
+}
+
 // Decode the block encoding created by blockDeltaEncoding()
 
 template <const int BD>
@@ -41,7 +152,8 @@ void block_delta_process_decode(
                          const unsigned int blockWidth,
                          const unsigned int blockHeight,
                          uint8_t *outBlockBytesPtr,
-                         int outBlockNumBytes)
+                         int outBlockNumBytes,
+                         const BlockDeltaPredictor predictor = BlockDeltaPredictorLeft)
 {
     const int blockDim = BD;
     
@@ -90,6 +202,12 @@ void block_delta_process_decode(
         vector<uint8_t> decodedBlockBytes;
         decodedBlockBytes.resize(blockDim * blockDim);
         
+        if (predictor != BlockDeltaPredictorLeft) {
+            block_delta_predict_decode(predictor, blockDim, blockPtr, blockDim, decodedBlockBytes.data(), blockDim);
+            decoder.blockVectors[blocki] = std::move(decodedBlockBytes);
+            continue;
+        }
+        
         // Reverse deltas for column 0
         
         vec[0] = blockPtr[0];
@@ -208,7 +326,8 @@ void block_delta_process_encode(const uint8_t * inBytes,
                           const int outBlockHeight,
                           vector<uint8_t> & outEncodedBlockBytes,
                           int * numBaseValues,
-                          int * numBlockValues)
+                          int * numBlockValues,
+                          const BlockDeltaPredictor predictor = BlockDeltaPredictorLeft)
 {
     const int dumpBlockInOutBytes = 0;
     const int dumpDeltaBytes = 0;
@@ -257,6 +376,12 @@ void block_delta_process_encode(const uint8_t * inBytes,
     
     int blocki = 0;
     for ( vector<uint8_t> & inOutBlockVec : encoder.blockVectors ) {
+        if (predictor != BlockDeltaPredictorLeft) {
+            block_delta_predict_encode(predictor, blockDim, inOutBlockVec.data(), blockDim, inOutBlockVec.data(), blockDim);
+            blocki++;
+            continue;
+        }
+        
         // Calculate deltas for column 0
         
         if (dumpDeltaBytes) {
@@ -326,51 +451,29 @@ void block_delta_process_encode(const uint8_t * inBytes,
         // (0, row) to (width, row)
         
         for ( int row = 0; row < height; row++ ) {
-            for ( int col = 0; col < width; col++ ) {
-                int offset = (row * width) + col;
-                uint8_t byteVal = inOutBlockVec[offset];
-                deltaVec[col] = byteVal;
-            }
+            uint8_t *rowPtr = &inOutBlockVec[row * width];
             
             if (dumpDeltaBytes) {
                 printf("row%4d bytes:\n", row);
-                for ( uint8_t byteVal : deltaVec ) {
-                    printf("0x%02X ", byteVal);
+                for ( int col = 0; col < width; col++ ) {
+                    printf("0x%02X ", rowPtr[col]);
                 }
                 
                 printf("\n");
             }
             
-            vector<uint8_t> rowSignedDeltaBytes = encodeDelta(deltaVec);
+            // Zigzag deltas for (1, row) to (width, row) written back
+            // over the block in place, (0, row) is the previous value
+            // for column 1 and is replaced by the column 0 delta below.
             
-            if (dumpDeltaBytes) {
-                printf("row%4d delta bytes:\n", row);
-                for ( uint8_t byteVal : rowSignedDeltaBytes ) {
-                    printf("0x%02X ", byteVal);
-                }
-                
-                printf("\n");
-            }
-            
-            // Copy row deltas back into block order vec
+            zigzag_byte_deltas_encode(rowPtr + 1, rowPtr + 1, width - 1, rowPtr[0]);
             
             if (dumpDeltaBytes) {
                 printf("zerod bytes:\n");
                 printf("---- ");
-            }
-            
-            for ( int col = 1; col < width; col++ ) {
-                int offset = (row * width) + col;
-                uint8_t sVal = rowSignedDeltaBytes[col];
-                uint8_t zerodVal = pixelpack_int8_to_offset_uint8(sVal);
-                inOutBlockVec[offset] = zerodVal;
-                
-                if (dumpDeltaBytes) {
-                    printf("0x%02X ", zerodVal);
+                for ( int col = 1; col < width; col++ ) {
+                    printf("0x%02X ", rowPtr[col]);
                 }
-            }
-            
-            if (dumpDeltaBytes) {
                 printf("\n");
             }
         } // end foreach row
@@ -452,7 +555,8 @@ void block_delta_process_encode(const uint8_t * inBytes,
                                        (int)outEncodedBlockBytes.size(),
                                        width, height,
                                        blockWidth, blockHeight,
-                                       outBlockBytes.data(), (int)outBlockBytes.size());
+                                       outBlockBytes.data(), (int)outBlockBytes.size(),
+                                       predictor);
         
         for (int i = 0; i < inNumBytes; i++) {
             int inByte = inBytes[i];
@@ -581,90 +685,307 @@ void block_process_rice_opt(
     return;
 }
 
-// Generate an input vector of uint32_t blocki values based on
-// a width and height. Return blocki values in an order that
-// supports table lookups by original blocki.
+// Wide sample version of block_delta_process_decode(), T is uint16_t and
+// numBits indicates the sample bit depth (10, 12, or 16). Deltas were
+// calculated modulo 2^numBits so that each zigzag value fits in numBits.
 
-template <const int blockDim, const int blockiDim>
-void block_reorder_blocki(int width,
-                          int height,
-                          vector<uint32_t> & blockiVec,
-                          vector<uint32_t> & blockiLookupVec,
-                          const bool resolve = false)
+template <const int BD, typename T>
+void block_delta_process_decode_wide(
+                         const T * inEncodedBlockSamples,
+                         int inEncodedBlockNumSamples,
+                         const int width,
+                         const int height,
+                         const unsigned int blockWidth,
+                         const unsigned int blockHeight,
+                         const int numBits,
+                         T *outSamplesPtr,
+                         int outNumSamples)
 {
-  // blockDim corresponds to the dimension of the block that corresponds to a single blocki
-  // For example, with 2x2 blocks a blocki value corresponds to 4 pixels and an input that
-  // is 4x4 would generate 4 blocki values (0, 1, 2, 3).
+    const int blockDim = BD;
+    const uint32_t mask = (1 << numBits) - 1;
+    
+    int numBlocks = inEncodedBlockNumSamples / (blockDim * blockDim);
+    assert((inEncodedBlockNumSamples % (blockDim * blockDim)) == 0);
+    
+#if defined(DEBUG)
+    assert(numBits > 8 && numBits <= (int) (sizeof(T) * 8));
+#endif // DEBUG
+    
+    BlockDecoder<T, blockDim> decoder;
+    
+    decoder.blockVectors.resize(numBlocks);
+    
+    for (int blocki = 0; blocki < numBlocks; blocki++) {
+        const T *blockPtr = inEncodedBlockSamples + (blocki * (blockDim * blockDim));
+        
+        vector<T> decodedBlock;
+        decodedBlock.resize(blockDim * blockDim);
+        
+        // Reverse deltas for column 0, (0,0) is stored as is
+        
+        uint32_t prev = blockPtr[0];
+        decodedBlock[0] = prev;
+        
+        for ( int row = 1; row < blockDim; row++ ) {
+            int offset = (row * blockDim);
+            uint32_t delta = zigzag_offset_to_num_neg_nbits(blockPtr[offset], numBits);
+            prev = (prev + delta) & mask;
+            decodedBlock[offset] = prev;
+        }
+        
+        // Reverse deltas for each row starting from the column 0 value
+        
+        for ( int row = 0; row < blockDim; row++ ) {
+            int offset = (row * blockDim);
+            prev = decodedBlock[offset];
+            
+            for ( int col = 1; col < blockDim; col++ ) {
+                uint32_t delta = zigzag_offset_to_num_neg_nbits(blockPtr[offset + col], numBits);
+                prev = (prev + delta) & mask;
+                decodedBlock[offset + col] = prev;
+            }
+        }
+        
+        decoder.blockVectors[blocki] = std::move(decodedBlock);
+    }
+    
+    decoder.flattenAndCrop(outSamplesPtr, outNumSamples, blockWidth, blockHeight, width, height);
+    
+    return;
+}
 
-  unsigned int numBlocksInWidth, numBlocksInHeight;
-  
-  {
-    BlockEncoder<uint32_t, blockDim> encoder;
+// Wide sample version of block_delta_process_encode(), the same column 0
+// then row delta ordering is used but each delta is a numBits wide value.
+// The input samples must not contain any bits above numBits.
+
+template <const int BD, typename T>
+void block_delta_process_encode_wide(const T * inSamples,
+                          int inNumSamples,
+                          const int width,
+                          const int height,
+                          const int outBlockWidth,
+                          const int outBlockHeight,
+                          const int numBits,
+                          vector<T> & outEncodedBlockSamples)
+{
+    const int blockDim = BD;
+    const uint32_t mask = (1 << numBits) - 1;
     
-    encoder.calcBlockWidthAndHeight(width, height, numBlocksInWidth, numBlocksInHeight);
-  }
+#if defined(DEBUG)
+    assert(numBits > 8 && numBits <= (int) (sizeof(T) * 8));
+    for (int i = 0; i < inNumSamples; i++) {
+        assert((inSamples[i] & ~mask) == 0);
+    }
+#endif // DEBUG
+    
+    BlockEncoder<T, blockDim> encoder;
+    
+    unsigned int blockWidth, blockHeight;
+    
+    if (outBlockWidth == 0) {
+        encoder.calcBlockWidthAndHeight(width, height, blockWidth, blockHeight);
+    } else {
+        blockWidth = outBlockWidth;
+        blockHeight = outBlockHeight;
+    }
+    
+    encoder.splitIntoBlocks(inSamples, inNumSamples, width, height, blockWidth, blockHeight, 0);
+    
+    const int numValuesEachBlock = (blockDim * blockDim);
+    
+    outEncodedBlockSamples.resize(numValuesEachBlock * encoder.blockVectors.size());
+    
+    T *outPtr = outEncodedBlockSamples.data();
+    
+    for ( vector<T> & blockVec : encoder.blockVectors ) {
+        // Row deltas are relative to column 0 of the same row, column 0 is
+        // relative to the row above. Read from blockVec and write deltas
+        // to the output so that the original values are not modified.
+        
+        for ( int row = 0; row < blockDim; row++ ) {
+            int offset = (row * blockDim);
+            
+            if (row == 0) {
+                outPtr[0] = blockVec[0];
+            } else {
+                uint32_t delta = (blockVec[offset] - blockVec[offset - blockDim]) & mask;
+                outPtr[offset] = zigzag_num_neg_to_offset_nbits(delta, numBits);
+            }
+            
+            for ( int col = 1; col < blockDim; col++ ) {
+                uint32_t delta = (blockVec[offset + col] - blockVec[offset + col - 1]) & mask;
+                outPtr[offset + col] = zigzag_num_neg_to_offset_nbits(delta, numBits);
+            }
+        }
+        
+        outPtr += numValuesEachBlock;
+    }
+    
+#if defined(DEBUG)
+    // Decode the encoded buffer and make sure it becomes the original input
+    
+    if (1)
+    {
+        vector<T> outSamples;
+        
+        outSamples.resize(inNumSamples);
+        
+        block_delta_process_decode_wide<blockDim>(outEncodedBlockSamples.data(),
+                                       (int)outEncodedBlockSamples.size(),
+                                       width, height,
+                                       blockWidth, blockHeight,
+                                       numBits,
+                                       outSamples.data(), (int)outSamples.size());
+        
+        for (int i = 0; i < inNumSamples; i++) {
+            assert(inSamples[i] == outSamples[i]);
+        }
+    }
+#endif // DEBUG
+    
+    return;
+}
+
+// Immutable blocki reorder tables for one (width, height) geometry.
+// blockiVec holds blocki values in image order and blockiLookupVec
+// holds the same values in big block order, blockiDim x blockiDim
+// blocks in each big block with padding blocks skipped.
+
+template <const int blockDim, const int blockiDim>
+class BlockReorderTables
+{
+public:
+  int width;
+  int height;
   
-  unsigned int numBlocks = numBlocksInWidth * numBlocksInHeight;
+  unsigned int numBlocksInWidth;
+  unsigned int numBlocksInHeight;
+  unsigned int numBigBlocksInWidth;
+  unsigned int numBigBlocksInHeight;
   
-  blockiVec.clear();
-  blockiVec.reserve(numBlocks);
+  vector<uint32_t> blockiVec;
+  vector<uint32_t> blockiLookupVec;
   
-  for ( int blocki = 0; blocki < numBlocks; blocki++ ) {
-    blockiVec.push_back(blocki);
+  BlockReorderTables(int width, int height)
+  : width(width),
+  height(height)
+  {
+    generate(width, height, blockiVec, blockiLookupVec);
+    
+    numBlocksInWidth = (width + blockDim - 1) / blockDim;
+    numBlocksInHeight = (height + blockDim - 1) / blockDim;
+    numBigBlocksInWidth = (numBlocksInWidth + blockiDim - 1) / blockiDim;
+    numBigBlocksInHeight = (numBlocksInHeight + blockiDim - 1) / blockiDim;
   }
   
-  // Split blocki values based on blockiDim, for example if blockiDim = 4
-  // then split blocki values in image order into 4x4 block order data.
-  
-  unsigned int numBigBlocksInWidth, numBigBlocksInHeight;
-  
-  BlockEncoder<uint32_t, blockiDim> encoder;
+  // Generate the tables directly from index arithmetic, the result is
+  // the same as splitting blockiVec with BlockEncoder<uint32_t, blockiDim>
   
-  encoder.calcBlockWidthAndHeight(numBlocksInWidth, numBlocksInHeight, numBigBlocksInWidth, numBigBlocksInHeight);
+  static
+  void generate(int width,
+                int height,
+                vector<uint32_t> & blockiVec,
+                vector<uint32_t> & blockiLookupVec)
+  {
+    const unsigned int numBlocksInWidth = (width + blockDim - 1) / blockDim;
+    const unsigned int numBlocksInHeight = (height + blockDim - 1) / blockDim;
+    const unsigned int numBigBlocksInWidth = (numBlocksInWidth + blockiDim - 1) / blockiDim;
+    const unsigned int numBigBlocksInHeight = (numBlocksInHeight + blockiDim - 1) / blockiDim;
+    
+    const unsigned int numBlocks = numBlocksInWidth * numBlocksInHeight;
+    
+    blockiVec.resize(numBlocks);
+    blockiLookupVec.resize(numBlocks);
+    
+    for ( unsigned int blocki = 0; blocki < numBlocks; blocki++ ) {
+      blockiVec[blocki] = blocki;
+    }
+    
+    uint32_t *outPtr = blockiLookupVec.data();
+    
+    for ( unsigned int bigBlockY = 0; bigBlockY < numBigBlocksInHeight; bigBlockY++ ) {
+      const unsigned int y0 = bigBlockY * blockiDim;
+      const unsigned int yEnd = min(y0 + blockiDim, numBlocksInHeight);
+      
+      for ( unsigned int bigBlockX = 0; bigBlockX < numBigBlocksInWidth; bigBlockX++ ) {
+        const unsigned int x0 = bigBlockX * blockiDim;
+        const unsigned int xEnd = min(x0 + blockiDim, numBlocksInWidth);
+        
+        for ( unsigned int y = y0; y < yEnd; y++ ) {
+          for ( unsigned int x = x0; x < xEnd; x++ ) {
+            *outPtr++ = (y * numBlocksInWidth) + x;
+          }
+        }
+      }
+    }
+    
+#if defined(DEBUG)
+    assert(outPtr == (blockiLookupVec.data() + numBlocks));
+#endif // DEBUG
+  }
+};
+
+// Number of geometries kept by block_reorder_blocki_tables()
+
+#define BLOCK_REORDER_TABLES_CACHE_SIZE 8
+
+// Process wide cache of reorder tables keyed by geometry. The tables
+// are created on first use and shared by later callers, the cache
+// holds the most recently used geometries and drops the least recently
+// used one when full. Callers that still hold evicted tables keep them.
 
-  blockiLookupVec.clear();
-  blockiLookupVec.reserve(numBlocks);
+template <const int blockDim, const int blockiDim>
+shared_ptr<const BlockReorderTables<blockDim, blockiDim> > block_reorder_blocki_tables(int width, int height)
+{
+  typedef BlockReorderTables<blockDim, blockiDim> TablesT;
   
-  uint32_t *inBlockWords = blockiVec.data();
+  static mutex cacheMutex;
+  static vector<shared_ptr<const TablesT> > cache;
   
-  encoder.splitIntoBlocks(inBlockWords, numBlocks, numBlocksInWidth, numBlocksInHeight, numBigBlocksInWidth, numBigBlocksInHeight, 0xFFFFFFFF);
+  unique_lock<mutex> lock(cacheMutex);
   
-  for ( vector<uint32_t> & inOutBlockVec : encoder.blockVectors ) {
-    for ( uint32_t blocki : inOutBlockVec ) {
-      // Skip any padding elements
-      if (blocki == 0xFFFFFFFF) {
-        // nop
-      } else {
-        blockiLookupVec.push_back(blocki);
-      }
+  for ( auto it = cache.begin(); it != cache.end(); ++it ) {
+    if ((*it)->width == width && (*it)->height == height) {
+      shared_ptr<const TablesT> tables = *it;
+      cache.erase(it);
+      cache.insert(cache.begin(), tables);
+      return tables;
     }
   }
   
-  assert(blockiVec.size() == blockiLookupVec.size());
+  shared_ptr<const TablesT> tables = make_shared<const TablesT>(width, height);
   
-  // If resolve is true, the lookup each original blocki
+  cache.insert(cache.begin(), tables);
   
-  if (resolve == true) {
-    vector<uint32_t> resolved;
-    resolved.reserve(blockiLookupVec.size());
-    
-    for ( uint32_t blocki : blockiVec ) {
-      int bigBlocki = (blocki / (blockiDim * blockiDim));
-      int bigBlockRooti = bigBlocki * (blockiDim * blockiDim);
-      int bigBlockOffset = (blocki - bigBlockRooti);
-      int offset = bigBlockRooti + bigBlockOffset;
-      uint32_t resolvedBlocki = blockiLookupVec[offset];
-      
-      if ((0)) {
-        printf("blocki %3d : bigBlocki %3d : bigBlockRooti %3d : lookupBlocki %3d\n", blocki, bigBlocki, bigBlockRooti, resolvedBlocki);
-      }
-            
-      resolved.push_back(resolvedBlocki);
-    }
-    
-    blockiLookupVec = resolved;
+  if (cache.size() > BLOCK_REORDER_TABLES_CACHE_SIZE) {
+    cache.pop_back();
   }
   
+  return tables;
+}
+
+// Generate an input vector of uint32_t blocki values based on
+// a width and height. Return blocki values in an order that
+// supports table lookups by original blocki. The tables are
+// generated directly into the output vectors.
+//
+// The last argument is ignored. It requested a pass that looked up
+// each blocki in the lookup table, but blockiVec is the identity so
+// that pass always returned the lookup table unchanged.
+
+template <const int blockDim, const int blockiDim>
+void block_reorder_blocki(int width,
+                          int height,
+                          vector<uint32_t> & blockiVec,
+                          vector<uint32_t> & blockiLookupVec,
+                          const bool /* resolve */ = false)
+{
+  // blockDim corresponds to the dimension of the block that corresponds to a single blocki
+  // For example, with 2x2 blocks a blocki value corresponds to 4 pixels and an input that
+  // is 4x4 would generate 4 blocki values (0, 1, 2, 3).
+  
+  BlockReorderTables<blockDim, blockiDim>::generate(width, height, blockiVec, blockiLookupVec);
+  
   return;
 }
 
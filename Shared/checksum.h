@@ -0,0 +1,299 @@
+//
+//  checksum.h
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Checksums used to validate decoded pixels. adler32 matches zlib
+//  and the original byte by byte my_adler32(), the SIMD paths sum 32
+//  byte chunks. hash64 is xxHash64, it is much faster than adler32
+//  on large buffers and is used for per big block hashes that can be
+//  checked independently as each tile is decoded.
+
+#ifndef _checksum_h
+#define _checksum_h
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// largest prime smaller than 65536
+#define CHECKSUM_ADLER_BASE 65521
+
+// NMAX is the largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1,
+// rounded down to a whole number of 32 byte chunks.
+#define CHECKSUM_ADLER_NMAX32 5536
+
+// Scalar adler32 update, s1 and s2 are reduced by the caller
+
+static inline
+void adler32_update_scalar(uint32_t *s1Ptr, uint32_t *s2Ptr, const uint8_t *buf, int len)
+{
+  uint32_t s1 = *s1Ptr;
+  uint32_t s2 = *s2Ptr;
+
+  for (int i = 0; i < len; i++) {
+    s1 += buf[i];
+    s2 += s1;
+  }
+
+  *s1Ptr = s1;
+  *s2Ptr = s2;
+}
+
+// Update s1 and s2 with numChunks 32 byte chunks. For each chunk
+// s2 gets 32 * s1 plus each byte weighted by 32 down to 1 and s1 gets
+// the sum of the bytes. The vector loop keeps the running s1 sums in
+// vps and multiplies by 32 once at the end.
+
+static inline
+void adler32_update_chunks(uint32_t *s1Ptr, uint32_t *s2Ptr, const uint8_t *buf, int numChunks)
+{
+  uint32_t s1 = *s1Ptr;
+  uint32_t s2 = *s2Ptr;
+
+#if defined(__AVX2__)
+  const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                           24, 23, 22, 21, 20, 19, 18, 17,
+                                           16, 15, 14, 13, 12, 11, 10, 9,
+                                           8, 7, 6, 5, 4, 3, 2, 1);
+  const __m256i ones = _mm256_set1_epi16(1);
+  const __m256i zero = _mm256_setzero_si256();
+
+  __m256i vs1 = zero;
+  __m256i vs2 = zero;
+  __m256i vps = zero;
+
+  for (int i = 0; i < numChunks; i++) {
+    const __m256i bytes = _mm256_loadu_si256((const __m256i *) (buf + (i * 32)));
+    vps = _mm256_add_epi32(vps, vs1);
+    vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(bytes, zero));
+    vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+  }
+
+  vs2 = _mm256_add_epi32(vs2, _mm256_slli_epi32(vps, 5));
+
+  __m128i sum1 = _mm_add_epi32(_mm256_castsi256_si128(vs1), _mm256_extracti128_si256(vs1, 1));
+  __m128i sum2 = _mm_add_epi32(_mm256_castsi256_si128(vs2), _mm256_extracti128_si256(vs2, 1));
+  sum1 = _mm_add_epi32(sum1, _mm_shuffle_epi32(sum1, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum2 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum2 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  s2 += (s1 * (uint32_t) (numChunks * 32)) + (uint32_t) _mm_cvtsi128_si32(sum2);
+  s1 += (uint32_t) _mm_cvtsi128_si32(sum1);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  static const uint8_t weightBytes[32] = {
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+    16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+  };
+  const uint8x8_t w0 = vld1_u8(weightBytes);
+  const uint8x8_t w1 = vld1_u8(weightBytes + 8);
+  const uint8x8_t w2 = vld1_u8(weightBytes + 16);
+  const uint8x8_t w3 = vld1_u8(weightBytes + 24);
+
+  uint32x4_t vs1 = vdupq_n_u32(0);
+  uint32x4_t vs2 = vdupq_n_u32(0);
+  uint32x4_t vps = vdupq_n_u32(0);
+
+  for (int i = 0; i < numChunks; i++) {
+    const uint8x16_t bytes0 = vld1q_u8(buf + (i * 32));
+    const uint8x16_t bytes1 = vld1q_u8(buf + (i * 32) + 16);
+    vps = vaddq_u32(vps, vs1);
+    vs1 = vpadalq_u16(vs1, vpadalq_u8(vpaddlq_u8(bytes0), bytes1));
+    uint16x8_t weighted = vmull_u8(vget_low_u8(bytes0), w0);
+    weighted = vmlal_u8(weighted, vget_high_u8(bytes0), w1);
+    weighted = vmlal_u8(weighted, vget_low_u8(bytes1), w2);
+    weighted = vmlal_u8(weighted, vget_high_u8(bytes1), w3);
+    vs2 = vpadalq_u16(vs2, weighted);
+  }
+
+  vs2 = vaddq_u32(vs2, vshlq_n_u32(vps, 5));
+
+  const uint32x2_t sum1 = vadd_u32(vget_low_u32(vs1), vget_high_u32(vs1));
+  const uint32x2_t sum2 = vadd_u32(vget_low_u32(vs2), vget_high_u32(vs2));
+
+  s2 += (s1 * (uint32_t) (numChunks * 32)) + vget_lane_u32(sum2, 0) + vget_lane_u32(sum2, 1);
+  s1 += vget_lane_u32(sum1, 0) + vget_lane_u32(sum1, 1);
+#elif defined(__SSE2__)
+  const __m128i weights0 = _mm_setr_epi16(32, 31, 30, 29, 28, 27, 26, 25);
+  const __m128i weights1 = _mm_setr_epi16(24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i weights2 = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+  const __m128i weights3 = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128i vs1 = zero;
+  __m128i vs2 = zero;
+  __m128i vps = zero;
+
+  for (int i = 0; i < numChunks; i++) {
+    const __m128i bytes0 = _mm_loadu_si128((const __m128i *) (buf + (i * 32)));
+    const __m128i bytes1 = _mm_loadu_si128((const __m128i *) (buf + (i * 32) + 16));
+    vps = _mm_add_epi32(vps, vs1);
+    vs1 = _mm_add_epi32(vs1, _mm_add_epi32(_mm_sad_epu8(bytes0, zero), _mm_sad_epu8(bytes1, zero)));
+    __m128i weighted = _mm_madd_epi16(_mm_unpacklo_epi8(bytes0, zero), weights0);
+    weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(bytes0, zero), weights1));
+    weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(bytes1, zero), weights2));
+    weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(bytes1, zero), weights3));
+    vs2 = _mm_add_epi32(vs2, weighted);
+  }
+
+  vs2 = _mm_add_epi32(vs2, _mm_slli_epi32(vps, 5));
+
+  __m128i sum1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(1, 0, 3, 2)));
+  __m128i sum2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum2 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  s2 += (s1 * (uint32_t) (numChunks * 32)) + (uint32_t) _mm_cvtsi128_si32(sum2);
+  s1 += (uint32_t) _mm_cvtsi128_si32(sum1);
+#else
+  for (int i = 0; i < numChunks; i++) {
+    adler32_update_scalar(&s1, &s2, buf + (i * 32), 32);
+  }
+#endif
+
+  *s1Ptr = s1;
+  *s2Ptr = s2;
+}
+
+// zlib compatible adler32, pass 1 as the initial adler value
+
+static inline
+uint32_t adler32_update(uint32_t adler, const uint8_t *buf, size_t len)
+{
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = (adler >> 16) & 0xffff;
+
+  while (len > 0) {
+    const int n = (len < CHECKSUM_ADLER_NMAX32) ? (int) len : CHECKSUM_ADLER_NMAX32;
+    const int numChunks = n / 32;
+
+    adler32_update_chunks(&s1, &s2, buf, numChunks);
+    adler32_update_scalar(&s1, &s2, buf + (numChunks * 32), n - (numChunks * 32));
+
+    s1 %= CHECKSUM_ADLER_BASE;
+    s2 %= CHECKSUM_ADLER_BASE;
+
+    buf += n;
+    len -= n;
+  }
+
+  return (s2 << 16) | s1;
+}
+
+// xxHash64
+
+#define CHECKSUM_H64_PRIME1 0x9E3779B185EBCA87ULL
+#define CHECKSUM_H64_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define CHECKSUM_H64_PRIME3 0x165667B19E3779F9ULL
+#define CHECKSUM_H64_PRIME4 0x85EBCA77C2B2AE63ULL
+#define CHECKSUM_H64_PRIME5 0x27D4EB2F165667C5ULL
+
+static inline
+uint64_t hash64_rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline
+uint64_t hash64_read64(const uint8_t *ptr)
+{
+  uint64_t v;
+  memcpy(&v, ptr, sizeof(v));
+  return v;
+}
+
+static inline
+uint32_t hash64_read32(const uint8_t *ptr)
+{
+  uint32_t v;
+  memcpy(&v, ptr, sizeof(v));
+  return v;
+}
+
+static inline
+uint64_t hash64_round(uint64_t acc, uint64_t input)
+{
+  acc += input * CHECKSUM_H64_PRIME2;
+  acc = hash64_rotl(acc, 31);
+  return acc * CHECKSUM_H64_PRIME1;
+}
+
+static inline
+uint64_t hash64_merge_round(uint64_t acc, uint64_t val)
+{
+  acc ^= hash64_round(0, val);
+  return (acc * CHECKSUM_H64_PRIME1) + CHECKSUM_H64_PRIME4;
+}
+
+// Hash len bytes, the result is the same as XXH64(buf, len, seed)
+// on a little endian target.
+
+static inline
+uint64_t hash64(const uint8_t *buf, size_t len, uint64_t seed)
+{
+  const uint8_t *ptr = buf;
+  const uint8_t *end = buf + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t v1 = seed + CHECKSUM_H64_PRIME1 + CHECKSUM_H64_PRIME2;
+    uint64_t v2 = seed + CHECKSUM_H64_PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - CHECKSUM_H64_PRIME1;
+
+    const uint8_t *limit = end - 32;
+
+    do {
+      v1 = hash64_round(v1, hash64_read64(ptr));
+      v2 = hash64_round(v2, hash64_read64(ptr + 8));
+      v3 = hash64_round(v3, hash64_read64(ptr + 16));
+      v4 = hash64_round(v4, hash64_read64(ptr + 24));
+      ptr += 32;
+    } while (ptr <= limit);
+
+    h = hash64_rotl(v1, 1) + hash64_rotl(v2, 7) + hash64_rotl(v3, 12) + hash64_rotl(v4, 18);
+    h = hash64_merge_round(h, v1);
+    h = hash64_merge_round(h, v2);
+    h = hash64_merge_round(h, v3);
+    h = hash64_merge_round(h, v4);
+  } else {
+    h = seed + CHECKSUM_H64_PRIME5;
+  }
+
+  h += (uint64_t) len;
+
+  while ((ptr + 8) <= end) {
+    h ^= hash64_round(0, hash64_read64(ptr));
+    h = (hash64_rotl(h, 27) * CHECKSUM_H64_PRIME1) + CHECKSUM_H64_PRIME4;
+    ptr += 8;
+  }
+
+  if ((ptr + 4) <= end) {
+    h ^= (uint64_t) hash64_read32(ptr) * CHECKSUM_H64_PRIME1;
+    h = (hash64_rotl(h, 23) * CHECKSUM_H64_PRIME2) + CHECKSUM_H64_PRIME3;
+    ptr += 4;
+  }
+
+  while (ptr < end) {
+    h ^= (*ptr) * CHECKSUM_H64_PRIME5;
+    h = hash64_rotl(h, 11) * CHECKSUM_H64_PRIME1;
+    ptr += 1;
+  }
+
+  h ^= h >> 33;
+  h *= CHECKSUM_H64_PRIME2;
+  h ^= h >> 29;
+  h *= CHECKSUM_H64_PRIME3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+#endif // _checksum_h
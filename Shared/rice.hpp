@@ -14,11 +14,30 @@
 #include <unordered_map>
 #endif // DEBUG
 
+#include <climits>
+#include <type_traits>
+
 #include "byte_bit_stream.hpp"
 #include "rice_util.hpp"
 
 using namespace std;
 
+// __clz is an ARM intrinsic, provide the same count leading zeros
+// operation when compiling for other targets. The 64 bit prefix
+// readers pass a uint64_t register, count zeros from bit 63.
+
+#if !(defined(__APPLE__) && (defined(__arm__) || defined(__arm64__)))
+static inline
+unsigned int __clz(uint32_t value) {
+  return (value == 0) ? 32 : __builtin_clz(value);
+}
+
+static inline
+unsigned int __clz(uint64_t value) {
+  return (value == 0) ? 64 : __builtin_clzll(value);
+}
+#endif
+
 class RiceEncoder
 {
 public:
@@ -123,7 +142,7 @@ public:
 #endif // DEBUG
         
         const unsigned int m = (1 << k); // 2^k
-        const unsigned int q = pot_div_k(n, m);
+        const unsigned int q = pot_div_k(n, k);
         
         if (debug) {
             printf("n %3d : k %3d : m %3d : q = n / m = %d\n", n, k, m, q);
@@ -1335,11 +1354,22 @@ public:
 // Special purpose split and block into groups of 4 encoding, where 4 values are
 // processed at a time so that prefix P and suffix S are stored as (SSSS PPPP)
 // 4 at a time. The prefix portion can contain OVER bits that do not fit into k.
+// The SB argument indicates the number of bits in each input symbol, the
+// default is 8 bits while 10, 12, or 16 bit samples use a uint16_t symbol
+// and an escape that emits (SB - k) OVER bits after the 16 zero bits.
+// The ESC argument is the number of zero bits in the escape code, a unary
+// prefix longer than ESC bits is emitted as ESC zeros and literal bits.
+// A shorter escape bounds the number of bits a decoder reads per symbol.
 
-template <const bool U1, const bool U2, class BWBS>
+template <const bool U1, const bool U2, class BWBS, const int SB = 8, const int ESC = 16>
 class RiceSplit16EncoderG4
 {
   public:
+  typedef typename std::conditional<(SB <= 8), uint8_t, uint16_t>::type symbol_type;
+  
+  static_assert(SB >= 8 && SB <= 16, "symbol bit width must be in range (8, 16)");
+  static_assert(ESC >= 8 && ESC <= 16, "escape bit width must be in range (8, 16)");
+  
   // Emit MSB bit order
   BitWriter<true, BWBS> bitWriter;
   
@@ -1401,7 +1431,7 @@ class RiceSplit16EncoderG4
   // if this method is invoked directly then finish()
   // must be invoked after all symbols have been encoded.
   
-  void encode(uint8_t n,
+  void encode(symbol_type n,
               const unsigned int k,
               const bool emitPrefix,
               const bool emitSuffix)
@@ -1425,17 +1455,17 @@ class RiceSplit16EncoderG4
       printf("n %3d : k %3d : m %3d : q = n / m = %d : unaryNumBits %d \n", n, k, m, q, unaryNumBits);
     }
     
-    if (unaryNumBits > 16) {
-      // unary1 -> LITERAL : encoded as 16 zero bits in a row.
+    if (unaryNumBits > ESC) {
+      // unary1 -> LITERAL : encoded as ESC zero bits in a row.
       
       if (emitPrefix) {
-        for (int i = 0; i < 16; i++) {
+        for (int i = 0; i < ESC; i++) {
           encodeBit(U1);
         }
       }
 
 #if defined(DEBUG)
-      for (int i = 0; i < 16; i++) {
+      for (int i = 0; i < ESC; i++) {
         if (debug) {
           prefixBitsThisSymbol.push_back(U1);
           bitsThisSymbol.push_back(U1);
@@ -1444,8 +1474,8 @@ class RiceSplit16EncoderG4
 #endif // DEBUG
       
 #if defined(DEBUG)
-      // Write all 8 bits to bitsThisSymbol debug vector
-      for (int i = 7; i >= 0; i--) {
+      // Write all SB bits to bitsThisSymbol debug vector
+      for (int i = SB-1; i >= 0; i--) {
         if (debug) {
           bool bit = (((n >> i) & 0x1) != 0);
           bitsThisSymbol.push_back(bit);
@@ -1455,10 +1485,10 @@ class RiceSplit16EncoderG4
       
       // Emit OVER bits (not k) to prefix stream
       
-      uint8_t overBits = 0;
+      symbol_type overBits = 0;
       
       if (emitPrefix || debug) {
-        for (int i = 7; i >= (int)k; i--) {
+        for (int i = SB-1; i >= (int)k; i--) {
           bool bit = (((n >> i) & 0x1) != 0);
           if (debug) {
             overBits |= (bit << i);
@@ -1478,7 +1508,7 @@ class RiceSplit16EncoderG4
 
       // Emit most significant k bits to suffix stream
       
-      uint8_t kBits = 0;
+      symbol_type kBits = 0;
       
       if (emitSuffix || debug) {
         for (int i = k - 1; i >= 0; i--) {
@@ -1501,8 +1531,8 @@ class RiceSplit16EncoderG4
       }
 
       if (debug) {
-        printf("kBits     %s (%d bits)\n", get_code_bits_as_string64(kBits, 8).c_str(), k);
-        printf("overBits  %s (%d bits)\n", get_code_bits_as_string64(overBits,8).c_str(), 8-k);
+        printf("kBits     %s (%d bits)\n", get_code_bits_as_string64(kBits, SB).c_str(), k);
+        printf("overBits  %s (%d bits)\n", get_code_bits_as_string64(overBits,SB).c_str(), SB-k);
         
 #if defined(DEBUG)
         // Combining overBits and q is simply a matter of ORing
@@ -1517,10 +1547,10 @@ class RiceSplit16EncoderG4
       // emit PREFIX and or SUFFIX
       
 #if defined(DEBUG)
-      // q can be in range (0, 15) : valid prefixCount range (1, 16)
-      assert(q < 16);
+      // q can be in range (0, ESC-1) : valid prefixCount range (1, ESC)
+      assert(q < ESC);
       assert(unaryNumBits > 0);
-      assert(unaryNumBits < 17);
+      assert(unaryNumBits <= ESC);
 #endif // DEBUG
       
       if (emitPrefix || debug) {
@@ -1601,13 +1631,13 @@ class RiceSplit16EncoderG4
   
   // Encode N symbols and emit any leftover bits
   
-  void encode(const uint8_t * byteVals, int numByteVals, const unsigned int k) {
+  void encode(const symbol_type * byteVals, int numByteVals, const unsigned int k) {
     const bool debug = false;
     for (int i = 0; i < numByteVals; i++) {
       if (debug) {
         printf("symboli %5d\n", i);
       }
-      uint8_t byteVal = byteVals[i];
+      symbol_type byteVal = byteVals[i];
       encode(byteVal, k);
     }
     finish();
@@ -1617,7 +1647,7 @@ class RiceSplit16EncoderG4
   // up in tables. Pass count table which indicates how many blocks the corresponding
   // n table entry corresponds to.
   
-  void encode(const uint8_t * byteVals, int numByteVals,
+  void encode(const symbol_type * byteVals, int numByteVals,
               const uint8_t * kLookupTable,
               int kLookupTableLength,
               const vector<uint32_t> & countTable,
@@ -1669,7 +1699,7 @@ class RiceSplit16EncoderG4
           // Prefix
           
           for ( int i = symboli ; i < symboli4Max; i++ ) {
-            uint8_t byteVal = byteVals[i];
+            symbol_type byteVal = byteVals[i];
             if (debug && 1) {
               printf("symboli %5d : blocki %5d : k %2d : prefix bits\n", symboli, blocki, k);
             }
@@ -1680,7 +1710,7 @@ class RiceSplit16EncoderG4
           // Suffix
           
           for ( int i = symboli ; i < symboli4Max; i++ ) {
-            uint8_t byteVal = byteVals[i];
+            symbol_type byteVal = byteVals[i];
             if (debug && 1) {
               printf("symboli %5d : blocki %5d : k %2d : suffix bits\n", symboli, blocki, k);
             }
@@ -1704,12 +1734,12 @@ class RiceSplit16EncoderG4
   // size query logic does not need to actually copy
   // encoded bytes so it is much faster than encoding.
   
-  int numBits(unsigned char n, const unsigned int k) {
+  int numBits(symbol_type n, const unsigned int k) {
     const unsigned int q = pot_div_k(n, k);
     const unsigned int unaryNumBits = q + 1;
-    if (unaryNumBits > 16) {
-      // 16 zeros = zero, special case to indicate literal 8 bits
-      return 16 + 8;
+    if (unaryNumBits > ESC) {
+      // ESC zeros = zero, special case to indicate literal SB bits
+      return ESC + SB;
     } else {
       return unaryNumBits + k;
     }
@@ -1717,10 +1747,10 @@ class RiceSplit16EncoderG4
   
   // Query the number of bits needed to store these symbols
   
-  int numBits(const uint8_t * byteVals, int numByteVals, const unsigned int k) {
+  int numBits(const symbol_type * byteVals, int numByteVals, const unsigned int k) {
     int totalNumBits = 0;
     for (int i = 0; i < numByteVals; i++) {
-      uint8_t byteVal = byteVals[i];
+      symbol_type byteVal = byteVals[i];
       totalNumBits += numBits(byteVal, k);
     }
     return totalNumBits;
@@ -1729,22 +1759,29 @@ class RiceSplit16EncoderG4
 };
 
 // Split encoding where elements are broken into prefix and suffix and then
-// grouped 4 at a time.
+// grouped 4 at a time. The SB and ESC arguments must match the symbol bit
+// width and escape bit width that were passed to RiceSplit16EncoderG4.
 
-template <const bool U1, const bool U2, class BRBS>
+template <const bool U1, const bool U2, class BRBS, const int SB = 8, const int ESC = 16>
 class RiceSplit16DecoderG4
 {
 public:
-  // Input bits. A unary prefix has a maximum length of 16
-  // and in that case the suffix contains the 8 literal bits.
-  // All symbol decode operations can be executed as long
-  // as 24 bits are loaded.
+  typedef typename std::conditional<(SB <= 8), uint8_t, uint16_t>::type symbol_type;
+  
+  static_assert(SB >= 8 && SB <= 16, "symbol bit width must be in range (8, 16)");
+  static_assert(ESC >= 8 && ESC <= 16, "escape bit width must be in range (8, 16)");
+  
+  // Input bits. A unary prefix has a maximum length of ESC
+  // and in that case the suffix contains the SB literal bits.
+  // All 8 bit symbol decode operations can be executed as long
+  // as 24 bits are loaded, a wide escape refills after the
+  // ESC zero bits have been consumed.
   
   uint32_t bits;
   
   BitReader<true, BRBS, 24> bitsReader;
   
-  uint8_t *outputBytePtr;
+  symbol_type *outputBytePtr;
   int outputByteOffset;
   int outputByteLength;
   
@@ -1765,7 +1802,7 @@ public:
   // Store refs to input and output byte bufers
   
   void setupInputOutput(const uint8_t * bitBuff, const int bitBuffN,
-                        uint8_t * symbolBuff, const int symbolBuffN)
+                        symbol_type * symbolBuff, const int symbolBuffN)
   {
     bitsReader.byteReader.setupInput(bitBuff, bitBuffN);
     
@@ -1786,48 +1823,54 @@ public:
 
   // Decode prefix portion of symbol
   
-  uint8_t decodePrefix(const unsigned int k) {
+  symbol_type decodePrefix(const unsigned int k) {
     const bool debug = false;
 
     unsigned int symbol;
 
-    if ((bits >> 16) == 0) {
-      // Special case for 16 bits of zeros in high halfword
+    if ((bits >> (32 - ESC)) == 0) {
+      // Special case for ESC bits of zeros at the MSB
       
 # if defined(DEBUG)
       assert(bitsReader.bitsInRegister >= 24);
 # endif // DEBUG
       
-      bits <<= 16;
+      bits <<= ESC;
       
       if (debug) {
-        printf("bits (del16): %s\n", get_code_bits_as_string64(bits, 32).c_str());
+        printf("bits (delESC): %s\n", get_code_bits_as_string64(bits, 32).c_str());
+      }
+      
+      if (SB > 8) {
+        // A wide literal could need up to 16 OVER bits, consume
+        // the ESC zero bits and refill before reading them.
+        bitsReader.bitsInRegister -= ESC;
+        refillBits();
       }
       
+      const unsigned int numEscapeBits = (SB > 8) ? 0 : ESC;
+      
 # if defined(DEBUG)
-      assert(bitsReader.bitsInRegister >= (8 - k));
+      assert(bitsReader.bitsInRegister >= (numEscapeBits + SB - k));
 # endif // DEBUG
       
-      symbol = (bits >> 24) >> k << k;
+      symbol = (bits >> (32 - SB)) >> k << k;
       
       if (debug) {
         printf("symbol      : %s\n", get_code_bits_as_string64(symbol, 32).c_str());
       }
       
-      bits <<= (8 - k);
+      bits <<= (SB - k);
       
       if (debug) {
         printf("bits (del pre) : %s\n", get_code_bits_as_string64(bits, 32).c_str());
       }
       
-# if defined(DEBUG)
-      assert(bitsReader.bitsInRegister >= (24 - k));
-# endif // DEBUG
-      
-      bitsReader.bitsInRegister -= (24 - k);
+      bitsReader.bitsInRegister -= (numEscapeBits + SB - k);
     } else {
 # if defined(DEBUG)
-      assert((bits & 0xFFFF0000) != 0);
+      // At least one of the top ESC bits is set
+      assert((bits & ~(0xFFFFFFFFu >> ESC)) != 0);
 # endif // DEBUG
       
       //unsigned int lz = __builtin_clz(bits);
@@ -1863,7 +1906,7 @@ public:
     return symbol;
   }
 
-  uint8_t decodeSuffix(const unsigned int k) {
+  symbol_type decodeSuffix(const unsigned int k) {
     const bool debug = false;
 
     unsigned int rem;
@@ -1911,7 +1954,7 @@ public:
         // Refill before reading a symbol
         refillBits();
         
-        uint8_t prefix = decodePrefix(k);
+        symbol_type prefix = decodePrefix(k);
         //uint8_t rem = decodeSuffix(k);
         
         unsigned int symbol;
@@ -1929,7 +1972,7 @@ public:
         refillBits();
         
         //uint8_t prefix = decodePrefix(k);
-        uint8_t rem = decodeSuffix(k);
+        symbol_type rem = decodeSuffix(k);
         
         unsigned int symbol = decodedSymbols[si];
         
@@ -1961,7 +2004,7 @@ public:
   // This method assumes that the k value is known.
   
   void decode(const uint8_t * bitBuff, const int bitBuffN,
-              uint8_t * symbolBuff, const int symbolBuffN,
+              symbol_type * symbolBuff, const int symbolBuffN,
               const unsigned int k)
   {
     setupInputOutput(bitBuff, bitBuffN, symbolBuff, symbolBuffN);
@@ -1976,7 +2019,7 @@ public:
   // n table entry corresponds to.
   
   void decode(const uint8_t * bitBuff, int bitBuffN,
-              uint8_t * symbolBuff, const int symbolBuffN,
+              symbol_type * symbolBuff, const int symbolBuffN,
               const uint8_t * kLookupTable,
               int kLookupTableLength,
               const vector<uint32_t> & countTable,
@@ -2041,6 +2084,32 @@ public:
   }
 };
 
+// Find optimal K for a block of symbols encoded with RiceSplit16EncoderG4,
+// k is in the range (0, SB-1). Wide symbols use the wider escape cost and
+// ESC is the escape bit width the block will be encoded with.
+
+template <const int SB, const int ESC = 16>
+int optimalRiceKG4(
+                   const typename RiceSplit16EncoderG4<false, true, BitWriterByteStream, SB, ESC>::symbol_type * inSymbols,
+                   int inNumSymbols)
+{
+  RiceSplit16EncoderG4<false, true, BitWriterByteStream, SB, ESC> encoder;
+  
+  int minBlockSize = 0x7FFFFFFF;
+  int minBlockK = -1;
+  
+  for (int k = 0 ; k < SB; k++) {
+    int numBitsForBlock = encoder.numBits(inSymbols, inNumSymbols, k);
+    
+    if (numBitsForBlock < minBlockSize) {
+      minBlockSize = numBitsForBlock;
+      minBlockK = k;
+    }
+  }
+  
+  return minBlockK;
+}
+
 // Special purpose "split" rice encoding where the bits that make up the unary
 // prefix bits are stored in one buffer while the remainder bits are stored
 // in a second buffer. This encoder checks for the case where the unary bits
@@ -0,0 +1,462 @@
+//
+//  rice_adapters.hpp
+//
+//  Created by Mo DeJong on 6/3/18.
+//  Copyright © 2018 helpurock. All rights reserved.
+//
+//  Uniform adapters over the coder families in rice.hpp. Each adapter
+//  encodes the same input (symbols in 8x8 block order and a per block
+//  k table) into one or more byte streams and decodes them back. The
+//  split prefix decoders only parse the unary prefix, so adapters for
+//  those decoders report prefixOnly and decode to prefix counts in
+//  the range (1, 17). Adapters share a static interface so that a
+//  round trip check or benchmark can be written once as a template.
+
+#ifndef _rice_adapters_hpp
+#define _rice_adapters_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "rice.hpp"
+
+using namespace std;
+
+// Input shared by all adapters
+
+class RiceCoderInput
+{
+public:
+  // Symbols in block order, blockSize symbols in each block
+  vector<uint8_t> symbols;
+
+  // k for each block followed by one zero pad entry
+  vector<uint8_t> kTable;
+
+  int blockSize;
+
+  RiceCoderInput()
+  : blockSize(0)
+  {
+  }
+
+  int numBlocks() const {
+    return (int) kTable.size() - 1;
+  }
+
+  // Count table and n table in the format accepted by table encode
+
+  void tables(vector<uint32_t> & countTable, vector<uint32_t> & nTable) const {
+    countTable.clear();
+    nTable.clear();
+    countTable.push_back(numBlocks());
+    nTable.push_back(blockSize);
+  }
+};
+
+// Encoded output is one or more byte streams
+
+class RiceCoderEncoded
+{
+public:
+  vector<vector<uint8_t> > streams;
+
+  int numBytes() const {
+    int n = 0;
+    for ( const vector<uint8_t> & stream : streams ) {
+      n += (int) stream.size();
+    }
+    return n;
+  }
+};
+
+// Prefix count parsed by the split prefix decoders, 17 indicates
+// the 16 zero bit escape.
+
+static inline
+uint8_t rice_adapter_prefix_count(const uint8_t symbol, const unsigned int k) {
+  const unsigned int q = symbol >> k;
+  return (q >= 16) ? 17 : (q + 1);
+}
+
+// Expected decode output for an adapter, the input symbols or the
+// prefix count for each symbol.
+
+template <class A>
+void rice_adapter_expected(const RiceCoderInput & input, vector<uint8_t> & expected)
+{
+  expected.resize(input.symbols.size());
+
+  for (int i = 0; i < (int)input.symbols.size(); i++) {
+    uint8_t symbol = input.symbols[i];
+    if (A::prefixOnly) {
+      expected[i] = rice_adapter_prefix_count(symbol, input.kTable[i / input.blockSize]);
+    } else {
+      expected[i] = symbol;
+    }
+  }
+}
+
+// Encode, decode, and compare. Returns true when the decoded output
+// matches and writes the total encoded size in bytes.
+
+template <class A>
+bool rice_adapter_round_trip(const RiceCoderInput & input, int & outNumBytes)
+{
+  RiceCoderEncoded encoded;
+  A::encode(input, encoded);
+  outNumBytes = encoded.numBytes();
+
+  vector<uint8_t> decoded;
+  A::decode(input, encoded, decoded);
+
+  vector<uint8_t> expected;
+  rice_adapter_expected<A>(input, expected);
+
+  return decoded == expected;
+}
+
+// RiceEncoder and RiceDecoder
+
+class RiceAdapterRice
+{
+public:
+  static const bool prefixOnly = false;
+
+  static const char * name() {
+    return "Rice";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    RiceEncoder encoder;
+    encoder.encode(input.symbols.data(), (int)input.symbols.size(),
+                   input.kTable.data(), (int)input.kTable.size(),
+                   countTable, nTable);
+
+    encoded.streams.resize(1);
+    encoded.streams[0] = std::move(encoder.bytes);
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    RiceDecoder decoder;
+    decoded = decoder.decode(encoded.streams[0].data(), (int)encoded.streams[0].size(),
+                             input.kTable.data(), (int)input.kTable.size(),
+                             countTable, nTable);
+
+    // Pad bits at the end of the stream can decode as extra symbols
+    decoded.resize(input.symbols.size());
+  }
+};
+
+// RiceSplit16Encoder and RiceSplit16Decoder
+
+class RiceAdapterSplit16
+{
+public:
+  static const bool prefixOnly = false;
+
+  static const char * name() {
+    return "Split16";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    RiceSplit16Encoder<false, true, BitWriterByteStream> encoder;
+    encoder.encode(input.symbols.data(), (int)input.symbols.size(),
+                   input.kTable.data(), (int)input.kTable.size(),
+                   countTable, nTable);
+
+    encoded.streams.resize(1);
+    encoded.streams[0] = encoder.bitWriter.moveBytes();
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    decoded.resize(input.symbols.size());
+
+    RiceSplit16Decoder<false, true, BitReaderByteStream> decoder;
+    decoder.decode(encoded.streams[0].data(), (int)encoded.streams[0].size(),
+                   decoded.data(), (int)decoded.size(),
+                   input.kTable.data(), (int)input.kTable.size(),
+                   countTable, nTable);
+  }
+};
+
+// RiceSplit16EncoderG4 and RiceSplit16DecoderG4 with 8 bit symbols
+
+class RiceAdapterSplit16G4
+{
+public:
+  static const bool prefixOnly = false;
+
+  static const char * name() {
+    return "Split16G4";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    RiceSplit16EncoderG4<false, true, BitWriterByteStream> encoder;
+    encoder.encode(input.symbols.data(), (int)input.symbols.size(),
+                   input.kTable.data(), (int)input.kTable.size(),
+                   countTable, nTable);
+
+    encoded.streams.resize(1);
+    encoded.streams[0] = encoder.bitWriter.moveBytes();
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    decoded.resize(input.symbols.size());
+
+    RiceSplit16DecoderG4<false, true, BitReaderByteStream> decoder;
+    decoder.decode(encoded.streams[0].data(), (int)encoded.streams[0].size(),
+                   decoded.data(), (int)decoded.size(),
+                   input.kTable.data(), (int)input.kTable.size(),
+                   countTable, nTable);
+  }
+};
+
+// RiceSplit16x2Encoder writes prefix and suffix bits to 2 streams
+
+class RiceAdapterSplit16x2
+{
+public:
+  static const bool prefixOnly = false;
+
+  static const char * name() {
+    return "Split16x2";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    RiceSplit16x2Encoder<false, true, BitWriterByteStream> encoder;
+    encoder.encode(input.symbols.data(), (int)input.symbols.size(),
+                   input.kTable.data(), (int)input.kTable.size(),
+                   countTable, nTable);
+
+    encoded.streams.resize(2);
+    encoded.streams[0] = encoder.prefixBitWriter.moveBytes();
+    encoded.streams[1] = encoder.remBitWriter.moveBytes();
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    vector<uint32_t> countTable, nTable;
+    input.tables(countTable, nTable);
+
+    decoded.resize(input.symbols.size());
+
+    RiceSplit16x2Decoder<false, true, BitReaderByteStream> decoder;
+    decoder.decode(encoded.streams[0].data(), (int)encoded.streams[0].size(),
+                   encoded.streams[1].data(), (int)encoded.streams[1].size(),
+                   decoded.data(), (int)decoded.size(),
+                   input.kTable.data(), (int)input.kTable.size(),
+                   countTable, nTable);
+  }
+};
+
+// RiceSplit16x2PrefixDecoder parses only the prefix stream
+
+class RiceAdapterSplit16x2Prefix
+{
+public:
+  static const bool prefixOnly = true;
+
+  static const char * name() {
+    return "Split16x2Prefix";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+    RiceAdapterSplit16x2::encode(input, encoded);
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    decoded.resize(input.symbols.size());
+
+    RiceSplit16x2PrefixDecoder<false, true, BitReaderByteStream> decoder;
+    decoder.decode(encoded.streams[0].data(), (int)encoded.streams[0].size(),
+                   decoded.data(), (int)decoded.size());
+  }
+};
+
+// RiceSplit16x2PrefixDecoder64 buffers output bytes in a 64 bit register
+
+class RiceAdapterSplit16x2Prefix64
+{
+public:
+  static const bool prefixOnly = true;
+
+  static const char * name() {
+    return "Split16x2Prefix64";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+    RiceAdapterSplit16x2::encode(input, encoded);
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    decoded.resize(input.symbols.size());
+
+    RiceSplit16x2PrefixDecoder64<false, true, BitReaderByteStream> decoder;
+    decoder.decode(encoded.streams[0].data(), (int)encoded.streams[0].size(),
+                   decoded.data(), (int)decoded.size());
+  }
+};
+
+// RiceSplit16x2PrefixDecoder64Read64 reads the prefix stream 64 bits
+// at a time, the stream is rewritten as little endian 64 bit words.
+
+class RiceAdapterSplit16x2Prefix64Read64
+{
+public:
+  static const bool prefixOnly = true;
+
+  static const char * name() {
+    return "Split16x2Prefix64Read64";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+    RiceAdapterSplit16x2::encode(input, encoded);
+    encoded.streams[0] = PrefixBitStreamRewrite64(encoded.streams[0]);
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    decoded.resize(input.symbols.size());
+
+    // Copy to 64 bit aligned words
+    vector<uint64_t> words(encoded.streams[0].size() / sizeof(uint64_t));
+    memcpy(words.data(), encoded.streams[0].data(), words.size() * sizeof(uint64_t));
+
+    RiceSplit16x2PrefixDecoder64Read64<BitReaderStream64> decoder;
+    decoder.prefixBitsReader.byteReader64.setupInput(words.data());
+    decoder.setupOutput(decoded.data());
+    decoder.decodeSymbols(decoded.size());
+  }
+};
+
+// 4 prefix streams decoded at the same time with the interleaved
+// readers. Each stream holds 1/4 of the blocks, the decoded prefix
+// counts are interleaved (S0, S1, S2, S3) and are deinterleaved back
+// to input order. The number of blocks must be a multiple of 4.
+
+class RiceAdapterInterleaved4x
+{
+public:
+  static const bool prefixOnly = true;
+
+  static const char * name() {
+    return "Interleaved4xPrefix64";
+  }
+
+  static void splitInput(const RiceCoderInput & input, const int streami, RiceCoderInput & streamInput) {
+    const int numBlocksEachStream = input.numBlocks() / 4;
+    const int numSymbolsEachStream = numBlocksEachStream * input.blockSize;
+
+    streamInput.blockSize = input.blockSize;
+    streamInput.symbols.assign(input.symbols.begin() + (streami * numSymbolsEachStream),
+                               input.symbols.begin() + ((streami + 1) * numSymbolsEachStream));
+    streamInput.kTable.assign(input.kTable.begin() + (streami * numBlocksEachStream),
+                              input.kTable.begin() + ((streami + 1) * numBlocksEachStream));
+    streamInput.kTable.push_back(0);
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+#if defined(DEBUG)
+    assert((input.numBlocks() % 4) == 0);
+#endif // DEBUG
+
+    // 4 prefix streams followed by 4 suffix streams
+
+    encoded.streams.resize(8);
+
+    for (int streami = 0; streami < 4; streami++) {
+      RiceCoderInput streamInput;
+      splitInput(input, streami, streamInput);
+
+      RiceCoderEncoded streamEncoded;
+      RiceAdapterSplit16x2Prefix64Read64::encode(streamInput, streamEncoded);
+      encoded.streams[streami] = std::move(streamEncoded.streams[0]);
+      encoded.streams[4 + streami] = std::move(streamEncoded.streams[1]);
+    }
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    const int numSymbolsEachStream = (int) input.symbols.size() / 4;
+
+    vector<vector<uint64_t> > words(4);
+    vector<BitReader64<BitReaderStream64, 16> > readers(4);
+
+    for (int streami = 0; streami < 4; streami++) {
+      const vector<uint8_t> & stream = encoded.streams[streami];
+      words[streami].resize(stream.size() / sizeof(uint64_t));
+      memcpy(words[streami].data(), stream.data(), words[streami].size() * sizeof(uint64_t));
+      readers[streami].byteReader64.setupInput(words[streami].data());
+    }
+
+    vector<uint8_t> interleaved(input.symbols.size());
+    rice_decode_prefix_bits_4x_both_interleaved_readers(readers, numSymbolsEachStream, interleaved.data());
+
+    decoded = ByteStreamDeinterleaveN(interleaved, 4);
+  }
+};
+
+// ByteStreamMultiplexer and ByteStreamDemultiplexer, 4 split16 streams
+// are multiplexed into one byte stream. Each stream holds 1/4 of the
+// blocks, the number of blocks must be a multiple of 16.
+
+class RiceAdapterMultiplexer
+{
+public:
+  static const bool prefixOnly = false;
+
+  static const char * name() {
+    return "Multiplexer4";
+  }
+
+  static void encode(const RiceCoderInput & input, RiceCoderEncoded & encoded) {
+#if defined(DEBUG)
+    assert((input.numBlocks() % 16) == 0);
+#endif // DEBUG
+
+    vector<vector<uint8_t> > vecOfVecs(4);
+
+    for (int streami = 0; streami < 4; streami++) {
+      RiceCoderInput streamInput;
+      RiceAdapterInterleaved4x::splitInput(input, streami, streamInput);
+      vecOfVecs[streami] = std::move(streamInput.symbols);
+    }
+
+    encoded.streams.resize(1);
+    encoded.streams[0] = ByteStreamMultiplexer(vecOfVecs, input.kTable, input.blockSize);
+  }
+
+  static void decode(const RiceCoderInput & input, const RiceCoderEncoded & encoded, vector<uint8_t> & decoded) {
+    decoded.resize(input.symbols.size());
+
+    ByteStreamDemultiplexer((unsigned int) input.symbols.size() / 4,
+                            4,
+                            encoded.streams[0].data(),
+                            (int) encoded.streams[0].size(),
+                            decoded.data(),
+                            input.kTable,
+                            input.blockSize);
+  }
+};
+
+#endif // _rice_adapters_hpp
@@ -22,12 +22,13 @@ using namespace std;
 // POT divide: q = (n / m) where m is 2^k
 // This implementation is needed inside the encoder to avoid a costly
 // divide operation for each symbol. Also used when counting bits.
+// Note that k can be larger than 7 when encoding wide symbols.
 
 static inline
 unsigned int pot_div_k(const unsigned int n, const unsigned int k) {
 #if defined(DEBUG)
     {
-        assert(k >= 0 && k <= 7);
+        assert(k <= 15);
     }
 #endif // DEBUG
     unsigned int q = n >> k;
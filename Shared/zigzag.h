@@ -12,6 +12,14 @@
 
 #include <stdio.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // zerod representation
 
 // 0 = 0, -1 = 1, 1 = 2, -2 = 3, 2 = 4, -3 = 5, 3 = 6
@@ -97,4 +105,138 @@ zigzag_offset_to_num_neg(uint8_t value) {
   return (int8_t) (high7Bits ^ -low1Bits);
 }
 
+// Zigzag encoding for a delta that is stored as a N bit two's complement
+// value, where N is in the range (8, 16). Deltas between N bit samples
+// are calculated modulo 2^N so that the zigzag result is also N bits.
+
+static inline
+uint16_t
+zigzag_num_neg_to_offset_nbits(uint32_t value, const int numBits) {
+  const uint32_t mask = (1 << numBits) - 1;
+  uint32_t unValue = value & mask;
+  uint32_t highBits = (unValue << 1) & mask;
+  uint32_t low1Bits = unValue >> (numBits-1);
+  unValue = highBits ^ -low1Bits;
+  return unValue & mask;
+}
+
+// Reverse zigzag_num_neg_to_offset_nbits(), the result is the N bit
+// two's complement delta that can be added to the previous sample.
+
+static inline
+uint16_t
+zigzag_offset_to_num_neg_nbits(uint32_t value, const int numBits) {
+  const uint32_t mask = (1 << numBits) - 1;
+  uint32_t unValue = value & mask;
+  uint32_t highBits = unValue >> 1;
+  uint32_t low1Bits = unValue & 0x1;
+  return (highBits ^ -low1Bits) & mask;
+}
+
+// Single pass delta encode of numBytes bytes, each output byte is the
+// signed 8 bit delta from the previous input byte and the first is the
+// delta from prev. When zigzag is non-zero each delta is mapped with
+// zigzag_num_neg_to_offset(). Every input vector is loaded before the
+// matching output is stored, so outBytes may be the same as inBytes.
+
+static inline
+void
+byte_deltas_encode_impl(const uint8_t *inBytes, uint8_t *outBytes, const int numBytes, uint8_t prev, const int zigzag) {
+  int i = 0;
+  
+#if defined(__AVX2__)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i last = _mm256_set1_epi8((char) prev);
+    
+    for ( ; (i + 32) <= numBytes; i += 32) {
+      __m256i cur = _mm256_loadu_si256((const __m256i *) (inBytes + i));
+      // [last[31], cur[0] ... cur[30]]
+      __m256i cross = _mm256_permute2x128_si256(last, cur, 0x21);
+      __m256i before = _mm256_alignr_epi8(cur, cross, 15);
+      __m256i delta = _mm256_sub_epi8(cur, before);
+      if (zigzag) {
+        delta = _mm256_xor_si256(_mm256_add_epi8(delta, delta), _mm256_cmpgt_epi8(zero, delta));
+      }
+      _mm256_storeu_si256((__m256i *) (outBytes + i), delta);
+      last = cur;
+    }
+    
+    if (i > 0) {
+      prev = (uint8_t) _mm256_extract_epi8(last, 31);
+    }
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  {
+    uint8x16_t last = vdupq_n_u8(prev);
+    
+    for ( ; (i + 16) <= numBytes; i += 16) {
+      uint8x16_t cur = vld1q_u8(inBytes + i);
+      uint8x16_t before = vextq_u8(last, cur, 15);
+      uint8x16_t delta = vsubq_u8(cur, before);
+      if (zigzag) {
+        int8x16_t sdelta = vreinterpretq_s8_u8(delta);
+        delta = vreinterpretq_u8_s8(veorq_s8(vshlq_n_s8(sdelta, 1), vshrq_n_s8(sdelta, 7)));
+      }
+      vst1q_u8(outBytes + i, delta);
+      last = cur;
+    }
+    
+    if (i > 0) {
+      prev = vgetq_lane_u8(last, 15);
+    }
+  }
+#elif defined(__SSE2__)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i last = _mm_set1_epi8((char) prev);
+    
+    for ( ; (i + 16) <= numBytes; i += 16) {
+      __m128i cur = _mm_loadu_si128((const __m128i *) (inBytes + i));
+      __m128i before = _mm_or_si128(_mm_slli_si128(cur, 1), _mm_srli_si128(last, 15));
+      __m128i delta = _mm_sub_epi8(cur, before);
+      if (zigzag) {
+        delta = _mm_xor_si128(_mm_add_epi8(delta, delta), _mm_cmpgt_epi8(zero, delta));
+      }
+      _mm_storeu_si128((__m128i *) (outBytes + i), delta);
+      last = cur;
+    }
+    
+    if (i > 0) {
+      prev = (uint8_t) (_mm_extract_epi16(last, 7) >> 8);
+    }
+  }
+#endif
+  
+  for ( ; i < numBytes; i++) {
+    uint8_t cur = inBytes[i];
+    uint8_t delta = cur - prev;
+    outBytes[i] = zigzag ? zigzag_num_neg_to_offset((int8_t) delta) : delta;
+    prev = cur;
+  }
+}
+
+// Signed byte deltas, same result as encodeDelta() without allocation
+
+static inline
+void
+byte_deltas_encode(const uint8_t *inBytes, uint8_t *outBytes, const int numBytes, const uint8_t prev) {
+  byte_deltas_encode_impl(inBytes, outBytes, numBytes, prev, 0);
+}
+
+// Zigzag byte deltas, same result as encodeDelta() followed by
+// pixelpack_int8_to_offset_uint8() for each delta.
+
+static inline
+void
+zigzag_byte_deltas_encode(const uint8_t *inBytes, uint8_t *outBytes, const int numBytes, const uint8_t prev) {
+  byte_deltas_encode_impl(inBytes, outBytes, numBytes, prev, 1);
+}
+
+static inline
+void
+zigzag_byte_deltas_encode_inplace(uint8_t *bytes, const int numBytes) {
+  byte_deltas_encode_impl(bytes, bytes, numBytes, 0, 1);
+}
+
 #endif // zigzag_h